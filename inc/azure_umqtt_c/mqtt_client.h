@@ -30,12 +30,42 @@ typedef struct MQTT_CLIENT_TAG* MQTT_CLIENT_HANDLE;
     MQTT_CLIENT_ON_UNSUBSCRIBE_ACK,  \
     MQTT_CLIENT_ON_DISCONNECT,       \
     MQTT_CLIENT_NO_PING_RESPONSE,    \
-    MQTT_CLIENT_ON_ERROR
+    MQTT_CLIENT_ON_ERROR,            \
+    MQTT_CLIENT_ON_PACKET_DISCARDED
 
 DEFINE_ENUM(MQTT_CLIENT_EVENT_RESULT, MQTT_CLIENT_EVENT_VALUES);
 
+#define MQTT_CLIENT_FLOW_CONTROL_MODE_VALUES \
+    MQTT_CLIENT_FLOW_CONTROL_FAIL,           \
+    MQTT_CLIENT_FLOW_CONTROL_QUEUE
+
+DEFINE_ENUM(MQTT_CLIENT_FLOW_CONTROL_MODE, MQTT_CLIENT_FLOW_CONTROL_MODE_VALUES);
+
+/* Returned by the publish functions when flow control refused a message, every other failure is a positive value */
+#define MQTT_CLIENT_WINDOW_FULL     (-1)
+
+/* Stored by mqtt_client_get_dowork_timeout when the client has no timed work pending */
+#define MQTT_CLIENT_NO_TIMEOUT      UINT32_MAX
+
+/* Outbound counters, packetCount / sendCount is the coalescing ratio */
+typedef struct MQTT_CLIENT_SEND_STATS_TAG
+{
+    uint64_t packetCount;
+    uint64_t sendCount;
+    uint64_t byteCount;
+} MQTT_CLIENT_SEND_STATS;
+
 typedef void(*ON_MQTT_OPERATION_CALLBACK)(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* callbackCtx);
+/* msgHandle borrows its topic name and payload from the receive buffer and is destroyed when the callback returns,
+   call mqttmessage_retain or mqttmessage_clone to keep it longer */
 typedef void(*ON_MQTT_MESSAGE_RECV_CALLBACK)(MQTT_MESSAGE_HANDLE msgHandle, void* callbackCtx);
+typedef void(*ON_MQTT_PUBLISH_SEND_COMPLETE)(MQTT_MESSAGE_HANDLE msgHandle, IO_SEND_RESULT sendResult, void* context);
+/* A streamed PUBLISH is reported as onPublishBegin, any number of onPublishChunk calls and onPublishEnd. The topic name and
+   chunk data are only valid for the duration of the callback */
+typedef void(*ON_MQTT_PUBLISH_BEGIN_CALLBACK)(const char* topicName, QOS_VALUE qosValue, size_t payloadLength, void* context);
+typedef void(*ON_MQTT_PUBLISH_CHUNK_CALLBACK)(const uint8_t* data, size_t length, void* context);
+typedef void(*ON_MQTT_PUBLISH_END_CALLBACK)(void* context);
+typedef void(*ON_MQTT_WRITABLE_CALLBACK)(MQTT_CLIENT_HANDLE handle, void* context);
 
 MOCKABLE_FUNCTION(, MQTT_CLIENT_HANDLE, mqtt_client_init, ON_MQTT_MESSAGE_RECV_CALLBACK, msgRecv, ON_MQTT_OPERATION_CALLBACK, opCallback, void*, callbackCtx);
 MOCKABLE_FUNCTION(, void, mqtt_client_deinit, MQTT_CLIENT_HANDLE, handle);
@@ -43,14 +73,61 @@ MOCKABLE_FUNCTION(, void, mqtt_client_deinit, MQTT_CLIENT_HANDLE, handle);
 MOCKABLE_FUNCTION(, int, mqtt_client_connect, MQTT_CLIENT_HANDLE, handle, XIO_HANDLE, xioHandle, MQTT_CLIENT_OPTIONS*, mqttOptions);
 MOCKABLE_FUNCTION(, int, mqtt_client_disconnect, MQTT_CLIENT_HANDLE, handle);
 
+/* A packetId of 0, as the argument of a subscribe, unsubscribe or QoS 1 or 2 publish or in a QoS 1 or 2 message, lets the client pick the lowest free packet id. The id picked
+   for a message is stored in it, mqtt_client_get_last_packet_id returns the one used by the last publish, subscribe or unsubscribe */
 MOCKABLE_FUNCTION(, int, mqtt_client_subscribe, MQTT_CLIENT_HANDLE, handle, uint16_t, packetId, SUBSCRIBE_PAYLOAD*, subscribeList, size_t, count);
 MOCKABLE_FUNCTION(, int, mqtt_client_unsubscribe, MQTT_CLIENT_HANDLE, handle, uint16_t, packetId, const char**, unsubscribeList, size_t, count);
 
 MOCKABLE_FUNCTION(, int, mqtt_client_publish, MQTT_CLIENT_HANDLE, handle, MQTT_MESSAGE_HANDLE, msgHandle);
+MOCKABLE_FUNCTION(, int, mqtt_client_publish_topic, MQTT_CLIENT_HANDLE, handle, MQTT_TOPIC_HANDLE, topicHandle, QOS_VALUE, qosValue, bool, duplicateMsg, bool, isRetained, uint16_t, packetId, const uint8_t*, appMsg, size_t, appMsgLength);
+MOCKABLE_FUNCTION(, int, mqtt_client_publish_template, MQTT_CLIENT_HANDLE, handle, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle, uint16_t, packetId, const uint8_t*, appMsg, size_t, appMsgLength);
+/* mqtt_client_publish_reserve returns maxLen bytes inside the outbound PUBLISH packet for the application to serialize its payload into,
+   mqtt_client_publish_commit then sends the first actualLen bytes. The region and a QoS 1 or 2 packet id are held until commit or the next reserve */
+MOCKABLE_FUNCTION(, uint8_t*, mqtt_client_publish_reserve, MQTT_CLIENT_HANDLE, handle, const char*, topicName, QOS_VALUE, qosValue, bool, isRetained, uint16_t, packetId, size_t, maxLen);
+MOCKABLE_FUNCTION(, int, mqtt_client_publish_commit, MQTT_CLIENT_HANDLE, handle, size_t, actualLen);
+/* mqtt_client_publish_batch encodes count messages back to back and sends them with one xio_send. When msgResults is not NULL
+   it receives count entries, 0 for each message that was sent */
+MOCKABLE_FUNCTION(, int, mqtt_client_publish_batch, MQTT_CLIENT_HANDLE, handle, MQTT_MESSAGE_HANDLE*, msgHandles, size_t, count, int*, msgResults);
+MOCKABLE_FUNCTION(, int, mqtt_client_publish_segmented, MQTT_CLIENT_HANDLE, handle, MQTT_MESSAGE_HANDLE, msgHandle, ON_MQTT_PUBLISH_SEND_COMPLETE, onSendComplete, void*, context);
 
 MOCKABLE_FUNCTION(, void, mqtt_client_dowork, MQTT_CLIENT_HANDLE, handle);
+/* Milliseconds until mqtt_client_dowork has a ping, retry or coalesced send to do, 0 right after it received data since a TLS xio
+   may hold more. Between those deadlines the client only needs mqtt_client_dowork when its transport has received data or can
+   write data it still holds, which lets an event loop sleep instead of polling */
+MOCKABLE_FUNCTION(, int, mqtt_client_get_dowork_timeout, MQTT_CLIENT_HANDLE, handle, uint32_t*, timeoutMs);
+/* Sends the xio accepted but has not completed, e.g. the rest of a partial write. While there are any an event loop should also
+   wake the client when its socket is writable */
+MOCKABLE_FUNCTION(, int, mqtt_client_get_pending_send_count, MQTT_CLIENT_HANDLE, handle, size_t*, pendingSendCount);
+MOCKABLE_FUNCTION(, int, mqtt_client_get_last_packet_id, MQTT_CLIENT_HANDLE, handle, uint16_t*, packetId);
 
 MOCKABLE_FUNCTION(, void, mqtt_client_set_trace, MQTT_CLIENT_HANDLE, handle, bool, traceOn, bool, rawBytesOn);
+/* With maxBatchSize > 0 outbound packets are queued and written with one xio_send when maxBatchSize bytes are queued or
+   when mqtt_client_dowork runs at least maxDelayMs after the first of them was queued */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_send_coalescing, MQTT_CLIENT_HANDLE, handle, size_t, maxBatchSize, uint32_t, maxDelayMs);
+MOCKABLE_FUNCTION(, int, mqtt_client_get_send_stats, MQTT_CLIENT_HANDLE, handle, MQTT_CLIENT_SEND_STATS*, sendStats);
+/* Inbound packets split across reads are reassembled in a buffer that is kept between packets unless it grew past highWaterMark bytes.
+   The buffers outbound PUBLISH packets are encoded and reserved in follow the same limit, 16KB unless set */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_reassembly_high_water_mark, MQTT_CLIENT_HANDLE, handle, size_t, highWaterMark);
+/* Inbound packets with a remaining length above maxPacketSize are skipped without being buffered, counted and reported as
+   MQTT_CLIENT_ON_PACKET_DISCARDED with a PACKET_DISCARDED msgInfo. The connection stays up. 0 removes the limit */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_max_packet_size, MQTT_CLIENT_HANDLE, handle, size_t, maxPacketSize);
+MOCKABLE_FUNCTION(, int, mqtt_client_get_discarded_packet_count, MQTT_CLIENT_HANDLE, handle, uint64_t*, discardedCount);
+/* Inbound PUBLISH packets of at least threshold bytes are streamed to the callbacks below instead of being buffered and
+   delivered to the ON_MQTT_MESSAGE_RECV_CALLBACK, so their memory use does not depend on the payload size. NULL callbacks turn it off */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_publish_streaming, MQTT_CLIENT_HANDLE, handle, size_t, threshold, ON_MQTT_PUBLISH_BEGIN_CALLBACK, onPublishBegin, ON_MQTT_PUBLISH_CHUNK_CALLBACK, onPublishChunk, ON_MQTT_PUBLISH_END_CALLBACK, onPublishEnd, void*, context);
+/* With maxInFlight > 0 a DUP flagged clone of every QoS 1 and 2 message, or a copy of the packet for mqtt_client_publish_topic,
+   mqtt_client_publish_template and mqtt_client_publish_commit, is kept until its PUBACK or PUBCOMP arrives, and publishing fails once maxInFlight messages are
+   waiting or when the packet id is still in flight. Unacknowledged messages are sent again by mqtt_client_dowork every retryTimeoutMs, or only on reconnect when it is 0,
+   and after every accepted CONNACK. Tracking can only be changed while no message is in flight, 0 turns it off */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_inflight_tracking, MQTT_CLIENT_HANDLE, handle, size_t, maxInFlight, uint32_t, retryTimeoutMs);
+MOCKABLE_FUNCTION(, int, mqtt_client_get_inflight_count, MQTT_CLIENT_HANDLE, handle, size_t*, inFlightCount);
+/* With maxInFlight > 0 at most maxInFlight QoS 1 and 2 publishes wait for their PUBACK or PUBCOMP. Further messages are refused with
+   MQTT_CLIENT_WINDOW_FULL in MQTT_CLIENT_FLOW_CONTROL_FAIL mode, or queued and sent in order as acks arrive in MQTT_CLIENT_FLOW_CONTROL_QUEUE
+   mode, a queued message is a clone that gets its packet id when it is sent. mqtt_client_publish_topic, mqtt_client_publish_template and
+   mqtt_client_publish_commit are refused in both modes since their packet cannot be queued. Once a message was refused or queued onWritable is called when the
+   queue is empty and the window has room again. Flow control can only be changed while the window is empty, 0 turns it off */
+MOCKABLE_FUNCTION(, int, mqtt_client_set_flow_control, MQTT_CLIENT_HANDLE, handle, size_t, maxInFlight, MQTT_CLIENT_FLOW_CONTROL_MODE, mode, ON_MQTT_WRITABLE_CALLBACK, onWritable, void*, context);
+MOCKABLE_FUNCTION(, int, mqtt_client_get_flow_control_state, MQTT_CLIENT_HANDLE, handle, size_t*, windowCount, size_t*, queuedCount);
 
 #ifdef __cplusplus
 }
@@ -22,7 +22,61 @@ extern "C" {
 
 typedef struct MQTTCODEC_INSTANCE_TAG* MQTTCODEC_HANDLE;
 
-typedef void(*ON_PACKET_COMPLETE_CALLBACK)(void* context, CONTROL_PACKET_TYPE packet, int flags, BUFFER_HANDLE headerData);
+#define MQTT_PUBLISH_SEGMENT_COUNT      2
+#define MQTT_PING_PACKET_SIZE           2
+#define MQTT_DISCONNECT_PACKET_SIZE     2
+#define MQTT_PUBLISH_REPLY_PACKET_SIZE  4
+#define MQTT_MAX_FIXED_HEADER_SIZE      5
+
+typedef struct MQTT_BUFFER_SEGMENT_TAG
+{
+    const uint8_t* data;
+    size_t length;
+} MQTT_BUFFER_SEGMENT;
+
+/* A decoded packet inside the buffer given to mqtt_codec_parse. header is the variable header that follows the fixed header
+   and payload the bytes after it, both point into that buffer */
+typedef struct MQTT_PACKET_VIEW_TAG
+{
+    CONTROL_PACKET_TYPE packetType;
+    int flags;
+    const uint8_t* header;
+    size_t headerLength;
+    const uint8_t* payload;
+    size_t payloadLength;
+} MQTT_PACKET_VIEW;
+
+/* The mqtt_codec_decode functions read a packet body in place, the pointers they return point into it. The topic name
+   is not NUL terminated */
+typedef struct MQTT_PUBLISH_VIEW_TAG
+{
+    const char* topicName;
+    size_t topicLength;
+    uint16_t packetId;
+    QOS_VALUE qosValue;
+    bool isDuplicateMsg;
+    bool isRetained;
+    const uint8_t* payload;
+    size_t payloadLength;
+} MQTT_PUBLISH_VIEW;
+
+typedef struct MQTT_SUBACK_VIEW_TAG
+{
+    uint16_t packetId;
+    const uint8_t* returnCodes;
+    size_t returnCodeCount;
+} MQTT_SUBACK_VIEW;
+
+/* data points at the packet body after the fixed header. It is either borrowed from the buffer passed to mqtt_codec_bytesReceived
+   or owned by the codec, in both cases it is only valid for the duration of the callback */
+typedef void(*ON_PACKET_COMPLETE_CALLBACK)(void* context, CONTROL_PACKET_TYPE packet, int flags, const uint8_t* data, size_t length);
+/* Streamed PUBLISH packets are reported as a begin, any number of payload chunks and an end. topicName and data are only
+   valid for the duration of the callback */
+typedef void(*ON_PUBLISH_BEGIN_CALLBACK)(void* context, int flags, const char* topicName, uint16_t packetId, size_t payloadLength);
+typedef void(*ON_PUBLISH_CHUNK_CALLBACK)(void* context, const uint8_t* data, size_t length);
+typedef void(*ON_PUBLISH_END_CALLBACK)(void* context);
+/* Called once the remaining length of a packet larger than the maximum packet size is known, its bytes are then skipped */
+typedef void(*ON_PACKET_DISCARDED_CALLBACK)(void* context, CONTROL_PACKET_TYPE packet, size_t packetLength);
 
 MOCKABLE_FUNCTION(, MQTTCODEC_HANDLE, mqtt_codec_create, ON_PACKET_COMPLETE_CALLBACK, packetComplete, void*, callbackCtx);
 MOCKABLE_FUNCTION(, void, mqtt_codec_destroy, MQTTCODEC_HANDLE, handle);
@@ -30,6 +84,7 @@ MOCKABLE_FUNCTION(, void, mqtt_codec_destroy, MQTTCODEC_HANDLE, handle);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_connect, const MQTT_CLIENT_OPTIONS*, mqttOptions);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_disconnect);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publish, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, const char*, topicName, const uint8_t*, msgBuffer, size_t, buffLen);
+MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publishSegments, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, const char*, topicName, const uint8_t*, msgBuffer, size_t, buffLen, MQTT_BUFFER_SEGMENT*, segments);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publishAck, uint16_t, packetId);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publishReceived, uint16_t, packetId);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publishRelease, uint16_t, packetId);
@@ -38,7 +93,71 @@ MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_ping);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_subscribe, uint16_t, packetId, SUBSCRIBE_PAYLOAD*, subscribeList, size_t, count);
 MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_unsubscribe, uint16_t, packetId, const char**, unsubscribeList, size_t, count);
 
+/* A topic handle validates a PUBLISH topic name once and keeps its length prefixed wire encoding for repeated publishes */
+MOCKABLE_FUNCTION(, MQTT_TOPIC_HANDLE, mqtt_codec_topicCreate, const char*, topicName);
+MOCKABLE_FUNCTION(, void, mqtt_codec_topicDestroy, MQTT_TOPIC_HANDLE, topicHandle);
+MOCKABLE_FUNCTION(, const char*, mqtt_codec_topicGetName, MQTT_TOPIC_HANDLE, topicHandle);
+MOCKABLE_FUNCTION(, BUFFER_HANDLE, mqtt_codec_publishTopic, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, MQTT_TOPIC_HANDLE, topicHandle, const uint8_t*, msgBuffer, size_t, buffLen);
+
+/* A publish template pre-computes the flags and variable header shared by every publish to a topic, only the
+   packet id and payload vary per packet. A template is never written after create, so one template can be used from
+   several clients at once. mqtt_codec_publishTemplateSegments builds the header in caller storage of at least
+   mqtt_codec_publishTemplateHeaderSize bytes, mqtt_codec_publishTemplateGetQos tells whether a packet id has to be reserved */
+MOCKABLE_FUNCTION(, MQTT_PUBLISH_TEMPLATE_HANDLE, mqtt_codec_publishTemplateCreate, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, const char*, topicName);
+MOCKABLE_FUNCTION(, void, mqtt_codec_publishTemplateDestroy, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishTemplate_into, uint8_t*, buffer, size_t, capacity, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle, uint16_t, packetId, const uint8_t*, msgBuffer, size_t, buffLen);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishTemplateHeaderSize, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle);
+MOCKABLE_FUNCTION(, QOS_VALUE, mqtt_codec_publishTemplateGetQos, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle);
+MOCKABLE_FUNCTION(, int, mqtt_codec_publishTemplateSegments, MQTT_PUBLISH_TEMPLATE_HANDLE, templateHandle, uint16_t, packetId, const uint8_t*, msgBuffer, size_t, buffLen, uint8_t*, header, size_t, capacity, MQTT_BUFFER_SEGMENT*, segments);
+
+/* mqtt_codec_publishReserve_into lays out a PUBLISH packet whose payload is written in place by the caller: MQTT_MAX_FIXED_HEADER_SIZE
+   bytes of room for the fixed header, the variable header and maxLen bytes of payload. It returns the reserved size (nothing is
+   written when buffer is too small) or 0 on error. mqtt_codec_publishCommit writes the fixed header for the actual payload length
+   directly in front of the variable header and returns the packet length, the packet starts at buffer + *packetOffset */
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishReserve_into, uint8_t*, buffer, size_t, capacity, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, const char*, topicName, size_t, maxLen);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishCommit, uint8_t*, buffer, size_t, reservedLen, size_t, maxLen, size_t, actualLen, size_t*, packetOffset);
+
+/* PINGREQ and DISCONNECT never change, these return the static MQTT_PING_PACKET_SIZE and MQTT_DISCONNECT_PACKET_SIZE byte encodings */
+MOCKABLE_FUNCTION(, const uint8_t*, mqtt_codec_pingPacket);
+MOCKABLE_FUNCTION(, const uint8_t*, mqtt_codec_disconnectPacket);
+
+/* The _into functions encode into caller owned memory and return the bytes written, the bytes required when
+   buffer is NULL or capacity is too small (nothing is written), or 0 when the packet cannot be encoded */
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_connect_into, uint8_t*, buffer, size_t, capacity, const MQTT_CLIENT_OPTIONS*, mqttOptions);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_disconnect_into, uint8_t*, buffer, size_t, capacity);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publish_into, uint8_t*, buffer, size_t, capacity, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, const char*, topicName, const uint8_t*, msgBuffer, size_t, buffLen);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishTopic_into, uint8_t*, buffer, size_t, capacity, QOS_VALUE, qosValue, bool, duplicateMsg, bool, serverRetain, uint16_t, packetId, MQTT_TOPIC_HANDLE, topicHandle, const uint8_t*, msgBuffer, size_t, buffLen);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishAck_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishReceived_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishRelease_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_publishComplete_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_ping_into, uint8_t*, buffer, size_t, capacity);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_subscribe_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId, SUBSCRIBE_PAYLOAD*, subscribeList, size_t, count);
+MOCKABLE_FUNCTION(, size_t, mqtt_codec_unsubscribe_into, uint8_t*, buffer, size_t, capacity, uint16_t, packetId, const char**, unsubscribeList, size_t, count);
+
 MOCKABLE_FUNCTION(, int, mqtt_codec_bytesReceived, MQTTCODEC_HANDLE, handle, const unsigned char*, buffer, size_t, size);
+/* Drops the error state left by a failed mqtt_codec_bytesReceived and any partly decoded packet, the next byte starts a new packet */
+MOCKABLE_FUNCTION(, void, mqtt_codec_reset, MQTTCODEC_HANDLE, handle);
+/* Packets that arrive split across reads are reassembled in a buffer the codec keeps between packets. Once a packet
+   larger than highWaterMark has been delivered the buffer is freed instead of kept */
+MOCKABLE_FUNCTION(, int, mqtt_codec_setReassemblyHighWaterMark, MQTTCODEC_HANDLE, handle, size_t, highWaterMark);
+/* PUBLISH packets with a remaining length of at least threshold are parsed as they arrive and their payload passed on in
+   chunks, so they are never held in memory whole. Passing NULL callbacks turns streaming off */
+MOCKABLE_FUNCTION(, int, mqtt_codec_setPublishStreaming, MQTTCODEC_HANDLE, handle, size_t, threshold, ON_PUBLISH_BEGIN_CALLBACK, publishBegin, ON_PUBLISH_CHUNK_CALLBACK, publishChunk, ON_PUBLISH_END_CALLBACK, publishEnd);
+/* Packets with a remaining length above maxPacketSize are skipped without being buffered or streamed and counted, the
+   stream stays usable. A maxPacketSize of 0, the default, accepts any length the protocol allows */
+MOCKABLE_FUNCTION(, int, mqtt_codec_setMaxPacketSize, MQTTCODEC_HANDLE, handle, size_t, maxPacketSize, ON_PACKET_DISCARDED_CALLBACK, packetDiscarded);
+MOCKABLE_FUNCTION(, uint64_t, mqtt_codec_getDiscardedPacketCount, MQTTCODEC_HANDLE, handle);
+/* Typed decoding of the body passed to ON_PACKET_COMPLETE_CALLBACK or MQTT_PACKET_VIEW::header, nothing is copied or allocated.
+   mqtt_codec_decodeAck reads the packet id of PUBACK, PUBREC, PUBREL, PUBCOMP and UNSUBACK */
+MOCKABLE_FUNCTION(, int, mqtt_codec_decodeConnack, const uint8_t*, data, size_t, length, CONNECT_ACK*, connack);
+MOCKABLE_FUNCTION(, int, mqtt_codec_decodePublish, int, flags, const uint8_t*, data, size_t, length, MQTT_PUBLISH_VIEW*, publishView);
+MOCKABLE_FUNCTION(, int, mqtt_codec_decodeAck, const uint8_t*, data, size_t, length, uint16_t*, packetId);
+MOCKABLE_FUNCTION(, int, mqtt_codec_decodeSuback, const uint8_t*, data, size_t, length, MQTT_SUBACK_VIEW*, subackView);
+/* Pull alternative to mqtt_codec_bytesReceived: decodes the complete packets at the start of buffer, at most maxPackets of them,
+   into packets without copying. *consumed is the length of those packets, the caller keeps the rest and passes it again with more data.
+   A failed call leaves no state behind, and a codec left in error by mqtt_codec_bytesReceived is reset first */
+MOCKABLE_FUNCTION(, int, mqtt_codec_parse, MQTTCODEC_HANDLE, handle, const uint8_t*, buffer, size_t, size, size_t*, consumed, MQTT_PACKET_VIEW*, packets, size_t, maxPackets, size_t*, packetCount);
 
 #ifdef __cplusplus
 }
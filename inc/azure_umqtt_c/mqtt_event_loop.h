@@ -0,0 +1,50 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef MQTT_EVENT_LOOP_H
+#define MQTT_EVENT_LOOP_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+extern "C" {
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif // __cplusplus
+
+#include "azure_umqtt_c/mqtt_client.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+/* Drives many clients from one thread on Linux. A client is only given to mqtt_client_dowork when epoll reports its socket
+   readable, or writable while the xio holds unsent data, or when the deadline from mqtt_client_get_dowork_timeout is reached,
+   so idle connections cost no CPU */
+typedef struct MQTT_EVENT_LOOP_TAG* MQTT_EVENT_LOOP_HANDLE;
+
+typedef struct MQTT_EVENT_LOOP_STATS_TAG
+{
+    uint64_t waitCount;
+    uint64_t readyCount;
+    uint64_t timerCount;
+} MQTT_EVENT_LOOP_STATS;
+
+MOCKABLE_FUNCTION(, MQTT_EVENT_LOOP_HANDLE, mqtt_event_loop_create);
+MOCKABLE_FUNCTION(, void, mqtt_event_loop_destroy, MQTT_EVENT_LOOP_HANDLE, handle);
+
+/* fd is the socket under the xio of the client, or -1 for a client that is only serviced at its deadlines. The xio layer does not
+   expose its socket, so the application passes the one it connected or its own xio created. A client is added once, is
+   serviced on the next mqtt_event_loop_run_once and has to be removed before mqtt_client_deinit */
+MOCKABLE_FUNCTION(, int, mqtt_event_loop_add, MQTT_EVENT_LOOP_HANDLE, handle, MQTT_CLIENT_HANDLE, client, int, fd);
+MOCKABLE_FUNCTION(, int, mqtt_event_loop_remove, MQTT_EVENT_LOOP_HANDLE, handle, MQTT_CLIENT_HANDLE, client);
+/* Call after using a client outside the loop, e.g. publishing or connecting, so its deadline is taken again on the next run */
+MOCKABLE_FUNCTION(, int, mqtt_event_loop_schedule, MQTT_EVENT_LOOP_HANDLE, handle, MQTT_CLIENT_HANDLE, client);
+
+/* Waits up to maxWaitMs for a socket to become ready or a client deadline, then calls mqtt_client_dowork for each client with work */
+MOCKABLE_FUNCTION(, int, mqtt_event_loop_run_once, MQTT_EVENT_LOOP_HANDLE, handle, uint32_t, maxWaitMs);
+MOCKABLE_FUNCTION(, int, mqtt_event_loop_get_stats, MQTT_EVENT_LOOP_HANDLE, handle, MQTT_EVENT_LOOP_STATS*, loopStats);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // MQTT_EVENT_LOOP_H
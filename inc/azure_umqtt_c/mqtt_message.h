@@ -20,19 +20,48 @@ extern "C" {
 
 typedef struct MQTT_MESSAGE_TAG* MQTT_MESSAGE_HANDLE;
 
+/* Releases a payload adopted by mqttmessage_create_take_ownership, free can be passed directly */
+typedef void(*MQTT_MESSAGE_PAYLOAD_FREE)(void* appMsg);
+
+/* hitCount messages were allocated from the pool, missCount with malloc because every slot was in use */
+typedef struct MQTT_MESSAGE_POOL_STATS_TAG
+{
+    uint64_t hitCount;
+    uint64_t missCount;
+    size_t slotsInUse;
+    size_t capacity;
+} MQTT_MESSAGE_POOL_STATS;
+
 MOCKABLE_FUNCTION(, MQTT_MESSAGE_HANDLE, mqttmessage_create, uint16_t, packetId, const char*, topicName, QOS_VALUE, qosValue, const uint8_t*, appMsg, size_t, appMsgLength);
 MOCKABLE_FUNCTION(,void, mqttmessage_destroy, MQTT_MESSAGE_HANDLE, handle);
+/* Clones share the topic name and payload of handle, which are never modified. Each clone has its own packet id and flags and
+   may be destroyed from any thread */
 MOCKABLE_FUNCTION(,MQTT_MESSAGE_HANDLE, mqttmessage_clone, MQTT_MESSAGE_HANDLE, handle);
+/* A borrowed message references topicName and appMsg instead of copying them, it must not outlive them. mqttmessage_retain
+   copies borrowed data into the message and takes a reference, every retain is matched by one more mqttmessage_destroy */
+MOCKABLE_FUNCTION(, MQTT_MESSAGE_HANDLE, mqttmessage_createBorrowed, uint16_t, packetId, const char*, topicName, QOS_VALUE, qosValue, const uint8_t*, appMsg, size_t, appMsgLength);
+MOCKABLE_FUNCTION(, MQTT_MESSAGE_HANDLE, mqttmessage_retain, MQTT_MESSAGE_HANDLE, handle);
+/* The message adopts appMsg instead of copying it and calls payloadFree on it when the message and all of its clones are destroyed.
+   If NULL is returned the caller still owns appMsg */
+MOCKABLE_FUNCTION(, MQTT_MESSAGE_HANDLE, mqttmessage_create_take_ownership, uint16_t, packetId, const char*, topicName, QOS_VALUE, qosValue, uint8_t*, appMsg, size_t, appMsgLength, MQTT_MESSAGE_PAYLOAD_FREE, payloadFree);
 
 MOCKABLE_FUNCTION(, uint16_t, mqttmessage_getPacketId, MQTT_MESSAGE_HANDLE, handle);
 MOCKABLE_FUNCTION(, const char*, mqttmessage_getTopicName, MQTT_MESSAGE_HANDLE, handle);
 MOCKABLE_FUNCTION(, QOS_VALUE, mqttmessage_getQosType, MQTT_MESSAGE_HANDLE, handle);
 MOCKABLE_FUNCTION(, bool, mqttmessage_getIsDuplicateMsg, MQTT_MESSAGE_HANDLE, handle);
 MOCKABLE_FUNCTION(, bool, mqttmessage_getIsRetained, MQTT_MESSAGE_HANDLE, handle);
+MOCKABLE_FUNCTION(, int, mqttmessage_setPacketId, MQTT_MESSAGE_HANDLE, handle, uint16_t, packetId);
 MOCKABLE_FUNCTION(, int, mqttmessage_setIsDuplicateMsg, MQTT_MESSAGE_HANDLE, handle, bool, duplicateMsg);
 MOCKABLE_FUNCTION(, int, mqttmessage_setIsRetained, MQTT_MESSAGE_HANDLE, handle, bool, retainMsg);
 MOCKABLE_FUNCTION(, const APP_PAYLOAD*, mqttmessage_getApplicationMsg, MQTT_MESSAGE_HANDLE, handle);
 
+/* mqttmessage_initPool sets aside capacity fixed size slots that messages are allocated from before falling back to malloc. A slot
+   holds the message and, up to MQTT_MESSAGE_INLINE_SIZE bytes, its topic name and payload. There is one pool per process,
+   mqttmessage_deinitPool fails while a pooled message is alive and neither call may run concurrently with other mqttmessage calls */
+MOCKABLE_FUNCTION(, int, mqttmessage_initPool, size_t, capacity);
+MOCKABLE_FUNCTION(, int, mqttmessage_deinitPool);
+MOCKABLE_FUNCTION(, int, mqttmessage_getPoolStats, MQTT_MESSAGE_POOL_STATS*, poolStats);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
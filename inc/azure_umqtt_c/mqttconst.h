@@ -103,6 +103,15 @@ typedef struct PUBLISH_ACK_TAG
     uint16_t packetId;
 } PUBLISH_ACK;
 
+typedef struct PACKET_DISCARDED_TAG
+{
+    CONTROL_PACKET_TYPE packetType;
+    size_t packetLength;
+} PACKET_DISCARDED;
+
+typedef struct MQTT_TOPIC_TAG* MQTT_TOPIC_HANDLE;
+typedef struct MQTT_PUBLISH_TEMPLATE_TAG* MQTT_PUBLISH_TEMPLATE_HANDLE;
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
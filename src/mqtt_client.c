@@ -13,17 +13,94 @@
 #include <time.h>
 
 #define KEEP_ALIVE_BUFFER_SEC           10
-#define VARIABLE_HEADER_OFFSET          2
-#define RETAIN_FLAG_MASK                0x1
 #define QOS_LEAST_ONCE_FLAG_MASK        0x2
 #define QOS_EXACTLY_ONCE_FLAG_MASK      0x4
 #define DUPLICATE_FLAG_MASK             0x8
 #define CONNECT_PACKET_MASK             0xf0
 #define TIME_MAX_BUFFER                 16
 #define DEFAULT_MAX_PING_RESPONSE_TIME  90
+#define DEFAULT_BUFFER_HIGH_WATER_MARK  (16 * 1024)
+#define TOPIC_NAME_STACK_SIZE           128
+#define SUBACK_STACK_RETURN_CODES       16
+#define IN_FLIGHT_NONE                  0xFFFF
+#define PACKET_ID_WORD_BITS             64
+#define PACKET_ID_WORD_COUNT            (65536 / PACKET_ID_WORD_BITS)
+#define PACKET_ID_SUMMARY_COUNT         (PACKET_ID_WORD_COUNT / PACKET_ID_WORD_BITS)
 
 static const char* FORMAT_HEX_CHAR = "0x%02x ";
 
+typedef enum IN_FLIGHT_STATE_TAG
+{
+    IN_FLIGHT_WAIT_PUBACK,
+    IN_FLIGHT_WAIT_PUBREC,
+    IN_FLIGHT_WAIT_PUBCOMP
+} IN_FLIGHT_STATE;
+
+typedef struct IN_FLIGHT_ENTRY_TAG
+{
+    // DUP flagged clone of the published message, NULL once the PUBREC arrived and only the PUBREL is sent again
+    MQTT_MESSAGE_HANDLE msgHandle;
+    // DUP flagged copy of the packet instead of a clone for publishes sent from a buffer rather than a message
+    uint8_t* packet;
+    size_t packetLen;
+    uint64_t sendTimeMs;
+    uint16_t packetId;
+    IN_FLIGHT_STATE state;
+    // Entries in use are linked in the order they were last sent, free entries through next
+    uint16_t prev;
+    uint16_t next;
+} IN_FLIGHT_ENTRY;
+
+// The entries are found by packet id through slots, an open addressed table of entry indexes with at least twice as
+// many slots as entries so probe sequences stay short
+typedef struct IN_FLIGHT_TABLE_TAG
+{
+    IN_FLIGHT_ENTRY* entries;
+    uint16_t* slots;
+    size_t maxCount;
+    size_t count;
+    size_t slotMask;
+    uint16_t head;
+    uint16_t tail;
+    uint16_t freeEntry;
+    uint32_t retryTimeoutMs;
+} IN_FLIGHT_TABLE;
+
+// One bit per packet id, set while the id is in use
+typedef struct PACKET_ID_MAP_TAG
+{
+    // Bit n of summary[i] is set when words[i * 64 + n] has no free id left, so a free id is found without scanning every word
+    uint64_t summary[PACKET_ID_SUMMARY_COUNT];
+    uint64_t words[PACKET_ID_WORD_COUNT];
+} PACKET_ID_MAP;
+
+// A publish waiting for room in the flow control window, a segmented publish keeps the message and callback of the caller
+typedef struct PENDING_PUBLISH_TAG
+{
+    MQTT_MESSAGE_HANDLE msgHandle;
+    ON_MQTT_PUBLISH_SEND_COMPLETE onSendComplete;
+    void* context;
+    struct PENDING_PUBLISH_TAG* next;
+} PENDING_PUBLISH;
+
+// The packet ids holding a window slot are kept in an open addressed set with at least twice as many slots as the window,
+// 0 marks a free slot since it is never a packet id
+typedef struct PUBLISH_WINDOW_TAG
+{
+    uint16_t* slots;
+    size_t slotMask;
+    size_t maxCount;
+    size_t count;
+    MQTT_CLIENT_FLOW_CONTROL_MODE mode;
+    PENDING_PUBLISH* queueHead;
+    PENDING_PUBLISH* queueTail;
+    size_t queuedCount;
+    // Set when a publish was refused or queued, cleared once fnWritable was called
+    bool blocked;
+    ON_MQTT_WRITABLE_CALLBACK fnWritable;
+    void* writableCtx;
+} PUBLISH_WINDOW;
+
 typedef struct MQTT_CLIENT_TAG
 {
     XIO_HANDLE xioHandle;
@@ -43,58 +120,72 @@ typedef struct MQTT_CLIENT_TAG
     bool rawBytesTrace;
     uint64_t timeSincePing;
     uint16_t maxPingRespTime;
+    uint8_t* sendBuffer;
+    size_t sendBufferSize;
+    // Packet ids of the QoS 1 and 2 messages a batch encoded, so a failed send gives back only theirs
+    uint16_t* batchPacketIds;
+    size_t batchPacketIdsSize;
+    // A reserved publish is kept apart from the send buffer so other packets can be sent while the application writes its payload
+    uint8_t* reserveBuffer;
+    size_t reserveBufferSize;
+    size_t reservedLen;
+    size_t reservedPayloadLen;
+    QOS_VALUE reservedQosValue;
+    uint16_t reservedPacketId;
+    // The send and reserve buffers are kept between packets unless a packet made them grow past this, like the codec reassembly buffer
+    size_t bufferHighWaterMark;
+    // When coalescing is on, packets are appended to the send queue and written with one xio_send per dowork cycle
+    size_t maxBatchSize;
+    uint32_t maxBatchDelayMs;
+    uint8_t* sendQueue;
+    size_t sendQueueSize;
+    size_t sendQueueLen;
+    uint64_t sendQueueStartMs;
+    MQTT_CLIENT_SEND_STATS sendStats;
+    // xio_send calls whose on_send_complete has not been called yet, the xio still holds data for them
+    size_t pendingSendCount;
+    // Set when bytes arrived since mqtt_client_dowork began, a TLS xio may hold more that only its next xio_dowork delivers
+    bool bytesReceived;
+    // Streamed PUBLISH packets are handed to these callbacks instead of fnMessageRecv, the ack is sent once the payload ends
+    ON_MQTT_PUBLISH_BEGIN_CALLBACK fnPublishBegin;
+    ON_MQTT_PUBLISH_CHUNK_CALLBACK fnPublishChunk;
+    ON_MQTT_PUBLISH_END_CALLBACK fnPublishEnd;
+    void* streamCtx;
+    QOS_VALUE streamQosValue;
+    uint16_t streamPacketId;
+    // QoS 1 and 2 messages published with a message handle are kept until they are acknowledged
+    IN_FLIGHT_TABLE inFlight;
+    // Allocated by the first packet id reservation, clients that only publish with QoS 0 never allocate it
+    PACKET_ID_MAP* packetIds;
+    uint16_t lastPacketId;
+    // Limits the QoS 1 and 2 publishes waiting for an ack when flow control is on
+    PUBLISH_WINDOW window;
 } MQTT_CLIENT;
 
-static uint16_t byteutil_read_uint16(uint8_t** buffer)
-{
-    uint16_t result = 0;
-    if (buffer != NULL)
-    {
-        result = 256 * ((uint8_t)(**buffer)) + (uint8_t)(*(*buffer + 1));
-        *buffer += 2; // Move the ptr
-    }
-    return result;
-}
-
-static char* byteutil_readUTF(uint8_t** buffer, size_t* byteLen)
+typedef struct PUBLISH_SEND_CONTEXT_TAG
 {
-    char* result = NULL;
-    if (buffer != NULL)
-    {
-        // Get the length of the string
-        int len = byteutil_read_uint16(buffer);
-        if (len > 0)
-        {
-            result = (char*)malloc(len + 1);
-            if (result != NULL)
-            {
-                (void)memcpy(result, *buffer, len);
-                result[len] = '\0';
-                *buffer += len;
-                if (byteLen != NULL)
-                {
-                    *byteLen = len;
-                }
-            }
-        }
-    }
-    return result;
-}
+    MQTT_CLIENT* clientData;
+    MQTT_MESSAGE_HANDLE msgHandle;
+    ON_MQTT_PUBLISH_SEND_COMPLETE onSendComplete;
+    void* context;
+} PUBLISH_SEND_CONTEXT;
 
-static uint8_t byteutil_readByte(uint8_t** buffer)
+static void completePendingSend(MQTT_CLIENT* mqttData)
 {
-    uint8_t result = 0;
-    if (buffer != NULL)
+    // A send made before mqtt_client_connect reset the count may still complete
+    if (mqttData->pendingSendCount > 0)
     {
-        result = **buffer;
-        (*buffer)++;
+        mqttData->pendingSendCount--;
     }
-    return result;
 }
 
 static void sendComplete(void* context, IO_SEND_RESULT send_result)
 {
     MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        completePendingSend(mqttData);
+    }
     if (mqttData != NULL && mqttData->fnOperationCallback != NULL && send_result == IO_SEND_OK)
     {
         if (mqttData->packetState == DISCONNECT_TYPE)
@@ -205,7 +296,21 @@ static void logIncomingMsgTrace(MQTT_CLIENT* clientData, CONTROL_PACKET_TYPE pac
     }
 }
 
-static int sendPacketItem(MQTT_CLIENT* clientData, const unsigned char* data, size_t length)
+// Every xio_send goes through here so the sends the xio has not completed yet are counted
+static int sendToXio(MQTT_CLIENT* clientData, const void* data, size_t length, ON_SEND_COMPLETE onSendComplete, void* context)
+{
+    int result;
+    // Counted first since the xio may complete the send before xio_send returns
+    clientData->pendingSendCount++;
+    result = xio_send(clientData->xioHandle, data, length, onSendComplete, context);
+    if (result != 0)
+    {
+        clientData->pendingSendCount--;
+    }
+    return result;
+}
+
+static int sendPacketData(MQTT_CLIENT* clientData, const unsigned char* data, size_t length, ON_SEND_COMPLETE onSendComplete, void* context)
 {
     int result;
 
@@ -216,7 +321,7 @@ static int sendPacketItem(MQTT_CLIENT* clientData, const unsigned char* data, si
     }
     else
     {
-        result = xio_send(clientData->xioHandle, (const void*)data, length, sendComplete, clientData);
+        result = sendToXio(clientData, (const void*)data, length, onSendComplete, context);
         if (result != 0)
         {
             LOG(LOG_ERROR, LOG_LINE, "%d: Failure sending control packet data", result);
@@ -224,156 +329,1334 @@ static int sendPacketItem(MQTT_CLIENT* clientData, const unsigned char* data, si
         }
         else
         {
+            clientData->sendStats.sendCount++;
+            clientData->sendStats.byteCount += length;
             logOutgoingingMsgTrace(clientData, (const uint8_t*)data, length);
         }
     }
     return result;
 }
 
-static void onOpenComplete(void* context, IO_OPEN_RESULT open_result)
+// The send buffers grow to fit the packet and are kept for the next one, see trimSendBuffers
+static int ensureBufferSize(uint8_t** buffer, size_t* bufferSize, size_t packetLen)
 {
-    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
-    if (mqttData != NULL)
+    int result;
+    if (packetLen <= *bufferSize)
     {
-        if (open_result == IO_OPEN_OK && !mqttData->socketConnected)
+        result = 0;
+    }
+    else
+    {
+        uint8_t* newBuffer = (uint8_t*)realloc(*buffer, packetLen);
+        if (newBuffer == NULL)
         {
-            mqttData->packetState = CONNECT_TYPE;
-            mqttData->socketConnected = true;
-            // Send the Connect packet
-            BUFFER_HANDLE connPacket = mqtt_codec_connect(&mqttData->mqttOptions);
-            if (connPacket == NULL)
-            {
-                /*Codes_SRS_MQTT_CLIENT_07_007: [If any failure is encountered then mqtt_client_connect shall return a non-zero value.]*/
-                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_connect failed");
-            }
-            else
-            {
-                /*Codes_SRS_MQTT_CLIENT_07_009: [On success mqtt_client_connect shall send the MQTT CONNECT to the endpoint.]*/
-                if (sendPacketItem(mqttData, BUFFER_u_char(connPacket), BUFFER_length(connPacket)) != 0)
-                {
-                    /*Codes_SRS_MQTT_CLIENT_07_007: [If any failure is encountered then mqtt_client_connect shall return a non-zero value.]*/
-                    LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_connect failed");
-                }
-                BUFFER_delete(connPacket);
-            }
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating the send buffer");
+            result = __LINE__;
         }
-        else if (open_result == IO_OPEN_ERROR)
+        else
         {
-            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+            *buffer = newBuffer;
+            *bufferSize = packetLen;
+            result = 0;
         }
     }
+    return result;
 }
 
-static void onBytesReceived(void* context, const unsigned char* buffer, size_t size)
+static int ensureBatchPacketIdsSize(MQTT_CLIENT* clientData, size_t count)
 {
-    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
-    if (mqttData != NULL)
+    int result;
+    if (count <= clientData->batchPacketIdsSize)
     {
-        if (mqtt_codec_bytesReceived(mqttData->codec_handle, buffer, size) != 0)
+        result = 0;
+    }
+    else
+    {
+        uint16_t* newIds = (uint16_t*)realloc(clientData->batchPacketIds, count * sizeof(uint16_t));
+        if (newIds == NULL)
         {
-            if (mqttData->fnOperationCallback)
-            {
-                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-            }
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating the batch packet ids");
+            result = __LINE__;
+        }
+        else
+        {
+            clientData->batchPacketIds = newIds;
+            clientData->batchPacketIdsSize = count;
+            result = 0;
         }
     }
+    return result;
 }
 
-static void onIoError(void* context)
+// Frees the send buffer, the batch packet ids, and the reserve buffer when no publish is reserved in it, once a packet made them grow past the high water mark
+static void trimSendBuffers(MQTT_CLIENT* clientData)
 {
-    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
-    if (mqttData != NULL && mqttData->fnOperationCallback)
+    /*Codes_SRS_MQTT_CLIENT_07_128: [Once a PUBLISH encoded in the send buffer or the reserve buffer was handed to the transport, a send buffer, a batch packet id buffer or an unused reserve buffer larger than the high water mark shall be freed.]*/
+    if (clientData->sendBufferSize > clientData->bufferHighWaterMark)
     {
-        /*Codes_SRS_MQTT_CLIENT_07_032: [If the actionResult parameter is of type MQTT_CLIENT_ON_DISCONNECT or MQTT_CLIENT_ON_ERROR the the msgInfo value shall be NULL.]*/
-        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-        mqttData->socketConnected = false;
+        free(clientData->sendBuffer);
+        clientData->sendBuffer = NULL;
+        clientData->sendBufferSize = 0;
+    }
+    if (clientData->batchPacketIdsSize * sizeof(uint16_t) > clientData->bufferHighWaterMark)
+    {
+        free(clientData->batchPacketIds);
+        clientData->batchPacketIds = NULL;
+        clientData->batchPacketIdsSize = 0;
+    }
+    if (clientData->reservedLen == 0 && clientData->reserveBufferSize > clientData->bufferHighWaterMark)
+    {
+        free(clientData->reserveBuffer);
+        clientData->reserveBuffer = NULL;
+        clientData->reserveBufferSize = 0;
     }
 }
 
-static int cloneMqttOptions(MQTT_CLIENT* mqttData, const MQTT_CLIENT_OPTIONS* mqttOptions)
+static int flushSendQueue(MQTT_CLIENT* clientData)
 {
-    int result = 0;
-    if (mqttOptions->clientId != NULL)
+    int result;
+    if (clientData->sendQueueLen == 0)
     {
-        if (mallocAndStrcpy_s(&mqttData->mqttOptions.clientId, mqttOptions->clientId) != 0)
-        {
-            result = __LINE__;
-        }
+        result = 0;
     }
-    if (result == 0 && mqttOptions->willTopic != NULL)
+    else
     {
-        if (mallocAndStrcpy_s(&mqttData->mqttOptions.willTopic, mqttOptions->willTopic) != 0)
+        size_t queueLen = clientData->sendQueueLen;
+        clientData->sendQueueLen = 0;
+        result = sendPacketData(clientData, clientData->sendQueue, queueLen, sendComplete, clientData);
+    }
+    return result;
+}
+
+// Sends packetCount packets that are laid out back to back in data, either right away or through the send queue
+static int queuePacketData(MQTT_CLIENT* clientData, const unsigned char* data, size_t length, size_t packetCount)
+{
+    int result;
+    if (clientData->maxBatchSize == 0)
+    {
+        result = sendPacketData(clientData, data, length, sendComplete, clientData);
+    }
+    else if (clientData->sendQueueLen > 0 && clientData->sendQueueLen + length > clientData->maxBatchSize && flushSendQueue(clientData) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (length >= clientData->maxBatchSize)
+    {
+        // Packets that fill a batch on their own are not worth copying
+        result = sendPacketData(clientData, data, length, sendComplete, clientData);
+    }
+    else if (ensureBufferSize(&clientData->sendQueue, &clientData->sendQueueSize, clientData->maxBatchSize) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (clientData->sendQueueLen == 0 && clientData->maxBatchDelayMs > 0 && tickcounter_get_current_ms(clientData->packetTickCntr, &clientData->sendQueueStartMs) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Failure getting current ms tickcounter");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)memcpy(clientData->sendQueue + clientData->sendQueueLen, data, length);
+        clientData->sendQueueLen += length;
+        result = (clientData->sendQueueLen >= clientData->maxBatchSize) ? flushSendQueue(clientData) : 0;
+    }
+
+    if (result == 0)
+    {
+        clientData->sendStats.packetCount += packetCount;
+    }
+    return result;
+}
+
+static int sendPacketItem(MQTT_CLIENT* clientData, const unsigned char* data, size_t length)
+{
+    return queuePacketData(clientData, data, length, 1);
+}
+
+// Acks are always 4 bytes, so they are encoded on the stack and sent without touching the heap
+static void sendPublishReply(MQTT_CLIENT* clientData, const uint8_t* replyPacket, size_t replyLen)
+{
+    if (replyLen != MQTT_PUBLISH_REPLY_PACKET_SIZE)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Failed to encode publish reply message.");
+        if (clientData->fnOperationCallback)
         {
-            result = __LINE__;
+            clientData->fnOperationCallback(clientData, MQTT_CLIENT_ON_ERROR, NULL, clientData->ctx);
         }
     }
-    if (result == 0 && mqttOptions->willMessage != NULL)
+    else
     {
-        if (mallocAndStrcpy_s(&mqttData->mqttOptions.willMessage, mqttOptions->willMessage) != 0)
+        (void)sendPacketItem(clientData, replyPacket, replyLen);
+    }
+}
+
+static void acknowledgePublish(MQTT_CLIENT* clientData, QOS_VALUE qosValue, uint16_t packetId)
+{
+    /*Codes_SRS_MQTT_CLIENT_07_043: [The PUBACK, PUBREC, PUBREL and PUBCOMP replies shall be encoded on the stack with the mqtt_codec_*_into functions and sent without allocating memory.]*/
+    uint8_t replyPacket[MQTT_PUBLISH_REPLY_PACKET_SIZE];
+    if (qosValue == DELIVER_EXACTLY_ONCE)
+    {
+        sendPublishReply(clientData, replyPacket, mqtt_codec_publishReceived_into(replyPacket, sizeof(replyPacket), packetId));
+    }
+    else if (qosValue == DELIVER_AT_LEAST_ONCE)
+    {
+        sendPublishReply(clientData, replyPacket, mqtt_codec_publishAck_into(replyPacket, sizeof(replyPacket), packetId));
+    }
+}
+
+static unsigned int findFirstZero(uint64_t value)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(~value);
+#else
+    unsigned int result = 0;
+    while ((value & 1) != 0)
+    {
+        value >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+static void resetPacketIds(PACKET_ID_MAP* packetIds)
+{
+    memset(packetIds, 0, sizeof(PACKET_ID_MAP));
+    // 0 is not a valid packet id
+    packetIds->words[0] = 1;
+}
+
+static void markPacketId(PACKET_ID_MAP* packetIds, uint16_t packetId)
+{
+    size_t wordIndex = packetId / PACKET_ID_WORD_BITS;
+    packetIds->words[wordIndex] |= (uint64_t)1 << (packetId % PACKET_ID_WORD_BITS);
+    if (packetIds->words[wordIndex] == UINT64_MAX)
+    {
+        packetIds->summary[wordIndex / PACKET_ID_WORD_BITS] |= (uint64_t)1 << (wordIndex % PACKET_ID_WORD_BITS);
+    }
+}
+
+static void releasePacketId(MQTT_CLIENT* mqttData, uint16_t packetId)
+{
+    if (mqttData->packetIds != NULL && packetId != 0)
+    {
+        size_t wordIndex = packetId / PACKET_ID_WORD_BITS;
+        mqttData->packetIds->words[wordIndex] &= ~((uint64_t)1 << (packetId % PACKET_ID_WORD_BITS));
+        mqttData->packetIds->summary[wordIndex / PACKET_ID_WORD_BITS] &= ~((uint64_t)1 << (wordIndex % PACKET_ID_WORD_BITS));
+    }
+}
+
+// Marks packetId as in use, or when it is 0 picks the lowest free packet id. Returns 0 if no packet id is free or the map cannot be allocated
+static uint16_t reservePacketId(MQTT_CLIENT* mqttData, uint16_t packetId)
+{
+    uint16_t result = 0;
+    if (mqttData->packetIds == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_132: [The map of packet ids in use shall be allocated by the first packet id reservation, whether the caller chose the id or the client picks it, so that every packet id chosen by the caller is marked.]*/
+        mqttData->packetIds = (PACKET_ID_MAP*)malloc(sizeof(PACKET_ID_MAP));
+        if (mqttData->packetIds == NULL)
         {
-            result = __LINE__;
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure allocating the packet id map");
+        }
+        else
+        {
+            resetPacketIds(mqttData->packetIds);
         }
     }
-    if (result == 0 && mqttOptions->username != NULL)
+
+    if (mqttData->packetIds == NULL)
     {
-        if (mallocAndStrcpy_s(&mqttData->mqttOptions.username, mqttOptions->username) != 0)
+        result = 0;
+    }
+    else if (packetId != 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_106: [Packet ids chosen by the caller shall be marked as in use, so that the ids the client picks do not collide with them.]*/
+        markPacketId(mqttData->packetIds, packetId);
+        result = packetId;
+    }
+    else
+    {
+        PACKET_ID_MAP* packetIds = mqttData->packetIds;
+        for (size_t index = 0; index < PACKET_ID_SUMMARY_COUNT; index++)
         {
-            result = __LINE__;
+            if (packetIds->summary[index] != UINT64_MAX)
+            {
+                size_t wordIndex = index * PACKET_ID_WORD_BITS + findFirstZero(packetIds->summary[index]);
+                result = (uint16_t)(wordIndex * PACKET_ID_WORD_BITS + findFirstZero(packetIds->words[wordIndex]));
+                markPacketId(packetIds, result);
+                break;
+            }
+        }
+
+        if (result == 0)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: every packet id is in use");
         }
     }
-    if (result == 0 && mqttOptions->password != NULL)
+
+    if (result != 0)
     {
-        if (mallocAndStrcpy_s(&mqttData->mqttOptions.password, mqttOptions->password) != 0)
+        mqttData->lastPacketId = result;
+    }
+    return result;
+}
+
+static size_t findInFlightSlot(const IN_FLIGHT_TABLE* inFlight, uint16_t packetId)
+{
+    // Packet ids mostly follow each other so their low bits spread them over the slots without hashing
+    size_t slot = packetId & inFlight->slotMask;
+    while (inFlight->slots[slot] != IN_FLIGHT_NONE && inFlight->entries[inFlight->slots[slot]].packetId != packetId)
+    {
+        slot = (slot + 1) & inFlight->slotMask;
+    }
+    return slot;
+}
+
+static bool isInFlight(const IN_FLIGHT_TABLE* inFlight, uint16_t packetId)
+{
+    return inFlight->count > 0 && inFlight->slots[findInFlightSlot(inFlight, packetId)] != IN_FLIGHT_NONE;
+}
+
+// Reserves the packet id of a QoS 1 or 2 publish encoded in a buffer, the caller encodes it with the id stored in packetId
+static int reserveBufferPacketId(MQTT_CLIENT* mqttData, QOS_VALUE qosValue, uint16_t* packetId)
+{
+    int result;
+    if (qosValue != DELIVER_AT_LEAST_ONCE && qosValue != DELIVER_EXACTLY_ONCE)
+    {
+        result = 0;
+    }
+    else if (*packetId != 0 && isInFlight(&mqttData->inFlight, *packetId))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_140: [A QoS 1 or 2 publish with a packet id that is still in flight shall fail without being sent, and the message in flight shall keep waiting for its acknowledgement.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: packet id %u is still in flight", (unsigned int)*packetId);
+        result = __LINE__;
+    }
+    else
+    {
+        uint16_t reservedId = reservePacketId(mqttData, *packetId);
+        if (reservedId == 0)
         {
             result = __LINE__;
         }
+        else
+        {
+            *packetId = reservedId;
+            result = 0;
+        }
     }
-    if (result == 0)
+    return result;
+}
+
+// Reserves the packet id of a QoS 1 or 2 message, storing the id the client picked in the message when its packet id is 0
+static int reservePublishPacketId(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle, QOS_VALUE qosValue, uint16_t* packetId)
+{
+    int result;
+    uint16_t reservedId = *packetId;
+    if (reserveBufferPacketId(mqttData, qosValue, &reservedId) != 0)
     {
-        mqttData->mqttOptions.keepAliveInterval = mqttOptions->keepAliveInterval;
-        mqttData->mqttOptions.messageRetain = mqttOptions->messageRetain;
-        mqttData->mqttOptions.useCleanSession = mqttOptions->useCleanSession;
-        mqttData->mqttOptions.qualityOfServiceValue = mqttOptions->qualityOfServiceValue;
+        result = __LINE__;
+    }
+    else if (reservedId != *packetId && mqttmessage_setPacketId(msgHandle, reservedId) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqttmessage_setPacketId failed");
+        releasePacketId(mqttData, reservedId);
+        result = __LINE__;
     }
     else
     {
-        free(mqttData->mqttOptions.clientId);
-        free(mqttData->mqttOptions.willTopic);
-        free(mqttData->mqttOptions.willMessage);
-        free(mqttData->mqttOptions.username);
-        free(mqttData->mqttOptions.password);
+        *packetId = reservedId;
+        result = 0;
     }
     return result;
 }
 
-static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int flags, BUFFER_HANDLE headerData)
+// Encodes the PUBLISH for msgHandle at offset in the send buffer and returns its length, or 0 on failure, along with its QOS and packet id.
+// New publishes reserve their packet id, resends keep the one they were sent with. Batches grow the buffer geometrically so appending
+// many small packets does not realloc once per packet
+static size_t encodePublishMessage(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle, size_t offset, bool reserveId, QOS_VALUE* qosValue, uint16_t* packetId)
 {
-    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
-    if ((mqttData != NULL && headerData != NULL) || packet == PINGRESP_TYPE)
+    size_t result;
+    /*Codes_SRS_MQTT_CLIENT_07_021: [mqtt_client_publish shall get the message information from the MQTT_MESSAGE_HANDLE.]*/
+    const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+    if (payload == NULL)
     {
-        size_t len = BUFFER_length(headerData);
-        uint8_t* iterator = BUFFER_u_char(headerData);
-
-        logIncomingMsgTrace(mqttData, packet, flags, iterator, len);
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqttmessage_getApplicationMsg failed");
+        *qosValue = DELIVER_AT_MOST_ONCE;
+        *packetId = 0;
+        result = 0;
+    }
+    else
+    {
+        *qosValue = mqttmessage_getQosType(msgHandle);
+        bool isDuplicateMsg = mqttmessage_getIsDuplicateMsg(msgHandle);
+        bool isRetained = mqttmessage_getIsRetained(msgHandle);
+        *packetId = mqttmessage_getPacketId(msgHandle);
+        const char* topicName = mqttmessage_getTopicName(msgHandle);
 
-        if ((iterator != NULL && len > 0) || packet == PINGRESP_TYPE)
+        /*Codes_SRS_MQTT_CLIENT_07_105: [When a QoS 1 or 2 message has packet id 0 mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall pick the lowest free packet id and store it in the message with mqttmessage_setPacketId before encoding it.]*/
+        /*Codes_SRS_MQTT_CLIENT_07_042: [mqtt_client_publish shall encode the PUBLISH packet by calling mqtt_codec_publish_into with a send buffer owned by the client, growing the buffer only when the packet does not fit.]*/
+        size_t packetLen = (reserveId && reservePublishPacketId(mqttData, msgHandle, *qosValue, packetId) != 0) ? 0 : mqtt_codec_publish_into(mqttData->sendBuffer + offset, mqttData->sendBufferSize - offset, *qosValue, isDuplicateMsg, isRetained, *packetId, topicName, payload->message, payload->length);
+        if (packetLen > mqttData->sendBufferSize - offset)
         {
-            switch (packet)
+            size_t requiredSize = offset + packetLen;
+            if (offset > 0 && requiredSize < mqttData->sendBufferSize * 2)
             {
-                case CONNACK_TYPE:
-                {
-                    if (mqttData->fnOperationCallback != NULL)
+                requiredSize = mqttData->sendBufferSize * 2;
+            }
+
+            if (ensureBufferSize(&mqttData->sendBuffer, &mqttData->sendBufferSize, requiredSize) != 0)
+            {
+                packetLen = 0;
+            }
+            else
+            {
+                packetLen = mqtt_codec_publish_into(mqttData->sendBuffer + offset, mqttData->sendBufferSize - offset, *qosValue, isDuplicateMsg, isRetained, *packetId, topicName, payload->message, payload->length);
+            }
+        }
+
+        if (packetLen == 0 || packetLen > mqttData->sendBufferSize - offset)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publish_into failed");
+            result = 0;
+        }
+        else
+        {
+            result = packetLen;
+        }
+    }
+    return result;
+}
+
+static void unlinkInFlight(IN_FLIGHT_TABLE* inFlight, uint16_t index)
+{
+    IN_FLIGHT_ENTRY* entry = &inFlight->entries[index];
+    if (entry->prev == IN_FLIGHT_NONE)
+    {
+        inFlight->head = entry->next;
+    }
+    else
+    {
+        inFlight->entries[entry->prev].next = entry->next;
+    }
+    if (entry->next == IN_FLIGHT_NONE)
+    {
+        inFlight->tail = entry->prev;
+    }
+    else
+    {
+        inFlight->entries[entry->next].prev = entry->prev;
+    }
+}
+
+static void appendInFlight(IN_FLIGHT_TABLE* inFlight, uint16_t index, uint64_t sendTimeMs)
+{
+    IN_FLIGHT_ENTRY* entry = &inFlight->entries[index];
+    entry->sendTimeMs = sendTimeMs;
+    entry->prev = inFlight->tail;
+    entry->next = IN_FLIGHT_NONE;
+    if (inFlight->tail == IN_FLIGHT_NONE)
+    {
+        inFlight->head = index;
+    }
+    else
+    {
+        inFlight->entries[inFlight->tail].next = index;
+    }
+    inFlight->tail = index;
+}
+
+// Drops what the entry would send again as a PUBLISH
+static void releaseInFlightPublish(IN_FLIGHT_ENTRY* entry)
+{
+    if (entry->msgHandle != NULL)
+    {
+        mqttmessage_destroy(entry->msgHandle);
+        entry->msgHandle = NULL;
+    }
+    free(entry->packet);
+    entry->packet = NULL;
+}
+
+static void removeInFlight(IN_FLIGHT_TABLE* inFlight, size_t slot)
+{
+    uint16_t index = inFlight->slots[slot];
+    IN_FLIGHT_ENTRY* entry = &inFlight->entries[index];
+    releaseInFlightPublish(entry);
+    unlinkInFlight(inFlight, index);
+    entry->next = inFlight->freeEntry;
+    inFlight->freeEntry = index;
+    inFlight->count--;
+
+    // Backward shift deletion, every entry after the hole that may live there moves up so no tombstones are needed
+    inFlight->slots[slot] = IN_FLIGHT_NONE;
+    size_t next = slot;
+    for (;;)
+    {
+        next = (next + 1) & inFlight->slotMask;
+        if (inFlight->slots[next] == IN_FLIGHT_NONE)
+        {
+            break;
+        }
+        size_t home = inFlight->entries[inFlight->slots[next]].packetId & inFlight->slotMask;
+        if (((next - home) & inFlight->slotMask) >= ((next - slot) & inFlight->slotMask))
+        {
+            inFlight->slots[slot] = inFlight->slots[next];
+            inFlight->slots[next] = IN_FLIGHT_NONE;
+            slot = next;
+        }
+    }
+}
+
+static void clearInFlight(IN_FLIGHT_TABLE* inFlight)
+{
+    while (inFlight->head != IN_FLIGHT_NONE)
+    {
+        IN_FLIGHT_ENTRY* entry = &inFlight->entries[inFlight->head];
+        inFlight->head = entry->next;
+        releaseInFlightPublish(entry);
+    }
+    free(inFlight->entries);
+    inFlight->entries = NULL;
+    inFlight->slots = NULL;
+    inFlight->maxCount = 0;
+    inFlight->count = 0;
+    inFlight->slotMask = 0;
+    inFlight->tail = IN_FLIGHT_NONE;
+    inFlight->freeEntry = IN_FLIGHT_NONE;
+}
+
+static uint64_t getInFlightTime(MQTT_CLIENT* mqttData)
+{
+    uint64_t result;
+    if (tickcounter_get_current_ms(mqttData->packetTickCntr, &result) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Failure getting current ms tickcounter");
+        result = mqttData->packetSendTimeMs;
+    }
+    return result;
+}
+
+// Finds the slot for a new entry for packetId, publishes whose packet id is still in flight are refused before they get here
+static int findFreeInFlightSlot(IN_FLIGHT_TABLE* inFlight, uint16_t packetId, size_t* slot)
+{
+    int result;
+    *slot = findInFlightSlot(inFlight, packetId);
+    if (inFlight->slots[*slot] != IN_FLIGHT_NONE)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: packet id %u is already in flight", (unsigned int)packetId);
+        result = __LINE__;
+    }
+    else if (inFlight->count >= inFlight->maxCount)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: %lu messages are already in flight", (unsigned long)inFlight->count);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void addInFlight(MQTT_CLIENT* mqttData, size_t slot, MQTT_MESSAGE_HANDLE resendHandle, uint8_t* resendPacket, size_t resendPacketLen, QOS_VALUE qosValue, uint16_t packetId)
+{
+    IN_FLIGHT_TABLE* inFlight = &mqttData->inFlight;
+    uint16_t index = inFlight->freeEntry;
+    IN_FLIGHT_ENTRY* entry = &inFlight->entries[index];
+    inFlight->freeEntry = entry->next;
+    entry->msgHandle = resendHandle;
+    entry->packet = resendPacket;
+    entry->packetLen = resendPacketLen;
+    entry->packetId = packetId;
+    entry->state = (qosValue == DELIVER_EXACTLY_ONCE) ? IN_FLIGHT_WAIT_PUBREC : IN_FLIGHT_WAIT_PUBACK;
+    appendInFlight(inFlight, index, getInFlightTime(mqttData));
+    inFlight->slots[slot] = index;
+    inFlight->count++;
+}
+
+// Keeps a DUP flagged clone of a QoS 1 or 2 message so it can be sent again until it is acknowledged
+static int trackPublish(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle, QOS_VALUE qosValue, uint16_t packetId)
+{
+    int result;
+    size_t slot;
+    if (mqttData->inFlight.entries == NULL || (qosValue != DELIVER_AT_LEAST_ONCE && qosValue != DELIVER_EXACTLY_ONCE))
+    {
+        result = 0;
+    }
+    else if (findFreeInFlightSlot(&mqttData->inFlight, packetId, &slot) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        MQTT_MESSAGE_HANDLE resendHandle = mqttmessage_clone(msgHandle);
+        if (resendHandle == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure cloning the in flight message");
+            result = __LINE__;
+        }
+        else if (mqttmessage_setIsDuplicateMsg(resendHandle, true) != 0)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure setting the DUP flag of the in flight message");
+            mqttmessage_destroy(resendHandle);
+            result = __LINE__;
+        }
+        else
+        {
+            addInFlight(mqttData, slot, resendHandle, NULL, 0, qosValue, packetId);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+// Keeps a DUP flagged copy of a QoS 1 or 2 PUBLISH encoded in a buffer, there is no message to clone for it
+static int trackPublishPacket(MQTT_CLIENT* mqttData, const uint8_t* packet, size_t packetLen, QOS_VALUE qosValue, uint16_t packetId)
+{
+    int result;
+    size_t slot;
+    if (mqttData->inFlight.entries == NULL || (qosValue != DELIVER_AT_LEAST_ONCE && qosValue != DELIVER_EXACTLY_ONCE))
+    {
+        result = 0;
+    }
+    else if (findFreeInFlightSlot(&mqttData->inFlight, packetId, &slot) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        uint8_t* resendPacket = (uint8_t*)malloc(packetLen);
+        if (resendPacket == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure copying the in flight packet");
+            result = __LINE__;
+        }
+        else
+        {
+            (void)memcpy(resendPacket, packet, packetLen);
+            resendPacket[0] |= DUPLICATE_FLAG_MASK;
+            addInFlight(mqttData, slot, NULL, resendPacket, packetLen, qosValue, packetId);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void completeInFlight(MQTT_CLIENT* mqttData, CONTROL_PACKET_TYPE packet, uint16_t packetId)
+{
+    IN_FLIGHT_TABLE* inFlight = &mqttData->inFlight;
+    if (inFlight->count > 0)
+    {
+        size_t slot = findInFlightSlot(inFlight, packetId);
+        if (inFlight->slots[slot] != IN_FLIGHT_NONE)
+        {
+            uint16_t index = inFlight->slots[slot];
+            IN_FLIGHT_ENTRY* entry = &inFlight->entries[index];
+            if ((packet == PUBACK_TYPE && entry->state == IN_FLIGHT_WAIT_PUBACK) || (packet == PUBCOMP_TYPE && entry->state == IN_FLIGHT_WAIT_PUBCOMP))
+            {
+                removeInFlight(inFlight, slot);
+            }
+            else if (packet == PUBREC_TYPE && entry->state == IN_FLIGHT_WAIT_PUBREC)
+            {
+                // From here on only the PUBREL is sent again, so the message is no longer needed
+                releaseInFlightPublish(entry);
+                entry->state = IN_FLIGHT_WAIT_PUBCOMP;
+                unlinkInFlight(inFlight, index);
+                appendInFlight(inFlight, index, getInFlightTime(mqttData));
+            }
+        }
+    }
+}
+
+// Releases the packet id of a QoS 1 or 2 PUBLISH that could not be sent, unless the message stays in flight and will be sent again
+static void releaseUnsentPacketId(MQTT_CLIENT* mqttData, QOS_VALUE qosValue, uint16_t packetId)
+{
+    if ((qosValue == DELIVER_AT_LEAST_ONCE || qosValue == DELIVER_EXACTLY_ONCE) && !isInFlight(&mqttData->inFlight, packetId))
+    {
+        releasePacketId(mqttData, packetId);
+    }
+}
+
+// Drops a reserved publish that was not committed and gives its packet id back
+static void releaseReservation(MQTT_CLIENT* mqttData)
+{
+    if (mqttData->reservedLen > 0)
+    {
+        mqttData->reservedLen = 0;
+        releaseUnsentPacketId(mqttData, mqttData->reservedQosValue, mqttData->reservedPacketId);
+    }
+}
+
+// Sends the PUBLISH or PUBREL of the entry again and moves it to the back of the send order, even when the send fails
+// so that one failing entry does not hold up the others
+static int resendInFlight(MQTT_CLIENT* mqttData, uint16_t index, uint64_t currentMs)
+{
+    int result;
+    IN_FLIGHT_ENTRY* entry = &mqttData->inFlight.entries[index];
+    if (entry->state == IN_FLIGHT_WAIT_PUBCOMP)
+    {
+        uint8_t replyPacket[MQTT_PUBLISH_REPLY_PACKET_SIZE];
+        size_t replyLen = mqtt_codec_publishRelease_into(replyPacket, sizeof(replyPacket), entry->packetId);
+        result = (replyLen != MQTT_PUBLISH_REPLY_PACKET_SIZE) ? __LINE__ : sendPacketItem(mqttData, replyPacket, replyLen);
+    }
+    else if (entry->packet != NULL)
+    {
+        result = sendPacketItem(mqttData, entry->packet, entry->packetLen);
+    }
+    else
+    {
+        QOS_VALUE qosValue;
+        uint16_t packetId;
+        /*Codes_SRS_MQTT_CLIENT_07_131: [A resent PUBLISH shall keep its packet id and shall not change the packet id returned by mqtt_client_get_last_packet_id.]*/
+        size_t packetLen = encodePublishMessage(mqttData, entry->msgHandle, 0, false, &qosValue, &packetId);
+        result = (packetLen == 0) ? __LINE__ : sendPacketItem(mqttData, mqttData->sendBuffer, packetLen);
+    }
+    unlinkInFlight(&mqttData->inFlight, index);
+    appendInFlight(&mqttData->inFlight, index, currentMs);
+
+    if (result != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: failure resending in flight packet id %u", (unsigned int)entry->packetId);
+    }
+    return result;
+}
+
+// Resends the entries that were last sent at least retryTimeoutMs ago, or all of them, oldest first
+static void resendExpiredInFlight(MQTT_CLIENT* mqttData, bool resendAll)
+{
+    IN_FLIGHT_TABLE* inFlight = &mqttData->inFlight;
+    if (inFlight->count > 0)
+    {
+        uint64_t currentMs = getInFlightTime(mqttData);
+        bool failed = false;
+
+        // Each resent entry moves to the back, so count steps visit every entry at most once
+        for (size_t remaining = inFlight->count; remaining > 0; remaining--)
+        {
+            if (!resendAll && currentMs - inFlight->entries[inFlight->head].sendTimeMs < inFlight->retryTimeoutMs)
+            {
+                break;
+            }
+            if (resendInFlight(mqttData, inFlight->head, currentMs) != 0)
+            {
+                failed = true;
+            }
+        }
+        trimSendBuffers(mqttData);
+
+        if (failed && mqttData->fnOperationCallback != NULL)
+        {
+            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+        }
+    }
+}
+
+static void onPublishSegmentsSendComplete(void* context, IO_SEND_RESULT send_result)
+{
+    PUBLISH_SEND_CONTEXT* sendContext = (PUBLISH_SEND_CONTEXT*)context;
+    if (sendContext != NULL)
+    {
+        MQTT_CLIENT* mqttData = sendContext->clientData;
+        completePendingSend(mqttData);
+        if (send_result != IO_SEND_OK)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "MQTT Send Complete Failure");
+            if (mqttData->fnOperationCallback)
+            {
+                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+            }
+        }
+        /*Codes_SRS_MQTT_CLIENT_07_041: [Once the payload segment has been sent, mqtt_client_publish_segmented shall call onSendComplete with the msgHandle, the send result and context, after which the payload may be released.]*/
+        sendContext->onSendComplete(sendContext->msgHandle, send_result, sendContext->context);
+        free(sendContext);
+    }
+}
+
+static size_t findWindowSlot(const PUBLISH_WINDOW* window, uint16_t packetId)
+{
+    size_t slot = packetId & window->slotMask;
+    while (window->slots[slot] != 0 && window->slots[slot] != packetId)
+    {
+        slot = (slot + 1) & window->slotMask;
+    }
+    return slot;
+}
+
+static void addToWindow(PUBLISH_WINDOW* window, uint16_t packetId)
+{
+    if (window->count < window->maxCount && packetId != 0)
+    {
+        size_t slot = findWindowSlot(window, packetId);
+        if (window->slots[slot] == 0)
+        {
+            window->slots[slot] = packetId;
+            window->count++;
+        }
+    }
+}
+
+// Frees the window slot of packetId and reports whether it held one, acks of packets sent outside the window hold none
+static bool removeFromWindow(PUBLISH_WINDOW* window, uint16_t packetId)
+{
+    bool result = false;
+    if (window->count > 0 && packetId != 0)
+    {
+        size_t slot = findWindowSlot(window, packetId);
+        if (window->slots[slot] == packetId)
+        {
+            window->count--;
+
+            // Backward shift deletion as in removeInFlight
+            window->slots[slot] = 0;
+            size_t next = slot;
+            for (;;)
+            {
+                next = (next + 1) & window->slotMask;
+                if (window->slots[next] == 0)
+                {
+                    break;
+                }
+                size_t home = window->slots[next] & window->slotMask;
+                if (((next - home) & window->slotMask) >= ((next - slot) & window->slotMask))
+                {
+                    window->slots[slot] = window->slots[next];
+                    window->slots[next] = 0;
+                    slot = next;
+                }
+            }
+            result = true;
+        }
+    }
+    return result;
+}
+
+// A QoS 1 or 2 publish that was sent, or that failed to send but stays in flight to be sent again, holds a window slot until it is
+// acknowledged, any other one gives its packet id back
+static void settlePublish(MQTT_CLIENT* mqttData, int sendResult, QOS_VALUE qosValue, uint16_t packetId)
+{
+    if (qosValue == DELIVER_AT_LEAST_ONCE || qosValue == DELIVER_EXACTLY_ONCE)
+    {
+        if (sendResult == 0 || isInFlight(&mqttData->inFlight, packetId))
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_114: [When flow control is on every QoS 1 and 2 publish that was sent shall hold a window slot until its PUBACK or PUBCOMP arrives, and so shall one whose send failed while it is kept in flight to be sent again.]*/
+            addToWindow(&mqttData->window, packetId);
+        }
+        else
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+            releasePacketId(mqttData, packetId);
+        }
+    }
+}
+
+static bool isWindowFull(const PUBLISH_WINDOW* window)
+{
+    return window->maxCount != 0 && (window->count >= window->maxCount || window->queueHead != NULL);
+}
+
+// A QoS 1 or 2 publish has to wait while the window is full, and behind the queued ones so they keep their order
+static bool isWindowClosed(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle)
+{
+    bool result;
+    if (!isWindowFull(&mqttData->window))
+    {
+        result = false;
+    }
+    else
+    {
+        QOS_VALUE qosValue = mqttmessage_getQosType(msgHandle);
+        result = (qosValue == DELIVER_AT_LEAST_ONCE || qosValue == DELIVER_EXACTLY_ONCE);
+    }
+    return result;
+}
+
+// A publish encoded in a buffer cannot wait in the queue, so a QoS 1 or 2 one is refused while the window is full
+static bool refuseBufferPublish(MQTT_CLIENT* mqttData, QOS_VALUE qosValue)
+{
+    bool result;
+    if ((qosValue != DELIVER_AT_LEAST_ONCE && qosValue != DELIVER_EXACTLY_ONCE) || !isWindowFull(&mqttData->window))
+    {
+        result = false;
+    }
+    else
+    {
+        // onWritable tells the application when to try again
+        mqttData->window.blocked = true;
+        result = true;
+    }
+    return result;
+}
+
+static int deferPublish(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle, ON_MQTT_PUBLISH_SEND_COMPLETE onSendComplete, void* context)
+{
+    int result;
+    PUBLISH_WINDOW* window = &mqttData->window;
+    window->blocked = true;
+    if (window->mode != MQTT_CLIENT_FLOW_CONTROL_QUEUE)
+    {
+        result = MQTT_CLIENT_WINDOW_FULL;
+    }
+    else
+    {
+        PENDING_PUBLISH* pending = (PENDING_PUBLISH*)malloc(sizeof(PENDING_PUBLISH));
+        if (pending == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure allocating a queued publish");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_116: [mqtt_client_publish and mqtt_client_publish_batch shall queue a clone of the message, mqtt_client_publish_segmented shall queue the message itself and call onSendComplete once it has been sent.]*/
+            // A segmented publish borrows the message until onSendComplete anyway, the clone of any other message shares its topic and payload
+            pending->msgHandle = (onSendComplete != NULL) ? msgHandle : mqttmessage_clone(msgHandle);
+            if (pending->msgHandle == NULL)
+            {
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqttmessage_clone failed");
+                free(pending);
+                result = __LINE__;
+            }
+            else
+            {
+                pending->onSendComplete = onSendComplete;
+                pending->context = context;
+                pending->next = NULL;
+                if (window->queueTail == NULL)
+                {
+                    window->queueHead = pending;
+                }
+                else
+                {
+                    window->queueTail->next = pending;
+                }
+                window->queueTail = pending;
+                window->queuedCount++;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+// Drops the publishes queued after last, or all of them when last is NULL, without sending them
+static void dropQueuedPublishes(PUBLISH_WINDOW* window, PENDING_PUBLISH* last)
+{
+    PENDING_PUBLISH* pending = (last == NULL) ? window->queueHead : last->next;
+    if (last == NULL)
+    {
+        window->queueHead = NULL;
+    }
+    else
+    {
+        last->next = NULL;
+    }
+    window->queueTail = last;
+
+    while (pending != NULL)
+    {
+        PENDING_PUBLISH* next = pending->next;
+        if (pending->onSendComplete != NULL)
+        {
+            pending->onSendComplete(pending->msgHandle, IO_SEND_CANCELLED, pending->context);
+        }
+        else
+        {
+            mqttmessage_destroy(pending->msgHandle);
+        }
+        free(pending);
+        window->queuedCount--;
+        pending = next;
+    }
+}
+
+// Encodes, tracks and sends one message that the flow control window let through
+static int publishMessage(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle)
+{
+    int result;
+    QOS_VALUE qosValue;
+    uint16_t packetId;
+    size_t packetLen = encodePublishMessage(mqttData, msgHandle, 0, true, &qosValue, &packetId);
+    if (packetLen == 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_098: [When in flight tracking is on mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall keep a DUP flagged clone of every QoS 1 and 2 message before sending it, and shall fail a message without sending it when maxInFlight messages are in flight.]*/
+    else if (trackPublish(mqttData, msgHandle, qosValue, packetId) != 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        mqttData->packetState = PUBLISH_TYPE;
+
+        /*Codes_SRS_MQTT_CLIENT_07_022: [On success mqtt_client_publish shall send the MQTT SUBCRIBE packet to the endpoint.]*/
+        if (sendPacketItem(mqttData, mqttData->sendBuffer, packetLen) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish send failed");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    trimSendBuffers(mqttData);
+    settlePublish(mqttData, result, qosValue, packetId);
+    return result;
+}
+
+// Sends the header and the borrowed payload of one message that the flow control window let through
+static int publishMessageSegments(MQTT_CLIENT* mqttData, MQTT_MESSAGE_HANDLE msgHandle, ON_MQTT_PUBLISH_SEND_COMPLETE onSendComplete, void* context)
+{
+    int result;
+    const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+    if (payload == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqttmessage_getApplicationMsg failed");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_038: [mqtt_client_publish_segmented shall encode only the PUBLISH header by calling mqtt_codec_publishSegments, borrowing the payload of msgHandle.]*/
+        MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
+        QOS_VALUE qosValue = mqttmessage_getQosType(msgHandle);
+        bool isDuplicateMsg = mqttmessage_getIsDuplicateMsg(msgHandle);
+        bool isRetained = mqttmessage_getIsRetained(msgHandle);
+        uint16_t packetId = mqttmessage_getPacketId(msgHandle);
+        const char* topicName = mqttmessage_getTopicName(msgHandle);
+
+        /*Codes_SRS_MQTT_CLIENT_07_105: [When a QoS 1 or 2 message has packet id 0 mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall pick the lowest free packet id and store it in the message with mqttmessage_setPacketId before encoding it.]*/
+        if (reservePublishPacketId(mqttData, msgHandle, qosValue, &packetId) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+            result = __LINE__;
+        }
+        else
+        {
+            BUFFER_HANDLE headerPacket = mqtt_codec_publishSegments(qosValue, isDuplicateMsg, isRetained, packetId, topicName, payload->message, payload->length, segments);
+            if (headerPacket == NULL)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publishSegments failed");
+                result = __LINE__;
+            }
+            else
+            {
+                PUBLISH_SEND_CONTEXT* sendContext = (PUBLISH_SEND_CONTEXT*)malloc(sizeof(PUBLISH_SEND_CONTEXT));
+                if (sendContext == NULL)
+                {
+                    /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                    LOG(LOG_ERROR, LOG_LINE, "Error: allocating publish send context failed");
+                    result = __LINE__;
+                }
+                else
+                {
+                    sendContext->clientData = mqttData;
+                    sendContext->msgHandle = msgHandle;
+                    sendContext->onSendComplete = onSendComplete;
+                    sendContext->context = context;
+
+                    mqttData->packetState = PUBLISH_TYPE;
+
+                    /*Codes_SRS_MQTT_CLIENT_07_098: [When in flight tracking is on mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall keep a DUP flagged clone of every QoS 1 and 2 message before sending it, and shall fail a message without sending it when maxInFlight messages are in flight.]*/
+                    if (trackPublish(mqttData, msgHandle, qosValue, packetId) != 0)
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                        free(sendContext);
+                        result = __LINE__;
+                    }
+                    // The segments are written straight to the transport, so anything queued before them has to go first
+                    else if (flushSendQueue(mqttData) != 0)
                     {
-                        /*Codes_SRS_MQTT_CLIENT_07_028: [If the actionResult parameter is of type CONNECT_ACK then the msgInfo value shall be a CONNECT_ACK structure.]*/
-                        CONNECT_ACK connack = { 0 };
-                        connack.isSessionPresent = (byteutil_readByte(&iterator) == 0x1) ? true : false;
-                        connack.returnCode = byteutil_readByte(&iterator);
+                        /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_segmented failed to flush the send queue");
+                        free(sendContext);
+                        result = __LINE__;
+                    }
+                    else if (segments[1].length == 0)
+                    {
+                        // Nothing is borrowed so the header is the complete packet
+                        if (sendPacketData(mqttData, segments[0].data, segments[0].length, onPublishSegmentsSendComplete, sendContext) != 0)
+                        {
+                            /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_segmented send failed");
+                            free(sendContext);
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            mqttData->sendStats.packetCount++;
+                            result = 0;
+                        }
+                    }
+                    /*Codes_SRS_MQTT_CLIENT_07_039: [mqtt_client_publish_segmented shall send the header segment followed by the payload segment without concatenating them.]*/
+                    else if (sendPacketData(mqttData, segments[0].data, segments[0].length, sendComplete, mqttData) != 0)
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+                        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_segmented header send failed");
+                        free(sendContext);
+                        result = __LINE__;
+                    }
+                    else if (sendToXio(mqttData, segments[1].data, segments[1].length, onPublishSegmentsSendComplete, sendContext) != 0)
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_040: [If the payload segment fails to send after the header was sent, mqtt_client_publish_segmented shall return a non-zero value since the connection can no longer be used.]*/
+                        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_segmented payload send failed, the connection is no longer usable");
+                        free(sendContext);
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        mqttData->sendStats.packetCount++;
+                        mqttData->sendStats.sendCount++;
+                        mqttData->sendStats.byteCount += segments[1].length;
+                        result = 0;
+                    }
+                }
+                BUFFER_delete(headerPacket);
+            }
+        }
+
+        settlePublish(mqttData, result, qosValue, packetId);
+    }
+    return result;
+}
+
+// Sends queued publishes while the window has room, then tells the application it may publish again if it was held back
+static void drainPublishWindow(MQTT_CLIENT* mqttData)
+{
+    PUBLISH_WINDOW* window = &mqttData->window;
+    while (window->queueHead != NULL && window->count < window->maxCount)
+    {
+        PENDING_PUBLISH* pending = window->queueHead;
+        window->queueHead = pending->next;
+        if (window->queueHead == NULL)
+        {
+            window->queueTail = NULL;
+        }
+        window->queuedCount--;
+
+        /*Codes_SRS_MQTT_CLIENT_07_118: [When a PUBACK or PUBCOMP frees a window slot the queued publishes shall be sent in order while the window has room, a queued publish that cannot be sent shall be reported with MQTT_CLIENT_ON_ERROR or to its onSendComplete with IO_SEND_ERROR.]*/
+        if (pending->onSendComplete != NULL)
+        {
+            if (publishMessageSegments(mqttData, pending->msgHandle, pending->onSendComplete, pending->context) != 0)
+            {
+                LOG(LOG_ERROR, LOG_LINE, "Error: failure sending a queued segmented publish");
+                pending->onSendComplete(pending->msgHandle, IO_SEND_ERROR, pending->context);
+            }
+        }
+        else
+        {
+            if (publishMessage(mqttData, pending->msgHandle) != 0)
+            {
+                LOG(LOG_ERROR, LOG_LINE, "Error: failure sending a queued publish");
+                if (mqttData->fnOperationCallback != NULL)
+                {
+                    mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+                }
+            }
+            mqttmessage_destroy(pending->msgHandle);
+        }
+        free(pending);
+    }
+
+    if (window->blocked && window->queueHead == NULL && window->count < window->maxCount)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_119: [After a publish was refused or queued onWritable shall be called once the queue is empty and the window has a free slot.]*/
+        window->blocked = false;
+        if (window->fnWritable != NULL)
+        {
+            window->fnWritable(mqttData, window->writableCtx);
+        }
+    }
+}
+
+static void onOpenComplete(void* context, IO_OPEN_RESULT open_result)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        if (open_result == IO_OPEN_OK && !mqttData->socketConnected)
+        {
+            mqttData->packetState = CONNECT_TYPE;
+            mqttData->socketConnected = true;
+            // Send the Connect packet
+            BUFFER_HANDLE connPacket = mqtt_codec_connect(&mqttData->mqttOptions);
+            if (connPacket == NULL)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_007: [If any failure is encountered then mqtt_client_connect shall return a non-zero value.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_connect failed");
+            }
+            else
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_009: [On success mqtt_client_connect shall send the MQTT CONNECT to the endpoint.]*/
+                if (sendPacketItem(mqttData, BUFFER_u_char(connPacket), BUFFER_length(connPacket)) != 0)
+                {
+                    /*Codes_SRS_MQTT_CLIENT_07_007: [If any failure is encountered then mqtt_client_connect shall return a non-zero value.]*/
+                    LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_connect failed");
+                }
+                BUFFER_delete(connPacket);
+            }
+        }
+        else if (open_result == IO_OPEN_ERROR)
+        {
+            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+        }
+    }
+}
+
+static void onBytesReceived(void* context, const unsigned char* buffer, size_t size)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        mqttData->bytesReceived = true;
+        if (mqtt_codec_bytesReceived(mqttData->codec_handle, buffer, size) != 0)
+        {
+            if (mqttData->fnOperationCallback)
+            {
+                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+            }
+        }
+    }
+}
+
+static void onIoError(void* context)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL && mqttData->fnOperationCallback)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_032: [If the actionResult parameter is of type MQTT_CLIENT_ON_DISCONNECT or MQTT_CLIENT_ON_ERROR the the msgInfo value shall be NULL.]*/
+        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+        mqttData->socketConnected = false;
+    }
+}
+
+static int cloneMqttOptions(MQTT_CLIENT* mqttData, const MQTT_CLIENT_OPTIONS* mqttOptions)
+{
+    int result = 0;
+    if (mqttOptions->clientId != NULL)
+    {
+        if (mallocAndStrcpy_s(&mqttData->mqttOptions.clientId, mqttOptions->clientId) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && mqttOptions->willTopic != NULL)
+    {
+        if (mallocAndStrcpy_s(&mqttData->mqttOptions.willTopic, mqttOptions->willTopic) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && mqttOptions->willMessage != NULL)
+    {
+        if (mallocAndStrcpy_s(&mqttData->mqttOptions.willMessage, mqttOptions->willMessage) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && mqttOptions->username != NULL)
+    {
+        if (mallocAndStrcpy_s(&mqttData->mqttOptions.username, mqttOptions->username) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0 && mqttOptions->password != NULL)
+    {
+        if (mallocAndStrcpy_s(&mqttData->mqttOptions.password, mqttOptions->password) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    if (result == 0)
+    {
+        mqttData->mqttOptions.keepAliveInterval = mqttOptions->keepAliveInterval;
+        mqttData->mqttOptions.messageRetain = mqttOptions->messageRetain;
+        mqttData->mqttOptions.useCleanSession = mqttOptions->useCleanSession;
+        mqttData->mqttOptions.qualityOfServiceValue = mqttOptions->qualityOfServiceValue;
+    }
+    else
+    {
+        free(mqttData->mqttOptions.clientId);
+        free(mqttData->mqttOptions.willTopic);
+        free(mqttData->mqttOptions.willMessage);
+        free(mqttData->mqttOptions.username);
+        free(mqttData->mqttOptions.password);
+    }
+    return result;
+}
+
+static void reportDecodeError(MQTT_CLIENT* mqttData, CONTROL_PACKET_TYPE packet)
+{
+    LOG(LOG_ERROR, LOG_LINE, "failure decoding packet type 0x%x", (unsigned int)packet);
+    /*Codes_SRS_MQTT_CLIENT_07_093: [If an inbound packet cannot be decoded the client shall call the Operation Callback with MQTT_CLIENT_ON_ERROR.]*/
+    if (mqttData->fnOperationCallback)
+    {
+        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
+    }
+}
+
+static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int flags, const uint8_t* data, size_t len)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL && (data != NULL || packet == PINGRESP_TYPE))
+    {
+        logIncomingMsgTrace(mqttData, packet, flags, data, len);
 
-                        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_CONNACK, (void*)&connack, mqttData->ctx);
+        if ((data != NULL && len > 0) || packet == PINGRESP_TYPE)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_090: [The CONNACK, PUBLISH, PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK and UNSUBACK packets shall be decoded in place with the mqtt_codec_decode functions.]*/
+            switch (packet)
+            {
+                case CONNACK_TYPE:
+                {
+                    /*Codes_SRS_MQTT_CLIENT_07_028: [If the actionResult parameter is of type CONNECT_ACK then the msgInfo value shall be a CONNECT_ACK structure.]*/
+                    CONNECT_ACK connack = { 0 };
+                    if (mqtt_codec_decodeConnack(data, len, &connack) != 0)
+                    {
+                        reportDecodeError(mqttData, packet);
+                    }
+                    else
+                    {
+                        if (mqttData->fnOperationCallback != NULL)
+                        {
+                            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_CONNACK, (void*)&connack, mqttData->ctx);
+                        }
 
                         if (connack.returnCode == CONNECTION_ACCEPTED)
                         {
                             mqttData->clientConnected = true;
+                            // Without a map no packet id was ever reserved, so none is in flight or reserved either
+                            if (mqttData->packetIds != NULL)
+                            {
+                                /*Codes_SRS_MQTT_CLIENT_07_108: [When a CONNACK accepts the connection every packet id shall be released except those of in flight messages, whose acks are still expected, and that of a reserved publish.]*/
+                                resetPacketIds(mqttData->packetIds);
+                                for (uint16_t index = mqttData->inFlight.head; index != IN_FLIGHT_NONE; index = mqttData->inFlight.entries[index].next)
+                                {
+                                    markPacketId(mqttData->packetIds, mqttData->inFlight.entries[index].packetId);
+                                }
+                                if (mqttData->reservedLen > 0 && (mqttData->reservedQosValue == DELIVER_AT_LEAST_ONCE || mqttData->reservedQosValue == DELIVER_EXACTLY_ONCE))
+                                {
+                                    markPacketId(mqttData->packetIds, mqttData->reservedPacketId);
+                                }
+                            }
+                            /*Codes_SRS_MQTT_CLIENT_07_101: [When a CONNACK accepts the connection every in flight message shall be sent again in the order it was sent, a PUBLISH with the DUP flag set and a PUBREL as is.]*/
+                            resendExpiredInFlight(mqttData, true);
+                            if (mqttData->window.maxCount > 0)
+                            {
+                                /*Codes_SRS_MQTT_CLIENT_07_120: [When a CONNACK accepts the connection the window shall only keep the packet ids of in flight messages and the queued publishes shall then be sent while the window has room.]*/
+                                (void)memset(mqttData->window.slots, 0, (mqttData->window.slotMask + 1) * sizeof(uint16_t));
+                                mqttData->window.count = 0;
+                                for (uint16_t index = mqttData->inFlight.head; index != IN_FLIGHT_NONE; index = mqttData->inFlight.entries[index].next)
+                                {
+                                    addToWindow(&mqttData->window, mqttData->inFlight.entries[index].packetId);
+                                }
+                                drainPublishWindow(mqttData);
+                            }
                         }
                     }
                     break;
@@ -382,33 +1665,19 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
                 {
                     if (mqttData->fnMessageRecv != NULL)
                     {
-                        bool isDuplicateMsg = (flags & DUPLICATE_FLAG_MASK) ? true : false;
-                        bool isRetainMsg = (flags & RETAIN_FLAG_MASK) ? true : false;
-                        QOS_VALUE qosValue = (flags == 0) ? DELIVER_AT_MOST_ONCE : (flags & QOS_LEAST_ONCE_FLAG_MASK) ? DELIVER_AT_LEAST_ONCE : DELIVER_EXACTLY_ONCE;
-
-                        uint8_t* initialPos = iterator;
-                        char* topicName = byteutil_readUTF(&iterator, NULL);
-                        if (topicName == NULL)
+                        MQTT_PUBLISH_VIEW publishView;
+                        if (mqtt_codec_decodePublish(flags, data, len, &publishView) != 0)
                         {
-                            LOG(LOG_ERROR, LOG_LINE, "Publish MSG: failure reading topic name");
-                            if (mqttData->fnOperationCallback)
-                            {
-                                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-                            }
+                            reportDecodeError(mqttData, packet);
                         }
                         else
                         {
-                            uint16_t packetId = 0;
-                            if (qosValue != DELIVER_AT_MOST_ONCE)
-                            {
-                                packetId = byteutil_read_uint16(&iterator);
-                            }
-                            size_t length = len - (iterator - initialPos);
-
-                            MQTT_MESSAGE_HANDLE msgHandle = mqttmessage_create(packetId, topicName, qosValue, iterator, length);
-                            if (msgHandle == NULL)
+                            /*Codes_SRS_MQTT_CLIENT_07_092: [The topic name of an inbound PUBLISH shall be NUL terminated in a stack buffer, memory shall only be allocated for topic names of TOPIC_NAME_STACK_SIZE bytes or more.]*/
+                            char topicBuffer[TOPIC_NAME_STACK_SIZE];
+                            char* topicName = (publishView.topicLength < sizeof(topicBuffer)) ? topicBuffer : (char*)malloc(publishView.topicLength + 1);
+                            if (topicName == NULL)
                             {
-                                LOG(LOG_ERROR, LOG_LINE, "failure in mqttmessage_create");
+                                LOG(LOG_ERROR, LOG_LINE, "Publish MSG: failure allocating topic name");
                                 if (mqttData->fnOperationCallback)
                                 {
                                     mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
@@ -416,10 +1685,14 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
                             }
                             else
                             {
-                                if (mqttmessage_setIsDuplicateMsg(msgHandle, isDuplicateMsg) != 0 ||
-                                    mqttmessage_setIsRetained(msgHandle, isRetainMsg) != 0)
+                                (void)memcpy(topicName, publishView.topicName, publishView.topicLength);
+                                topicName[publishView.topicLength] = '\0';
+
+                                /*Codes_SRS_MQTT_CLIENT_07_094: [The message passed to the ON_MQTT_MESSAGE_RECV_CALLBACK shall borrow its topic name and payload from the inbound packet with mqttmessage_createBorrowed.]*/
+                                MQTT_MESSAGE_HANDLE msgHandle = mqttmessage_createBorrowed(publishView.packetId, topicName, publishView.qosValue, publishView.payload, publishView.payloadLength);
+                                if (msgHandle == NULL)
                                 {
-                                    LOG(LOG_ERROR, LOG_LINE, "failure setting mqtt message property");
+                                    LOG(LOG_ERROR, LOG_LINE, "failure in mqttmessage_createBorrowed");
                                     if (mqttData->fnOperationCallback)
                                     {
                                         mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
@@ -427,42 +1700,27 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
                                 }
                                 else
                                 {
-                                    mqttData->fnMessageRecv(msgHandle, mqttData->ctx);
-
-                                    BUFFER_HANDLE pubRel = NULL;
-                                    if (qosValue == DELIVER_EXACTLY_ONCE)
+                                    if (mqttmessage_setIsDuplicateMsg(msgHandle, publishView.isDuplicateMsg) != 0 ||
+                                        mqttmessage_setIsRetained(msgHandle, publishView.isRetained) != 0)
                                     {
-                                        pubRel = mqtt_codec_publishReceived(packetId);
-                                        if (pubRel == NULL)
+                                        LOG(LOG_ERROR, LOG_LINE, "failure setting mqtt message property");
+                                        if (mqttData->fnOperationCallback)
                                         {
-                                            LOG(LOG_ERROR, LOG_LINE, "Failed to allocate publish receive message.");
-                                            if (mqttData->fnOperationCallback)
-                                            {
-                                                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-                                            }
+                                            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
                                         }
                                     }
-                                    else if (qosValue == DELIVER_AT_LEAST_ONCE)
+                                    else
                                     {
-                                        pubRel = mqtt_codec_publishAck(packetId);
-                                        if (pubRel == NULL)
-                                        {
-                                            LOG(LOG_ERROR, LOG_LINE, "Failed to allocate publish ack message.");
-                                            if (mqttData->fnOperationCallback)
-                                            {
-                                                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-                                            }
-                                        }
-                                    }
-                                    if (pubRel != NULL)
-                                    {
-                                        (void)sendPacketItem(mqttData, BUFFER_u_char(pubRel), BUFFER_length(pubRel));
-                                        BUFFER_delete(pubRel);
+                                        mqttData->fnMessageRecv(msgHandle, mqttData->ctx);
+                                        acknowledgePublish(mqttData, publishView.qosValue, publishView.packetId);
                                     }
+                                    mqttmessage_destroy(msgHandle);
+                                }
+                                if (topicName != topicBuffer)
+                                {
+                                    free(topicName);
                                 }
-                                mqttmessage_destroy(msgHandle);
                             }
-                            free(topicName);
                         }
                     }
                     break;
@@ -472,78 +1730,86 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
                 case PUBREL_TYPE:
                 case PUBCOMP_TYPE:
                 {
-                    if (mqttData->fnOperationCallback)
+                    PUBLISH_ACK publish_ack = { 0 };
+                    if (mqtt_codec_decodeAck(data, len, &publish_ack.packetId) != 0)
+                    {
+                        reportDecodeError(mqttData, packet);
+                    }
+                    else
                     {
-                        /*Codes_SRS_MQTT_CLIENT_07_029: [If the actionResult parameter are of types PUBACK_TYPE, PUBREC_TYPE, PUBREL_TYPE or PUBCOMP_TYPE then the msgInfo value shall be a PUBLISH_ACK structure.]*/
-                        MQTT_CLIENT_EVENT_RESULT action = (packet == PUBACK_TYPE) ? MQTT_CLIENT_ON_PUBLISH_ACK :
-                            (packet == PUBREC_TYPE) ? MQTT_CLIENT_ON_PUBLISH_RECV :
-                            (packet == PUBREL_TYPE) ? MQTT_CLIENT_ON_PUBLISH_REL : MQTT_CLIENT_ON_PUBLISH_COMP;
+                        /*Codes_SRS_MQTT_CLIENT_07_099: [A PUBACK shall release an in flight QoS 1 message and a PUBREC the message of a QoS 2 publish, whose packet id stays in flight until the PUBCOMP arrives.]*/
+                        completeInFlight(mqttData, packet, publish_ack.packetId);
+                        bool windowOpened = false;
+                        if (packet == PUBACK_TYPE || packet == PUBCOMP_TYPE)
+                        {
+                            /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+                            releasePacketId(mqttData, publish_ack.packetId);
+                            /*Codes_SRS_MQTT_CLIENT_07_114: [When flow control is on every QoS 1 and 2 publish that was sent shall hold a window slot until its PUBACK or PUBCOMP arrives, and so shall one whose send failed while it is kept in flight to be sent again.]*/
+                            windowOpened = removeFromWindow(&mqttData->window, publish_ack.packetId);
+                        }
 
-                        PUBLISH_ACK publish_ack = { 0 };
-                        publish_ack.packetId = byteutil_read_uint16(&iterator);
+                        if (mqttData->fnOperationCallback)
+                        {
+                            /*Codes_SRS_MQTT_CLIENT_07_029: [If the actionResult parameter are of types PUBACK_TYPE, PUBREC_TYPE, PUBREL_TYPE or PUBCOMP_TYPE then the msgInfo value shall be a PUBLISH_ACK structure.]*/
+                            MQTT_CLIENT_EVENT_RESULT action = (packet == PUBACK_TYPE) ? MQTT_CLIENT_ON_PUBLISH_ACK :
+                                (packet == PUBREC_TYPE) ? MQTT_CLIENT_ON_PUBLISH_RECV :
+                                (packet == PUBREL_TYPE) ? MQTT_CLIENT_ON_PUBLISH_REL : MQTT_CLIENT_ON_PUBLISH_COMP;
+                            mqttData->fnOperationCallback(mqttData, action, (void*)&publish_ack, mqttData->ctx);
+                        }
 
-                        BUFFER_HANDLE pubRel = NULL;
-                        mqttData->fnOperationCallback(mqttData, action, (void*)&publish_ack, mqttData->ctx);
+                        /*Codes_SRS_MQTT_CLIENT_07_043: [The PUBACK, PUBREC, PUBREL and PUBCOMP replies shall be encoded on the stack with the mqtt_codec_*_into functions and sent without allocating memory.]*/
+                        uint8_t replyPacket[MQTT_PUBLISH_REPLY_PACKET_SIZE];
                         if (packet == PUBREC_TYPE)
                         {
-                            pubRel = mqtt_codec_publishRelease(publish_ack.packetId);
-                            if (pubRel == NULL)
-                            {
-                                LOG(LOG_ERROR, LOG_LINE, "Failed to allocate publish release message.");
-                                if (mqttData->fnOperationCallback)
-                                {
-                                    mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-                                }
-                            }
+                            sendPublishReply(mqttData, replyPacket, mqtt_codec_publishRelease_into(replyPacket, sizeof(replyPacket), publish_ack.packetId));
                         }
                         else if (packet == PUBREL_TYPE)
                         {
-                            pubRel = mqtt_codec_publishComplete(publish_ack.packetId);
-                            if (pubRel == NULL)
-                            {
-                                LOG(LOG_ERROR, LOG_LINE, "Failed to allocate publish complete message.");
-                                if (mqttData->fnOperationCallback)
-                                {
-                                    mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
-                                }
-                            }
+                            sendPublishReply(mqttData, replyPacket, mqtt_codec_publishComplete_into(replyPacket, sizeof(replyPacket), publish_ack.packetId));
                         }
-                        if (pubRel != NULL)
+
+                        if (windowOpened)
                         {
-                            (void)sendPacketItem(mqttData, BUFFER_u_char(pubRel), BUFFER_length(pubRel));
-                            BUFFER_delete(pubRel);
+                            drainPublishWindow(mqttData);
                         }
                     }
                     break;
                 }
                 case SUBACK_TYPE:
                 {
-                    if (mqttData->fnOperationCallback)
+                    MQTT_SUBACK_VIEW subackView;
+                    if (mqtt_codec_decodeSuback(data, len, &subackView) != 0)
                     {
-                        /*Codes_SRS_MQTT_CLIENT_07_030: [If the actionResult parameter is of type SUBACK_TYPE then the msgInfo value shall be a SUBSCRIBE_ACK structure.]*/
-                        SUBSCRIBE_ACK suback = { 0 };
-
-                        size_t remainLen = len;
-                        suback.packetId = byteutil_read_uint16(&iterator);
-                        remainLen -= 2;
-
-                        // Allocate the remaining len
-                        suback.qosReturn = (QOS_VALUE*)malloc(sizeof(QOS_VALUE)*remainLen);
-                        if (suback.qosReturn != NULL)
+                        reportDecodeError(mqttData, packet);
+                    }
+                    else
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+                        releasePacketId(mqttData, subackView.packetId);
+                        if (mqttData->fnOperationCallback)
                         {
-                            while (remainLen > 0)
+                            /*Codes_SRS_MQTT_CLIENT_07_030: [If the actionResult parameter is of type SUBACK_TYPE then the msgInfo value shall be a SUBSCRIBE_ACK structure.]*/
+                            /*Codes_SRS_MQTT_CLIENT_07_091: [The SUBACK return codes shall be converted in a stack array, memory shall only be allocated when there are more than SUBACK_STACK_RETURN_CODES of them.]*/
+                            QOS_VALUE qosBuffer[SUBACK_STACK_RETURN_CODES];
+                            SUBSCRIBE_ACK suback = { 0 };
+                            suback.packetId = subackView.packetId;
+                            suback.qosReturn = (subackView.returnCodeCount <= SUBACK_STACK_RETURN_CODES) ? qosBuffer : (QOS_VALUE*)malloc(sizeof(QOS_VALUE)*subackView.returnCodeCount);
+                            if (suback.qosReturn != NULL)
                             {
-                                suback.qosReturn[suback.qosCount++] = byteutil_readByte(&iterator);
-                                remainLen--;
+                                while (suback.qosCount < subackView.returnCodeCount)
+                                {
+                                    suback.qosReturn[suback.qosCount] = (QOS_VALUE)subackView.returnCodes[suback.qosCount];
+                                    suback.qosCount++;
+                                }
+                                mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_SUBSCRIBE_ACK, (void*)&suback, mqttData->ctx);
+                                if (suback.qosReturn != qosBuffer)
+                                {
+                                    free(suback.qosReturn);
+                                }
                             }
-                            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_SUBSCRIBE_ACK, (void*)&suback, mqttData->ctx);
-                            free(suback.qosReturn);
-                        }
-                        else
-                        {
-                            LOG(LOG_ERROR, LOG_LINE, "allocation of quality of service value failed.");
-                            if (mqttData->fnOperationCallback)
+                            else
                             {
+                                LOG(LOG_ERROR, LOG_LINE, "allocation of quality of service value failed.");
                                 mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
                             }
                         }
@@ -552,14 +1818,20 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
                 }
                 case UNSUBACK_TYPE:
                 {
-                    if (mqttData->fnOperationCallback)
+                    UNSUBSCRIBE_ACK unsuback = { 0 };
+                    if (mqtt_codec_decodeAck(data, len, &unsuback.packetId) != 0)
                     {
-                        /*Codes_SRS_MQTT_CLIENT_07_031: [If the actionResult parameter is of type UNSUBACK_TYPE then the msgInfo value shall be a UNSUBSCRIBE_ACK structure.]*/
-                        UNSUBSCRIBE_ACK unsuback = { 0 };
-                        iterator += VARIABLE_HEADER_OFFSET;
-                        unsuback.packetId = byteutil_read_uint16(&iterator);
-
-                        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_UNSUBSCRIBE_ACK, (void*)&unsuback, mqttData->ctx);
+                        reportDecodeError(mqttData, packet);
+                    }
+                    else
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+                        releasePacketId(mqttData, unsuback.packetId);
+                        if (mqttData->fnOperationCallback)
+                        {
+                            /*Codes_SRS_MQTT_CLIENT_07_031: [If the actionResult parameter is of type UNSUBACK_TYPE then the msgInfo value shall be a UNSUBSCRIBE_ACK structure.]*/
+                            mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_UNSUBSCRIBE_ACK, (void*)&unsuback, mqttData->ctx);
+                        }
                     }
                     break;
                 }
@@ -574,6 +1846,52 @@ static void recvCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int
     }
 }
 
+static void recvPublishBeginCallback(void* context, int flags, const char* topicName, uint16_t packetId, size_t payloadLength)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        mqttData->streamQosValue = (flags & QOS_EXACTLY_ONCE_FLAG_MASK) ? DELIVER_EXACTLY_ONCE : (flags & QOS_LEAST_ONCE_FLAG_MASK) ? DELIVER_AT_LEAST_ONCE : DELIVER_AT_MOST_ONCE;
+        mqttData->streamPacketId = packetId;
+        /*Codes_SRS_MQTT_CLIENT_07_082: [When a streamed PUBLISH begins the client shall call onPublishBegin with the topic name, QOS and payload length.]*/
+        mqttData->fnPublishBegin(topicName, mqttData->streamQosValue, payloadLength, mqttData->streamCtx);
+    }
+}
+
+static void recvPublishChunkCallback(void* context, const uint8_t* data, size_t length)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_083: [Each chunk of a streamed PUBLISH payload shall be passed to onPublishChunk as it arrives.]*/
+        mqttData->fnPublishChunk(data, length, mqttData->streamCtx);
+    }
+}
+
+static void recvPublishEndCallback(void* context)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_084: [When a streamed PUBLISH ends the client shall call onPublishEnd and then send the PUBACK or PUBREC its QOS requires.]*/
+        mqttData->fnPublishEnd(mqttData->streamCtx);
+        acknowledgePublish(mqttData, mqttData->streamQosValue, mqttData->streamPacketId);
+    }
+}
+
+static void recvPacketDiscardedCallback(void* context, CONTROL_PACKET_TYPE packet, size_t packetLength)
+{
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)context;
+    if (mqttData != NULL && mqttData->fnOperationCallback != NULL)
+    {
+        PACKET_DISCARDED packetDiscarded;
+        packetDiscarded.packetType = packet;
+        packetDiscarded.packetLength = packetLength;
+        /*Codes_SRS_MQTT_CLIENT_07_087: [When the codec discards an oversized packet the client shall call the Operation Callback with MQTT_CLIENT_ON_PACKET_DISCARDED and a PACKET_DISCARDED structure.]*/
+        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_PACKET_DISCARDED, &packetDiscarded, mqttData->ctx);
+    }
+}
+
 MQTT_CLIENT_HANDLE mqtt_client_init(ON_MQTT_MESSAGE_RECV_CALLBACK msgRecv, ON_MQTT_OPERATION_CALLBACK opCallback, void* callbackCtx)
 {
     MQTT_CLIENT* result;
@@ -613,6 +1931,56 @@ MQTT_CLIENT_HANDLE mqtt_client_init(ON_MQTT_MESSAGE_RECV_CALLBACK msgRecv, ON_MQ
             result->rawBytesTrace = false;
             result->timeSincePing = 0;
             result->maxPingRespTime = DEFAULT_MAX_PING_RESPONSE_TIME;
+            result->sendBuffer = NULL;
+            result->sendBufferSize = 0;
+            result->batchPacketIds = NULL;
+            result->batchPacketIdsSize = 0;
+            result->reserveBuffer = NULL;
+            result->reserveBufferSize = 0;
+            result->reservedLen = 0;
+            result->reservedPayloadLen = 0;
+            result->reservedQosValue = DELIVER_AT_MOST_ONCE;
+            result->reservedPacketId = 0;
+            result->bufferHighWaterMark = DEFAULT_BUFFER_HIGH_WATER_MARK;
+            result->maxBatchSize = 0;
+            result->maxBatchDelayMs = 0;
+            result->sendQueue = NULL;
+            result->sendQueueSize = 0;
+            result->sendQueueLen = 0;
+            result->sendQueueStartMs = 0;
+            result->sendStats.packetCount = 0;
+            result->sendStats.sendCount = 0;
+            result->sendStats.byteCount = 0;
+            result->pendingSendCount = 0;
+            result->bytesReceived = false;
+            result->fnPublishBegin = NULL;
+            result->fnPublishChunk = NULL;
+            result->fnPublishEnd = NULL;
+            result->streamCtx = NULL;
+            result->streamQosValue = DELIVER_AT_MOST_ONCE;
+            result->streamPacketId = 0;
+            result->inFlight.entries = NULL;
+            result->inFlight.slots = NULL;
+            result->inFlight.maxCount = 0;
+            result->inFlight.count = 0;
+            result->inFlight.slotMask = 0;
+            result->inFlight.head = IN_FLIGHT_NONE;
+            result->inFlight.tail = IN_FLIGHT_NONE;
+            result->inFlight.freeEntry = IN_FLIGHT_NONE;
+            result->inFlight.retryTimeoutMs = 0;
+            result->packetIds = NULL;
+            result->lastPacketId = 0;
+            result->window.slots = NULL;
+            result->window.slotMask = 0;
+            result->window.maxCount = 0;
+            result->window.count = 0;
+            result->window.mode = MQTT_CLIENT_FLOW_CONTROL_FAIL;
+            result->window.queueHead = NULL;
+            result->window.queueTail = NULL;
+            result->window.queuedCount = 0;
+            result->window.blocked = false;
+            result->window.fnWritable = NULL;
+            result->window.writableCtx = NULL;
             if (result->packetTickCntr == NULL)
             {
                 /*Codes_SRS_MQTT_CLIENT_07_002: [If any failure is encountered then mqttclient_init shall return NULL.]*/
@@ -644,6 +2012,11 @@ void mqtt_client_deinit(MQTT_CLIENT_HANDLE handle)
     {
         /*Codes_SRS_MQTT_CLIENT_07_005: [mqtt_client_deinit shall deallocate all memory allocated in this unit.]*/
         MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+        /*Codes_SRS_MQTT_CLIENT_07_121: [mqtt_client_deinit shall destroy the queued messages and call onSendComplete with IO_SEND_CANCELLED for queued segmented publishes.]*/
+        dropQueuedPublishes(&mqttData->window, NULL);
+        free(mqttData->window.slots);
+        clearInFlight(&mqttData->inFlight);
+        free(mqttData->packetIds);
         tickcounter_destroy(mqttData->packetTickCntr);
         mqtt_codec_destroy(mqttData->codec_handle);
         free(mqttData->mqttOptions.clientId);
@@ -651,6 +2024,10 @@ void mqtt_client_deinit(MQTT_CLIENT_HANDLE handle)
         free(mqttData->mqttOptions.willMessage);
         free(mqttData->mqttOptions.username);
         free(mqttData->mqttOptions.password);
+        free(mqttData->sendBuffer);
+        free(mqttData->batchPacketIds);
+        free(mqttData->reserveBuffer);
+        free(mqttData->sendQueue);
         free(mqttData);
     }
 }
@@ -676,6 +2053,8 @@ int mqtt_client_connect(MQTT_CLIENT_HANDLE handle, XIO_HANDLE xioHandle, MQTT_CL
         else
         {
             mqttData->xioHandle = xioHandle;
+            // Sends still pending on a previous xio are not written by this one
+            mqttData->pendingSendCount = 0;
             mqttData->packetState = UNKNOWN_TYPE;
             mqttData->qosValue = mqttOptions->qualityOfServiceValue;
             mqttData->keepAliveInterval = mqttOptions->keepAliveInterval;
@@ -710,44 +2089,429 @@ int mqtt_client_publish(MQTT_CLIENT_HANDLE handle, MQTT_MESSAGE_HANDLE msgHandle
         /*Codes_SRS_MQTT_CLIENT_07_019: [If one of the parameters handle or msgHandle is NULL then mqtt_client_publish shall return a non-zero value.]*/
         result = __LINE__;
     }
+    else if (isWindowClosed(mqttData, msgHandle))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_115: [While the window is full or publishes are queued a QoS 1 or 2 message shall not be sent, in MQTT_CLIENT_FLOW_CONTROL_FAIL mode it shall be refused with MQTT_CLIENT_WINDOW_FULL and in MQTT_CLIENT_FLOW_CONTROL_QUEUE mode it shall be queued and count as sent.]*/
+        result = deferPublish(mqttData, msgHandle, NULL, NULL);
+    }
+    else
+    {
+        result = publishMessage(mqttData, msgHandle);
+    }
+    return result;
+}
+
+int mqtt_client_publish_topic(MQTT_CLIENT_HANDLE handle, MQTT_TOPIC_HANDLE topicHandle, QOS_VALUE qosValue, bool duplicateMsg, bool isRetained, uint16_t packetId, const uint8_t* appMsg, size_t appMsgLength)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || topicHandle == NULL || (appMsg == NULL && appMsgLength > 0))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_046: [If handle or topicHandle is NULL, or if appMsg is NULL and appMsgLength is not 0, then mqtt_client_publish_topic shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_134: [While the window is full or publishes are queued mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall refuse a QoS 1 or 2 publish with MQTT_CLIENT_WINDOW_FULL, since a packet encoded in a buffer cannot be queued, and mqtt_client_publish_commit shall release the reservation.]*/
+    else if (refuseBufferPublish(mqttData, qosValue))
+    {
+        result = MQTT_CLIENT_WINDOW_FULL;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_135: [mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_reserve shall reserve the packet id of a QoS 1 or 2 publish, picking the lowest free one when packetId is 0.]*/
+    else if (reserveBufferPacketId(mqttData, qosValue, &packetId) != 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+        result = __LINE__;
+    }
     else
     {
-        /*Codes_SRS_MQTT_CLIENT_07_021: [mqtt_client_publish shall get the message information from the MQTT_MESSAGE_HANDLE.]*/
-        const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-        if (payload == NULL)
+        /*Codes_SRS_MQTT_CLIENT_07_047: [mqtt_client_publish_topic shall encode the PUBLISH packet by calling mqtt_codec_publishTopic_into with the client send buffer, growing the buffer only when the packet does not fit.]*/
+        size_t packetLen = mqtt_codec_publishTopic_into(mqttData->sendBuffer, mqttData->sendBufferSize, qosValue, duplicateMsg, isRetained, packetId, topicHandle, appMsg, appMsgLength);
+        if (packetLen > mqttData->sendBufferSize)
         {
-            /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
-            LOG(LOG_ERROR, LOG_LINE, "Error: mqttmessage_getApplicationMsg failed");
+            if (ensureBufferSize(&mqttData->sendBuffer, &mqttData->sendBufferSize, packetLen) != 0)
+            {
+                packetLen = 0;
+            }
+            else
+            {
+                packetLen = mqtt_codec_publishTopic_into(mqttData->sendBuffer, mqttData->sendBufferSize, qosValue, duplicateMsg, isRetained, packetId, topicHandle, appMsg, appMsgLength);
+            }
+        }
+
+        if (packetLen == 0 || packetLen > mqttData->sendBufferSize)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publishTopic_into failed");
+            result = __LINE__;
+        }
+        /*Codes_SRS_MQTT_CLIENT_07_136: [When in flight tracking is on mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall keep a DUP flagged copy of every QoS 1 and 2 packet before sending it, and shall fail a packet without sending it when maxInFlight messages are in flight.]*/
+        else if (trackPublishPacket(mqttData, mqttData->sendBuffer, packetLen, qosValue, packetId) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+            result = __LINE__;
+        }
+        else
+        {
+            mqttData->packetState = PUBLISH_TYPE;
+
+            /*Codes_SRS_MQTT_CLIENT_07_049: [On success mqtt_client_publish_topic shall send the MQTT PUBLISH packet to the endpoint and return 0.]*/
+            if (sendPacketItem(mqttData, mqttData->sendBuffer, packetLen) != 0)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_topic send failed");
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+        trimSendBuffers(mqttData);
+        settlePublish(mqttData, result, qosValue, packetId);
+    }
+    return result;
+}
+
+int mqtt_client_publish_template(MQTT_CLIENT_HANDLE handle, MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle, uint16_t packetId, const uint8_t* appMsg, size_t appMsgLength)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || templateHandle == NULL || (appMsg == NULL && appMsgLength > 0))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_050: [If handle or templateHandle is NULL, or if appMsg is NULL and appMsgLength is not 0, then mqtt_client_publish_template shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        QOS_VALUE qosValue = mqtt_codec_publishTemplateGetQos(templateHandle);
+        /*Codes_SRS_MQTT_CLIENT_07_134: [While the window is full or publishes are queued mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall refuse a QoS 1 or 2 publish with MQTT_CLIENT_WINDOW_FULL, since a packet encoded in a buffer cannot be queued, and mqtt_client_publish_commit shall release the reservation.]*/
+        if (refuseBufferPublish(mqttData, qosValue))
+        {
+            result = MQTT_CLIENT_WINDOW_FULL;
+        }
+        /*Codes_SRS_MQTT_CLIENT_07_135: [mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_reserve shall reserve the packet id of a QoS 1 or 2 publish, picking the lowest free one when packetId is 0.]*/
+        else if (reserveBufferPacketId(mqttData, qosValue, &packetId) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_052: [If any failure is encountered then mqtt_client_publish_template shall return a non-zero value.]*/
             result = __LINE__;
         }
         else
         {
-            BUFFER_HANDLE publishPacket = mqtt_codec_publish(mqttmessage_getQosType(msgHandle), mqttmessage_getIsDuplicateMsg(msgHandle),
-                mqttmessage_getIsRetained(msgHandle), mqttmessage_getPacketId(msgHandle), mqttmessage_getTopicName(msgHandle), payload->message, payload->length);
-            if (publishPacket == NULL)
+            /*Codes_SRS_MQTT_CLIENT_07_051: [mqtt_client_publish_template shall encode the PUBLISH packet by calling mqtt_codec_publishTemplate_into with the client send buffer, growing the buffer only when the packet does not fit.]*/
+            size_t packetLen = mqtt_codec_publishTemplate_into(mqttData->sendBuffer, mqttData->sendBufferSize, templateHandle, packetId, appMsg, appMsgLength);
+            if (packetLen > mqttData->sendBufferSize)
+            {
+                if (ensureBufferSize(&mqttData->sendBuffer, &mqttData->sendBufferSize, packetLen) != 0)
+                {
+                    packetLen = 0;
+                }
+                else
+                {
+                    packetLen = mqtt_codec_publishTemplate_into(mqttData->sendBuffer, mqttData->sendBufferSize, templateHandle, packetId, appMsg, appMsgLength);
+                }
+            }
+
+            if (packetLen == 0 || packetLen > mqttData->sendBufferSize)
             {
-                /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
-                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publish failed");
+                /*Codes_SRS_MQTT_CLIENT_07_052: [If any failure is encountered then mqtt_client_publish_template shall return a non-zero value.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publishTemplate_into failed");
+                result = __LINE__;
+            }
+            /*Codes_SRS_MQTT_CLIENT_07_136: [When in flight tracking is on mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall keep a DUP flagged copy of every QoS 1 and 2 packet before sending it, and shall fail a packet without sending it when maxInFlight messages are in flight.]*/
+            else if (trackPublishPacket(mqttData, mqttData->sendBuffer, packetLen, qosValue, packetId) != 0)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_052: [If any failure is encountered then mqtt_client_publish_template shall return a non-zero value.]*/
                 result = __LINE__;
             }
             else
             {
                 mqttData->packetState = PUBLISH_TYPE;
 
-                /*Codes_SRS_MQTT_CLIENT_07_022: [On success mqtt_client_publish shall send the MQTT SUBCRIBE packet to the endpoint.]*/
-                if (sendPacketItem(mqttData, BUFFER_u_char(publishPacket), BUFFER_length(publishPacket)) != 0)
+                /*Codes_SRS_MQTT_CLIENT_07_053: [On success mqtt_client_publish_template shall send the MQTT PUBLISH packet to the endpoint and return 0.]*/
+                if (sendPacketItem(mqttData, mqttData->sendBuffer, packetLen) != 0)
                 {
-                    /*Codes_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
-                    LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish send failed");
+                    /*Codes_SRS_MQTT_CLIENT_07_052: [If any failure is encountered then mqtt_client_publish_template shall return a non-zero value.]*/
+                    LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_template send failed");
                     result = __LINE__;
                 }
                 else
                 {
                     result = 0;
                 }
-                BUFFER_delete(publishPacket);
+            }
+            trimSendBuffers(mqttData);
+            settlePublish(mqttData, result, qosValue, packetId);
+        }
+    }
+    return result;
+}
+
+uint8_t* mqtt_client_publish_reserve(MQTT_CLIENT_HANDLE handle, const char* topicName, QOS_VALUE qosValue, bool isRetained, uint16_t packetId, size_t maxLen)
+{
+    uint8_t* result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || topicName == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_054: [If handle or topicName is NULL then mqtt_client_publish_reserve shall return NULL.]*/
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_055: [mqtt_client_publish_reserve shall release any previous reservation that was not committed, along with its packet id.]*/
+        releaseReservation(mqttData);
+
+        /*Codes_SRS_MQTT_CLIENT_07_135: [mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_reserve shall reserve the packet id of a QoS 1 or 2 publish, picking the lowest free one when packetId is 0.]*/
+        if (reserveBufferPacketId(mqttData, qosValue, &packetId) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_057: [If any failure is encountered then mqtt_client_publish_reserve shall return NULL.]*/
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_056: [mqtt_client_publish_reserve shall lay out the PUBLISH packet by calling mqtt_codec_publishReserve_into with a reserve buffer owned by the client, growing the buffer only when the packet does not fit.]*/
+            size_t reservedLen = mqtt_codec_publishReserve_into(mqttData->reserveBuffer, mqttData->reserveBufferSize, qosValue, false, isRetained, packetId, topicName, maxLen);
+            if (reservedLen > mqttData->reserveBufferSize)
+            {
+                if (ensureBufferSize(&mqttData->reserveBuffer, &mqttData->reserveBufferSize, reservedLen) != 0)
+                {
+                    reservedLen = 0;
+                }
+                else
+                {
+                    reservedLen = mqtt_codec_publishReserve_into(mqttData->reserveBuffer, mqttData->reserveBufferSize, qosValue, false, isRetained, packetId, topicName, maxLen);
+                }
+            }
+
+            if (reservedLen == 0 || reservedLen > mqttData->reserveBufferSize)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_057: [If any failure is encountered then mqtt_client_publish_reserve shall return NULL.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publishReserve_into failed");
+                releaseUnsentPacketId(mqttData, qosValue, packetId);
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_058: [On success mqtt_client_publish_reserve shall return a writable region of maxLen bytes that is the payload of the outbound PUBLISH packet.]*/
+                mqttData->reservedLen = reservedLen;
+                mqttData->reservedPayloadLen = maxLen;
+                mqttData->reservedQosValue = qosValue;
+                mqttData->reservedPacketId = packetId;
+                result = mqttData->reserveBuffer + reservedLen - maxLen;
+            }
+        }
+    }
+    return result;
+}
+
+int mqtt_client_publish_commit(MQTT_CLIENT_HANDLE handle, size_t actualLen)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || mqttData->reservedLen == 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_059: [If handle is NULL or no publish is reserved then mqtt_client_publish_commit shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_134: [While the window is full or publishes are queued mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall refuse a QoS 1 or 2 publish with MQTT_CLIENT_WINDOW_FULL, since a packet encoded in a buffer cannot be queued, and mqtt_client_publish_commit shall release the reservation.]*/
+    else if (refuseBufferPublish(mqttData, mqttData->reservedQosValue))
+    {
+        releaseReservation(mqttData);
+        trimSendBuffers(mqttData);
+        result = MQTT_CLIENT_WINDOW_FULL;
+    }
+    else
+    {
+        size_t packetOffset;
+        QOS_VALUE qosValue = mqttData->reservedQosValue;
+        uint16_t packetId = mqttData->reservedPacketId;
+        /*Codes_SRS_MQTT_CLIENT_07_060: [mqtt_client_publish_commit shall call mqtt_codec_publishCommit to write the remaining length for actualLen bytes of payload and shall release the reservation.]*/
+        size_t packetLen = mqtt_codec_publishCommit(mqttData->reserveBuffer, mqttData->reservedLen, mqttData->reservedPayloadLen, actualLen, &packetOffset);
+        mqttData->reservedLen = 0;
+        if (packetLen == 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_061: [If any failure is encountered then mqtt_client_publish_commit shall return a non-zero value.]*/
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_publishCommit failed");
+            result = __LINE__;
+        }
+        /*Codes_SRS_MQTT_CLIENT_07_136: [When in flight tracking is on mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall keep a DUP flagged copy of every QoS 1 and 2 packet before sending it, and shall fail a packet without sending it when maxInFlight messages are in flight.]*/
+        else if (trackPublishPacket(mqttData, mqttData->reserveBuffer + packetOffset, packetLen, qosValue, packetId) != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_061: [If any failure is encountered then mqtt_client_publish_commit shall return a non-zero value.]*/
+            result = __LINE__;
+        }
+        else
+        {
+            mqttData->packetState = PUBLISH_TYPE;
+
+            /*Codes_SRS_MQTT_CLIENT_07_062: [On success mqtt_client_publish_commit shall send the MQTT PUBLISH packet to the endpoint directly from the reserved buffer and return 0.]*/
+            if (sendPacketItem(mqttData, mqttData->reserveBuffer + packetOffset, packetLen) != 0)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_061: [If any failure is encountered then mqtt_client_publish_commit shall return a non-zero value.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_commit send failed");
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+        trimSendBuffers(mqttData);
+        settlePublish(mqttData, result, qosValue, packetId);
+    }
+    return result;
+}
+
+int mqtt_client_publish_batch(MQTT_CLIENT_HANDLE handle, MQTT_MESSAGE_HANDLE* msgHandles, size_t count, int* msgResults)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || msgHandles == NULL || count == 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_063: [If handle or msgHandles is NULL or count is 0 then mqtt_client_publish_batch shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_133: [mqtt_client_publish_batch shall record the packet ids of the QoS 1 and 2 messages it encodes in a buffer owned by the client, and if that buffer cannot hold count ids it shall set every msgResults entry to a non-zero value and return a non-zero value without sending.]*/
+    else if (ensureBatchPacketIdsSize(mqttData, count) != 0)
+    {
+        size_t index;
+        for (index = 0; msgResults != NULL && index < count; index++)
+        {
+            msgResults[index] = __LINE__;
+        }
+        result = __LINE__;
+    }
+    else
+    {
+        size_t index;
+        size_t batchLen = 0;
+        size_t encodedCount = 0;
+        size_t encodedIdCount = 0;
+        size_t queuedCount = 0;
+        size_t refusedCount = 0;
+        PENDING_PUBLISH* queueTail = mqttData->window.queueTail;
+
+        /*Codes_SRS_MQTT_CLIENT_07_064: [mqtt_client_publish_batch shall encode the PUBLISH packet of each message back to back in the client send buffer.]*/
+        for (index = 0; index < count; index++)
+        {
+            if (msgHandles[index] != NULL && isWindowClosed(mqttData, msgHandles[index]))
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_115: [While the window is full or publishes are queued a QoS 1 or 2 message shall not be sent, in MQTT_CLIENT_FLOW_CONTROL_FAIL mode it shall be refused with MQTT_CLIENT_WINDOW_FULL and in MQTT_CLIENT_FLOW_CONTROL_QUEUE mode it shall be queued and count as sent.]*/
+                /*Codes_SRS_MQTT_CLIENT_07_117: [mqtt_client_publish_batch shall set the msgResults entry of a refused message to MQTT_CLIENT_WINDOW_FULL and return MQTT_CLIENT_WINDOW_FULL when every message that was not sent or queued was refused, and if the send fails it shall drop the messages it queued and free the packet ids and window slots of the messages it encoded that are not kept in flight.]*/
+                int deferResult = deferPublish(mqttData, msgHandles[index], NULL, NULL);
+                if (deferResult == 0)
+                {
+                    queuedCount++;
+                }
+                else if (deferResult == MQTT_CLIENT_WINDOW_FULL)
+                {
+                    refusedCount++;
+                }
+                if (msgResults != NULL)
+                {
+                    msgResults[index] = deferResult;
+                }
+            }
+            else
+            {
+                QOS_VALUE qosValue = DELIVER_AT_MOST_ONCE;
+                uint16_t packetId = 0;
+                size_t packetLen = (msgHandles[index] == NULL) ? 0 : encodePublishMessage(mqttData, msgHandles[index], batchLen, true, &qosValue, &packetId);
+                /*Codes_SRS_MQTT_CLIENT_07_098: [When in flight tracking is on mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall keep a DUP flagged clone of every QoS 1 and 2 message before sending it, and shall fail a message without sending it when maxInFlight messages are in flight.]*/
+                if (packetLen == 0 || trackPublish(mqttData, msgHandles[index], qosValue, packetId) != 0)
+                {
+                    /*Codes_SRS_MQTT_CLIENT_07_065: [If a message is NULL or cannot be encoded then mqtt_client_publish_batch shall set its entry in msgResults to a non-zero value and continue with the next message.]*/
+                    LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_batch failed to encode message %u", (unsigned int)index);
+                    /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+                    releaseUnsentPacketId(mqttData, qosValue, packetId);
+                    if (msgResults != NULL)
+                    {
+                        msgResults[index] = __LINE__;
+                    }
+                }
+                else
+                {
+                    if (qosValue == DELIVER_AT_LEAST_ONCE || qosValue == DELIVER_EXACTLY_ONCE)
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_114: [When flow control is on every QoS 1 and 2 publish that was sent shall hold a window slot until its PUBACK or PUBCOMP arrives, and so shall one whose send failed while it is kept in flight to be sent again.]*/
+                        addToWindow(&mqttData->window, packetId);
+                        mqttData->batchPacketIds[encodedIdCount++] = packetId;
+                    }
+                    batchLen += packetLen;
+                    encodedCount++;
+                    if (msgResults != NULL)
+                    {
+                        msgResults[index] = 0;
+                    }
+                }
+            }
+        }
+
+        if (encodedCount == 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_066: [If no message could be encoded then mqtt_client_publish_batch shall return a non-zero value without sending.]*/
+            /*Codes_SRS_MQTT_CLIENT_07_117: [mqtt_client_publish_batch shall set the msgResults entry of a refused message to MQTT_CLIENT_WINDOW_FULL and return MQTT_CLIENT_WINDOW_FULL when every message that was not sent or queued was refused, and if the send fails it shall drop the messages it queued and free the packet ids and window slots of the messages it encoded that are not kept in flight.]*/
+            result = (queuedCount == count) ? 0 : (queuedCount + refusedCount == count) ? MQTT_CLIENT_WINDOW_FULL : __LINE__;
+        }
+        else
+        {
+            mqttData->packetState = PUBLISH_TYPE;
+
+            /*Codes_SRS_MQTT_CLIENT_07_067: [mqtt_client_publish_batch shall send all encoded packets with a single call to xio_send.]*/
+            if (queuePacketData(mqttData, mqttData->sendBuffer, batchLen, encodedCount) != 0)
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_068: [If the send fails then mqtt_client_publish_batch shall set the msgResults entry of every encoded message to a non-zero value and return a non-zero value.]*/
+                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_publish_batch send failed");
+                /*Codes_SRS_MQTT_CLIENT_07_117: [mqtt_client_publish_batch shall set the msgResults entry of a refused message to MQTT_CLIENT_WINDOW_FULL and return MQTT_CLIENT_WINDOW_FULL when every message that was not sent or queued was refused, and if the send fails it shall drop the messages it queued and free the packet ids and window slots of the messages it encoded that are not kept in flight.]*/
+                dropQueuedPublishes(&mqttData->window, queueTail);
+                for (index = 0; msgResults != NULL && index < count; index++)
+                {
+                    if (msgResults[index] == 0)
+                    {
+                        msgResults[index] = __LINE__;
+                    }
+                }
+                // Only the messages encoded here give their ids and window slots back, refused and earlier queued ones never took any
+                // and the ones that stay in flight will be sent again
+                for (index = 0; index < encodedIdCount; index++)
+                {
+                    uint16_t packetId = mqttData->batchPacketIds[index];
+                    if (!isInFlight(&mqttData->inFlight, packetId))
+                    {
+                        /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+                        releasePacketId(mqttData, packetId);
+                        (void)removeFromWindow(&mqttData->window, packetId);
+                    }
+                }
+                result = __LINE__;
+            }
+            else
+            {
+                /*Codes_SRS_MQTT_CLIENT_07_069: [mqtt_client_publish_batch shall return 0 only if every message was sent.]*/
+                /*Codes_SRS_MQTT_CLIENT_07_117: [mqtt_client_publish_batch shall set the msgResults entry of a refused message to MQTT_CLIENT_WINDOW_FULL and return MQTT_CLIENT_WINDOW_FULL when every message that was not sent or queued was refused, and if the send fails it shall drop the messages it queued and free the packet ids and window slots of the messages it encoded that are not kept in flight.]*/
+                result = (encodedCount + queuedCount == count) ? 0 : (encodedCount + queuedCount + refusedCount == count) ? MQTT_CLIENT_WINDOW_FULL : __LINE__;
             }
         }
+        trimSendBuffers(mqttData);
+    }
+    return result;
+}
+
+int mqtt_client_publish_segmented(MQTT_CLIENT_HANDLE handle, MQTT_MESSAGE_HANDLE msgHandle, ON_MQTT_PUBLISH_SEND_COMPLETE onSendComplete, void* context)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || msgHandle == NULL || onSendComplete == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_036: [If one of the parameters handle, msgHandle or onSendComplete is NULL then mqtt_client_publish_segmented shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else if (isWindowClosed(mqttData, msgHandle))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_115: [While the window is full or publishes are queued a QoS 1 or 2 message shall not be sent, in MQTT_CLIENT_FLOW_CONTROL_FAIL mode it shall be refused with MQTT_CLIENT_WINDOW_FULL and in MQTT_CLIENT_FLOW_CONTROL_QUEUE mode it shall be queued and count as sent.]*/
+        result = deferPublish(mqttData, msgHandle, onSendComplete, context);
+    }
+    else
+    {
+        result = publishMessageSegments(mqttData, msgHandle, onSendComplete, context);
     }
     return result;
 }
@@ -763,7 +2527,9 @@ int mqtt_client_subscribe(MQTT_CLIENT_HANDLE handle, uint16_t packetId, SUBSCRIB
     }
     else
     {
-        BUFFER_HANDLE subPacket = mqtt_codec_subscribe(packetId, subscribeList, count);
+        /*Codes_SRS_MQTT_CLIENT_07_104: [When packetId is 0 mqtt_client_subscribe and mqtt_client_unsubscribe shall use the lowest free packet id, and fail if every packet id is in use.]*/
+        packetId = reservePacketId(mqttData, packetId);
+        BUFFER_HANDLE subPacket = (packetId == 0) ? NULL : mqtt_codec_subscribe(packetId, subscribeList, count);
         if (subPacket == NULL)
         {
             /*Codes_SRS_MQTT_CLIENT_07_014: [If any failure is encountered then mqtt_client_subscribe shall return a non-zero value.]*/
@@ -787,6 +2553,12 @@ int mqtt_client_subscribe(MQTT_CLIENT_HANDLE handle, uint16_t packetId, SUBSCRIB
             }
             BUFFER_delete(subPacket);
         }
+
+        if (result != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+            releasePacketId(mqttData, packetId);
+        }
     }
     return result;
 }
@@ -802,7 +2574,9 @@ int mqtt_client_unsubscribe(MQTT_CLIENT_HANDLE handle, uint16_t packetId, const
     }
     else
     {
-        BUFFER_HANDLE unsubPacket = mqtt_codec_unsubscribe(packetId, unsubscribeList, count);
+        /*Codes_SRS_MQTT_CLIENT_07_104: [When packetId is 0 mqtt_client_subscribe and mqtt_client_unsubscribe shall use the lowest free packet id, and fail if every packet id is in use.]*/
+        packetId = reservePacketId(mqttData, packetId);
+        BUFFER_HANDLE unsubPacket = (packetId == 0) ? NULL : mqtt_codec_unsubscribe(packetId, unsubscribeList, count);
         if (unsubPacket == NULL)
         {
             /*Codes_SRS_MQTT_CLIENT_07_017: [If any failure is encountered then mqtt_client_unsubscribe shall return a non-zero value.]*/
@@ -826,6 +2600,12 @@ int mqtt_client_unsubscribe(MQTT_CLIENT_HANDLE handle, uint16_t packetId, const
             }
             BUFFER_delete(unsubPacket);
         }
+
+        if (result != 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+            releasePacketId(mqttData, packetId);
+        }
     }
     return result;
 }
@@ -841,30 +2621,20 @@ int mqtt_client_disconnect(MQTT_CLIENT_HANDLE handle)
     }
     else
     {
-        BUFFER_HANDLE disconnectPacket = mqtt_codec_disconnect();
-        if (disconnectPacket == NULL)
+        mqttData->packetState = DISCONNECT_TYPE;
+
+        /*Codes_SRS_MQTT_CLIENT_07_012: [On success mqtt_client_disconnect shall send the MQTT DISCONNECT packet to the endpoint.]*/
+        /*Codes_SRS_MQTT_CLIENT_07_044: [mqtt_client_disconnect shall send the constant DISCONNECT packet returned by mqtt_codec_disconnectPacket.]*/
+        /*Codes_SRS_MQTT_CLIENT_07_075: [mqtt_client_disconnect shall flush the send queue so the DISCONNECT packet is written immediately.]*/
+        if (sendPacketItem(mqttData, mqtt_codec_disconnectPacket(), MQTT_DISCONNECT_PACKET_SIZE) != 0 || flushSendQueue(mqttData) != 0)
         {
             /*Codes_SRS_MQTT_CLIENT_07_011: [If any failure is encountered then mqtt_client_disconnect shall return a non-zero value.]*/
-            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_disconnect failed");
-            mqttData->packetState = PACKET_TYPE_ERROR;
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_disconnect send failed");
             result = __LINE__;
         }
         else
         {
-            mqttData->packetState = DISCONNECT_TYPE;
-
-            /*Codes_SRS_MQTT_CLIENT_07_012: [On success mqtt_client_disconnect shall send the MQTT DISCONNECT packet to the endpoint.]*/
-            if (sendPacketItem(mqttData, BUFFER_u_char(disconnectPacket), BUFFER_length(disconnectPacket)) != 0)
-            {
-                /*Codes_SRS_MQTT_CLIENT_07_011: [If any failure is encountered then mqtt_client_disconnect shall return a non-zero value.]*/
-                LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_disconnect send failed");
-                result = __LINE__;
-            }
-            else
-            {
-                result = 0;
-            }
-            BUFFER_delete(disconnectPacket);
+            result = 0;
         }
     }
     return result;
@@ -877,6 +2647,7 @@ void mqtt_client_dowork(MQTT_CLIENT_HANDLE handle)
     if (mqttData != NULL)
     {
         /*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
+        mqttData->bytesReceived = false;
         xio_dowork(mqttData->xioHandle);
 
         /*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
@@ -906,12 +2677,35 @@ void mqtt_client_dowork(MQTT_CLIENT_HANDLE handle)
                 else if ((((current_ms - mqttData->packetSendTimeMs) / 1000) + KEEP_ALIVE_BUFFER_SEC) > mqttData->keepAliveInterval)
                 {
                     /*Codes_SRS_MQTT_CLIENT_07_026: [if keepAliveInternal is > 0 and the send time is greater than the MQTT KeepAliveInterval then it shall construct an MQTT PINGREQ packet.]*/
-                    BUFFER_HANDLE pingPacket = mqtt_codec_ping();
-                    if (pingPacket != NULL)
+                    /*Codes_SRS_MQTT_CLIENT_07_045: [mqtt_client_dowork shall send the constant PINGREQ packet returned by mqtt_codec_pingPacket.]*/
+                    /*Codes_SRS_MQTT_CLIENT_07_130: [mqtt_client_dowork shall flush the send queue after queuing the PINGREQ so the keep alive send time is updated before the next call.]*/
+                    (void)sendPacketItem(mqttData, mqtt_codec_pingPacket(), MQTT_PING_PACKET_SIZE);
+                    (void)flushSendQueue(mqttData);
+                    (void)tickcounter_get_current_ms(mqttData->packetTickCntr, &mqttData->timeSincePing);
+                }
+            }
+        }
+
+        if (mqttData->clientConnected && mqttData->inFlight.retryTimeoutMs > 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_100: [mqtt_client_dowork shall send again, oldest first, every in flight message whose PUBLISH or PUBREL was last sent retryTimeoutMs or more ago, a PUBLISH with the DUP flag set.]*/
+            resendExpiredInFlight(mqttData, false);
+        }
+
+        if (mqttData->sendQueueLen > 0)
+        {
+            uint64_t current_ms;
+            /*Codes_SRS_MQTT_CLIENT_07_073: [mqtt_client_dowork shall send the packets in the send queue with a single call to xio_send once maxDelayMs has elapsed since the first of them was queued.]*/
+            if (mqttData->maxBatchDelayMs == 0 ||
+                (tickcounter_get_current_ms(mqttData->packetTickCntr, &current_ms) == 0 && (current_ms - mqttData->sendQueueStartMs) >= mqttData->maxBatchDelayMs))
+            {
+                if (flushSendQueue(mqttData) != 0)
+                {
+                    /*Codes_SRS_MQTT_CLIENT_07_074: [If sending the send queue fails then mqtt_client_dowork shall call the Operation Callback function with MQTT_CLIENT_ON_ERROR.]*/
+                    LOG(LOG_ERROR, LOG_LINE, "Error: failure sending the send queue");
+                    if (mqttData->fnOperationCallback != NULL)
                     {
-                        (void)sendPacketItem(mqttData, BUFFER_u_char(pingPacket), BUFFER_length(pingPacket));
-                        BUFFER_delete(pingPacket);
-                        (void)tickcounter_get_current_ms(mqttData->packetTickCntr, &mqttData->timeSincePing);
+                        mqttData->fnOperationCallback(mqttData, MQTT_CLIENT_ON_ERROR, NULL, mqttData->ctx);
                     }
                 }
             }
@@ -919,6 +2713,200 @@ void mqtt_client_dowork(MQTT_CLIENT_HANDLE handle)
     }
 }
 
+int mqtt_client_get_dowork_timeout(MQTT_CLIENT_HANDLE handle, uint32_t* timeoutMs)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    uint64_t current_ms;
+    if (mqttData == NULL || timeoutMs == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_124: [If handle or timeoutMs is NULL then mqtt_client_get_dowork_timeout shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else if (tickcounter_get_current_ms(mqttData->packetTickCntr, &current_ms) != 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_125: [If tickcounter_get_current_ms fails then mqtt_client_get_dowork_timeout shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: tickcounter_get_current_ms failed");
+        result = __LINE__;
+    }
+    else
+    {
+        // Each deadline mirrors the matching check in mqtt_client_dowork
+        uint64_t deadline = UINT64_MAX;
+        if (mqttData->socketConnected && mqttData->clientConnected && mqttData->keepAliveInterval > 0)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_127: [When the keep alive interval is not longer than the ping buffer mqtt_client_get_dowork_timeout shall report the next PINGREQ at least a second after the last packet was sent.]*/
+            uint64_t pingDelayMs = (mqttData->keepAliveInterval > KEEP_ALIVE_BUFFER_SEC) ? (uint64_t)(mqttData->keepAliveInterval - KEEP_ALIVE_BUFFER_SEC + 1) * 1000 : 1000;
+            deadline = mqttData->packetSendTimeMs + pingDelayMs;
+            if (mqttData->timeSincePing > 0 && mqttData->timeSincePing + ((uint64_t)mqttData->maxPingRespTime + 1) * 1000 < deadline)
+            {
+                deadline = mqttData->timeSincePing + ((uint64_t)mqttData->maxPingRespTime + 1) * 1000;
+            }
+        }
+        if (mqttData->clientConnected && mqttData->inFlight.retryTimeoutMs > 0 && mqttData->inFlight.count > 0 &&
+            mqttData->inFlight.entries[mqttData->inFlight.head].sendTimeMs + mqttData->inFlight.retryTimeoutMs < deadline)
+        {
+            // The head of the in flight list is the message sent longest ago
+            deadline = mqttData->inFlight.entries[mqttData->inFlight.head].sendTimeMs + mqttData->inFlight.retryTimeoutMs;
+        }
+        if (mqttData->sendQueueLen > 0)
+        {
+            uint64_t flushMs = (mqttData->maxBatchDelayMs == 0) ? current_ms : mqttData->sendQueueStartMs + mqttData->maxBatchDelayMs;
+            if (flushMs < deadline)
+            {
+                deadline = flushMs;
+            }
+        }
+        if (mqttData->bytesReceived)
+        {
+            /*Codes_SRS_MQTT_CLIENT_07_137: [When bytes were received since mqtt_client_dowork began mqtt_client_get_dowork_timeout shall report 0, since a TLS xio may hold decrypted bytes that only its next xio_dowork delivers.]*/
+            deadline = current_ms;
+        }
+
+        /*Codes_SRS_MQTT_CLIENT_07_126: [mqtt_client_get_dowork_timeout shall store in timeoutMs the milliseconds left until mqtt_client_dowork has to send a PINGREQ, report a missing PINGRESP, resend an in flight message or send the send queue, 0 when one of them is due and MQTT_CLIENT_NO_TIMEOUT when none is pending, and return 0.]*/
+        if (deadline == UINT64_MAX)
+        {
+            *timeoutMs = MQTT_CLIENT_NO_TIMEOUT;
+        }
+        else if (deadline <= current_ms)
+        {
+            *timeoutMs = 0;
+        }
+        else
+        {
+            *timeoutMs = (deadline - current_ms < MQTT_CLIENT_NO_TIMEOUT) ? (uint32_t)(deadline - current_ms) : MQTT_CLIENT_NO_TIMEOUT - 1;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_get_pending_send_count(MQTT_CLIENT_HANDLE handle, size_t* pendingSendCount)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || pendingSendCount == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_138: [If handle or pendingSendCount is NULL then mqtt_client_get_pending_send_count shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_139: [mqtt_client_get_pending_send_count shall store in pendingSendCount the number of xio_send calls made since mqtt_client_connect whose send complete callback has not been called, and return 0.]*/
+        *pendingSendCount = mqttData->pendingSendCount;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_set_send_coalescing(MQTT_CLIENT_HANDLE handle, size_t maxBatchSize, uint32_t maxDelayMs)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_070: [If handle is NULL then mqtt_client_set_send_coalescing shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_071: [mqtt_client_set_send_coalescing shall send any queued packets before applying the new settings.]*/
+    else if (flushSendQueue(mqttData) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: failure sending the send queue");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_072: [mqtt_client_set_send_coalescing shall queue outbound packets until maxBatchSize bytes are queued or mqtt_client_dowork sends them, and a maxBatchSize of 0 shall turn coalescing off.]*/
+        mqttData->maxBatchSize = maxBatchSize;
+        mqttData->maxBatchDelayMs = maxDelayMs;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_get_send_stats(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_SEND_STATS* sendStats)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || sendStats == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_076: [If handle or sendStats is NULL then mqtt_client_get_send_stats shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_077: [mqtt_client_get_send_stats shall copy the number of packets, xio_send calls and bytes sent by the client into sendStats and return 0.]*/
+        *sendStats = mqttData->sendStats;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_set_reassembly_high_water_mark(MQTT_CLIENT_HANDLE handle, size_t highWaterMark)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_078: [If handle is NULL then mqtt_client_set_reassembly_high_water_mark shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_079: [mqtt_client_set_reassembly_high_water_mark shall call mqtt_codec_setReassemblyHighWaterMark and return a non-zero value if it fails.]*/
+    else if (mqtt_codec_setReassemblyHighWaterMark(mqttData->codec_handle, highWaterMark) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_setReassemblyHighWaterMark failed");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_129: [mqtt_client_set_reassembly_high_water_mark shall use highWaterMark for the send buffer and the reserve buffer too, freeing them right away when they are larger and not in use.]*/
+        mqttData->bufferHighWaterMark = highWaterMark;
+        trimSendBuffers(mqttData);
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_set_max_packet_size(MQTT_CLIENT_HANDLE handle, size_t maxPacketSize)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_085: [If handle is NULL then mqtt_client_set_max_packet_size shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_086: [mqtt_client_set_max_packet_size shall call mqtt_codec_setMaxPacketSize and return a non-zero value if it fails.]*/
+    else if (mqtt_codec_setMaxPacketSize(mqttData->codec_handle, maxPacketSize, recvPacketDiscardedCallback) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_setMaxPacketSize failed");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_get_discarded_packet_count(MQTT_CLIENT_HANDLE handle, uint64_t* discardedCount)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || discardedCount == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_088: [If handle or discardedCount is NULL then mqtt_client_get_discarded_packet_count shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_089: [mqtt_client_get_discarded_packet_count shall store the value of mqtt_codec_getDiscardedPacketCount in discardedCount and return 0.]*/
+        *discardedCount = mqtt_codec_getDiscardedPacketCount(mqttData->codec_handle);
+        result = 0;
+    }
+    return result;
+}
+
 void mqtt_client_set_trace(MQTT_CLIENT_HANDLE handle, bool traceOn, bool rawBytesOn)
 {
     MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
@@ -928,3 +2916,203 @@ void mqtt_client_set_trace(MQTT_CLIENT_HANDLE handle, bool traceOn, bool rawByte
         mqttData->rawBytesTrace = rawBytesOn;
     }
 }
+
+int mqtt_client_set_publish_streaming(MQTT_CLIENT_HANDLE handle, size_t threshold, ON_MQTT_PUBLISH_BEGIN_CALLBACK onPublishBegin, ON_MQTT_PUBLISH_CHUNK_CALLBACK onPublishChunk, ON_MQTT_PUBLISH_END_CALLBACK onPublishEnd, void* context)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    bool streamingOn = (onPublishBegin != NULL && onPublishChunk != NULL && onPublishEnd != NULL);
+    if (mqttData == NULL || (!streamingOn && (onPublishBegin != NULL || onPublishChunk != NULL || onPublishEnd != NULL)))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_080: [If handle is NULL, or only some of onPublishBegin, onPublishChunk and onPublishEnd are NULL, then mqtt_client_set_publish_streaming shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    /*Codes_SRS_MQTT_CLIENT_07_081: [mqtt_client_set_publish_streaming shall call mqtt_codec_setPublishStreaming with threshold, passing NULL callbacks when streaming is turned off, and return a non-zero value if it fails.]*/
+    else if (mqtt_codec_setPublishStreaming(mqttData->codec_handle, threshold,
+        streamingOn ? recvPublishBeginCallback : NULL, streamingOn ? recvPublishChunkCallback : NULL, streamingOn ? recvPublishEndCallback : NULL) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_codec_setPublishStreaming failed");
+        result = __LINE__;
+    }
+    else
+    {
+        mqttData->fnPublishBegin = onPublishBegin;
+        mqttData->fnPublishChunk = onPublishChunk;
+        mqttData->fnPublishEnd = onPublishEnd;
+        mqttData->streamCtx = context;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_set_inflight_tracking(MQTT_CLIENT_HANDLE handle, size_t maxInFlight, uint32_t retryTimeoutMs)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || maxInFlight >= IN_FLIGHT_NONE)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_095: [If handle is NULL or maxInFlight is 65535 or more then mqtt_client_set_inflight_tracking shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else if (mqttData->inFlight.count > 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_096: [If any message is in flight mqtt_client_set_inflight_tracking shall leave the settings unchanged and return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: %lu messages are in flight", (unsigned long)mqttData->inFlight.count);
+        result = __LINE__;
+    }
+    else if (maxInFlight == 0)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_097: [mqtt_client_set_inflight_tracking shall allocate the table for maxInFlight messages once, a maxInFlight of 0 shall turn tracking off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+        clearInFlight(&mqttData->inFlight);
+        mqttData->inFlight.retryTimeoutMs = 0;
+        result = 0;
+    }
+    else
+    {
+        size_t slotCount = 1;
+        while (slotCount < maxInFlight * 2)
+        {
+            slotCount <<= 1;
+        }
+
+        /*Codes_SRS_MQTT_CLIENT_07_097: [mqtt_client_set_inflight_tracking shall allocate the table for maxInFlight messages once, a maxInFlight of 0 shall turn tracking off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+        IN_FLIGHT_ENTRY* entries = (IN_FLIGHT_ENTRY*)malloc(maxInFlight * sizeof(IN_FLIGHT_ENTRY) + slotCount * sizeof(uint16_t));
+        if (entries == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure allocating the in flight table");
+            result = __LINE__;
+        }
+        else
+        {
+            clearInFlight(&mqttData->inFlight);
+            mqttData->inFlight.entries = entries;
+            mqttData->inFlight.slots = (uint16_t*)(entries + maxInFlight);
+            mqttData->inFlight.maxCount = maxInFlight;
+            mqttData->inFlight.slotMask = slotCount - 1;
+            mqttData->inFlight.retryTimeoutMs = retryTimeoutMs;
+            for (size_t index = 0; index < maxInFlight; index++)
+            {
+                entries[index].msgHandle = NULL;
+                entries[index].packet = NULL;
+                entries[index].next = (index + 1 < maxInFlight) ? (uint16_t)(index + 1) : IN_FLIGHT_NONE;
+            }
+            mqttData->inFlight.freeEntry = 0;
+            for (size_t index = 0; index < slotCount; index++)
+            {
+                mqttData->inFlight.slots[index] = IN_FLIGHT_NONE;
+            }
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int mqtt_client_get_inflight_count(MQTT_CLIENT_HANDLE handle, size_t* inFlightCount)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || inFlightCount == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_102: [If handle or inFlightCount is NULL then mqtt_client_get_inflight_count shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_103: [mqtt_client_get_inflight_count shall store the number of messages waiting for an acknowledgement in inFlightCount and return 0.]*/
+        *inFlightCount = mqttData->inFlight.count;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_get_last_packet_id(MQTT_CLIENT_HANDLE handle, uint16_t* packetId)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || packetId == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_109: [If handle or packetId is NULL then mqtt_client_get_last_packet_id shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_110: [mqtt_client_get_last_packet_id shall store the packet id used by the last QoS 1 or 2 publish, subscribe or unsubscribe in packetId and return 0.]*/
+        *packetId = mqttData->lastPacketId;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_client_set_flow_control(MQTT_CLIENT_HANDLE handle, size_t maxInFlight, MQTT_CLIENT_FLOW_CONTROL_MODE mode, ON_MQTT_WRITABLE_CALLBACK onWritable, void* context)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || maxInFlight >= IN_FLIGHT_NONE || (mode != MQTT_CLIENT_FLOW_CONTROL_FAIL && mode != MQTT_CLIENT_FLOW_CONTROL_QUEUE))
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_111: [If handle is NULL, mode is not an MQTT_CLIENT_FLOW_CONTROL_MODE value or maxInFlight is 65535 or more then mqtt_client_set_flow_control shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else if (mqttData->window.count > 0 || mqttData->window.queueHead != NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_112: [If a publish holds a window slot or is queued mqtt_client_set_flow_control shall leave the settings unchanged and return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: %lu publishes hold a window slot and %lu are queued", (unsigned long)mqttData->window.count, (unsigned long)mqttData->window.queuedCount);
+        result = __LINE__;
+    }
+    else
+    {
+        uint16_t* slots = NULL;
+        size_t slotCount = 0;
+        if (maxInFlight > 0)
+        {
+            slotCount = 1;
+            while (slotCount < maxInFlight * 2)
+            {
+                slotCount <<= 1;
+            }
+            /*Codes_SRS_MQTT_CLIENT_07_113: [mqtt_client_set_flow_control shall allocate the window for maxInFlight packet ids once, a maxInFlight of 0 shall turn flow control off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+            slots = (uint16_t*)malloc(slotCount * sizeof(uint16_t));
+        }
+
+        if (maxInFlight > 0 && slots == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure allocating the flow control window");
+            result = __LINE__;
+        }
+        else
+        {
+            if (slots != NULL)
+            {
+                (void)memset(slots, 0, slotCount * sizeof(uint16_t));
+            }
+            free(mqttData->window.slots);
+            mqttData->window.slots = slots;
+            mqttData->window.slotMask = (slotCount == 0) ? 0 : slotCount - 1;
+            mqttData->window.maxCount = maxInFlight;
+            mqttData->window.mode = mode;
+            mqttData->window.blocked = false;
+            mqttData->window.fnWritable = onWritable;
+            mqttData->window.writableCtx = context;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int mqtt_client_get_flow_control_state(MQTT_CLIENT_HANDLE handle, size_t* windowCount, size_t* queuedCount)
+{
+    int result;
+    MQTT_CLIENT* mqttData = (MQTT_CLIENT*)handle;
+    if (mqttData == NULL || windowCount == NULL || queuedCount == NULL)
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_122: [If handle, windowCount or queuedCount is NULL then mqtt_client_get_flow_control_state shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_CLIENT_07_123: [mqtt_client_get_flow_control_state shall store the number of publishes holding a window slot in windowCount and the number of queued publishes in queuedCount and return 0.]*/
+        *windowCount = mqttData->window.count;
+        *queuedCount = mqttData->window.queuedCount;
+        result = 0;
+    }
+    return result;
+}
@@ -27,7 +27,6 @@
 #define PUBLISH_QOS_RETAIN                  0x1
 
 #define PROTOCOL_NUMBER                     4
-#define CONN_FLAG_BYTE_OFFSET               7
 
 #define CONNECT_FIXED_HEADER_SIZE           2
 #define CONNECT_VARIABLE_HEADER_SIZE        10
@@ -35,35 +34,90 @@
 #define UNSUBSCRIBE_FIXED_HEADER_FLAG       0x2
 
 #define MAX_SEND_SIZE                       0xFFFFFF7F
+#define MAX_REMAINING_LENGTH                0xFFFFFFF
+#define FIXED_HEADER_TYPE_SIZE              1
+#define TOPIC_LENGTH_PREFIX_SIZE            2
+#define PACKET_ID_SIZE                      2
+#define MAX_REMAINING_LENGTH_BYTES          4
+#define CONNACK_VARIABLE_HEADER_SIZE        2
+#define CONNACK_SESSION_PRESENT_FLAG        0x1
+
+// Reassembly buffers larger than this are released once the packet has been delivered
+#define DEFAULT_REASSEMBLY_HIGH_WATER_MARK  (16 * 1024)
 
 #define CODEC_STATE_VALUES      \
     CODEC_STATE_FIXED_HEADER,   \
     CODEC_STATE_VAR_HEADER,     \
-    CODEC_STATE_PAYLOAD
+    CODEC_STATE_PUBLISH_HEADER, \
+    CODEC_STATE_PAYLOAD,        \
+    CODEC_STATE_DISCARD
 
 DEFINE_ENUM(CODEC_STATE_RESULT, CODEC_STATE_VALUES);
 
+static const uint8_t PINGREQ_PACKET[MQTT_PING_PACKET_SIZE] = { (uint8_t)PINGREQ_TYPE, 0x00 };
+static const uint8_t DISCONNECT_PACKET[MQTT_DISCONNECT_PACKET_SIZE] = { (uint8_t)DISCONNECT_TYPE, 0x00 };
+
 typedef struct MQTTCODEC_INSTANCE_TAG
 {
     CONTROL_PACKET_TYPE currPacket;
     CODEC_STATE_RESULT codecState;
     size_t bufferOffset;
     int headerFlags;
-    BUFFER_HANDLE headerData;
+    uint8_t* reassemblyBuffer;
+    size_t reassemblyCapacity;
+    size_t reassemblyHighWaterMark;
     ON_PACKET_COMPLETE_CALLBACK packetComplete;
+    ON_PUBLISH_BEGIN_CALLBACK publishBegin;
+    ON_PUBLISH_CHUNK_CALLBACK publishChunk;
+    ON_PUBLISH_END_CALLBACK publishEnd;
+    size_t streamThreshold;
+    size_t streamHeaderLength;
+    ON_PACKET_DISCARDED_CALLBACK packetDiscarded;
+    size_t maxPacketSize;
+    uint64_t discardedPacketCount;
     void* callContext;
     uint8_t storeRemainLen[4];
     size_t remainLenIndex;
+    size_t packetLength;
 } MQTTCODEC_INSTANCE;
 
+typedef struct MQTT_TOPIC_TAG
+{
+    size_t topicLen;
+    // Length prefix, topic bytes and a NULL terminator stored in the same allocation as the handle
+    uint8_t* encodedTopic;
+} MQTT_TOPIC;
+
+typedef struct MQTT_PUBLISH_TEMPLATE_TAG
+{
+    uint8_t packetFlags;
+    bool hasPacketId;
+    size_t variableHeaderLen;
+    // Variable header with a zero packet id, in the same allocation as the template. It is never written after create so a template can be shared
+    uint8_t* variableHeader;
+} MQTT_PUBLISH_TEMPLATE;
+
 typedef struct PUBLISH_HEADER_INFO_TAG
 {
     const char* topicName;
+    const uint8_t* encodedTopic;
+    size_t topicLen;
     uint16_t packetId;
-    const char* msgBuffer;
+    const uint8_t* msgBuffer;
+    size_t msgLen;
     QOS_VALUE qualityOfServiceValue;
 } PUBLISH_HEADER_INFO;
 
+typedef struct CONNECT_LENGTH_INFO_TAG
+{
+    size_t clientLen;
+    size_t usernameLen;
+    size_t passwordLen;
+    size_t willMessageLen;
+    size_t willTopicLen;
+    uint8_t connectFlags;
+} CONNECT_LENGTH_INFO;
+
 void byteutil_writeByte(uint8_t** buffer, uint8_t value)
 {
     if (buffer != NULL)
@@ -105,359 +159,372 @@ CONTROL_PACKET_TYPE processControlPacketType(uint8_t pktByte, int* flags)
     return result;
 }
 
-static int addListItemsToUnsubscribePacket(BUFFER_HANDLE ctrlPacket, const char** payloadList, size_t payloadCount)
+static size_t calculateRemainingLengthBytes(size_t remainLen)
 {
-    int result = 0;
-    if (payloadList == NULL || ctrlPacket == NULL)
+    size_t result = 1;
+    while (remainLen >= NEXT_128_CHUNK)
     {
-        result = __LINE__;
+        remainLen /= NEXT_128_CHUNK;
+        result++;
+    }
+    return result;
+}
+
+static void writeFixedHeader(uint8_t** iterator, CONTROL_PACKET_TYPE packetType, uint8_t flags, size_t remainLen)
+{
+    byteutil_writeByte(iterator, (uint8_t)packetType | flags);
+    // Calculate the length of packet
+    do
+    {
+        uint8_t encode = remainLen % 128;
+        remainLen /= 128;
+        // if there are more data to encode, set the top bit of this byte
+        if (remainLen > 0)
+        {
+            encode |= NEXT_128_CHUNK;
+        }
+        byteutil_writeByte(iterator, encode);
+    } while (remainLen > 0);
+}
+
+static size_t calculateHeaderLength(size_t remainLen, size_t borrowedLen)
+{
+    return FIXED_HEADER_TYPE_SIZE + calculateRemainingLengthBytes(remainLen) + remainLen - borrowedLen;
+}
+
+// Allocates the packet minus the trailing borrowedLen bytes, which the caller sends from its own memory
+static BUFFER_HANDLE constructControlPacketHeader(CONTROL_PACKET_TYPE packetType, uint8_t flags, size_t remainLen, size_t borrowedLen, uint8_t** iterator)
+{
+    BUFFER_HANDLE result;
+    if (remainLen > MAX_REMAINING_LENGTH || borrowedLen > remainLen)
+    {
+        result = NULL;
     }
     else
     {
-        for (size_t index = 0; index < payloadCount && result == 0; index++)
+        // The complete packet size is known up front so the buffer is only allocated once
+        size_t packetLen = calculateHeaderLength(remainLen, borrowedLen);
+        result = BUFFER_new();
+        if (result != NULL)
         {
-            // Add the Payload
-            size_t offsetLen = BUFFER_length(ctrlPacket);
-            size_t topicLen = strlen(payloadList[index]);
-            if (topicLen > USHRT_MAX)
-            {
-                result = __LINE__;
-            }
-            else if (BUFFER_enlarge(ctrlPacket, topicLen + 2) != 0)
+            if (BUFFER_pre_build(result, packetLen) != 0)
             {
-                result = __LINE__;
+                BUFFER_delete(result);
+                result = NULL;
             }
             else
             {
-                uint8_t* iterator = BUFFER_u_char(ctrlPacket);
-                iterator += offsetLen;
-                byteutil_writeUTF(&iterator, payloadList[index], (uint16_t)topicLen);
+                *iterator = BUFFER_u_char(result);
+                if (*iterator == NULL)
+                {
+                    BUFFER_delete(result);
+                    result = NULL;
+                }
+                else
+                {
+                    writeFixedHeader(iterator, packetType, flags, remainLen);
+                }
             }
         }
     }
     return result;
 }
 
-static int addListItemsToSubscribePacket(BUFFER_HANDLE ctrlPacket, SUBSCRIBE_PAYLOAD* payloadList, size_t payloadCount)
+static BUFFER_HANDLE constructControlPacket(CONTROL_PACKET_TYPE packetType, uint8_t flags, size_t remainLen, uint8_t** iterator)
 {
-    int result = 0;
-    if (payloadList == NULL || ctrlPacket == NULL)
+    return constructControlPacketHeader(packetType, flags, remainLen, 0, iterator);
+}
+
+// Returns the complete packet size, the fixed header is only written when the packet fits in the caller's buffer
+static size_t constructControlPacketInto(uint8_t* buffer, size_t capacity, CONTROL_PACKET_TYPE packetType, uint8_t flags, size_t remainLen, uint8_t** iterator)
+{
+    size_t result;
+    *iterator = NULL;
+    if (remainLen > MAX_REMAINING_LENGTH)
     {
-        result = __LINE__;
+        result = 0;
     }
     else
     {
-        for (size_t index = 0; index < payloadCount && result == 0; index++)
+        result = calculateHeaderLength(remainLen, 0);
+        if (buffer != NULL && result <= capacity)
         {
-            // Add the Payload
-            size_t offsetLen = BUFFER_length(ctrlPacket);
-            size_t topicLen = strlen(payloadList[index].subscribeTopic);
-            if (topicLen > USHRT_MAX)
-            {
-                result = __LINE__;
-            }
-            else if (BUFFER_enlarge(ctrlPacket, topicLen + 2 + 1) != 0)
-            {
-                result = __LINE__;
-            }
-            else
-            {
-                uint8_t* iterator = BUFFER_u_char(ctrlPacket);
-                iterator += offsetLen;
-                byteutil_writeUTF(&iterator, payloadList[index].subscribeTopic, (uint16_t)topicLen);
-                *iterator = payloadList[index].qosReturn;
-            }
+            *iterator = buffer;
+            writeFixedHeader(iterator, packetType, flags, remainLen);
         }
     }
     return result;
 }
 
-static int constructConnectVariableHeader(BUFFER_HANDLE ctrlPacket, const MQTT_CLIENT_OPTIONS* mqttOptions)
+static int calculateUnsubscribeLength(const char** payloadList, size_t payloadCount, size_t* remainLen)
 {
     int result = 0;
-    if (BUFFER_enlarge(ctrlPacket, CONNECT_VARIABLE_HEADER_SIZE) != 0)
-    {
-        result = __LINE__;
-    }
-    else
+    // Packet Id
+    *remainLen = 2;
+    for (size_t index = 0; index < payloadCount && result == 0; index++)
     {
-        uint8_t* iterator = BUFFER_u_char(ctrlPacket);
-        if (iterator == NULL)
+        size_t topicLen = strlen(payloadList[index]);
+        if (topicLen > USHRT_MAX)
         {
             result = __LINE__;
         }
         else
         {
-            byteutil_writeUTF(&iterator, "MQTT", 4);
-            byteutil_writeByte(&iterator, PROTOCOL_NUMBER);
-            byteutil_writeByte(&iterator, 0); // Flags will be entered later
-            byteutil_writeInt(&iterator, mqttOptions->keepAliveInterval);
-            result = 0;
+            *remainLen += topicLen + 2;
         }
     }
     return result;
 }
 
-static int constructPublishVariableHeader(BUFFER_HANDLE ctrlPacket, const PUBLISH_HEADER_INFO* publishHeader)
+static void writeUnsubscribePacketData(uint8_t** iterator, uint16_t packetId, const char** payloadList, size_t payloadCount)
 {
-    int result = 0;
-    size_t topicLen = 0;
-    size_t spaceLen = 0;
-    size_t idLen = 0;
-
-    size_t currLen = BUFFER_length(ctrlPacket);
-
-    topicLen = strlen(publishHeader->topicName);
-    spaceLen += 2;
-
-    if (publishHeader->qualityOfServiceValue != DELIVER_AT_MOST_ONCE)
+    byteutil_writeInt(iterator, packetId);
+    for (size_t index = 0; index < payloadCount; index++)
     {
-        // Packet Id is only set if the QOS is not 0
-        idLen = 2;
+        // Add the Payload
+        byteutil_writeUTF(iterator, payloadList[index], (uint16_t)strlen(payloadList[index]));
     }
+}
 
-    if (topicLen > USHRT_MAX)
-    {
-        result = __LINE__;
-    }
-    else if (BUFFER_enlarge(ctrlPacket, topicLen + idLen + spaceLen) != 0)
-    {
-        result = __LINE__;
-    }
-    else
+static int calculateSubscribeLength(const SUBSCRIBE_PAYLOAD* payloadList, size_t payloadCount, size_t* remainLen)
+{
+    int result = 0;
+    // Packet Id
+    *remainLen = 2;
+    for (size_t index = 0; index < payloadCount && result == 0; index++)
     {
-        uint8_t* iterator = BUFFER_u_char(ctrlPacket);
-        if (iterator == NULL)
+        size_t topicLen = strlen(payloadList[index].subscribeTopic);
+        if (topicLen > USHRT_MAX)
         {
             result = __LINE__;
         }
         else
         {
-            iterator += currLen;
-            /* The Topic Name MUST be present as the first field in the PUBLISH Packet Variable header.It MUST be 792 a UTF-8 encoded string [MQTT-3.3.2-1] as defined in section 1.5.3.*/
-            byteutil_writeUTF(&iterator, publishHeader->topicName, (uint16_t)topicLen);
-            if (idLen > 0)
-            {
-                byteutil_writeInt(&iterator, publishHeader->packetId);
-            }
-            result = 0;
+            *remainLen += topicLen + 2 + 1;
         }
     }
     return result;
 }
 
-static int constructSubscibeTypeVariableHeader(BUFFER_HANDLE ctrlPacket, uint16_t packetId)
+static void writeSubscribePacketData(uint8_t** iterator, uint16_t packetId, const SUBSCRIBE_PAYLOAD* payloadList, size_t payloadCount)
 {
-    int result = 0;
-    if (BUFFER_enlarge(ctrlPacket, 2) != 0)
+    byteutil_writeInt(iterator, packetId);
+    for (size_t index = 0; index < payloadCount; index++)
+    {
+        // Add the Payload
+        byteutil_writeUTF(iterator, payloadList[index].subscribeTopic, (uint16_t)strlen(payloadList[index].subscribeTopic));
+        byteutil_writeByte(iterator, (uint8_t)payloadList[index].qosReturn);
+    }
+}
+
+static int calculatePublishLength(PUBLISH_HEADER_INFO* publishHeader, size_t* remainLen)
+{
+    int result;
+    if (publishHeader->encodedTopic == NULL)
+    {
+        publishHeader->topicLen = strlen(publishHeader->topicName);
+    }
+    if (publishHeader->topicLen > USHRT_MAX)
     {
         result = __LINE__;
     }
     else
     {
-        uint8_t* iterator = BUFFER_u_char(ctrlPacket);
-        if (iterator == NULL)
-        {
-            result = __LINE__;
-        }
-        else
+        *remainLen = publishHeader->topicLen + 2 + publishHeader->msgLen;
+        if (publishHeader->qualityOfServiceValue != DELIVER_AT_MOST_ONCE)
         {
-            byteutil_writeInt(&iterator, packetId);
-            result = 0;
+            // Packet Id is only set if the QOS is not 0
+            *remainLen += 2;
         }
+        result = 0;
     }
     return result;
 }
 
-static BUFFER_HANDLE constructPublishReply(CONTROL_PACKET_TYPE type, uint8_t flags, uint16_t packetId)
+static uint8_t calculatePublishFlags(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain)
 {
-    BUFFER_HANDLE result = BUFFER_new();
-    if (result != NULL)
+    uint8_t result = 0;
+    if (duplicateMsg) result |= PUBLISH_DUP_FLAG;
+    if (serverRetain) result |= PUBLISH_QOS_RETAIN;
+    if (qosValue != DELIVER_AT_MOST_ONCE)
     {
-        if (BUFFER_pre_build(result, 4) != 0)
+        if (qosValue == DELIVER_AT_LEAST_ONCE)
         {
-            BUFFER_delete(result);
-            result = NULL;
+            result |= PUBLISH_QOS_AT_LEAST_ONCE;
         }
         else
         {
-            uint8_t* iterator = BUFFER_u_char(result);
-            if (iterator == NULL)
-            {
-                BUFFER_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                *iterator = (uint8_t)type | flags;
-                iterator++;
-                *iterator = 0x2;
-                iterator++;
-                byteutil_writeInt(&iterator, packetId);
-            }
+            result |= PUBLISH_QOS_EXACTLY_ONCE;
         }
     }
     return result;
 }
 
-static int constructFixedHeader(BUFFER_HANDLE ctrlPacket, CONTROL_PACKET_TYPE packetType, uint8_t flags)
+static void writePublishVariableHeader(uint8_t** iterator, const PUBLISH_HEADER_INFO* publishHeader)
 {
-    int result;
-    if (ctrlPacket == NULL)
+    /* The Topic Name MUST be present as the first field in the PUBLISH Packet Variable header.It MUST be 792 a UTF-8 encoded string [MQTT-3.3.2-1] as defined in section 1.5.3.*/
+    if (publishHeader->encodedTopic != NULL)
     {
-        return __LINE__;
+        (void)memcpy(*iterator, publishHeader->encodedTopic, publishHeader->topicLen + TOPIC_LENGTH_PREFIX_SIZE);
+        *iterator += publishHeader->topicLen + TOPIC_LENGTH_PREFIX_SIZE;
     }
     else
     {
-        size_t packetLen = BUFFER_length(ctrlPacket);
-        uint8_t remainSize[4] = { 0 };
-        size_t index = 0;
+        byteutil_writeUTF(iterator, publishHeader->topicName, (uint16_t)publishHeader->topicLen);
+    }
+    if (publishHeader->qualityOfServiceValue != DELIVER_AT_MOST_ONCE)
+    {
+        byteutil_writeInt(iterator, publishHeader->packetId);
+    }
+}
 
-        // Calculate the length of packet
-        do
-        {
-            uint8_t encode = packetLen % 128;
-            packetLen /= 128;
-            // if there are more data to encode, set the top bit of this byte
-            if (packetLen > 0)
-            {
-                encode |= NEXT_128_CHUNK;
-            }
-            remainSize[index++] = encode;
-        } while (packetLen > 0);
+static void writePublishPacketData(uint8_t** iterator, const PUBLISH_HEADER_INFO* publishHeader)
+{
+    writePublishVariableHeader(iterator, publishHeader);
+    if (publishHeader->msgLen > 0)
+    {
+        // Write Message
+        (void)memcpy(*iterator, publishHeader->msgBuffer, publishHeader->msgLen);
+        *iterator += publishHeader->msgLen;
+    }
+}
 
-        BUFFER_HANDLE fixedHeader = BUFFER_new();
-        if (fixedHeader == NULL)
-        {
-            result = __LINE__;
-        }
-        else if (BUFFER_pre_build(fixedHeader, index + 1) != 0)
+static int validatePublishTopic(const char* topicName, size_t* topicLen)
+{
+    int result;
+    if (topicName == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *topicLen = strlen(topicName);
+        // Topic names in a PUBLISH packet MUST NOT contain wildcard characters [MQTT-3.3.2-2]
+        if (*topicLen == 0 || *topicLen > USHRT_MAX || strpbrk(topicName, "+#") != NULL)
         {
-            BUFFER_delete(fixedHeader);
             result = __LINE__;
         }
         else
         {
-            uint8_t* iterator = BUFFER_u_char(fixedHeader);
-            *iterator = (uint8_t)packetType | flags;
-            iterator++;
-            (void)memcpy(iterator, remainSize, index);
-
-            result = BUFFER_prepend(ctrlPacket, fixedHeader);
-            BUFFER_delete(fixedHeader);
+            result = 0;
         }
     }
     return result;
 }
 
-static int constructConnPayload(BUFFER_HANDLE ctrlPacket, const MQTT_CLIENT_OPTIONS* mqttOptions)
+static size_t writeTemplateFixedHeader(uint8_t* buffer, const MQTT_PUBLISH_TEMPLATE* publishTemplate, size_t buffLen)
 {
-    int result = 0;
-    if (mqttOptions == NULL || ctrlPacket == NULL)
+    uint8_t* iterator = buffer;
+    writeFixedHeader(&iterator, PUBLISH_TYPE, publishTemplate->packetFlags, publishTemplate->variableHeaderLen + buffLen);
+    return (size_t)(iterator - buffer);
+}
+
+static BUFFER_HANDLE constructPublishReply(CONTROL_PACKET_TYPE type, uint8_t flags, uint16_t packetId)
+{
+    uint8_t* iterator;
+    BUFFER_HANDLE result = constructControlPacket(type, flags, 2, &iterator);
+    if (result != NULL)
     {
-        result = __LINE__;
+        byteutil_writeInt(&iterator, packetId);
     }
-    else
-    {
-        size_t clientLen = 0;
-        size_t usernameLen = 0;
-        size_t passwordLen = 0;
-        size_t willMessageLen = 0;
-        size_t willTopicLen = 0;
-        size_t spaceLen = 0;
+    return result;
+}
 
-        if (mqttOptions->clientId != NULL)
-        {
-            spaceLen += 2;
-            clientLen = strlen(mqttOptions->clientId);
-        }
-        if (mqttOptions->username != NULL)
-        {
-            spaceLen += 2;
-            usernameLen = strlen(mqttOptions->username);
-        }
-        if (mqttOptions->password != NULL)
-        {
-            spaceLen += 2;
-            passwordLen = strlen(mqttOptions->password);
-        }
-        if (mqttOptions->willMessage != NULL)
-        {
-            spaceLen += 2;
-            willMessageLen = strlen(mqttOptions->willMessage);
-        }
-        if (mqttOptions->willTopic != NULL)
-        {
-            spaceLen += 2;
-            willTopicLen = strlen(mqttOptions->willTopic);
-        }
+static size_t constructPublishReplyInto(uint8_t* buffer, size_t capacity, CONTROL_PACKET_TYPE type, uint8_t flags, uint16_t packetId)
+{
+    uint8_t* iterator;
+    size_t result = constructControlPacketInto(buffer, capacity, type, flags, 2, &iterator);
+    if (iterator != NULL)
+    {
+        byteutil_writeInt(&iterator, packetId);
+    }
+    return result;
+}
 
-        size_t currLen = BUFFER_length(ctrlPacket);
-        size_t totalLen = clientLen + usernameLen + passwordLen + willMessageLen + willTopicLen + spaceLen;
+static int calculateConnectLength(const MQTT_CLIENT_OPTIONS* mqttOptions, CONNECT_LENGTH_INFO* connectInfo, size_t* remainLen)
+{
+    int result;
+    connectInfo->clientLen = (mqttOptions->clientId != NULL) ? strlen(mqttOptions->clientId) : 0;
+    connectInfo->usernameLen = (mqttOptions->username != NULL) ? strlen(mqttOptions->username) : 0;
+    connectInfo->passwordLen = (mqttOptions->password != NULL) ? strlen(mqttOptions->password) : 0;
+    connectInfo->willMessageLen = (mqttOptions->willMessage != NULL) ? strlen(mqttOptions->willMessage) : 0;
+    connectInfo->willTopicLen = (mqttOptions->willTopic != NULL) ? strlen(mqttOptions->willTopic) : 0;
 
-        // Validate the Username & Password
-        if (clientLen > USHRT_MAX)
+    // Validate the Username & Password
+    if (connectInfo->clientLen > USHRT_MAX)
+    {
+        result = __LINE__;
+    }
+    else if (connectInfo->usernameLen == 0 && connectInfo->passwordLen > 0)
+    {
+        result = __LINE__;
+    }
+    else if ((connectInfo->willMessageLen > 0 && connectInfo->willTopicLen == 0) || (connectInfo->willTopicLen > 0 && connectInfo->willMessageLen == 0))
+    {
+        result = __LINE__;
+    }
+    else if (connectInfo->willMessageLen > USHRT_MAX || connectInfo->willTopicLen > USHRT_MAX || connectInfo->usernameLen > USHRT_MAX || connectInfo->passwordLen > USHRT_MAX)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        // The client identifier is always present, even when it is empty
+        *remainLen = CONNECT_VARIABLE_HEADER_SIZE + connectInfo->clientLen + 2;
+        connectInfo->connectFlags = 0;
+        if (connectInfo->willMessageLen > 0 && connectInfo->willTopicLen > 0)
         {
-            result = __LINE__;
+            connectInfo->connectFlags |= WILL_FLAG_FLAG;
+            connectInfo->connectFlags |= mqttOptions->qualityOfServiceValue;
+            if (mqttOptions->messageRetain)
+            {
+                connectInfo->connectFlags |= WILL_RETAIN_FLAG;
+            }
+            *remainLen += connectInfo->willTopicLen + 2 + connectInfo->willMessageLen + 2;
         }
-        else if (usernameLen == 0 && passwordLen > 0)
+        if (connectInfo->usernameLen > 0)
         {
-            result = __LINE__;
+            connectInfo->connectFlags |= USERNAME_FLAG;
+            *remainLen += connectInfo->usernameLen + 2;
         }
-        else if ( (willMessageLen > 0 && willTopicLen == 0) || (willTopicLen > 0 && willMessageLen == 0) )
+        if (connectInfo->passwordLen > 0)
         {
-            result = __LINE__;
+            connectInfo->connectFlags |= PASSWORD_FLAG;
+            *remainLen += connectInfo->passwordLen + 2;
         }
-        else if (BUFFER_enlarge(ctrlPacket, totalLen) != 0)
+        // TODO: Get the rest of the flags
+        if (mqttOptions->useCleanSession)
         {
-            result = __LINE__;
+            connectInfo->connectFlags |= CLEAN_SESSION_FLAG;
         }
-        else
-        {
-            uint8_t* packet = BUFFER_u_char(ctrlPacket);
-            uint8_t* iterator = packet;
+        result = 0;
+    }
+    return result;
+}
 
-            iterator += currLen;
-            byteutil_writeUTF(&iterator, mqttOptions->clientId, (uint16_t)clientLen);
+static void writeConnectPacketData(uint8_t** iterator, const MQTT_CLIENT_OPTIONS* mqttOptions, const CONNECT_LENGTH_INFO* connectInfo)
+{
+    // Variable Header
+    byteutil_writeUTF(iterator, "MQTT", 4);
+    byteutil_writeByte(iterator, PROTOCOL_NUMBER);
+    byteutil_writeByte(iterator, connectInfo->connectFlags);
+    byteutil_writeInt(iterator, mqttOptions->keepAliveInterval);
 
-            // TODO: Read on the Will Topic
-            if (willMessageLen > USHRT_MAX || willTopicLen > USHRT_MAX || usernameLen > USHRT_MAX || passwordLen > USHRT_MAX)
-            {
-                result = __LINE__;
-            }
-            else
-            {
-                if (willMessageLen > 0 && willTopicLen > 0)
-                {
-                    packet[CONN_FLAG_BYTE_OFFSET] |= WILL_FLAG_FLAG;
-                    byteutil_writeUTF(&iterator, mqttOptions->willTopic, (uint16_t)willTopicLen);
-                    packet[CONN_FLAG_BYTE_OFFSET] |= mqttOptions->qualityOfServiceValue;
-                    if (mqttOptions->messageRetain)
-                    {
-                        packet[CONN_FLAG_BYTE_OFFSET] |= WILL_RETAIN_FLAG;
-                    }
-                    byteutil_writeUTF(&iterator, mqttOptions->willMessage, (uint16_t)willMessageLen);
-                }
-                if (usernameLen > 0)
-                {
-                    packet[CONN_FLAG_BYTE_OFFSET] |= USERNAME_FLAG;
-                    byteutil_writeUTF(&iterator, mqttOptions->username, (uint16_t)usernameLen);
-                }
-                if (passwordLen > 0)
-                {
-                    packet[CONN_FLAG_BYTE_OFFSET] |= PASSWORD_FLAG;
-                    byteutil_writeUTF(&iterator, mqttOptions->password, (uint16_t)passwordLen);
-                }
-                // TODO: Get the rest of the flags
-                if (mqttOptions->useCleanSession)
-                {
-                    packet[CONN_FLAG_BYTE_OFFSET] |= CLEAN_SESSION_FLAG;
-                }
-                result = 0;
-            }
-        }
+    // Payload
+    byteutil_writeUTF(iterator, mqttOptions->clientId, (uint16_t)connectInfo->clientLen);
+    if ((connectInfo->connectFlags & WILL_FLAG_FLAG) != 0)
+    {
+        byteutil_writeUTF(iterator, mqttOptions->willTopic, (uint16_t)connectInfo->willTopicLen);
+        byteutil_writeUTF(iterator, mqttOptions->willMessage, (uint16_t)connectInfo->willMessageLen);
+    }
+    if (connectInfo->usernameLen > 0)
+    {
+        byteutil_writeUTF(iterator, mqttOptions->username, (uint16_t)connectInfo->usernameLen);
+    }
+    if (connectInfo->passwordLen > 0)
+    {
+        byteutil_writeUTF(iterator, mqttOptions->password, (uint16_t)connectInfo->passwordLen);
     }
-    return result;
 }
 
 static int prepareheaderDataInfo(MQTTCODEC_INSTANCE* codecData, uint8_t remainLen)
@@ -467,35 +534,29 @@ static int prepareheaderDataInfo(MQTTCODEC_INSTANCE* codecData, uint8_t remainLe
     {
         result = __LINE__;
     }
+    else if ((remainLen & NEXT_128_CHUNK) != 0 && codecData->remainLenIndex + 1 >= sizeof(codecData->storeRemainLen))
+    {
+        // The remaining length is encoded in at most 4 bytes
+        result = __LINE__;
+    }
     else
     {
         result = 0;
         codecData->storeRemainLen[codecData->remainLenIndex++] = remainLen;
-        if (remainLen < 0x7f)
+        if ((remainLen & NEXT_128_CHUNK) == 0)
         {
-            int multiplier = 1;
-            int totalLen = 0;
-            size_t index = 0;
-            uint8_t encodeByte = 0;
-            do
+            size_t multiplier = 1;
+            size_t totalLen = 0;
+            size_t index;
+            for (index = 0; index < codecData->remainLenIndex; index++)
             {
-                encodeByte = codecData->storeRemainLen[index++];
-                totalLen += (encodeByte & 127) * multiplier;
+                totalLen += (codecData->storeRemainLen[index] & 127) * multiplier;
                 multiplier *= NEXT_128_CHUNK;
-
-                if (multiplier > 128 * 128 * 128)
-                {
-                    result = __LINE__;
-                    break;
-                }
-            } while ( (encodeByte & NEXT_128_CHUNK) != 0);
-
-            if (totalLen > 0)
-            {
-                codecData->headerData = BUFFER_new();
-                (void)BUFFER_pre_build(codecData->headerData, totalLen);
-                codecData->bufferOffset = 0;
             }
+
+            // The packet body is only buffered once it is known not to be contiguous in the received bytes
+            codecData->packetLength = totalLen;
+            codecData->bufferOffset = 0;
             codecData->codecState = CODEC_STATE_VAR_HEADER;
 
             // Reset remainLen Index
@@ -506,132 +567,305 @@ static int prepareheaderDataInfo(MQTTCODEC_INSTANCE* codecData, uint8_t remainLe
     return result;
 }
 
-static void completePacketData(MQTTCODEC_INSTANCE* codecData)
+static void releaseReassemblyBuffer(MQTTCODEC_INSTANCE* codecData)
 {
-    if (codecData)
+    free(codecData->reassemblyBuffer);
+    codecData->reassemblyBuffer = NULL;
+    codecData->reassemblyCapacity = 0;
+}
+
+// The reassembly buffer is kept between packets and only grows, so steady state receive does not allocate
+static int ensureReassemblyCapacity(MQTTCODEC_INSTANCE* codecData, size_t packetLength)
+{
+    int result;
+    if (packetLength <= codecData->reassemblyCapacity)
     {
-        if (codecData->packetComplete != NULL)
+        result = 0;
+    }
+    else
+    {
+        uint8_t* newBuffer = (uint8_t*)realloc(codecData->reassemblyBuffer, packetLength);
+        if (newBuffer == NULL)
         {
-            codecData->packetComplete(codecData->callContext, codecData->currPacket, codecData->headerFlags, codecData->headerData);
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating the reassembly buffer");
+            result = __LINE__;
+        }
+        else
+        {
+            codecData->reassemblyBuffer = newBuffer;
+            codecData->reassemblyCapacity = packetLength;
+            result = 0;
         }
-
-        // Clean up data
-        codecData->currPacket = UNKNOWN_TYPE;
-        codecData->codecState = CODEC_STATE_FIXED_HEADER;
-        codecData->headerFlags = 0;
-        BUFFER_delete(codecData->headerData);
-        codecData->headerData = NULL;
     }
+    return result;
 }
 
-MQTTCODEC_HANDLE mqtt_codec_create(ON_PACKET_COMPLETE_CALLBACK packetComplete, void* callbackCtx)
+static void resetPacketState(MQTTCODEC_INSTANCE* codecData)
 {
-    MQTTCODEC_HANDLE result;
-    result = malloc(sizeof(MQTTCODEC_INSTANCE) );
-    /* Codes_SRS_MQTT_CODEC_07_001: [If a failure is encountered then mqtt_codec_create shall return NULL.] */
-    if (result != NULL)
+    codecData->currPacket = UNKNOWN_TYPE;
+    codecData->codecState = CODEC_STATE_FIXED_HEADER;
+    codecData->headerFlags = 0;
+    codecData->packetLength = 0;
+    codecData->bufferOffset = 0;
+    codecData->streamHeaderLength = 0;
+
+    /* Codes_SRS_MQTT_CODEC_07_073: [Once a packet has been delivered, if the reassembly buffer is larger than the high water mark it shall be freed.] */
+    if (codecData->reassemblyCapacity > codecData->reassemblyHighWaterMark)
     {
-        /* Codes_SRS_MQTT_CODEC_07_002: [On success mqtt_codec_create shall return a MQTTCODEC_HANDLE value.] */
-        result->currPacket = UNKNOWN_TYPE;
-        result->codecState = CODEC_STATE_FIXED_HEADER;
-        result->headerFlags = 0;
-        result->bufferOffset = 0;
-        result->packetComplete = packetComplete;
-        result->callContext = callbackCtx;
-        result->headerData = NULL;
-        memset(result->storeRemainLen, 0, 4 * sizeof(uint8_t));
-        result->remainLenIndex = 0;
+        releaseReassemblyBuffer(codecData);
     }
-    return result;
 }
 
-void mqtt_codec_destroy(MQTTCODEC_HANDLE handle)
+static void completePacketData(MQTTCODEC_INSTANCE* codecData, const uint8_t* data, size_t length)
 {
-    /* Codes_SRS_MQTT_CODEC_07_003: [If the handle parameter is NULL then mqtt_codec_destroy shall do nothing.] */
-    if (handle != NULL)
+    if (codecData)
     {
-        MQTTCODEC_INSTANCE* codecData = (MQTTCODEC_INSTANCE*)handle;
-        /* Codes_SRS_MQTT_CODEC_07_004: [mqtt_codec_destroy shall deallocate all memory that has been allocated by this object.] */
-        BUFFER_delete(codecData->headerData);
-        free(codecData);
+        if (codecData->packetComplete != NULL)
+        {
+            codecData->packetComplete(codecData->callContext, codecData->currPacket, codecData->headerFlags, data, length);
+        }
+
+        // Clean up data
+        resetPacketState(codecData);
     }
 }
 
-BUFFER_HANDLE mqtt_codec_connect(const MQTT_CLIENT_OPTIONS* mqttOptions)
+static void completePublishStream(MQTTCODEC_INSTANCE* codecData)
 {
-    BUFFER_HANDLE result;
-    /* Codes_SRS_MQTT_CODEC_07_008: [If the parameters mqttOptions is NULL then mqtt_codec_connect shall return a null value.] */
-    if (mqttOptions == NULL)
+    /* Codes_SRS_MQTT_CODEC_07_080: [Once the last payload byte has been passed on mqtt_codec_bytesReceived shall call the ON_PUBLISH_END_CALLBACK function.] */
+    codecData->publishEnd(codecData->callContext);
+    resetPacketState(codecData);
+}
+
+static void beginDiscard(MQTTCODEC_INSTANCE* codecData)
+{
+    /* Codes_SRS_MQTT_CODEC_07_084: [If the remaining length of a packet is larger than the maximum packet size mqtt_codec_bytesReceived shall count it, call the ON_PACKET_DISCARDED_CALLBACK function and skip its bytes without buffering them.] */
+    LOG(LOG_ERROR, LOG_LINE, "Discarding a packet of %lu bytes, the maximum packet size is %lu", (unsigned long)codecData->packetLength, (unsigned long)codecData->maxPacketSize);
+    codecData->discardedPacketCount++;
+    codecData->codecState = CODEC_STATE_DISCARD;
+    if (codecData->packetDiscarded != NULL)
     {
-        result = NULL;
+        codecData->packetDiscarded(codecData->callContext, codecData->currPacket, codecData->packetLength);
+    }
+}
+
+static int beginPublishStream(MQTTCODEC_INSTANCE* codecData)
+{
+    int result;
+    // The 2 byte topic length, the topic plus its terminator and the packet id are collected in the reassembly buffer
+    if (codecData->packetLength < TOPIC_LENGTH_PREFIX_SIZE || ensureReassemblyCapacity(codecData, TOPIC_LENGTH_PREFIX_SIZE + 1) != 0)
+    {
+        result = __LINE__;
     }
     else
     {
-        /* Codes_SRS_MQTT_CODEC_07_009: [mqtt_codec_connect shall construct a BUFFER_HANDLE that represents a MQTT CONNECT packet.] */
-        result = BUFFER_new();
-        if (result != NULL)
+        codecData->streamHeaderLength = TOPIC_LENGTH_PREFIX_SIZE;
+        codecData->codecState = CODEC_STATE_PUBLISH_HEADER;
+        result = 0;
+    }
+    return result;
+}
+
+static int processPublishStreamHeader(MQTTCODEC_INSTANCE* codecData)
+{
+    int result;
+    size_t packetIdLength = ((codecData->headerFlags & (PUBLISH_QOS_AT_LEAST_ONCE | PUBLISH_QOS_EXACTLY_ONCE)) != 0) ? PACKET_ID_SIZE : 0;
+    uint8_t* header = codecData->reassemblyBuffer;
+    if (codecData->streamHeaderLength == TOPIC_LENGTH_PREFIX_SIZE)
+    {
+        // Now that the topic length is known collect the rest of the variable header
+        size_t topicLength = ((size_t)header[0] << 8) | header[1];
+        size_t headerLength = TOPIC_LENGTH_PREFIX_SIZE + topicLength + packetIdLength;
+        if (topicLength == 0 || headerLength > codecData->packetLength)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Invalid PUBLISH topic length");
+            result = __LINE__;
+        }
+        else if (ensureReassemblyCapacity(codecData, headerLength + 1) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            codecData->streamHeaderLength = headerLength;
+            result = 0;
+        }
+    }
+    else
+    {
+        size_t topicLength = codecData->streamHeaderLength - TOPIC_LENGTH_PREFIX_SIZE - packetIdLength;
+        uint16_t packetId = 0;
+        if (packetIdLength > 0)
+        {
+            packetId = (uint16_t)((header[TOPIC_LENGTH_PREFIX_SIZE + topicLength] << 8) | header[TOPIC_LENGTH_PREFIX_SIZE + topicLength + 1]);
+        }
+        // The packet id has been read so its first byte can terminate the topic
+        header[TOPIC_LENGTH_PREFIX_SIZE + topicLength] = '\0';
+        codecData->codecState = CODEC_STATE_PAYLOAD;
+
+        /* Codes_SRS_MQTT_CODEC_07_078: [Once the topic name and packet id of a streamed PUBLISH have been read mqtt_codec_bytesReceived shall call the ON_PUBLISH_BEGIN_CALLBACK function with the payload length.] */
+        codecData->publishBegin(codecData->callContext, codecData->headerFlags, (const char*)header + TOPIC_LENGTH_PREFIX_SIZE, packetId, codecData->packetLength - codecData->streamHeaderLength);
+        if (codecData->bufferOffset == codecData->packetLength)
+        {
+            completePublishStream(codecData);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+// Decodes the remaining length at the start of buffer, lengthBytes is 0 when buffer ends before the last length byte
+static int decodeRemainingLength(const uint8_t* buffer, size_t size, size_t* remainLen, size_t* lengthBytes)
+{
+    int result = 0;
+    size_t multiplier = 1;
+    size_t index;
+    *remainLen = 0;
+    *lengthBytes = 0;
+    for (index = 0; index < size; index++)
+    {
+        *remainLen += (buffer[index] & 127) * multiplier;
+        if ((buffer[index] & NEXT_128_CHUNK) == 0)
         {
-            // Add Variable Header Information
-            if (constructConnectVariableHeader(result, mqttOptions) != 0)
+            *lengthBytes = index + 1;
+            break;
+        }
+        else if (index + 1 >= MAX_REMAINING_LENGTH_BYTES)
+        {
+            result = __LINE__;
+            break;
+        }
+        multiplier *= NEXT_128_CHUNK;
+    }
+    return result;
+}
+
+static int getVariableHeaderLength(CONTROL_PACKET_TYPE packetType, int flags, const uint8_t* body, size_t bodyLength, size_t* headerLength)
+{
+    int result = 0;
+    switch (packetType)
+    {
+        case PUBLISH_TYPE:
+            if (bodyLength < TOPIC_LENGTH_PREFIX_SIZE)
             {
-                /* Codes_SRS_MQTT_CODEC_07_010: [If any error is encountered then mqtt_codec_connect shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
+                result = __LINE__;
             }
             else
             {
-                if (constructConnPayload(result, mqttOptions) != 0)
-                {
-                    /* Codes_SRS_MQTT_CODEC_07_010: [If any error is encountered then mqtt_codec_connect shall return NULL.] */
-                    BUFFER_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    if (constructFixedHeader(result, CONNECT_TYPE, 0) != 0)
-                    {
-                        /* Codes_SRS_MQTT_CODEC_07_010: [If any error is encountered then mqtt_codec_connect shall return NULL.] */
-                        BUFFER_delete(result);
-                        result = NULL;
-                    }
-                }
+                *headerLength = TOPIC_LENGTH_PREFIX_SIZE + (((size_t)body[0] << 8) | body[1]) +
+                    (((flags & (PUBLISH_QOS_AT_LEAST_ONCE | PUBLISH_QOS_EXACTLY_ONCE)) != 0) ? PACKET_ID_SIZE : 0);
             }
-        }
+            break;
+        case CONNECT_TYPE:
+            *headerLength = CONNECT_VARIABLE_HEADER_SIZE;
+            break;
+        case CONNACK_TYPE:
+        case PUBACK_TYPE:
+        case PUBREC_TYPE:
+        case PUBREL_TYPE:
+        case PUBCOMP_TYPE:
+        case SUBSCRIBE_TYPE:
+        case SUBACK_TYPE:
+        case UNSUBSCRIBE_TYPE:
+        case UNSUBACK_TYPE:
+            // CONNACK carries its flags and return code, the others their packet id
+            *headerLength = PACKET_ID_SIZE;
+            break;
+        default:
+            *headerLength = 0;
+            break;
+    }
+    if (result == 0 && *headerLength > bodyLength)
+    {
+        result = __LINE__;
     }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_disconnect()
+MQTTCODEC_HANDLE mqtt_codec_create(ON_PACKET_COMPLETE_CALLBACK packetComplete, void* callbackCtx)
 {
-    /* Codes_SRS_MQTT_CODEC_07_011: [On success mqtt_codec_disconnect shall construct a BUFFER_HANDLE that represents a MQTT DISCONNECT packet.] */
-    BUFFER_HANDLE result = BUFFER_new();
+    MQTTCODEC_HANDLE result;
+    result = malloc(sizeof(MQTTCODEC_INSTANCE) );
+    /* Codes_SRS_MQTT_CODEC_07_001: [If a failure is encountered then mqtt_codec_create shall return NULL.] */
     if (result != NULL)
     {
-        if (BUFFER_enlarge(result, 2) != 0)
+        /* Codes_SRS_MQTT_CODEC_07_002: [On success mqtt_codec_create shall return a MQTTCODEC_HANDLE value.] */
+        result->currPacket = UNKNOWN_TYPE;
+        result->codecState = CODEC_STATE_FIXED_HEADER;
+        result->headerFlags = 0;
+        result->bufferOffset = 0;
+        result->packetComplete = packetComplete;
+        result->callContext = callbackCtx;
+        result->reassemblyBuffer = NULL;
+        result->reassemblyCapacity = 0;
+        result->reassemblyHighWaterMark = DEFAULT_REASSEMBLY_HIGH_WATER_MARK;
+        result->publishBegin = NULL;
+        result->publishChunk = NULL;
+        result->publishEnd = NULL;
+        result->streamThreshold = 0;
+        result->streamHeaderLength = 0;
+        result->packetDiscarded = NULL;
+        result->maxPacketSize = 0;
+        result->discardedPacketCount = 0;
+        memset(result->storeRemainLen, 0, 4 * sizeof(uint8_t));
+        result->remainLenIndex = 0;
+        result->packetLength = 0;
+    }
+    return result;
+}
+
+void mqtt_codec_destroy(MQTTCODEC_HANDLE handle)
+{
+    /* Codes_SRS_MQTT_CODEC_07_003: [If the handle parameter is NULL then mqtt_codec_destroy shall do nothing.] */
+    if (handle != NULL)
+    {
+        MQTTCODEC_INSTANCE* codecData = (MQTTCODEC_INSTANCE*)handle;
+        /* Codes_SRS_MQTT_CODEC_07_004: [mqtt_codec_destroy shall deallocate all memory that has been allocated by this object.] */
+        free(codecData->reassemblyBuffer);
+        free(codecData);
+    }
+}
+
+BUFFER_HANDLE mqtt_codec_connect(const MQTT_CLIENT_OPTIONS* mqttOptions)
+{
+    BUFFER_HANDLE result;
+    /* Codes_SRS_MQTT_CODEC_07_008: [If the parameters mqttOptions is NULL then mqtt_codec_connect shall return a null value.] */
+    if (mqttOptions == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        CONNECT_LENGTH_INFO connectInfo;
+        size_t remainLen = 0;
+        if (calculateConnectLength(mqttOptions, &connectInfo, &remainLen) != 0)
         {
-            /* Codes_SRS_MQTT_CODEC_07_012: [If any error is encountered mqtt_codec_disconnect shall return NULL.] */
-            BUFFER_delete(result);
+            /* Codes_SRS_MQTT_CODEC_07_010: [If any error is encountered then mqtt_codec_connect shall return NULL.] */
             result = NULL;
         }
         else
         {
-            uint8_t* iterator = BUFFER_u_char(result);
-            if (iterator == NULL)
-            {
-                /* Codes_SRS_MQTT_CODEC_07_012: [If any error is encountered mqtt_codec_disconnect shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
-            }
-            else
+            /* Codes_SRS_MQTT_CODEC_07_009: [mqtt_codec_connect shall construct a BUFFER_HANDLE that represents a MQTT CONNECT packet.] */
+            uint8_t* iterator;
+            result = constructControlPacket(CONNECT_TYPE, 0, remainLen, &iterator);
+            if (result != NULL)
             {
-                iterator[0] = DISCONNECT_TYPE;
-                iterator[1] = 0;
+                writeConnectPacketData(&iterator, mqttOptions, &connectInfo);
             }
         }
     }
     return result;
 }
 
+BUFFER_HANDLE mqtt_codec_disconnect()
+{
+    /* Codes_SRS_MQTT_CODEC_07_011: [On success mqtt_codec_disconnect shall construct a BUFFER_HANDLE that represents a MQTT DISCONNECT packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_012: [If any error is encountered mqtt_codec_disconnect shall return NULL.] */
+    uint8_t* iterator;
+    BUFFER_HANDLE result = constructControlPacket(DISCONNECT_TYPE, 0, 0, &iterator);
+    return result;
+}
+
 BUFFER_HANDLE mqtt_codec_publish(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, const uint8_t* msgBuffer, size_t buffLen)
 {
     BUFFER_HANDLE result;
@@ -649,179 +883,251 @@ BUFFER_HANDLE mqtt_codec_publish(QOS_VALUE qosValue, bool duplicateMsg, bool ser
     else
     {
         PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
         publishInfo.topicName = topicName;
         publishInfo.packetId = packetId;
         publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgBuffer = msgBuffer;
+        publishInfo.msgLen = buffLen;
 
-        uint8_t headerFlags = 0;
-        if (duplicateMsg) headerFlags |= PUBLISH_DUP_FLAG;
-        if (serverRetain) headerFlags |= PUBLISH_QOS_RETAIN;
-        if (qosValue != DELIVER_AT_MOST_ONCE)
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0)
         {
-            if (qosValue == DELIVER_AT_LEAST_ONCE)
-            {
-                headerFlags |= PUBLISH_QOS_AT_LEAST_ONCE;
-            }
-            else
-            {
-                headerFlags |= PUBLISH_QOS_EXACTLY_ONCE;
-            }
+            /* Codes_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
+            result = NULL;
         }
-
-        /* Codes_SRS_MQTT_CODEC_07_007: [mqtt_codec_publish shall return a BUFFER_HANDLE that represents a MQTT PUBLISH message.] */
-        result = BUFFER_new();
-        if (result != NULL)
+        else
         {
-            if (constructPublishVariableHeader(result, &publishInfo) != 0)
-            {
-                /* Codes_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
-            }
-            else
+            /* Codes_SRS_MQTT_CODEC_07_007: [mqtt_codec_publish shall return a BUFFER_HANDLE that represents a MQTT PUBLISH message.] */
+            uint8_t* iterator;
+            result = constructControlPacket(PUBLISH_TYPE, calculatePublishFlags(qosValue, duplicateMsg, serverRetain), remainLen, &iterator);
+            if (result != NULL)
             {
-                size_t payloadOffset = BUFFER_length(result);
-                if (buffLen > 0)
-                {
-                    if (BUFFER_enlarge(result, buffLen) != 0)
-                    {
-                        /* Codes_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-                        BUFFER_delete(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        uint8_t* iterator = BUFFER_u_char(result);
-                        if (iterator == NULL)
-                        {
-                            /* Codes_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-                            BUFFER_delete(result);
-                            result = NULL;
-                        }
-                        else
-                        {
-                            iterator += payloadOffset;
-                            // Write Message
-                            memcpy(iterator, msgBuffer, buffLen);
-                        }
-                    }
-                }
-
-                if (result != NULL)
-                {
-                    if (constructFixedHeader(result, PUBLISH_TYPE, headerFlags) != 0)
-                    {
-                        /* Codes_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-                        BUFFER_delete(result);
-                        result = NULL;
-                    }
-                }
+                writePublishPacketData(&iterator, &publishInfo);
             }
         }
     }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_publishAck(uint16_t packetId)
+BUFFER_HANDLE mqtt_codec_publishSegments(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, const uint8_t* msgBuffer, size_t buffLen, MQTT_BUFFER_SEGMENT* segments)
 {
-    /* Codes_SRS_MQTT_CODEC_07_013: [On success mqtt_codec_publishAck shall return a BUFFER_HANDLE representation of a MQTT PUBACK packet.] */
-    /* Codes_SRS_MQTT_CODEC_07_014 : [If any error is encountered then mqtt_codec_publishAck shall return NULL.] */
-    BUFFER_HANDLE result = constructPublishReply(PUBACK_TYPE, 0, packetId);
+    BUFFER_HANDLE result;
+    /* Codes_SRS_MQTT_CODEC_07_037: [If the parameters topicName or segments are NULL, or if msgBuffer is NULL and buffLen is not 0 then mqtt_codec_publishSegments shall return NULL.] */
+    if (topicName == NULL || segments == NULL || (msgBuffer == NULL && buffLen > 0))
+    {
+        result = NULL;
+    }
+    /* Codes_SRS_MQTT_CODEC_07_038: [mqtt_codec_publishSegments shall return NULL if the buffLen variable is greater than the MAX_SEND_SIZE (0xFFFFFF7F).] */
+    else if (buffLen > MAX_SEND_SIZE)
+    {
+        result = NULL;
+    }
+    else
+    {
+        PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
+        publishInfo.topicName = topicName;
+        publishInfo.packetId = packetId;
+        publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgBuffer = msgBuffer;
+        publishInfo.msgLen = buffLen;
+
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_039: [If any error is encountered then mqtt_codec_publishSegments shall return NULL.] */
+            result = NULL;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_040: [mqtt_codec_publishSegments shall return a BUFFER_HANDLE that contains only the fixed and variable header of the MQTT PUBLISH message, with a remaining length that includes buffLen.] */
+            uint8_t* iterator;
+            result = constructControlPacketHeader(PUBLISH_TYPE, calculatePublishFlags(qosValue, duplicateMsg, serverRetain), remainLen, buffLen, &iterator);
+            if (result != NULL)
+            {
+                writePublishVariableHeader(&iterator, &publishInfo);
+
+                /* Codes_SRS_MQTT_CODEC_07_041: [mqtt_codec_publishSegments shall set segments[0] to the header bytes in the returned BUFFER_HANDLE and segments[1] to msgBuffer and buffLen without copying the payload.] */
+                size_t headerLen = calculateHeaderLength(remainLen, buffLen);
+                segments[0].data = iterator - headerLen;
+                segments[0].length = headerLen;
+                segments[1].data = msgBuffer;
+                segments[1].length = buffLen;
+            }
+        }
+    }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_publishReceived(uint16_t packetId)
+MQTT_TOPIC_HANDLE mqtt_codec_topicCreate(const char* topicName)
 {
-    /* Codes_SRS_MQTT_CODEC_07_015: [On success mqtt_codec_publishRecieved shall return a BUFFER_HANDLE representation of a MQTT PUBREC packet.] */
-    /* Codes_SRS_MQTT_CODEC_07_016 : [If any error is encountered then mqtt_codec_publishRecieved shall return NULL.] */
-    BUFFER_HANDLE result = constructPublishReply(PUBREC_TYPE, 0, packetId);
+    MQTT_TOPIC* result;
+    size_t topicLen;
+    /* Codes_SRS_MQTT_CODEC_07_049: [If topicName is NULL, empty, longer than 65535 bytes or contains the wildcard characters '+' or '#' then mqtt_codec_topicCreate shall return NULL.] */
+    if (validatePublishTopic(topicName, &topicLen) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Invalid topic name specified");
+        result = NULL;
+    }
+    /* Codes_SRS_MQTT_CODEC_07_050: [mqtt_codec_topicCreate shall allocate the handle and the length prefixed UTF-8 encoding of topicName in a single allocation.] */
+    else if ((result = (MQTT_TOPIC*)malloc(sizeof(MQTT_TOPIC) + TOPIC_LENGTH_PREFIX_SIZE + topicLen + 1)) == NULL)
+    {
+        /* Codes_SRS_MQTT_CODEC_07_051: [If any error is encountered then mqtt_codec_topicCreate shall return NULL.] */
+        LOG(LOG_ERROR, LOG_LINE, "Failure allocating topic handle");
+    }
+    else
+    {
+        uint8_t* iterator = (uint8_t*)(result + 1);
+        result->topicLen = topicLen;
+        result->encodedTopic = iterator;
+        byteutil_writeUTF(&iterator, topicName, (uint16_t)topicLen);
+        *iterator = '\0';
+    }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_publishRelease(uint16_t packetId)
+void mqtt_codec_topicDestroy(MQTT_TOPIC_HANDLE topicHandle)
 {
-    /* Codes_SRS_MQTT_CODEC_07_017: [On success mqtt_codec_publishRelease shall return a BUFFER_HANDLE representation of a MQTT PUBREL packet.] */
-    /* Codes_SRS_MQTT_CODEC_07_018 : [If any error is encountered then mqtt_codec_publishRelease shall return NULL.] */
-    BUFFER_HANDLE result = constructPublishReply(PUBREL_TYPE, 2, packetId);
-    return result;
+    /* Codes_SRS_MQTT_CODEC_07_052: [mqtt_codec_topicDestroy shall free all resources associated with topicHandle and shall do nothing if topicHandle is NULL.] */
+    if (topicHandle != NULL)
+    {
+        free(topicHandle);
+    }
 }
 
-BUFFER_HANDLE mqtt_codec_publishComplete(uint16_t packetId)
+const char* mqtt_codec_topicGetName(MQTT_TOPIC_HANDLE topicHandle)
 {
-    /* Codes_SRS_MQTT_CODEC_07_019: [On success mqtt_codec_publishComplete shall return a BUFFER_HANDLE representation of a MQTT PUBCOMP packet.] */
-    /* Codes_SRS_MQTT_CODEC_07_020 : [If any error is encountered then mqtt_codec_publishComplete shall return NULL.] */
-    BUFFER_HANDLE result = constructPublishReply(PUBCOMP_TYPE, 0, packetId);
+    const char* result;
+    if (topicHandle == NULL)
+    {
+        /* Codes_SRS_MQTT_CODEC_07_053: [If topicHandle is NULL then mqtt_codec_topicGetName shall return NULL.] */
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_054: [mqtt_codec_topicGetName shall return the NULL terminated topic name stored in topicHandle.] */
+        result = (const char*)topicHandle->encodedTopic + TOPIC_LENGTH_PREFIX_SIZE;
+    }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_ping()
+BUFFER_HANDLE mqtt_codec_publishTopic(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, MQTT_TOPIC_HANDLE topicHandle, const uint8_t* msgBuffer, size_t buffLen)
 {
-    /* Codes_SRS_MQTT_CODEC_07_021: [On success mqtt_codec_ping shall construct a BUFFER_HANDLE that represents a MQTT PINGREQ packet.] */
-    BUFFER_HANDLE result = BUFFER_new();
-    if (result != NULL)
+    BUFFER_HANDLE result;
+    /* Codes_SRS_MQTT_CODEC_07_055: [If topicHandle is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall fail.] */
+    if (topicHandle == NULL || (msgBuffer == NULL && buffLen > 0) || buffLen > MAX_SEND_SIZE)
+    {
+        result = NULL;
+    }
+    else
     {
-        if (BUFFER_enlarge(result, 2) != 0)
+        PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
+        publishInfo.encodedTopic = topicHandle->encodedTopic;
+        publishInfo.topicLen = topicHandle->topicLen;
+        publishInfo.packetId = packetId;
+        publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgBuffer = msgBuffer;
+        publishInfo.msgLen = buffLen;
+
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0)
         {
-            /* Codes_SRS_MQTT_CODEC_07_022: [If any error is encountered mqtt_codec_ping shall return NULL.] */
-            BUFFER_delete(result);
             result = NULL;
         }
         else
         {
-            uint8_t* iterator = BUFFER_u_char(result);
-            if (iterator == NULL)
-            {
-                /* Codes_SRS_MQTT_CODEC_07_022: [If any error is encountered mqtt_codec_ping shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
-            }
-            else
+            /* Codes_SRS_MQTT_CODEC_07_056: [mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall copy the pre-encoded topic from topicHandle and shall produce the same packet as mqtt_codec_publish and mqtt_codec_publish_into.] */
+            uint8_t* iterator;
+            result = constructControlPacket(PUBLISH_TYPE, calculatePublishFlags(qosValue, duplicateMsg, serverRetain), remainLen, &iterator);
+            if (result != NULL)
             {
-                iterator[0] = PINGREQ_TYPE;
-                iterator[1] = 0;
+                writePublishPacketData(&iterator, &publishInfo);
             }
         }
     }
     return result;
 }
 
-BUFFER_HANDLE mqtt_codec_subscribe(uint16_t packetId, SUBSCRIBE_PAYLOAD* subscribeList, size_t count)
+MQTT_PUBLISH_TEMPLATE_HANDLE mqtt_codec_publishTemplateCreate(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, const char* topicName)
 {
-    BUFFER_HANDLE result;
-    /* Codes_SRS_MQTT_CODEC_07_023: [If the parameters subscribeList is NULL or if count is 0 then mqtt_codec_subscribe shall return NULL.] */
-    if (subscribeList == NULL || count == 0)
+    MQTT_PUBLISH_TEMPLATE* result;
+    size_t topicLen;
+    /* Codes_SRS_MQTT_CODEC_07_057: [If topicName is not a valid PUBLISH topic as defined for mqtt_codec_topicCreate or qosValue is not a valid QOS_VALUE then mqtt_codec_publishTemplateCreate shall return NULL.] */
+    if (validatePublishTopic(topicName, &topicLen) != 0 || (qosValue != DELIVER_AT_MOST_ONCE && qosValue != DELIVER_AT_LEAST_ONCE && qosValue != DELIVER_EXACTLY_ONCE))
     {
+        LOG(LOG_ERROR, LOG_LINE, "Invalid publish template parameters specified");
         result = NULL;
     }
     else
     {
-        /* Codes_SRS_MQTT_CODEC_07_026: [mqtt_codec_subscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.]*/
-        result = BUFFER_new();
-        if (result != NULL)
+        bool hasPacketId = (qosValue != DELIVER_AT_MOST_ONCE);
+        size_t variableHeaderLen = TOPIC_LENGTH_PREFIX_SIZE + topicLen + (hasPacketId ? PACKET_ID_SIZE : 0);
+        /* Codes_SRS_MQTT_CODEC_07_058: [mqtt_codec_publishTemplateCreate shall pre-compute the PUBLISH flags and variable header in a single allocation.] */
+        if ((result = (MQTT_PUBLISH_TEMPLATE*)malloc(sizeof(MQTT_PUBLISH_TEMPLATE) + variableHeaderLen)) == NULL)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_059: [If any error is encountered then mqtt_codec_publishTemplateCreate shall return NULL.] */
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating publish template");
+        }
+        else
         {
-            if (constructSubscibeTypeVariableHeader(result, packetId) != 0)
+            uint8_t* iterator;
+            result->packetFlags = calculatePublishFlags(qosValue, duplicateMsg, serverRetain);
+            result->hasPacketId = hasPacketId;
+            result->variableHeaderLen = variableHeaderLen;
+            result->variableHeader = (uint8_t*)(result + 1);
+
+            iterator = result->variableHeader;
+            byteutil_writeUTF(&iterator, topicName, (uint16_t)topicLen);
+            if (hasPacketId)
             {
-                /* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
+                byteutil_writeInt(&iterator, 0);
             }
-            else
+        }
+    }
+    return result;
+}
+
+void mqtt_codec_publishTemplateDestroy(MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle)
+{
+    /* Codes_SRS_MQTT_CODEC_07_060: [mqtt_codec_publishTemplateDestroy shall free all resources associated with templateHandle and shall do nothing if templateHandle is NULL.] */
+    if (templateHandle != NULL)
+    {
+        free(templateHandle);
+    }
+}
+
+size_t mqtt_codec_publishTemplate_into(uint8_t* buffer, size_t capacity, MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle, uint16_t packetId, const uint8_t* msgBuffer, size_t buffLen)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_061: [If templateHandle or segments is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTemplate_into shall return 0 and mqtt_codec_publishTemplateSegments shall return a non-zero value.] */
+    if (templateHandle == NULL || (msgBuffer == NULL && buffLen > 0) || buffLen > MAX_SEND_SIZE)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t remainLen = templateHandle->variableHeaderLen + buffLen;
+        if (remainLen > MAX_REMAINING_LENGTH)
+        {
+            result = 0;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+            result = calculateHeaderLength(remainLen, 0);
+            if (buffer != NULL && result <= capacity)
             {
-                /* Codes_SRS_MQTT_CODEC_07_024: [mqtt_codec_subscribe shall iterate through count items in the subscribeList.] */
-                if (addListItemsToSubscribePacket(result, subscribeList, count) != 0)
+                /* Codes_SRS_MQTT_CODEC_07_062: [mqtt_codec_publishTemplate_into shall write the fixed header, copy the pre-computed variable header, stamp packetId in place when the QoS requires one and copy msgBuffer.] */
+                uint8_t* iterator = buffer + writeTemplateFixedHeader(buffer, templateHandle, buffLen);
+                (void)memcpy(iterator, templateHandle->variableHeader, templateHandle->variableHeaderLen);
+                iterator += templateHandle->variableHeaderLen;
+                if (templateHandle->hasPacketId)
                 {
-                    /* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-                    BUFFER_delete(result);
-                    result = NULL;
+                    iterator[-2] = (uint8_t)(packetId >> 8);
+                    iterator[-1] = (uint8_t)(packetId & 0xff);
                 }
-                else
+                if (buffLen > 0)
                 {
-                    if (constructFixedHeader(result, SUBSCRIBE_TYPE, SUBSCRIBE_FIXED_HEADER_FLAG) != 0)
-                    {
-                        /* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-                        BUFFER_delete(result);
-                        result = NULL;
-                    }
+                    (void)memcpy(iterator, msgBuffer, buffLen);
                 }
             }
         }
@@ -829,6 +1135,209 @@ BUFFER_HANDLE mqtt_codec_subscribe(uint16_t packetId, SUBSCRIBE_PAYLOAD* subscri
     return result;
 }
 
+size_t mqtt_codec_publishTemplateHeaderSize(MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle)
+{
+    size_t result;
+    if (templateHandle == NULL)
+    {
+        /* Codes_SRS_MQTT_CODEC_07_103: [If templateHandle is NULL then mqtt_codec_publishTemplateHeaderSize shall return 0.] */
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_102: [mqtt_codec_publishTemplateHeaderSize shall return the header storage mqtt_codec_publishTemplateSegments needs for any payload, MQTT_MAX_FIXED_HEADER_SIZE plus the variable header length.] */
+        result = MQTT_MAX_FIXED_HEADER_SIZE + templateHandle->variableHeaderLen;
+    }
+    return result;
+}
+
+QOS_VALUE mqtt_codec_publishTemplateGetQos(MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle)
+{
+    QOS_VALUE result;
+    if (templateHandle == NULL)
+    {
+        /* Codes_SRS_MQTT_CODEC_07_109: [If templateHandle is NULL then mqtt_codec_publishTemplateGetQos shall return DELIVER_FAILURE.] */
+        result = DELIVER_FAILURE;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_108: [mqtt_codec_publishTemplateGetQos shall return the QoS the template was created with.] */
+        result = (templateHandle->packetFlags & PUBLISH_QOS_EXACTLY_ONCE) ? DELIVER_EXACTLY_ONCE : (templateHandle->packetFlags & PUBLISH_QOS_AT_LEAST_ONCE) ? DELIVER_AT_LEAST_ONCE : DELIVER_AT_MOST_ONCE;
+    }
+    return result;
+}
+
+int mqtt_codec_publishTemplateSegments(MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle, uint16_t packetId, const uint8_t* msgBuffer, size_t buffLen, uint8_t* header, size_t capacity, MQTT_BUFFER_SEGMENT* segments)
+{
+    int result;
+    /* Codes_SRS_MQTT_CODEC_07_061: [If templateHandle or segments is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTemplate_into shall return 0 and mqtt_codec_publishTemplateSegments shall return a non-zero value.] */
+    if (templateHandle == NULL || segments == NULL || (msgBuffer == NULL && buffLen > 0) || buffLen > MAX_SEND_SIZE)
+    {
+        result = __LINE__;
+    }
+    else if (templateHandle->variableHeaderLen + buffLen > MAX_REMAINING_LENGTH)
+    {
+        result = __LINE__;
+    }
+    else if (header == NULL || capacity < calculateHeaderLength(templateHandle->variableHeaderLen + buffLen, buffLen))
+    {
+        /* Codes_SRS_MQTT_CODEC_07_104: [If header is NULL or capacity is smaller than the header of the packet then mqtt_codec_publishTemplateSegments shall return a non-zero value.] */
+        LOG(LOG_ERROR, LOG_LINE, "Publish template header storage is too small");
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_063: [mqtt_codec_publishTemplateSegments shall build the fixed header, the variable header and packetId in header without writing to the template, and set segments[0] to the header and segments[1] to msgBuffer without copying the payload.] */
+        uint8_t* iterator = header + writeTemplateFixedHeader(header, templateHandle, buffLen);
+        (void)memcpy(iterator, templateHandle->variableHeader, templateHandle->variableHeaderLen);
+        iterator += templateHandle->variableHeaderLen;
+        if (templateHandle->hasPacketId)
+        {
+            iterator[-2] = (uint8_t)(packetId >> 8);
+            iterator[-1] = (uint8_t)(packetId & 0xff);
+        }
+
+        segments[0].data = header;
+        segments[0].length = (size_t)(iterator - header);
+        segments[1].data = msgBuffer;
+        segments[1].length = buffLen;
+        result = 0;
+    }
+    return result;
+}
+
+size_t mqtt_codec_publishReserve_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, size_t maxLen)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_064: [If topicName is NULL or maxLen is greater than MAX_SEND_SIZE then mqtt_codec_publishReserve_into shall return 0.] */
+    if (topicName == NULL || maxLen > MAX_SEND_SIZE)
+    {
+        result = 0;
+    }
+    else
+    {
+        PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
+        publishInfo.topicName = topicName;
+        publishInfo.packetId = packetId;
+        publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgLen = maxLen;
+
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0 || remainLen > MAX_REMAINING_LENGTH)
+        {
+            result = 0;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_065: [mqtt_codec_publishReserve_into shall return MQTT_MAX_FIXED_HEADER_SIZE plus the variable header length plus maxLen and shall not write to buffer if buffer is NULL or capacity is smaller than that.] */
+            result = MQTT_MAX_FIXED_HEADER_SIZE + remainLen;
+            if (buffer != NULL && result <= capacity)
+            {
+                /* Codes_SRS_MQTT_CODEC_07_066: [mqtt_codec_publishReserve_into shall store the PUBLISH type and flags in the first byte of buffer and write the variable header after MQTT_MAX_FIXED_HEADER_SIZE bytes, leaving the last maxLen bytes for the payload.] */
+                uint8_t* iterator = buffer + MQTT_MAX_FIXED_HEADER_SIZE;
+                buffer[0] = (uint8_t)PUBLISH_TYPE | calculatePublishFlags(qosValue, duplicateMsg, serverRetain);
+                writePublishVariableHeader(&iterator, &publishInfo);
+            }
+        }
+    }
+    return result;
+}
+
+size_t mqtt_codec_publishCommit(uint8_t* buffer, size_t reservedLen, size_t maxLen, size_t actualLen, size_t* packetOffset)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_067: [If buffer or packetOffset is NULL, if reservedLen cannot hold the fixed header room and maxLen bytes or if actualLen is greater than maxLen then mqtt_codec_publishCommit shall return 0.] */
+    if (buffer == NULL || packetOffset == NULL || reservedLen < MQTT_MAX_FIXED_HEADER_SIZE || maxLen > reservedLen - MQTT_MAX_FIXED_HEADER_SIZE || actualLen > maxLen)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_068: [mqtt_codec_publishCommit shall write the fixed header for actualLen bytes of payload so that it ends where the variable header starts, set packetOffset to the start of the packet and return the packet length.] */
+        size_t remainLen = reservedLen - MQTT_MAX_FIXED_HEADER_SIZE - maxLen + actualLen;
+        size_t fixedHeaderLen = FIXED_HEADER_TYPE_SIZE + calculateRemainingLengthBytes(remainLen);
+        uint8_t packetByte = buffer[0];
+        uint8_t* iterator = buffer + MQTT_MAX_FIXED_HEADER_SIZE - fixedHeaderLen;
+        writeFixedHeader(&iterator, (CONTROL_PACKET_TYPE)PACKET_TYPE_BYTE(packetByte), FLAG_VALUE_BYTE(packetByte), remainLen);
+
+        *packetOffset = MQTT_MAX_FIXED_HEADER_SIZE - fixedHeaderLen;
+        result = fixedHeaderLen + remainLen;
+    }
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_publishAck(uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_013: [On success mqtt_codec_publishAck shall return a BUFFER_HANDLE representation of a MQTT PUBACK packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_014 : [If any error is encountered then mqtt_codec_publishAck shall return NULL.] */
+    BUFFER_HANDLE result = constructPublishReply(PUBACK_TYPE, 0, packetId);
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_publishReceived(uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_015: [On success mqtt_codec_publishRecieved shall return a BUFFER_HANDLE representation of a MQTT PUBREC packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_016 : [If any error is encountered then mqtt_codec_publishRecieved shall return NULL.] */
+    BUFFER_HANDLE result = constructPublishReply(PUBREC_TYPE, 0, packetId);
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_publishRelease(uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_017: [On success mqtt_codec_publishRelease shall return a BUFFER_HANDLE representation of a MQTT PUBREL packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_018 : [If any error is encountered then mqtt_codec_publishRelease shall return NULL.] */
+    BUFFER_HANDLE result = constructPublishReply(PUBREL_TYPE, 2, packetId);
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_publishComplete(uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_019: [On success mqtt_codec_publishComplete shall return a BUFFER_HANDLE representation of a MQTT PUBCOMP packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_020 : [If any error is encountered then mqtt_codec_publishComplete shall return NULL.] */
+    BUFFER_HANDLE result = constructPublishReply(PUBCOMP_TYPE, 0, packetId);
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_ping()
+{
+    /* Codes_SRS_MQTT_CODEC_07_021: [On success mqtt_codec_ping shall construct a BUFFER_HANDLE that represents a MQTT PINGREQ packet.] */
+    /* Codes_SRS_MQTT_CODEC_07_022: [If any error is encountered mqtt_codec_ping shall return NULL.] */
+    uint8_t* iterator;
+    BUFFER_HANDLE result = constructControlPacket(PINGREQ_TYPE, 0, 0, &iterator);
+    return result;
+}
+
+BUFFER_HANDLE mqtt_codec_subscribe(uint16_t packetId, SUBSCRIBE_PAYLOAD* subscribeList, size_t count)
+{
+    BUFFER_HANDLE result;
+    /* Codes_SRS_MQTT_CODEC_07_023: [If the parameters subscribeList is NULL or if count is 0 then mqtt_codec_subscribe shall return NULL.] */
+    if (subscribeList == NULL || count == 0)
+    {
+        result = NULL;
+    }
+    else
+    {
+        size_t remainLen = 0;
+        /* Codes_SRS_MQTT_CODEC_07_024: [mqtt_codec_subscribe shall iterate through count items in the subscribeList.] */
+        if (calculateSubscribeLength(subscribeList, count, &remainLen) != 0)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
+            result = NULL;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_026: [mqtt_codec_subscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.]*/
+            uint8_t* iterator;
+            result = constructControlPacket(SUBSCRIBE_TYPE, SUBSCRIBE_FIXED_HEADER_FLAG, remainLen, &iterator);
+            if (result != NULL)
+            {
+                writeSubscribePacketData(&iterator, packetId, subscribeList, count);
+            }
+        }
+    }
+    return result;
+}
+
 BUFFER_HANDLE mqtt_codec_unsubscribe(uint16_t packetId, const char** unsubscribeList, size_t count)
 {
     BUFFER_HANDLE result;
@@ -839,40 +1348,237 @@ BUFFER_HANDLE mqtt_codec_unsubscribe(uint16_t packetId, const char** unsubscribe
     }
     else
     {
-        /* Codes_SRS_MQTT_CODEC_07_030: [mqtt_codec_unsubscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.] */
-        result = BUFFER_new();
-        if (result != NULL)
+        size_t remainLen = 0;
+        /* Codes_SRS_MQTT_CODEC_07_028: [mqtt_codec_unsubscribe shall iterate through count items in the unsubscribeList.] */
+        if (calculateUnsubscribeLength(unsubscribeList, count, &remainLen) != 0)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
+            result = NULL;
+        }
+        else
         {
-            if (constructSubscibeTypeVariableHeader(result, packetId) != 0)
+            /* Codes_SRS_MQTT_CODEC_07_030: [mqtt_codec_unsubscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.] */
+            uint8_t* iterator;
+            result = constructControlPacket(UNSUBSCRIBE_TYPE, UNSUBSCRIBE_FIXED_HEADER_FLAG, remainLen, &iterator);
+            if (result != NULL)
             {
-                /* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-                BUFFER_delete(result);
-                result = NULL;
+                writeUnsubscribePacketData(&iterator, packetId, unsubscribeList, count);
             }
-            else
+        }
+    }
+    return result;
+}
+
+const uint8_t* mqtt_codec_pingPacket(void)
+{
+    /* Codes_SRS_MQTT_CODEC_07_047: [mqtt_codec_pingPacket shall return a pointer to the constant MQTT_PING_PACKET_SIZE byte MQTT PINGREQ packet.] */
+    return PINGREQ_PACKET;
+}
+
+const uint8_t* mqtt_codec_disconnectPacket(void)
+{
+    /* Codes_SRS_MQTT_CODEC_07_048: [mqtt_codec_disconnectPacket shall return a pointer to the constant MQTT_DISCONNECT_PACKET_SIZE byte MQTT DISCONNECT packet.] */
+    return DISCONNECT_PACKET;
+}
+
+size_t mqtt_codec_connect_into(uint8_t* buffer, size_t capacity, const MQTT_CLIENT_OPTIONS* mqttOptions)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_042: [If mqttOptions is NULL or the options fail the same validation as mqtt_codec_connect then mqtt_codec_connect_into shall return 0.] */
+    if (mqttOptions == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        CONNECT_LENGTH_INFO connectInfo;
+        size_t remainLen = 0;
+        if (calculateConnectLength(mqttOptions, &connectInfo, &remainLen) != 0)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_042: [If mqttOptions is NULL or the options fail the same validation as mqtt_codec_connect then mqtt_codec_connect_into shall return 0.] */
+            result = 0;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+            /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+            uint8_t* iterator;
+            result = constructControlPacketInto(buffer, capacity, CONNECT_TYPE, 0, remainLen, &iterator);
+            if (iterator != NULL)
             {
-                /* Codes_SRS_MQTT_CODEC_07_028: [mqtt_codec_unsubscribe shall iterate through count items in the unsubscribeList.] */
-                if (addListItemsToUnsubscribePacket(result, unsubscribeList, count) != 0)
-                {
-                    /* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-                    BUFFER_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    if (constructFixedHeader(result, UNSUBSCRIBE_TYPE, UNSUBSCRIBE_FIXED_HEADER_FLAG) != 0)
-                    {
-                        /* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-                        BUFFER_delete(result);
-                        result = NULL;
-                    }
-                }
+                writeConnectPacketData(&iterator, mqttOptions, &connectInfo);
+            }
+        }
+    }
+    return result;
+}
+
+size_t mqtt_codec_disconnect_into(uint8_t* buffer, size_t capacity)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    uint8_t* iterator;
+    return constructControlPacketInto(buffer, capacity, DISCONNECT_TYPE, 0, 0, &iterator);
+}
+
+size_t mqtt_codec_publish_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, const uint8_t* msgBuffer, size_t buffLen)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_045: [If topicName is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publish_into shall return 0.] */
+    if (topicName == NULL || (msgBuffer == NULL && buffLen > 0) || buffLen > MAX_SEND_SIZE)
+    {
+        result = 0;
+    }
+    else
+    {
+        PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
+        publishInfo.topicName = topicName;
+        publishInfo.packetId = packetId;
+        publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgBuffer = msgBuffer;
+        publishInfo.msgLen = buffLen;
+
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_045: [If topicName is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publish_into shall return 0.] */
+            result = 0;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+            /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+            uint8_t* iterator;
+            result = constructControlPacketInto(buffer, capacity, PUBLISH_TYPE, calculatePublishFlags(qosValue, duplicateMsg, serverRetain), remainLen, &iterator);
+            if (iterator != NULL)
+            {
+                writePublishPacketData(&iterator, &publishInfo);
+            }
+        }
+    }
+    return result;
+}
+
+size_t mqtt_codec_publishTopic_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, MQTT_TOPIC_HANDLE topicHandle, const uint8_t* msgBuffer, size_t buffLen)
+{
+    size_t result;
+    /* Codes_SRS_MQTT_CODEC_07_055: [If topicHandle is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall fail.] */
+    if (topicHandle == NULL || (msgBuffer == NULL && buffLen > 0) || buffLen > MAX_SEND_SIZE)
+    {
+        result = 0;
+    }
+    else
+    {
+        PUBLISH_HEADER_INFO publishInfo = { 0 };
+        size_t remainLen = 0;
+        publishInfo.encodedTopic = topicHandle->encodedTopic;
+        publishInfo.topicLen = topicHandle->topicLen;
+        publishInfo.packetId = packetId;
+        publishInfo.qualityOfServiceValue = qosValue;
+        publishInfo.msgBuffer = msgBuffer;
+        publishInfo.msgLen = buffLen;
+
+        if (calculatePublishLength(&publishInfo, &remainLen) != 0)
+        {
+            result = 0;
+        }
+        else
+        {
+            /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+            /* Codes_SRS_MQTT_CODEC_07_056: [mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall copy the pre-encoded topic from topicHandle and shall produce the same packet as mqtt_codec_publish and mqtt_codec_publish_into.] */
+            uint8_t* iterator;
+            result = constructControlPacketInto(buffer, capacity, PUBLISH_TYPE, calculatePublishFlags(qosValue, duplicateMsg, serverRetain), remainLen, &iterator);
+            if (iterator != NULL)
+            {
+                writePublishPacketData(&iterator, &publishInfo);
             }
         }
     }
     return result;
 }
 
+size_t mqtt_codec_publishAck_into(uint8_t* buffer, size_t capacity, uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    return constructPublishReplyInto(buffer, capacity, PUBACK_TYPE, 0, packetId);
+}
+
+size_t mqtt_codec_publishReceived_into(uint8_t* buffer, size_t capacity, uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    return constructPublishReplyInto(buffer, capacity, PUBREC_TYPE, 0, packetId);
+}
+
+size_t mqtt_codec_publishRelease_into(uint8_t* buffer, size_t capacity, uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    return constructPublishReplyInto(buffer, capacity, PUBREL_TYPE, 2, packetId);
+}
+
+size_t mqtt_codec_publishComplete_into(uint8_t* buffer, size_t capacity, uint16_t packetId)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    return constructPublishReplyInto(buffer, capacity, PUBCOMP_TYPE, 0, packetId);
+}
+
+size_t mqtt_codec_ping_into(uint8_t* buffer, size_t capacity)
+{
+    /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+    /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+    uint8_t* iterator;
+    return constructControlPacketInto(buffer, capacity, PINGREQ_TYPE, 0, 0, &iterator);
+}
+
+size_t mqtt_codec_subscribe_into(uint8_t* buffer, size_t capacity, uint16_t packetId, SUBSCRIBE_PAYLOAD* subscribeList, size_t count)
+{
+    size_t result;
+    size_t remainLen = 0;
+    /* Codes_SRS_MQTT_CODEC_07_046: [If subscribeList or unsubscribeList is NULL, if count is 0 or if any topic is longer than 65535 bytes then mqtt_codec_subscribe_into and mqtt_codec_unsubscribe_into shall return 0.] */
+    if (subscribeList == NULL || count == 0 || calculateSubscribeLength(subscribeList, count, &remainLen) != 0)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+        /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+        uint8_t* iterator;
+        result = constructControlPacketInto(buffer, capacity, SUBSCRIBE_TYPE, SUBSCRIBE_FIXED_HEADER_FLAG, remainLen, &iterator);
+        if (iterator != NULL)
+        {
+            writeSubscribePacketData(&iterator, packetId, subscribeList, count);
+        }
+    }
+    return result;
+}
+
+size_t mqtt_codec_unsubscribe_into(uint8_t* buffer, size_t capacity, uint16_t packetId, const char** unsubscribeList, size_t count)
+{
+    size_t result;
+    size_t remainLen = 0;
+    /* Codes_SRS_MQTT_CODEC_07_046: [If subscribeList or unsubscribeList is NULL, if count is 0 or if any topic is longer than 65535 bytes then mqtt_codec_subscribe_into and mqtt_codec_unsubscribe_into shall return 0.] */
+    if (unsubscribeList == NULL || count == 0 || calculateUnsubscribeLength(unsubscribeList, count, &remainLen) != 0)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+        /* Codes_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+        uint8_t* iterator;
+        result = constructControlPacketInto(buffer, capacity, UNSUBSCRIBE_TYPE, UNSUBSCRIBE_FIXED_HEADER_FLAG, remainLen, &iterator);
+        if (iterator != NULL)
+        {
+            writeUnsubscribePacketData(&iterator, packetId, unsubscribeList, count);
+        }
+    }
+    return result;
+}
+
 int mqtt_codec_bytesReceived(MQTTCODEC_HANDLE handle, const unsigned char* buffer, size_t size)
 {
     int result;
@@ -910,43 +1616,128 @@ int mqtt_codec_bytesReceived(MQTTCODEC_HANDLE handle, const unsigned char* buffe
                         codec_Data->currPacket = PACKET_TYPE_ERROR;
                         result = __LINE__;
                     }
-                    if (codec_Data->currPacket == PINGRESP_TYPE)
+                    else if (codec_Data->codecState == CODEC_STATE_VAR_HEADER && codec_Data->maxPacketSize > 0 && codec_Data->packetLength > codec_Data->maxPacketSize)
+                    {
+                        beginDiscard(codec_Data);
+                    }
+                    else if (codec_Data->codecState == CODEC_STATE_VAR_HEADER && codec_Data->currPacket == PUBLISH_TYPE && codec_Data->publishBegin != NULL &&
+                        codec_Data->packetLength >= codec_Data->streamThreshold)
+                    {
+                        /* Codes_SRS_MQTT_CODEC_07_077: [When streaming is on, a PUBLISH whose remaining length is at least threshold shall be parsed incrementally instead of being buffered.] */
+                        if (beginPublishStream(codec_Data) != 0)
+                        {
+                            /* Codes_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+                            codec_Data->currPacket = PACKET_TYPE_ERROR;
+                            result = __LINE__;
+                        }
+                    }
+                    else if (codec_Data->codecState == CODEC_STATE_VAR_HEADER && codec_Data->packetLength == 0)
                     {
+                        // Packets without a body, such as PINGRESP, are complete once the remaining length is read
                         /* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-                        completePacketData(codec_Data);
+                        completePacketData(codec_Data, NULL, 0);
                     }
                 }
             }
             else if (codec_Data->codecState == CODEC_STATE_VAR_HEADER)
             {
-                if (codec_Data->headerData == NULL)
+                if (codec_Data->bufferOffset == 0 && size - index >= codec_Data->packetLength)
                 {
-                    codec_Data->codecState = CODEC_STATE_PAYLOAD;
+                    /* Codes_SRS_MQTT_CODEC_07_070: [If the whole packet body is contiguous in buffer then mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function with a pointer into buffer and shall not copy the packet.] */
+                    const uint8_t* packetData = buffer + index;
+
+                    // The loop moves past the last byte of the packet
+                    index += codec_Data->packetLength - 1;
+
+                    /* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+                    completePacketData(codec_Data, packetData, codec_Data->packetLength);
+                }
+                /* Codes_SRS_MQTT_CODEC_07_071: [If the packet body spans more than one call then mqtt_codec_bytesReceived shall reassemble it in a buffer owned by the codec.] */
+                /* Codes_SRS_MQTT_CODEC_07_072: [The reassembly buffer shall be reused for subsequent packets and only reallocated when a packet does not fit in it.] */
+                else if (codec_Data->bufferOffset == 0 && ensureReassemblyCapacity(codec_Data, codec_Data->packetLength) != 0)
+                {
+                    /* Codes_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+                    codec_Data->currPacket = PACKET_TYPE_ERROR;
+                    result = __LINE__;
                 }
                 else
                 {
-                    uint8_t* dataBytes = BUFFER_u_char(codec_Data->headerData);
-                    if (dataBytes == NULL)
+                    /* Codes_SRS_MQTT_CODEC_07_069: [Once the remaining length of a packet is known mqtt_codec_bytesReceived shall copy all of the packet bytes available in buffer in a single operation.] */
+                    size_t copyLen = codec_Data->packetLength - codec_Data->bufferOffset;
+                    if (copyLen > size - index)
                     {
-                        /* Codes_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
-                        codec_Data->currPacket = PACKET_TYPE_ERROR;
-                        result = __LINE__;
+                        copyLen = size - index;
                     }
-                    else
-                    {
-                        // Increment the data
-                        dataBytes += codec_Data->bufferOffset++;
-                        *dataBytes = iterator;
+                    (void)memcpy(codec_Data->reassemblyBuffer + codec_Data->bufferOffset, buffer + index, copyLen);
+                    codec_Data->bufferOffset += copyLen;
 
-                        size_t totalLen = BUFFER_length(codec_Data->headerData);
-                        if (codec_Data->bufferOffset >= totalLen)
-                        {
-                            /* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-                            completePacketData(codec_Data);
-                        }
+                    // The loop moves past the last copied byte
+                    index += copyLen - 1;
+
+                    if (codec_Data->bufferOffset >= codec_Data->packetLength)
+                    {
+                        /* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+                        completePacketData(codec_Data, codec_Data->reassemblyBuffer, codec_Data->packetLength);
                     }
                 }
             }
+            else if (codec_Data->codecState == CODEC_STATE_PUBLISH_HEADER)
+            {
+                size_t copyLen = codec_Data->streamHeaderLength - codec_Data->bufferOffset;
+                if (copyLen > size - index)
+                {
+                    copyLen = size - index;
+                }
+                (void)memcpy(codec_Data->reassemblyBuffer + codec_Data->bufferOffset, buffer + index, copyLen);
+                codec_Data->bufferOffset += copyLen;
+
+                // The loop moves past the last copied byte
+                index += copyLen - 1;
+
+                if (codec_Data->bufferOffset == codec_Data->streamHeaderLength && processPublishStreamHeader(codec_Data) != 0)
+                {
+                    /* Codes_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+                    codec_Data->currPacket = PACKET_TYPE_ERROR;
+                    result = __LINE__;
+                }
+            }
+            else if (codec_Data->codecState == CODEC_STATE_PAYLOAD)
+            {
+                /* Codes_SRS_MQTT_CODEC_07_079: [mqtt_codec_bytesReceived shall pass the payload bytes of a streamed PUBLISH available in buffer to the ON_PUBLISH_CHUNK_CALLBACK function without copying them.] */
+                size_t chunkLen = codec_Data->packetLength - codec_Data->bufferOffset;
+                if (chunkLen > size - index)
+                {
+                    chunkLen = size - index;
+                }
+                codec_Data->publishChunk(codec_Data->callContext, buffer + index, chunkLen);
+                codec_Data->bufferOffset += chunkLen;
+
+                // The loop moves past the last byte passed on
+                index += chunkLen - 1;
+
+                if (codec_Data->bufferOffset == codec_Data->packetLength)
+                {
+                    completePublishStream(codec_Data);
+                }
+            }
+            else if (codec_Data->codecState == CODEC_STATE_DISCARD)
+            {
+                size_t skipLen = codec_Data->packetLength - codec_Data->bufferOffset;
+                if (skipLen > size - index)
+                {
+                    skipLen = size - index;
+                }
+                codec_Data->bufferOffset += skipLen;
+
+                // The loop moves past the last skipped byte
+                index += skipLen - 1;
+
+                if (codec_Data->bufferOffset == codec_Data->packetLength)
+                {
+                    /* Codes_SRS_MQTT_CODEC_07_085: [Once the last byte of a discarded packet has been skipped mqtt_codec_bytesReceived shall continue with the next packet.] */
+                    resetPacketState(codec_Data);
+                }
+            }
             else
             {
                 /* Codes_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
@@ -957,3 +1748,257 @@ int mqtt_codec_bytesReceived(MQTTCODEC_HANDLE handle, const unsigned char* buffe
     }
     return result;
 }
+
+void mqtt_codec_reset(MQTTCODEC_HANDLE handle)
+{
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_105: [If handle is NULL then mqtt_codec_reset shall do nothing.] */
+    if (codec_Data != NULL)
+    {
+        /* Codes_SRS_MQTT_CODEC_07_106: [mqtt_codec_reset shall drop the error state and any partly decoded packet so the next byte passed to mqtt_codec_bytesReceived starts a new packet.] */
+        codec_Data->remainLenIndex = 0;
+        memset(codec_Data->storeRemainLen, 0, 4 * sizeof(uint8_t));
+        resetPacketState(codec_Data);
+    }
+}
+
+int mqtt_codec_setReassemblyHighWaterMark(MQTTCODEC_HANDLE handle, size_t highWaterMark)
+{
+    int result;
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_074: [If the parameter handle is NULL then mqtt_codec_setReassemblyHighWaterMark shall return a non-zero value.] */
+    if (codec_Data == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_075: [mqtt_codec_setReassemblyHighWaterMark shall store highWaterMark and return zero, freeing a larger reassembly buffer if no packet is being reassembled.] */
+        codec_Data->reassemblyHighWaterMark = highWaterMark;
+        if (codec_Data->bufferOffset == 0 && codec_Data->reassemblyCapacity > highWaterMark)
+        {
+            releaseReassemblyBuffer(codec_Data);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_codec_setPublishStreaming(MQTTCODEC_HANDLE handle, size_t threshold, ON_PUBLISH_BEGIN_CALLBACK publishBegin, ON_PUBLISH_CHUNK_CALLBACK publishChunk, ON_PUBLISH_END_CALLBACK publishEnd)
+{
+    int result;
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_076: [If handle is NULL, or only some of publishBegin, publishChunk and publishEnd are NULL, then mqtt_codec_setPublishStreaming shall return a non-zero value.] */
+    if (codec_Data == NULL ||
+        !((publishBegin == NULL && publishChunk == NULL && publishEnd == NULL) || (publishBegin != NULL && publishChunk != NULL && publishEnd != NULL)))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_081: [mqtt_codec_setPublishStreaming shall store the callbacks and threshold, which take effect from the next packet, and return zero. NULL callbacks turn streaming off.] */
+        codec_Data->publishBegin = publishBegin;
+        codec_Data->publishChunk = publishChunk;
+        codec_Data->publishEnd = publishEnd;
+        codec_Data->streamThreshold = threshold;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_codec_setMaxPacketSize(MQTTCODEC_HANDLE handle, size_t maxPacketSize, ON_PACKET_DISCARDED_CALLBACK packetDiscarded)
+{
+    int result;
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_082: [If the parameter handle is NULL then mqtt_codec_setMaxPacketSize shall return a non-zero value.] */
+    if (codec_Data == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_083: [mqtt_codec_setMaxPacketSize shall store maxPacketSize and packetDiscarded, which take effect from the next packet, and return zero. A maxPacketSize of 0 removes the limit.] */
+        codec_Data->maxPacketSize = maxPacketSize;
+        codec_Data->packetDiscarded = packetDiscarded;
+        result = 0;
+    }
+    return result;
+}
+
+uint64_t mqtt_codec_getDiscardedPacketCount(MQTTCODEC_HANDLE handle)
+{
+    uint64_t result;
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_086: [If the parameter handle is NULL then mqtt_codec_getDiscardedPacketCount shall return 0.] */
+    if (codec_Data == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_087: [mqtt_codec_getDiscardedPacketCount shall return the number of packets discarded for exceeding the maximum packet size.] */
+        result = codec_Data->discardedPacketCount;
+    }
+    return result;
+}
+
+int mqtt_codec_parse(MQTTCODEC_HANDLE handle, const uint8_t* buffer, size_t size, size_t* consumed, MQTT_PACKET_VIEW* packets, size_t maxPackets, size_t* packetCount)
+{
+    int result;
+    MQTTCODEC_INSTANCE* codec_Data = (MQTTCODEC_INSTANCE*)handle;
+    /* Codes_SRS_MQTT_CODEC_07_088: [If the parameters handle, consumed, packets or packetCount are NULL, or buffer is NULL and size is not zero, then mqtt_codec_parse shall return a non-zero value.] */
+    if (codec_Data == NULL || consumed == NULL || packets == NULL || packetCount == NULL || (buffer == NULL && size > 0))
+    {
+        result = __LINE__;
+    }
+    /* Codes_SRS_MQTT_CODEC_07_089: [If a packet passed to mqtt_codec_bytesReceived is only partly decoded then mqtt_codec_parse shall return a non-zero value.] */
+    else if (codec_Data->currPacket != PACKET_TYPE_ERROR && (codec_Data->codecState != CODEC_STATE_FIXED_HEADER || codec_Data->currPacket != UNKNOWN_TYPE))
+    {
+        LOG(LOG_ERROR, LOG_LINE, "mqtt_codec_parse cannot be used while mqtt_codec_bytesReceived is decoding a packet");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t offset = 0;
+        if (codec_Data->currPacket == PACKET_TYPE_ERROR)
+        {
+            /* Codes_SRS_MQTT_CODEC_07_107: [If an earlier call to mqtt_codec_bytesReceived failed then mqtt_codec_parse shall reset the codec as mqtt_codec_reset does and decode buffer from its first byte.] */
+            mqtt_codec_reset(codec_Data);
+        }
+        result = 0;
+        *consumed = 0;
+        *packetCount = 0;
+
+        /* Codes_SRS_MQTT_CODEC_07_091: [mqtt_codec_parse shall stop when maxPackets packets have been decoded or the next packet is not complete in buffer, the bytes of that packet are not consumed.] */
+        while (result == 0 && *packetCount < maxPackets && size - offset > FIXED_HEADER_TYPE_SIZE)
+        {
+            size_t remainLen;
+            size_t lengthBytes;
+            if (decodeRemainingLength(buffer + offset + FIXED_HEADER_TYPE_SIZE, size - offset - FIXED_HEADER_TYPE_SIZE, &remainLen, &lengthBytes) != 0)
+            {
+                /* Codes_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+                LOG(LOG_ERROR, LOG_LINE, "Invalid remaining length");
+                result = __LINE__;
+            }
+            else if (lengthBytes == 0)
+            {
+                break;
+            }
+            else if (codec_Data->maxPacketSize > 0 && remainLen > codec_Data->maxPacketSize)
+            {
+                /* Codes_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+                LOG(LOG_ERROR, LOG_LINE, "Packet of %lu bytes is larger than the maximum packet size", (unsigned long)remainLen);
+                result = __LINE__;
+            }
+            else if (size - offset - FIXED_HEADER_TYPE_SIZE - lengthBytes < remainLen)
+            {
+                break;
+            }
+            else
+            {
+                /* Codes_SRS_MQTT_CODEC_07_090: [mqtt_codec_parse shall describe each complete packet at the start of buffer in packets with its type, flags, variable header and payload, set packetCount and consumed and return zero.] */
+                /* Codes_SRS_MQTT_CODEC_07_092: [The header and payload of each MQTT_PACKET_VIEW shall point into buffer, mqtt_codec_parse shall not copy or allocate.] */
+                MQTT_PACKET_VIEW* view = &packets[*packetCount];
+                const uint8_t* body = buffer + offset + FIXED_HEADER_TYPE_SIZE + lengthBytes;
+                view->packetType = processControlPacketType(buffer[offset], &view->flags);
+                if (getVariableHeaderLength(view->packetType, view->flags, body, remainLen, &view->headerLength) != 0)
+                {
+                    /* Codes_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+                    LOG(LOG_ERROR, LOG_LINE, "Variable header is longer than the packet");
+                    result = __LINE__;
+                }
+                else
+                {
+                    view->header = body;
+                    view->payload = body + view->headerLength;
+                    view->payloadLength = remainLen - view->headerLength;
+                    offset += FIXED_HEADER_TYPE_SIZE + lengthBytes + remainLen;
+                    *consumed = offset;
+                    (*packetCount)++;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int mqtt_codec_decodeConnack(const uint8_t* data, size_t length, CONNECT_ACK* connack)
+{
+    int result;
+    /* Codes_SRS_MQTT_CODEC_07_094: [If data or connack is NULL, or length is less than 2, then mqtt_codec_decodeConnack shall return a non-zero value.] */
+    if (data == NULL || connack == NULL || length < CONNACK_VARIABLE_HEADER_SIZE)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_095: [mqtt_codec_decodeConnack shall set isSessionPresent from the first byte of data and returnCode from the second and return zero.] */
+        connack->isSessionPresent = (data[0] & CONNACK_SESSION_PRESENT_FLAG) != 0;
+        connack->returnCode = (CONNECT_RETURN_CODE)data[1];
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_codec_decodePublish(int flags, const uint8_t* data, size_t length, MQTT_PUBLISH_VIEW* publishView)
+{
+    int result;
+    int qosBits = (flags & (PUBLISH_QOS_AT_LEAST_ONCE | PUBLISH_QOS_EXACTLY_ONCE)) >> 1;
+    size_t topicLength = (data != NULL && length >= TOPIC_LENGTH_PREFIX_SIZE) ? (((size_t)data[0] << 8) | data[1]) : 0;
+    size_t headerLength = TOPIC_LENGTH_PREFIX_SIZE + topicLength + ((qosBits != 0) ? PACKET_ID_SIZE : 0);
+    /* Codes_SRS_MQTT_CODEC_07_096: [If data or publishView is NULL, the topic name is empty, the topic name and packet id do not fit in length or flags hold an invalid QOS then mqtt_codec_decodePublish shall return a non-zero value.] */
+    if (data == NULL || publishView == NULL || topicLength == 0 || headerLength > length || qosBits > DELIVER_EXACTLY_ONCE)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_097: [mqtt_codec_decodePublish shall point topicName and payload into data, set the packet id, QOS, duplicate and retain values and return zero.] */
+        publishView->topicName = (const char*)data + TOPIC_LENGTH_PREFIX_SIZE;
+        publishView->topicLength = topicLength;
+        publishView->packetId = (qosBits != 0) ? (uint16_t)((data[TOPIC_LENGTH_PREFIX_SIZE + topicLength] << 8) | data[TOPIC_LENGTH_PREFIX_SIZE + topicLength + 1]) : 0;
+        publishView->qosValue = (QOS_VALUE)qosBits;
+        publishView->isDuplicateMsg = (flags & PUBLISH_DUP_FLAG) != 0;
+        publishView->isRetained = (flags & PUBLISH_QOS_RETAIN) != 0;
+        publishView->payload = data + headerLength;
+        publishView->payloadLength = length - headerLength;
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_codec_decodeAck(const uint8_t* data, size_t length, uint16_t* packetId)
+{
+    int result;
+    /* Codes_SRS_MQTT_CODEC_07_098: [If data or packetId is NULL, or length is less than 2, then mqtt_codec_decodeAck shall return a non-zero value.] */
+    if (data == NULL || packetId == NULL || length < PACKET_ID_SIZE)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_099: [mqtt_codec_decodeAck shall read the packet id from the first two bytes of data and return zero.] */
+        *packetId = (uint16_t)((data[0] << 8) | data[1]);
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_codec_decodeSuback(const uint8_t* data, size_t length, MQTT_SUBACK_VIEW* subackView)
+{
+    int result;
+    /* Codes_SRS_MQTT_CODEC_07_100: [If data or subackView is NULL, or length is less than 2, then mqtt_codec_decodeSuback shall return a non-zero value.] */
+    if (data == NULL || subackView == NULL || length < PACKET_ID_SIZE)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTT_CODEC_07_101: [mqtt_codec_decodeSuback shall read the packet id, point returnCodes at the bytes that follow it in data and return zero.] */
+        subackView->packetId = (uint16_t)((data[0] << 8) | data[1]);
+        subackView->returnCodes = data + PACKET_ID_SIZE;
+        subackView->returnCodeCount = length - PACKET_ID_SIZE;
+        result = 0;
+    }
+    return result;
+}
@@ -0,0 +1,550 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "azure_umqtt_c/mqtt_event_loop.h"
+
+#define EVENT_LOOP_MAX_EVENTS           64
+#define EVENT_LOOP_MIN_CAPACITY         16
+#define EVENT_LOOP_NO_DEADLINE          UINT64_MAX
+#define EVENT_LOOP_RETRY_MS             1000
+#define EVENT_LOOP_HASH_MULTIPLIER      0x9E3779B97F4A7C15ULL
+
+typedef struct EVENT_LOOP_CLIENT_TAG
+{
+    // NULL once the client was removed from a callback while the loop runs
+    MQTT_CLIENT_HANDLE client;
+    int fd;
+    // Set while the socket is also registered for writability because the xio holds data it has not written
+    bool writeWatched;
+    uint64_t deadlineMs;
+    size_t heapIndex;
+    struct EVENT_LOOP_CLIENT_TAG* nextRemoved;
+} EVENT_LOOP_CLIENT;
+
+typedef struct MQTT_EVENT_LOOP_TAG
+{
+    int epollFd;
+    TICK_COUNTER_HANDLE tickCounter;
+    // Binary min heap of the registrations ordered by deadline, the earliest one decides how long epoll_wait may sleep
+    EVENT_LOOP_CLIENT** heap;
+    size_t heapCapacity;
+    size_t count;
+    // The registrations are found by client through slots, an open addressed table with at least twice as many slots as clients
+    EVENT_LOOP_CLIENT** slots;
+    size_t slotMask;
+    // Registrations removed during mqtt_event_loop_run_once are freed when it returns, the ready events may still point at them
+    EVENT_LOOP_CLIENT* removed;
+    bool running;
+    MQTT_EVENT_LOOP_STATS stats;
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+} MQTT_EVENT_LOOP;
+
+static size_t homeSlot(const MQTT_EVENT_LOOP* loop, MQTT_CLIENT_HANDLE client)
+{
+    // Client handles are allocations of the same size, a multiplicative hash spreads their regular addresses over the slots
+    return (size_t)(((uint64_t)(uintptr_t)client * EVENT_LOOP_HASH_MULTIPLIER) >> 32) & loop->slotMask;
+}
+
+static size_t findClientSlot(const MQTT_EVENT_LOOP* loop, MQTT_CLIENT_HANDLE client)
+{
+    size_t slot = homeSlot(loop, client);
+    while (loop->slots[slot] != NULL && loop->slots[slot]->client != client)
+    {
+        slot = (slot + 1) & loop->slotMask;
+    }
+    return slot;
+}
+
+static EVENT_LOOP_CLIENT* findClient(const MQTT_EVENT_LOOP* loop, MQTT_CLIENT_HANDLE client)
+{
+    return (loop->count == 0) ? NULL : loop->slots[findClientSlot(loop, client)];
+}
+
+static void removeClientSlot(MQTT_EVENT_LOOP* loop, MQTT_CLIENT_HANDLE client)
+{
+    size_t slot = findClientSlot(loop, client);
+    size_t next = slot;
+
+    // Backward shift deletion keeps every probe sequence unbroken without tombstones
+    loop->slots[slot] = NULL;
+    for (;;)
+    {
+        next = (next + 1) & loop->slotMask;
+        if (loop->slots[next] == NULL)
+        {
+            break;
+        }
+        size_t home = homeSlot(loop, loop->slots[next]->client);
+        if (((next - home) & loop->slotMask) >= ((next - slot) & loop->slotMask))
+        {
+            loop->slots[slot] = loop->slots[next];
+            loop->slots[next] = NULL;
+            slot = next;
+        }
+    }
+}
+
+// Makes room for one more registration in the heap and the slot table
+static int reserveClient(MQTT_EVENT_LOOP* loop)
+{
+    int result = 0;
+    if (loop->count == loop->heapCapacity)
+    {
+        size_t newCapacity = (loop->heapCapacity == 0) ? EVENT_LOOP_MIN_CAPACITY : loop->heapCapacity * 2;
+        EVENT_LOOP_CLIENT** newHeap = (EVENT_LOOP_CLIENT**)realloc(loop->heap, newCapacity * sizeof(EVENT_LOOP_CLIENT*));
+        if (newHeap == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure growing the event loop heap to %lu clients", (unsigned long)newCapacity);
+            result = __LINE__;
+        }
+        else
+        {
+            loop->heap = newHeap;
+            loop->heapCapacity = newCapacity;
+        }
+    }
+
+    if (result == 0 && (loop->count + 1) * 2 > loop->slotMask + 1)
+    {
+        size_t slotCount = (loop->slots == NULL) ? EVENT_LOOP_MIN_CAPACITY * 2 : (loop->slotMask + 1) * 2;
+        EVENT_LOOP_CLIENT** newSlots = (EVENT_LOOP_CLIENT**)malloc(slotCount * sizeof(EVENT_LOOP_CLIENT*));
+        if (newSlots == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure growing the event loop slots to %lu", (unsigned long)slotCount);
+            result = __LINE__;
+        }
+        else
+        {
+            EVENT_LOOP_CLIENT** oldSlots = loop->slots;
+            for (size_t index = 0; index < slotCount; index++)
+            {
+                newSlots[index] = NULL;
+            }
+            loop->slots = newSlots;
+            loop->slotMask = slotCount - 1;
+            for (size_t index = 0; index < loop->count; index++)
+            {
+                loop->slots[findClientSlot(loop, loop->heap[index]->client)] = loop->heap[index];
+            }
+            free(oldSlots);
+        }
+    }
+    return result;
+}
+
+static void swapHeapEntries(MQTT_EVENT_LOOP* loop, size_t first, size_t second)
+{
+    EVENT_LOOP_CLIENT* entry = loop->heap[first];
+    loop->heap[first] = loop->heap[second];
+    loop->heap[second] = entry;
+    loop->heap[first]->heapIndex = first;
+    loop->heap[second]->heapIndex = second;
+}
+
+// Moves the entry at index up or down until the heap order holds again
+static void restoreHeapOrder(MQTT_EVENT_LOOP* loop, size_t index)
+{
+    while (index > 0 && loop->heap[(index - 1) / 2]->deadlineMs > loop->heap[index]->deadlineMs)
+    {
+        swapHeapEntries(loop, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+    for (;;)
+    {
+        size_t smallest = index;
+        size_t child = index * 2 + 1;
+        if (child < loop->count && loop->heap[child]->deadlineMs < loop->heap[smallest]->deadlineMs)
+        {
+            smallest = child;
+        }
+        if (child + 1 < loop->count && loop->heap[child + 1]->deadlineMs < loop->heap[smallest]->deadlineMs)
+        {
+            smallest = child + 1;
+        }
+        if (smallest == index)
+        {
+            break;
+        }
+        swapHeapEntries(loop, index, smallest);
+        index = smallest;
+    }
+}
+
+static void removeHeapEntry(MQTT_EVENT_LOOP* loop, EVENT_LOOP_CLIENT* entry)
+{
+    size_t index = entry->heapIndex;
+    loop->count--;
+    if (index != loop->count)
+    {
+        loop->heap[index] = loop->heap[loop->count];
+        loop->heap[index]->heapIndex = index;
+        restoreHeapOrder(loop, index);
+    }
+}
+
+static void unregisterSocket(MQTT_EVENT_LOOP* loop, EVENT_LOOP_CLIENT* entry)
+{
+    if (entry->fd != -1)
+    {
+        // A socket the application already closed has left the epoll set by itself, so a failure here is not an error
+        (void)epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+        entry->fd = -1;
+        entry->writeWatched = false;
+    }
+}
+
+// Readability alone misses the rest of a partial write, which the xio only writes from xio_dowork once the socket takes it
+static void watchPendingSends(MQTT_EVENT_LOOP* loop, EVENT_LOOP_CLIENT* entry)
+{
+    size_t pendingSendCount;
+    bool sendPending;
+    if (mqtt_client_get_pending_send_count(entry->client, &pendingSendCount) != 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_get_pending_send_count failed");
+        sendPending = false;
+    }
+    else
+    {
+        sendPending = (pendingSendCount > 0);
+    }
+
+    if (sendPending != entry->writeWatched)
+    {
+        struct epoll_event event;
+        event.events = sendPending ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.ptr = entry;
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, entry->fd, &event) != 0)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: epoll_ctl failed to modify fd %d with errno %d", entry->fd, errno);
+        }
+        else
+        {
+            entry->writeWatched = sendPending;
+        }
+    }
+}
+
+static void serviceClient(MQTT_EVENT_LOOP* loop, EVENT_LOOP_CLIENT* entry, uint64_t currentMs)
+{
+    uint32_t timeoutMs;
+    mqtt_client_dowork(entry->client);
+
+    // The client may have been removed by one of its callbacks
+    if (entry->client != NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+        if (mqtt_client_get_dowork_timeout(entry->client, &timeoutMs) != 0)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Error: mqtt_client_get_dowork_timeout failed");
+            entry->deadlineMs = currentMs + EVENT_LOOP_RETRY_MS;
+        }
+        else if (timeoutMs == MQTT_CLIENT_NO_TIMEOUT)
+        {
+            entry->deadlineMs = EVENT_LOOP_NO_DEADLINE;
+        }
+        else
+        {
+            // Work that mqtt_client_dowork could not finish is tried again on the next tick instead of spinning on it
+            entry->deadlineMs = currentMs + ((timeoutMs == 0) ? 1 : timeoutMs);
+        }
+        restoreHeapOrder(loop, entry->heapIndex);
+
+        if (entry->fd != -1)
+        {
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_022: [After mqtt_client_dowork the socket of a client shall also be registered for writability while mqtt_client_get_pending_send_count reports sends the xio has not completed, and for readability only once they completed or when mqtt_client_get_pending_send_count fails.]*/
+            watchPendingSends(loop, entry);
+        }
+    }
+}
+
+MQTT_EVENT_LOOP_HANDLE mqtt_event_loop_create(void)
+{
+    MQTT_EVENT_LOOP* result = (MQTT_EVENT_LOOP*)malloc(sizeof(MQTT_EVENT_LOOP));
+    if (result == NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_002: [If any of them cannot be created mqtt_event_loop_create shall free what was created and return NULL.]*/
+        LOG(LOG_ERROR, LOG_LINE, "mqtt_event_loop_create failure: Allocation Failure");
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_001: [mqtt_event_loop_create shall allocate the loop, an epoll instance and a tickcounter and return the MQTT_EVENT_LOOP_HANDLE on success.]*/
+        result->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        result->tickCounter = NULL;
+        result->heap = NULL;
+        result->heapCapacity = 0;
+        result->count = 0;
+        result->slots = NULL;
+        result->slotMask = 0;
+        result->removed = NULL;
+        result->running = false;
+        result->stats.waitCount = 0;
+        result->stats.readyCount = 0;
+        result->stats.timerCount = 0;
+        if (result->epollFd == -1)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "mqtt_event_loop_create failure: epoll_create1 failed with errno %d", errno);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->tickCounter = tickcounter_create();
+            if (result->tickCounter == NULL)
+            {
+                LOG(LOG_ERROR, LOG_LINE, "mqtt_event_loop_create failure: tickcounter_create failure");
+                (void)close(result->epollFd);
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+void mqtt_event_loop_destroy(MQTT_EVENT_LOOP_HANDLE handle)
+{
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    /*Codes_SRS_MQTT_EVENT_LOOP_07_003: [If handle is NULL then mqtt_event_loop_destroy shall do nothing.]*/
+    if (loop != NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_004: [mqtt_event_loop_destroy shall close the epoll instance and free every registration without calling into the clients.]*/
+        for (size_t index = 0; index < loop->count; index++)
+        {
+            free(loop->heap[index]);
+        }
+        while (loop->removed != NULL)
+        {
+            EVENT_LOOP_CLIENT* entry = loop->removed;
+            loop->removed = entry->nextRemoved;
+            free(entry);
+        }
+        (void)close(loop->epollFd);
+        tickcounter_destroy(loop->tickCounter);
+        free(loop->slots);
+        free(loop->heap);
+        free(loop);
+    }
+}
+
+int mqtt_event_loop_add(MQTT_EVENT_LOOP_HANDLE handle, MQTT_CLIENT_HANDLE client, int fd)
+{
+    int result;
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    if (loop == NULL || client == NULL || fd < -1 || findClient(loop, client) != NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_005: [If handle or client is NULL, fd is below -1 or client was already added then mqtt_event_loop_add shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified mqtt_event_loop_add");
+        result = __LINE__;
+    }
+    else if (reserveClient(loop) != 0)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_007: [If any allocation fails mqtt_event_loop_add shall leave the loop unchanged and return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        EVENT_LOOP_CLIENT* entry = (EVENT_LOOP_CLIENT*)malloc(sizeof(EVENT_LOOP_CLIENT));
+        if (entry == NULL)
+        {
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_007: [If any allocation fails mqtt_event_loop_add shall leave the loop unchanged and return a non-zero value.]*/
+            LOG(LOG_ERROR, LOG_LINE, "Error: failure allocating an event loop registration");
+            result = __LINE__;
+        }
+        else
+        {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = entry;
+            entry->client = client;
+            entry->fd = fd;
+            entry->writeWatched = false;
+            entry->nextRemoved = NULL;
+
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_006: [When fd is not -1 mqtt_event_loop_add shall register it with epoll for readability, and if that fails it shall return a non-zero value.]*/
+            if (fd != -1 && epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                LOG(LOG_ERROR, LOG_LINE, "Error: epoll_ctl failed to add fd %d with errno %d", fd, errno);
+                free(entry);
+                result = __LINE__;
+            }
+            else
+            {
+                /*Codes_SRS_MQTT_EVENT_LOOP_07_008: [mqtt_event_loop_add shall make the client due so the next mqtt_event_loop_run_once calls mqtt_client_dowork for it, and return 0.]*/
+                entry->deadlineMs = 0;
+                entry->heapIndex = loop->count;
+                loop->heap[loop->count] = entry;
+                loop->slots[findClientSlot(loop, client)] = entry;
+                loop->count++;
+                restoreHeapOrder(loop, entry->heapIndex);
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+int mqtt_event_loop_remove(MQTT_EVENT_LOOP_HANDLE handle, MQTT_CLIENT_HANDLE client)
+{
+    int result;
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    EVENT_LOOP_CLIENT* entry = (loop == NULL || client == NULL) ? NULL : findClient(loop, client);
+    if (entry == NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_009: [If handle or client is NULL or client was not added then mqtt_event_loop_remove shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified mqtt_event_loop_remove");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_010: [mqtt_event_loop_remove shall unregister the socket of the client from epoll, forget the client and return 0.]*/
+        unregisterSocket(loop, entry);
+        removeClientSlot(loop, client);
+        removeHeapEntry(loop, entry);
+        if (loop->running)
+        {
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_011: [A client removed from a callback during mqtt_event_loop_run_once shall not be called again by that run.]*/
+            entry->client = NULL;
+            entry->nextRemoved = loop->removed;
+            loop->removed = entry;
+        }
+        else
+        {
+            free(entry);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_event_loop_schedule(MQTT_EVENT_LOOP_HANDLE handle, MQTT_CLIENT_HANDLE client)
+{
+    int result;
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    EVENT_LOOP_CLIENT* entry = (loop == NULL || client == NULL) ? NULL : findClient(loop, client);
+    if (entry == NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_012: [If handle or client is NULL or client was not added then mqtt_event_loop_schedule shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified mqtt_event_loop_schedule");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_013: [mqtt_event_loop_schedule shall make the client due so the next mqtt_event_loop_run_once calls mqtt_client_dowork for it and takes its deadline again, and return 0.]*/
+        entry->deadlineMs = 0;
+        restoreHeapOrder(loop, entry->heapIndex);
+        result = 0;
+    }
+    return result;
+}
+
+int mqtt_event_loop_run_once(MQTT_EVENT_LOOP_HANDLE handle, uint32_t maxWaitMs)
+{
+    int result;
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    uint64_t currentMs;
+    if (loop == NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_014: [If handle is NULL or tickcounter_get_current_ms fails then mqtt_event_loop_run_once shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified mqtt_event_loop_run_once");
+        result = __LINE__;
+    }
+    else if (tickcounter_get_current_ms(loop->tickCounter, &currentMs) != 0)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_014: [If handle is NULL or tickcounter_get_current_ms fails then mqtt_event_loop_run_once shall return a non-zero value.]*/
+        LOG(LOG_ERROR, LOG_LINE, "Error: tickcounter_get_current_ms failed");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_015: [mqtt_event_loop_run_once shall call epoll_wait with the smaller of maxWaitMs and the time left until the earliest client deadline, 0 when that deadline has been reached.]*/
+        uint64_t waitMs = (maxWaitMs > INT_MAX) ? INT_MAX : maxWaitMs;
+        if (loop->count > 0 && loop->heap[0]->deadlineMs != EVENT_LOOP_NO_DEADLINE)
+        {
+            if (loop->heap[0]->deadlineMs <= currentMs)
+            {
+                waitMs = 0;
+            }
+            else if (loop->heap[0]->deadlineMs - currentMs < waitMs)
+            {
+                waitMs = loop->heap[0]->deadlineMs - currentMs;
+            }
+        }
+
+        loop->running = true;
+        int eventCount = epoll_wait(loop->epollFd, loop->events, EVENT_LOOP_MAX_EVENTS, (int)waitMs);
+        loop->stats.waitCount++;
+        if (eventCount == -1 && errno != EINTR)
+        {
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_016: [If epoll_wait fails for any reason but EINTR then mqtt_event_loop_run_once shall return a non-zero value.]*/
+            LOG(LOG_ERROR, LOG_LINE, "Error: epoll_wait failed with errno %d", errno);
+            result = __LINE__;
+        }
+        else
+        {
+            // Keeps the time from before the wait if the tick counter fails now, the deadlines are then only taken early
+            (void)tickcounter_get_current_ms(loop->tickCounter, &currentMs);
+
+            /*Codes_SRS_MQTT_EVENT_LOOP_07_017: [mqtt_event_loop_run_once shall call mqtt_client_dowork for every client whose socket epoll reports, then for every client whose deadline has been reached, and return 0.]*/
+            for (int index = 0; index < eventCount; index++)
+            {
+                EVENT_LOOP_CLIENT* entry = (EVENT_LOOP_CLIENT*)loop->events[index].data.ptr;
+                if (entry->client != NULL)
+                {
+                    serviceClient(loop, entry, currentMs);
+                    loop->stats.readyCount++;
+                    if (entry->client != NULL && (loop->events[index].events & (EPOLLERR | EPOLLHUP)) != 0)
+                    {
+                        /*Codes_SRS_MQTT_EVENT_LOOP_07_019: [When epoll reports a hang up or an error on a socket mqtt_event_loop_run_once shall unregister it after calling mqtt_client_dowork and keep servicing the client at its deadlines.]*/
+                        // Level triggered epoll would report the dead socket on every wait until the application removes the client
+                        LOG(LOG_ERROR, LOG_LINE, "Error: fd %d hung up, the client is only serviced at its deadlines", entry->fd);
+                        unregisterSocket(loop, entry);
+                    }
+                }
+            }
+
+            // serviceClient always moves the deadline past currentMs, so every due client is called once
+            while (loop->count > 0 && loop->heap[0]->deadlineMs <= currentMs)
+            {
+                serviceClient(loop, loop->heap[0], currentMs);
+                loop->stats.timerCount++;
+            }
+            result = 0;
+        }
+        loop->running = false;
+
+        while (loop->removed != NULL)
+        {
+            EVENT_LOOP_CLIENT* entry = loop->removed;
+            loop->removed = entry->nextRemoved;
+            free(entry);
+        }
+    }
+    return result;
+}
+
+int mqtt_event_loop_get_stats(MQTT_EVENT_LOOP_HANDLE handle, MQTT_EVENT_LOOP_STATS* loopStats)
+{
+    int result;
+    MQTT_EVENT_LOOP* loop = (MQTT_EVENT_LOOP*)handle;
+    if (loop == NULL || loopStats == NULL)
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_020: [If handle or loopStats is NULL then mqtt_event_loop_get_stats shall return a non-zero value.]*/
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MQTT_EVENT_LOOP_07_021: [mqtt_event_loop_get_stats shall copy the number of epoll_wait calls and of mqtt_client_dowork calls made for a ready socket and for a reached deadline into loopStats and return 0.]*/
+        *loopStats = loop->stats;
+        result = 0;
+    }
+    return result;
+}
@@ -2,8 +2,29 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <string.h>
 #include "azure_umqtt_c/mqtt_message.h"
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/refcount.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+// Messages whose topic name and payload take up to MQTT_MESSAGE_INLINE_SIZE bytes keep them in the allocation of the message
+#ifndef MQTT_MESSAGE_INLINE_SIZE
+#define MQTT_MESSAGE_INLINE_SIZE    128
+#endif
+
+// Topic name and payload of a message. They are never modified after creation so the clones of a message share them
+typedef struct MQTT_MESSAGE_DATA_TAG
+{
+    char* topicName;
+    APP_PAYLOAD appPayload;
+    // Set when the payload was adopted from the caller, the topic name then follows the data in the same allocation
+    MQTT_MESSAGE_PAYLOAD_FREE payloadFree;
+    void* ownedPayload;
+} MQTT_MESSAGE_DATA;
+
+DEFINE_REFCOUNT_TYPE(MQTT_MESSAGE_DATA);
 
 typedef struct MQTT_MESSAGE_TAG
 {
@@ -13,8 +34,208 @@ typedef struct MQTT_MESSAGE_TAG
     APP_PAYLOAD appPayload;
     bool isDuplicateMsg;
     bool isMessageRetained;
+    // Owns topicName and appPayload when they are stored apart from the message, NULL when they are inline or borrowed
+    MQTT_MESSAGE_DATA* data;
+    // topicName and appPayload point at the creator's memory
+    bool isBorrowed;
 } MQTT_MESSAGE;
 
+DEFINE_REFCOUNT_TYPE(MQTT_MESSAGE);
+
+// A pool slot holds a message with the largest inline topic name and payload, rounded up so every slot stays pointer aligned
+#define MESSAGE_POOL_SLOT_SIZE  ((sizeof(REFCOUNT_TYPE(MQTT_MESSAGE)) + MQTT_MESSAGE_INLINE_SIZE + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*))
+
+typedef struct MQTT_MESSAGE_POOL_TAG
+{
+    LOCK_HANDLE lock;
+    unsigned char* slots;
+    // Free slots are linked through their first bytes
+    void* freeSlots;
+    MQTT_MESSAGE_POOL_STATS stats;
+} MQTT_MESSAGE_POOL;
+
+static MQTT_MESSAGE_POOL* g_messagePool = NULL;
+
+static void* takePoolSlot(void)
+{
+    void* result = NULL;
+    MQTT_MESSAGE_POOL* pool = g_messagePool;
+    if (pool != NULL && Lock(pool->lock) == LOCK_OK)
+    {
+        if (pool->freeSlots == NULL)
+        {
+            pool->stats.missCount++;
+        }
+        else
+        {
+            result = pool->freeSlots;
+            pool->freeSlots = *(void**)result;
+            pool->stats.hitCount++;
+            pool->stats.slotsInUse++;
+        }
+        (void)Unlock(pool->lock);
+    }
+    return result;
+}
+
+static void freeMessage(MQTT_MESSAGE* msgInfo)
+{
+    MQTT_MESSAGE_POOL* pool = g_messagePool;
+    unsigned char* slot = (unsigned char*)msgInfo;
+    if (pool != NULL && slot >= pool->slots && slot < pool->slots + pool->stats.capacity * MESSAGE_POOL_SLOT_SIZE)
+    {
+        if (Lock(pool->lock) != LOCK_OK)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Failure locking the message pool, the slot is lost");
+        }
+        else
+        {
+            *(void**)slot = pool->freeSlots;
+            pool->freeSlots = slot;
+            pool->stats.slotsInUse--;
+            (void)Unlock(pool->lock);
+        }
+    }
+    else
+    {
+        free(msgInfo);
+    }
+}
+
+// Copies the topic name followed by the payload into storage and returns the stored topic name
+static char* storeMessageData(char* storage, const char* topicName, size_t topicLength, const uint8_t* appMsg, size_t appMsgLength, APP_PAYLOAD* appPayload)
+{
+    (void)memcpy(storage, topicName, topicLength);
+    appPayload->length = appMsgLength;
+    if (appMsgLength > 0)
+    {
+        appPayload->message = (uint8_t*)storage + topicLength;
+        (void)memcpy(appPayload->message, appMsg, appMsgLength);
+    }
+    else
+    {
+        appPayload->message = NULL;
+    }
+    return storage;
+}
+
+static MQTT_MESSAGE_DATA* createMessageData(const char* topicName, size_t topicLength, const uint8_t* appMsg, size_t appMsgLength)
+{
+    MQTT_MESSAGE_DATA* result = REFCOUNT_TYPE_CREATE(MQTT_MESSAGE_DATA);
+    if (result != NULL)
+    {
+        char* storage = (char*)malloc(topicLength + appMsgLength);
+        if (storage == NULL)
+        {
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->topicName = storeMessageData(storage, topicName, topicLength, appMsg, appMsgLength, &result->appPayload);
+            result->payloadFree = NULL;
+            result->ownedPayload = NULL;
+        }
+    }
+    return result;
+}
+
+// Copies only the topic name, appMsg is referenced and handed to payloadFree with the last reference
+static MQTT_MESSAGE_DATA* createOwnedMessageData(const char* topicName, size_t topicLength, uint8_t* appMsg, size_t appMsgLength, MQTT_MESSAGE_PAYLOAD_FREE payloadFree)
+{
+    MQTT_MESSAGE_DATA* result;
+    REFCOUNT_TYPE(MQTT_MESSAGE_DATA)* refCounted = (REFCOUNT_TYPE(MQTT_MESSAGE_DATA)*)malloc(sizeof(REFCOUNT_TYPE(MQTT_MESSAGE_DATA)) + topicLength);
+    if (refCounted == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        refCounted->count = 1;
+        result = &refCounted->counted;
+        result->topicName = (char*)(refCounted + 1);
+        (void)memcpy(result->topicName, topicName, topicLength);
+        result->appPayload.message = (appMsgLength > 0) ? appMsg : NULL;
+        result->appPayload.length = appMsgLength;
+        result->payloadFree = payloadFree;
+        result->ownedPayload = appMsg;
+    }
+    return result;
+}
+
+static void releaseMessageData(MQTT_MESSAGE_DATA* data)
+{
+    if (DEC_REF(MQTT_MESSAGE_DATA, data) == DEC_RETURN_ZERO)
+    {
+        if (data->payloadFree != NULL)
+        {
+            if (data->ownedPayload != NULL)
+            {
+                data->payloadFree(data->ownedPayload);
+            }
+        }
+        else
+        {
+            free(data->topicName);
+        }
+        free(data);
+    }
+}
+
+static void setMessageData(MQTT_MESSAGE* msgInfo, MQTT_MESSAGE_DATA* data)
+{
+    msgInfo->data = data;
+    msgInfo->topicName = data->topicName;
+    msgInfo->appPayload = data->appPayload;
+}
+
+// inlineSize bytes of storage follow the message in the same allocation, see inlineStorage. inlineSize never exceeds
+// MQTT_MESSAGE_INLINE_SIZE so any message fits in a pool slot
+static MQTT_MESSAGE* createMessage(uint16_t packetId, QOS_VALUE qosValue, size_t inlineSize)
+{
+    MQTT_MESSAGE* result;
+    /* Codes_SRS_MQTTMESSAGE_07_046: [When the pool is initialized a message shall be allocated from a free slot, counted in hitCount, or with malloc when no slot is free, counted in missCount.] */
+    REFCOUNT_TYPE(MQTT_MESSAGE)* refCounted = (REFCOUNT_TYPE(MQTT_MESSAGE)*)takePoolSlot();
+    if (refCounted != NULL)
+    {
+        refCounted->count = 1;
+        result = &refCounted->counted;
+    }
+    else if (inlineSize == 0)
+    {
+        result = REFCOUNT_TYPE_CREATE(MQTT_MESSAGE);
+    }
+    else
+    {
+        refCounted = (REFCOUNT_TYPE(MQTT_MESSAGE)*)malloc(sizeof(REFCOUNT_TYPE(MQTT_MESSAGE)) + inlineSize);
+        if (refCounted == NULL)
+        {
+            result = NULL;
+        }
+        else
+        {
+            refCounted->count = 1;
+            result = &refCounted->counted;
+        }
+    }
+
+    if (result != NULL)
+    {
+        result->packetId = packetId;
+        result->qosInfo = qosValue;
+        result->isDuplicateMsg = false;
+        result->isMessageRetained = false;
+        result->data = NULL;
+        result->isBorrowed = false;
+    }
+    return result;
+}
+
+static char* inlineStorage(MQTT_MESSAGE* msgInfo)
+{
+    return (char*)((REFCOUNT_TYPE(MQTT_MESSAGE)*)msgInfo + 1);
+}
+
 MQTT_MESSAGE_HANDLE mqttmessage_create(uint16_t packetId, const char* topicName, QOS_VALUE qosValue, const uint8_t* appMsg, size_t appMsgLength)
 {
     /* Codes_SRS_MQTTMESSAGE_07_001:[If the parameters topicName is NULL is zero then mqttmessage_create shall return NULL.] */
@@ -26,42 +247,32 @@ MQTT_MESSAGE_HANDLE mqttmessage_create(uint16_t packetId, const char* topicName,
     else
     {
         /* Codes_SRS_MQTTMESSAGE_07_002: [mqttmessage_create shall allocate and copy the topicName and appMsg parameters.] */
-        result = malloc(sizeof(MQTT_MESSAGE));
-        if (result != NULL)
+        size_t topicLength = strlen(topicName) + 1;
+        if (topicLength <= MQTT_MESSAGE_INLINE_SIZE && appMsgLength <= MQTT_MESSAGE_INLINE_SIZE - topicLength)
         {
-            if (mallocAndStrcpy_s(&result->topicName, topicName) != 0)
+            /* Codes_SRS_MQTTMESSAGE_07_037: [If the topicName with its terminator and appMsg take up to MQTT_MESSAGE_INLINE_SIZE bytes mqttmessage_create shall store them in the allocation of the message.] */
+            result = createMessage(packetId, qosValue, topicLength + appMsgLength);
+            if (result != NULL)
             {
-                /* Codes_SRS_MQTTMESSAGE_07_003: [If any memory allocation fails mqttmessage_create shall free any allocated memory and return NULL.] */
-                free(result);
-                result = NULL;
+                result->topicName = storeMessageData(inlineStorage(result), topicName, topicLength, appMsg, appMsgLength, &result->appPayload);
             }
-            else
+        }
+        else
+        {
+            /* Codes_SRS_MQTTMESSAGE_07_038: [Otherwise mqttmessage_create shall store the topicName and appMsg in a separate allocation that the clones of the message share.] */
+            result = createMessage(packetId, qosValue, 0);
+            if (result != NULL)
             {
-                result->packetId = packetId;
-                result->isDuplicateMsg = false;
-                result->isMessageRetained = false;
-                result->qosInfo = qosValue;
-
-                /* Codes_SRS_MQTTMESSAGE_07_002: [mqttmessage_create shall allocate and copy the topicName and appMsg parameters.] */
-                result->appPayload.length = appMsgLength;
-                if (result->appPayload.length > 0)
+                MQTT_MESSAGE_DATA* data = createMessageData(topicName, topicLength, appMsg, appMsgLength);
+                if (data == NULL)
                 {
-                    result->appPayload.message = malloc(appMsgLength);
-                    if (result->appPayload.message == NULL)
-                    {
-                        /* Codes_SRS_MQTTMESSAGE_07_003: [If any memory allocation fails mqttmessage_create shall free any allocated memory and return NULL.] */
-                        free(result->topicName);
-                        free(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        memcpy(result->appPayload.message, appMsg, appMsgLength);
-                    }
+                    /* Codes_SRS_MQTTMESSAGE_07_003: [If any memory allocation fails mqttmessage_create shall free any allocated memory and return NULL.] */
+                    freeMessage(result);
+                    result = NULL;
                 }
                 else
                 {
-                    result->appPayload.message = NULL;
+                    setMessageData(result, data);
                 }
             }
         }
@@ -76,20 +287,118 @@ void mqttmessage_destroy(MQTT_MESSAGE_HANDLE handle)
     /* Codes_SRS_MQTTMESSAGE_07_005: [If the handle parameter is NULL then mqttmessage_destroyMessage shall do nothing] */
     if (msgInfo != NULL)
     {
-        /* Codes_SRS_MQTTMESSAGE_07_006: [mqttmessage_destroyMessage shall free all resources associated with the MQTT_MESSAGE_HANDLE value] */
-        free(msgInfo->topicName);
-        if (msgInfo->appPayload.message != NULL)
+        /* Codes_SRS_MQTTMESSAGE_07_033: [mqttmessage_destroy shall release one reference and only free the message when no reference is left. The topicName and appMsg of a borrowed message shall not be freed.] */
+        if (DEC_REF(MQTT_MESSAGE, msgInfo) == DEC_RETURN_ZERO)
         {
-            free(msgInfo->appPayload.message);
+            /* Codes_SRS_MQTTMESSAGE_07_006: [mqttmessage_destroyMessage shall free all resources associated with the MQTT_MESSAGE_HANDLE value] */
+            /* Codes_SRS_MQTTMESSAGE_07_036: [The topicName and appMsg storage shall be freed with the last message that shares it.] */
+            /* Codes_SRS_MQTTMESSAGE_07_051: [An appMsg adopted by mqttmessage_create_take_ownership shall be passed to its payloadFree with the last message that shares it.] */
+            if (msgInfo->data != NULL)
+            {
+                releaseMessageData(msgInfo->data);
+            }
+            /* Codes_SRS_MQTTMESSAGE_07_047: [A message allocated from the pool shall return its slot to the pool when it is freed.] */
+            freeMessage(msgInfo);
         }
-        free(msgInfo);
     }
 }
 
-MQTT_MESSAGE_HANDLE mqttmessage_clone(MQTT_MESSAGE_HANDLE handle)
+MQTT_MESSAGE_HANDLE mqttmessage_createBorrowed(uint16_t packetId, const char* topicName, QOS_VALUE qosValue, const uint8_t* appMsg, size_t appMsgLength)
+{
+    MQTT_MESSAGE* result;
+    /* Codes_SRS_MQTTMESSAGE_07_026: [If topicName is NULL, or appMsg is NULL and appMsgLength is not zero, then mqttmessage_createBorrowed shall return NULL.] */
+    if (topicName == NULL || (appMsg == NULL && appMsgLength > 0))
+    {
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_027: [mqttmessage_createBorrowed shall only allocate the message, topicName and appMsg shall be referenced without being copied.] */
+        /* Codes_SRS_MQTTMESSAGE_07_028: [If the allocation fails mqttmessage_createBorrowed shall return NULL.] */
+        result = createMessage(packetId, qosValue, 0);
+        if (result != NULL)
+        {
+            result->isBorrowed = true;
+            result->topicName = (char*)topicName;
+            result->appPayload.message = (appMsgLength > 0) ? (uint8_t*)appMsg : NULL;
+            result->appPayload.length = appMsgLength;
+        }
+    }
+    return result;
+}
+
+MQTT_MESSAGE_HANDLE mqttmessage_create_take_ownership(uint16_t packetId, const char* topicName, QOS_VALUE qosValue, uint8_t* appMsg, size_t appMsgLength, MQTT_MESSAGE_PAYLOAD_FREE payloadFree)
+{
+    MQTT_MESSAGE* result;
+    /* Codes_SRS_MQTTMESSAGE_07_048: [If topicName or payloadFree is NULL, or appMsg is NULL and appMsgLength is not zero, then mqttmessage_create_take_ownership shall return NULL.] */
+    if (topicName == NULL || payloadFree == NULL || (appMsg == NULL && appMsgLength > 0))
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified topicName: %p, payloadFree: %p, appMsgLength: %lu", topicName, (void*)payloadFree, (unsigned long)appMsgLength);
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_049: [mqttmessage_create_take_ownership shall copy the topicName and reference appMsg without copying it.] */
+        result = createMessage(packetId, qosValue, 0);
+        if (result != NULL)
+        {
+            MQTT_MESSAGE_DATA* data = createOwnedMessageData(topicName, strlen(topicName) + 1, appMsg, appMsgLength, payloadFree);
+            if (data == NULL)
+            {
+                /* Codes_SRS_MQTTMESSAGE_07_050: [If any memory allocation fails mqttmessage_create_take_ownership shall free any allocated memory, leave appMsg owned by the caller and return NULL.] */
+                freeMessage(result);
+                result = NULL;
+            }
+            else
+            {
+                setMessageData(result, data);
+            }
+        }
+    }
+    return result;
+}
+
+MQTT_MESSAGE_HANDLE mqttmessage_retain(MQTT_MESSAGE_HANDLE handle)
 {
     MQTT_MESSAGE_HANDLE result;
     if (handle == NULL)
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_029: [If handle is NULL then mqttmessage_retain shall return NULL.] */
+        result = NULL;
+    }
+    else
+    {
+        MQTT_MESSAGE* msgInfo = (MQTT_MESSAGE*)handle;
+        /* Codes_SRS_MQTTMESSAGE_07_030: [If the message is borrowed mqttmessage_retain shall copy the topicName and appMsg into memory owned by the message.] */
+        if (msgInfo->isBorrowed)
+        {
+            MQTT_MESSAGE_DATA* data = createMessageData(msgInfo->topicName, strlen(msgInfo->topicName) + 1, msgInfo->appPayload.message, msgInfo->appPayload.length);
+            if (data != NULL)
+            {
+                setMessageData(msgInfo, data);
+                msgInfo->isBorrowed = false;
+            }
+        }
+
+        if (msgInfo->isBorrowed)
+        {
+            /* Codes_SRS_MQTTMESSAGE_07_031: [If the copy fails mqttmessage_retain shall leave the message unchanged and return NULL.] */
+            result = NULL;
+        }
+        else
+        {
+            /* Codes_SRS_MQTTMESSAGE_07_032: [mqttmessage_retain shall add a reference to the message and return handle.] */
+            (void)INC_REF(MQTT_MESSAGE, msgInfo);
+            result = handle;
+        }
+    }
+    return result;
+}
+
+MQTT_MESSAGE_HANDLE mqttmessage_clone(MQTT_MESSAGE_HANDLE handle)
+{
+    MQTT_MESSAGE* result;
+    if (handle == NULL)
     {
         /* Codes_SRS_MQTTMESSAGE_07_007: [If handle parameter is NULL then mqttmessage_clone shall return NULL.] */
         result = NULL;
@@ -98,11 +407,26 @@ MQTT_MESSAGE_HANDLE mqttmessage_clone(MQTT_MESSAGE_HANDLE handle)
     {
         /* Codes_SRS_MQTTMESSAGE_07_008: [mqttmessage_clone shall create a new MQTT_MESSAGE_HANDLE with data content identical of the handle value.] */
         MQTT_MESSAGE* mqtt_message = (MQTT_MESSAGE*)handle;
-        result = mqttmessage_create(mqtt_message->packetId, mqtt_message->topicName, mqtt_message->qosInfo, mqtt_message->appPayload.message, mqtt_message->appPayload.length);
+        if (mqtt_message->data == NULL)
+        {
+            /* Codes_SRS_MQTTMESSAGE_07_035: [If handle is borrowed or stores its topicName and appMsg inline mqttmessage_clone shall copy them as mqttmessage_create does.] */
+            result = (MQTT_MESSAGE*)mqttmessage_create(mqtt_message->packetId, mqtt_message->topicName, mqtt_message->qosInfo, mqtt_message->appPayload.message, mqtt_message->appPayload.length);
+        }
+        else
+        {
+            /* Codes_SRS_MQTTMESSAGE_07_034: [Otherwise mqttmessage_clone shall only allocate the new message and share the topicName and appMsg storage of handle by adding a reference to it.] */
+            result = createMessage(mqtt_message->packetId, mqtt_message->qosInfo, 0);
+            if (result != NULL)
+            {
+                (void)INC_REF(MQTT_MESSAGE_DATA, mqtt_message->data);
+                setMessageData(result, mqtt_message->data);
+            }
+        }
+
         if (result != NULL)
         {
-            (void)mqttmessage_setIsDuplicateMsg(result, mqtt_message->isDuplicateMsg);
-            (void)mqttmessage_setIsRetained(result, mqtt_message->isMessageRetained);
+            result->isDuplicateMsg = mqtt_message->isDuplicateMsg;
+            result->isMessageRetained = mqtt_message->isMessageRetained;
         }
     }
     return result;
@@ -193,6 +517,24 @@ bool mqttmessage_getIsRetained(MQTT_MESSAGE_HANDLE handle)
     return result;
 }
 
+int mqttmessage_setPacketId(MQTT_MESSAGE_HANDLE handle, uint16_t packetId)
+{
+    int result;
+    /* Codes_SRS_MQTTMESSAGE_07_052: [If handle is NULL then mqttmessage_setPacketId shall return a non-zero value.] */
+    if (handle == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_053: [mqttmessage_setPacketId shall store the packetId value in the MQTT_MESSAGE_HANDLE handle.] */
+        MQTT_MESSAGE* msgInfo = (MQTT_MESSAGE*)handle;
+        msgInfo->packetId = packetId;
+        result = 0;
+    }
+    return result;
+}
+
 int mqttmessage_setIsDuplicateMsg(MQTT_MESSAGE_HANDLE handle, bool duplicateMsg)
 {
     int result;
@@ -245,3 +587,99 @@ const APP_PAYLOAD* mqttmessage_getApplicationMsg(MQTT_MESSAGE_HANDLE handle)
     }
     return result;
 }
+
+int mqttmessage_initPool(size_t capacity)
+{
+    int result;
+    /* Codes_SRS_MQTTMESSAGE_07_039: [If capacity is zero or the pool is already initialized mqttmessage_initPool shall return a non-zero value.] */
+    if (capacity == 0 || capacity > SIZE_MAX / MESSAGE_POOL_SLOT_SIZE || g_messagePool != NULL)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Invalid parameter specified capacity: %lu or the pool is already initialized", (unsigned long)capacity);
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_040: [mqttmessage_initPool shall allocate capacity slots that each hold a message with up to MQTT_MESSAGE_INLINE_SIZE bytes of topicName and appMsg.] */
+        /* Codes_SRS_MQTTMESSAGE_07_041: [If any allocation fails mqttmessage_initPool shall free any allocated memory and return a non-zero value.] */
+        MQTT_MESSAGE_POOL* pool = (MQTT_MESSAGE_POOL*)malloc(sizeof(MQTT_MESSAGE_POOL));
+        if (pool == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating the message pool");
+            result = __LINE__;
+        }
+        else if ((pool->slots = (unsigned char*)malloc(capacity * MESSAGE_POOL_SLOT_SIZE)) == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Failure allocating %lu message pool slots", (unsigned long)capacity);
+            free(pool);
+            result = __LINE__;
+        }
+        else if ((pool->lock = Lock_Init()) == NULL)
+        {
+            LOG(LOG_ERROR, LOG_LINE, "Failure creating the message pool lock");
+            free(pool->slots);
+            free(pool);
+            result = __LINE__;
+        }
+        else
+        {
+            pool->freeSlots = NULL;
+            for (size_t index = capacity; index > 0; index--)
+            {
+                void* slot = pool->slots + (index - 1) * MESSAGE_POOL_SLOT_SIZE;
+                *(void**)slot = pool->freeSlots;
+                pool->freeSlots = slot;
+            }
+            memset(&pool->stats, 0, sizeof(pool->stats));
+            pool->stats.capacity = capacity;
+            g_messagePool = pool;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int mqttmessage_deinitPool(void)
+{
+    int result;
+    MQTT_MESSAGE_POOL* pool = g_messagePool;
+    /* Codes_SRS_MQTTMESSAGE_07_042: [If the pool is not initialized or a message allocated from it has not been freed mqttmessage_deinitPool shall return a non-zero value.] */
+    if (pool == NULL || pool->stats.slotsInUse > 0)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "The message pool is not initialized or still in use");
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_043: [mqttmessage_deinitPool shall free the pool, messages created afterwards shall be allocated with malloc.] */
+        g_messagePool = NULL;
+        (void)Lock_Deinit(pool->lock);
+        free(pool->slots);
+        free(pool);
+        result = 0;
+    }
+    return result;
+}
+
+int mqttmessage_getPoolStats(MQTT_MESSAGE_POOL_STATS* poolStats)
+{
+    int result;
+    MQTT_MESSAGE_POOL* pool = g_messagePool;
+    /* Codes_SRS_MQTTMESSAGE_07_044: [If poolStats is NULL or the pool is not initialized mqttmessage_getPoolStats shall return a non-zero value.] */
+    if (poolStats == NULL || pool == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (Lock(pool->lock) != LOCK_OK)
+    {
+        LOG(LOG_ERROR, LOG_LINE, "Failure locking the message pool");
+        result = __LINE__;
+    }
+    else
+    {
+        /* Codes_SRS_MQTTMESSAGE_07_045: [mqttmessage_getPoolStats shall copy the pool counters to poolStats.] */
+        *poolStats = pool->stats;
+        (void)Unlock(pool->lock);
+        result = 0;
+    }
+    return result;
+}
@@ -30,6 +30,20 @@ void* my_gballoc_malloc(size_t size)
     return alloc_result;
 }
 
+void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    void* alloc_result;
+    if (g_fail_alloc_calls != 0)
+    {
+        alloc_result = NULL;
+    }
+    else
+    {
+        alloc_result = realloc(ptr, size);
+    }
+    return alloc_result;
+}
+
 void my_gballoc_free(void* ptr)
 {
     free(ptr);
@@ -59,6 +73,13 @@ static const char* TEST_PASSWORD = "testpassword";
 
 static const char* TEST_TOPIC_NAME = "topic Name";
 static const APP_PAYLOAD TEST_APP_PAYLOAD = { (uint8_t*)"Message to send", 15 };
+static const APP_PAYLOAD TEST_EMPTY_APP_PAYLOAD = { NULL, 0 };
+static const size_t TEST_PUBLISH_PACKET_LEN = 31;
+static const uint8_t TEST_PING_PACKET[] = { 0xc0, 0x00 };
+static const size_t TEST_RESERVE_VARIABLE_HEADER_LEN = 14;
+static const size_t TEST_RESERVE_MAX_LEN = 64;
+static const size_t TEST_RESERVE_PACKET_OFFSET = 3;
+static const uint8_t TEST_DISCONNECT_PACKET[] = { 0xe0, 0x00 };
 static const char* TEST_CLIENT_ID = "test_client_id";
 static const char* TEST_SUBSCRIPTION_TOPIC = "subTopic";
 static SUBSCRIBE_PAYLOAD TEST_SUBSCRIBE_PAYLOAD[] = { {"subTopic1", DELIVER_AT_LEAST_ONCE }, {"subTopic2", DELIVER_EXACTLY_ONCE } };
@@ -69,15 +90,30 @@ static const TICK_COUNTER_HANDLE TEST_COUNTER_HANDLE = (TICK_COUNTER_HANDLE)0x12
 static const MQTTCODEC_HANDLE TEST_MQTTCODEC_HANDLE = (MQTTCODEC_HANDLE)0x13;
 static const MQTT_MESSAGE_HANDLE TEST_MESSAGE_HANDLE = (MQTT_MESSAGE_HANDLE)0x14;
 static BUFFER_HANDLE TEST_BUFFER_HANDLE = (BUFFER_HANDLE)0x15;
+static const MQTT_TOPIC_HANDLE TEST_TOPIC_HANDLE = (MQTT_TOPIC_HANDLE)0x16;
+static const MQTT_PUBLISH_TEMPLATE_HANDLE TEST_TEMPLATE_HANDLE = (MQTT_PUBLISH_TEMPLATE_HANDLE)0x17;
 static const uint16_t TEST_KEEP_ALIVE_INTERVAL = 20;
 static const uint16_t TEST_PACKET_ID = (uint16_t)0x1234;
 static const unsigned char* TEST_BUFFER_U_CHAR = (const unsigned char*)0x19;
 
 static bool g_operationCallbackInvoked;
 static bool g_msgRecvCallbackInvoked;
+static bool g_errorCallbackInvoked;
 static bool g_mqtt_codec_publish_func_fail;
+static bool g_publishSendCompleteInvoked;
+static IO_SEND_RESULT g_publishSendCompleteResult;
+static MQTT_MESSAGE_HANDLE g_publishSendCompleteMsg;
+static size_t g_writableCount;
 static uint64_t g_current_ms;
+static QOS_VALUE g_streamQosValue;
+static size_t g_streamPayloadLength;
+static size_t g_streamPayloadReceived;
+static bool g_streamEndInvoked;
 ON_PACKET_COMPLETE_CALLBACK g_packetComplete;
+ON_PUBLISH_BEGIN_CALLBACK g_publishBegin;
+ON_PUBLISH_CHUNK_CALLBACK g_publishChunk;
+ON_PUBLISH_END_CALLBACK g_publishEnd;
+ON_PACKET_DISCARDED_CALLBACK g_packetDiscarded;
 ON_IO_OPEN_COMPLETE g_openComplete;
 ON_BYTES_RECEIVED g_bytesRecv;
 ON_IO_ERROR g_ioError;
@@ -107,6 +143,66 @@ extern "C" {
         return TEST_MQTTCODEC_HANDLE;
     }
 
+    int my_mqtt_codec_setPublishStreaming(MQTTCODEC_HANDLE handle, size_t threshold, ON_PUBLISH_BEGIN_CALLBACK publishBegin, ON_PUBLISH_CHUNK_CALLBACK publishChunk, ON_PUBLISH_END_CALLBACK publishEnd)
+    {
+        (void)handle;
+        (void)threshold;
+        g_publishBegin = publishBegin;
+        g_publishChunk = publishChunk;
+        g_publishEnd = publishEnd;
+        return 0;
+    }
+
+    int my_mqtt_codec_setMaxPacketSize(MQTTCODEC_HANDLE handle, size_t maxPacketSize, ON_PACKET_DISCARDED_CALLBACK packetDiscarded)
+    {
+        (void)handle;
+        (void)maxPacketSize;
+        g_packetDiscarded = packetDiscarded;
+        return 0;
+    }
+
+    int my_mqtt_codec_decodeConnack(const uint8_t* data, size_t length, CONNECT_ACK* connack)
+    {
+        (void)length;
+        connack->isSessionPresent = (data[0] & 0x1) != 0;
+        connack->returnCode = (CONNECT_RETURN_CODE)data[1];
+        return 0;
+    }
+
+    int my_mqtt_codec_decodePublish(int flags, const uint8_t* data, size_t length, MQTT_PUBLISH_VIEW* publishView)
+    {
+        size_t headerLength = 2 + ((data[0] << 8) | data[1]);
+        publishView->topicName = (const char*)data + 2;
+        publishView->topicLength = headerLength - 2;
+        publishView->qosValue = (QOS_VALUE)((flags & 0x6) >> 1);
+        publishView->packetId = 0;
+        if (publishView->qosValue != DELIVER_AT_MOST_ONCE)
+        {
+            publishView->packetId = (uint16_t)((data[headerLength] << 8) | data[headerLength + 1]);
+            headerLength += 2;
+        }
+        publishView->isDuplicateMsg = (flags & 0x8) != 0;
+        publishView->isRetained = (flags & 0x1) != 0;
+        publishView->payload = data + headerLength;
+        publishView->payloadLength = length - headerLength;
+        return 0;
+    }
+
+    int my_mqtt_codec_decodeAck(const uint8_t* data, size_t length, uint16_t* packetId)
+    {
+        (void)length;
+        *packetId = (uint16_t)((data[0] << 8) | data[1]);
+        return 0;
+    }
+
+    int my_mqtt_codec_decodeSuback(const uint8_t* data, size_t length, MQTT_SUBACK_VIEW* subackView)
+    {
+        subackView->packetId = (uint16_t)((data[0] << 8) | data[1]);
+        subackView->returnCodes = data + 2;
+        subackView->returnCodeCount = length - 2;
+        return 0;
+    }
+
     int my_xio_open(XIO_HANDLE handle, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
     {
         (void)handle;
@@ -141,26 +237,98 @@ extern "C" {
         return 0;
     }
 
-    BUFFER_HANDLE my_mqtt_codec_publishComplete(uint16_t packetId)
+    size_t my_mqtt_codec_publishReply_into(uint8_t* buffer, size_t capacity, uint16_t packetId)
     {
-        (void)packetId;
-        BUFFER_HANDLE buffer_result = TEST_BUFFER_HANDLE;
+        size_t result;
         if (g_mqtt_codec_publish_func_fail)
         {
-            buffer_result = NULL;
+            result = 0;
+        }
+        else
+        {
+            result = MQTT_PUBLISH_REPLY_PACKET_SIZE;
+            if (buffer != NULL && capacity >= MQTT_PUBLISH_REPLY_PACKET_SIZE)
+            {
+                buffer[0] = 0x40;
+                buffer[1] = 0x02;
+                buffer[2] = (uint8_t)(packetId >> 8);
+                buffer[3] = (uint8_t)(packetId & 0xff);
+            }
         }
-        return buffer_result;
+        return result;
     }
 
-    BUFFER_HANDLE my_mqtt_codec_publishRelease(uint16_t packetId)
+    size_t my_mqtt_codec_publish_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, const uint8_t* msgBuffer, size_t buffLen)
     {
+        (void)qosValue;
+        (void)duplicateMsg;
+        (void)serverRetain;
         (void)packetId;
-        BUFFER_HANDLE buffer_result = TEST_BUFFER_HANDLE;
-        if (g_mqtt_codec_publish_func_fail)
+        (void)topicName;
+        (void)msgBuffer;
+        (void)buffLen;
+        if (buffer != NULL && capacity >= TEST_PUBLISH_PACKET_LEN)
+        {
+            memset(buffer, 0x30, TEST_PUBLISH_PACKET_LEN);
+        }
+        return TEST_PUBLISH_PACKET_LEN;
+    }
+
+    size_t my_mqtt_codec_publishTopic_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, MQTT_TOPIC_HANDLE topicHandle, const uint8_t* msgBuffer, size_t buffLen)
+    {
+        (void)topicHandle;
+        return my_mqtt_codec_publish_into(buffer, capacity, qosValue, duplicateMsg, serverRetain, packetId, TEST_TOPIC_NAME, msgBuffer, buffLen);
+    }
+
+    size_t my_mqtt_codec_publishTemplate_into(uint8_t* buffer, size_t capacity, MQTT_PUBLISH_TEMPLATE_HANDLE templateHandle, uint16_t packetId, const uint8_t* msgBuffer, size_t buffLen)
+    {
+        (void)templateHandle;
+        return my_mqtt_codec_publish_into(buffer, capacity, DELIVER_AT_LEAST_ONCE, false, false, packetId, TEST_TOPIC_NAME, msgBuffer, buffLen);
+    }
+
+    size_t my_mqtt_codec_publishReserve_into(uint8_t* buffer, size_t capacity, QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, size_t maxLen)
+    {
+        (void)qosValue;
+        (void)duplicateMsg;
+        (void)serverRetain;
+        (void)packetId;
+        (void)topicName;
+        size_t result = MQTT_MAX_FIXED_HEADER_SIZE + TEST_RESERVE_VARIABLE_HEADER_LEN + maxLen;
+        if (buffer != NULL && capacity >= result)
+        {
+            memset(buffer, 0x30, result - maxLen);
+        }
+        return result;
+    }
+
+    size_t my_mqtt_codec_publishCommit(uint8_t* buffer, size_t reservedLen, size_t maxLen, size_t actualLen, size_t* packetOffset)
+    {
+        (void)buffer;
+        size_t result;
+        if (actualLen > maxLen)
         {
-            buffer_result = NULL;
+            result = 0;
         }
-        return buffer_result;
+        else
+        {
+            *packetOffset = TEST_RESERVE_PACKET_OFFSET;
+            result = reservedLen - maxLen + actualLen - TEST_RESERVE_PACKET_OFFSET;
+        }
+        return result;
+    }
+
+    BUFFER_HANDLE my_mqtt_codec_publishSegments(QOS_VALUE qosValue, bool duplicateMsg, bool serverRetain, uint16_t packetId, const char* topicName, const uint8_t* msgBuffer, size_t buffLen, MQTT_BUFFER_SEGMENT* segments)
+    {
+        (void)qosValue;
+        (void)duplicateMsg;
+        (void)serverRetain;
+        (void)packetId;
+        (void)topicName;
+        segments[0].data = TEST_BUFFER_U_CHAR;
+        segments[0].length = 11;
+        segments[1].data = msgBuffer;
+        segments[1].length = buffLen;
+        return TEST_BUFFER_HANDLE;
     }
 
 #ifdef __cplusplus
@@ -202,37 +370,60 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(ON_IO_OPEN_COMPLETE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(ON_BYTES_RECEIVED, void*);
     REGISTER_UMOCK_ALIAS_TYPE(ON_IO_ERROR, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_MQTT_PUBLISH_SEND_COMPLETE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_PUBLISH_BEGIN_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_PUBLISH_CHUNK_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_PUBLISH_END_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_PACKET_DISCARDED_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(uint64_t, unsigned long long);
     REGISTER_TYPE(QOS_VALUE, QOS_VALUE);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
     REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_create, my_mqtt_codec_create);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_setPublishStreaming, my_mqtt_codec_setPublishStreaming);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_setMaxPacketSize, my_mqtt_codec_setMaxPacketSize);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_decodeConnack, my_mqtt_codec_decodeConnack);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_decodePublish, my_mqtt_codec_decodePublish);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_decodeAck, my_mqtt_codec_decodeAck);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_decodeSuback, my_mqtt_codec_decodeSuback);
     REGISTER_GLOBAL_MOCK_HOOK(xio_open, my_xio_open);
     REGISTER_GLOBAL_MOCK_HOOK(xio_send, my_xio_send);
     REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
-    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishRelease, my_mqtt_codec_publishRelease);
-    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishComplete, my_mqtt_codec_publishComplete);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishAck_into, my_mqtt_codec_publishReply_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishReceived_into, my_mqtt_codec_publishReply_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishRelease_into, my_mqtt_codec_publishReply_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishComplete_into, my_mqtt_codec_publishReply_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishSegments, my_mqtt_codec_publishSegments);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publish_into, my_mqtt_codec_publish_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishTopic_into, my_mqtt_codec_publishTopic_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishTemplate_into, my_mqtt_codec_publishTemplate_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishReserve_into, my_mqtt_codec_publishReserve_into);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_codec_publishCommit, my_mqtt_codec_publishCommit);
     REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_connect, TEST_BUFFER_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_publish, TEST_BUFFER_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_subscribe, TEST_BUFFER_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_unsubscribe, TEST_BUFFER_HANDLE);
-    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_disconnect, TEST_BUFFER_HANDLE);
-    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_ping, TEST_BUFFER_HANDLE);
-    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_publishAck, TEST_BUFFER_HANDLE);
-    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_publishReceived, TEST_BUFFER_HANDLE);
+    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_disconnectPacket, TEST_DISCONNECT_PACKET);
+    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_pingPacket, TEST_PING_PACKET);
     REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_bytesReceived, 0);
+    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_setReassemblyHighWaterMark, 0);
     REGISTER_GLOBAL_MOCK_RETURN(xio_close, 0);
     REGISTER_GLOBAL_MOCK_RETURN(platform_init, 0);
     REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_COUNTER_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(BUFFER_u_char, (unsigned char*)TEST_BUFFER_U_CHAR);
     REGISTER_GLOBAL_MOCK_RETURN(BUFFER_length, 11);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_create, TEST_MESSAGE_HANDLE);
+    REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_createBorrowed, TEST_MESSAGE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_clone, TEST_MESSAGE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getPacketId, TEST_PACKET_ID);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getTopicName, TEST_TOPIC_NAME);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getQosType, DELIVER_AT_LEAST_ONCE);
+    REGISTER_GLOBAL_MOCK_RETURN(mqtt_codec_publishTemplateGetQos, DELIVER_AT_LEAST_ONCE);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getIsDuplicateMsg, true);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getIsRetained, true);
+    REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_setPacketId, 0);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_setIsDuplicateMsg, 0);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_setIsRetained, 0);
     REGISTER_GLOBAL_MOCK_RETURN(mqttmessage_getApplicationMsg, &TEST_APP_PAYLOAD);
@@ -255,9 +446,22 @@ TEST_FUNCTION_INITIALIZE(method_init)
     g_fail_alloc_calls = 0;
     g_current_ms = 0;
     g_packetComplete = NULL;
+    g_publishBegin = NULL;
+    g_publishChunk = NULL;
+    g_publishEnd = NULL;
+    g_packetDiscarded = NULL;
+    g_streamQosValue = DELIVER_FAILURE;
+    g_streamPayloadLength = 0;
+    g_streamPayloadReceived = 0;
+    g_streamEndInvoked = false;
     g_operationCallbackInvoked = false;
     g_msgRecvCallbackInvoked = false;
+    g_errorCallbackInvoked = false;
     g_mqtt_codec_publish_func_fail = false;
+    g_publishSendCompleteInvoked = false;
+    g_publishSendCompleteResult = IO_SEND_CANCELLED;
+    g_publishSendCompleteMsg = NULL;
+    g_writableCount = 0;
     g_openComplete = NULL;
     g_onCompleteCtx = NULL;
     g_sendComplete = NULL;
@@ -281,6 +485,42 @@ static void TestRecvCallback(MQTT_MESSAGE_HANDLE msgHandle, void* context)
     g_msgRecvCallbackInvoked = true;
 }
 
+static void TestPublishBeginCallback(const char* topicName, QOS_VALUE qosValue, size_t payloadLength, void* context)
+{
+    (void)topicName;
+    (void)context;
+    g_streamQosValue = qosValue;
+    g_streamPayloadLength = payloadLength;
+}
+
+static void TestPublishChunkCallback(const uint8_t* data, size_t length, void* context)
+{
+    (void)data;
+    (void)context;
+    g_streamPayloadReceived += length;
+}
+
+static void TestPublishEndCallback(void* context)
+{
+    (void)context;
+    g_streamEndInvoked = true;
+}
+
+static void TestPublishSendComplete(MQTT_MESSAGE_HANDLE msgHandle, IO_SEND_RESULT sendResult, void* context)
+{
+    (void)context;
+    g_publishSendCompleteInvoked = true;
+    g_publishSendCompleteResult = sendResult;
+    g_publishSendCompleteMsg = msgHandle;
+}
+
+static void TestWritableCallback(MQTT_CLIENT_HANDLE handle, void* context)
+{
+    (void)handle;
+    (void)context;
+    g_writableCount++;
+}
+
 static void TestOpCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* context)
 {
     (void)handle;
@@ -357,8 +597,12 @@ static void TestOpCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT a
             }
             break;
         }
-        case MQTT_CLIENT_ON_DISCONNECT:
         case MQTT_CLIENT_ON_ERROR:
+        {
+            g_errorCallbackInvoked = true;
+            break;
+        }
+        case MQTT_CLIENT_ON_DISCONNECT:
         {
             if (msgInfo != NULL)
             {
@@ -374,6 +618,21 @@ static void TestOpCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT a
             g_operationCallbackInvoked = true;
         }
         break;
+        case MQTT_CLIENT_ON_PACKET_DISCARDED:
+        {
+            if (context != NULL && msgInfo != NULL)
+            {
+                const PACKET_DISCARDED* discarded = (PACKET_DISCARDED*)msgInfo;
+                TEST_COMPLETE_DATA_INSTANCE* testData = (TEST_COMPLETE_DATA_INSTANCE*)context;
+                PACKET_DISCARDED* validate = (PACKET_DISCARDED*)testData->msgInfo;
+                if (testData->actionResult == actionResult && validate->packetType == discarded->packetType &&
+                    validate->packetLength == discarded->packetLength)
+                {
+                    g_operationCallbackInvoked = true;
+                }
+            }
+            break;
+        }
     }
 }
 
@@ -497,6 +756,9 @@ TEST_FUNCTION(mqtt_client_deinit_succeeds)
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     EXPECTED_CALL(mqtt_codec_destroy(IGNORED_PTR_ARG));
 
     // act
@@ -833,6 +1095,7 @@ TEST_FUNCTION(mqtt_client_subscribe_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2));
     STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
     STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
@@ -909,6 +1172,7 @@ TEST_FUNCTION(mqtt_client_unsubscribe_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2));
     STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
     STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
@@ -977,20 +1241,52 @@ TEST_FUNCTION(mqtt_client_publish_getApplicationMsg_fail)
     mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_publish_mqtt_codec_publish_fail)
+/*Tests_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_publish shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_mqtt_codec_publish_into_fail)
 {
     // arrange
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(0);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_publish shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_send_buffer_alloc_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    // The packet id map is allocated by the first reservation, so only the buffer allocation fails
+    (void)mqtt_client_subscribe(mqttHandle, TEST_PACKET_ID + 1, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
-    EXPECTED_CALL(mqtt_codec_publish(DELIVER_AT_MOST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .SetReturn((BUFFER_HANDLE)NULL);
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    g_fail_alloc_calls = 1;
 
     // act
     int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
@@ -1000,10 +1296,11 @@ TEST_FUNCTION(mqtt_client_publish_mqtt_codec_publish_fail)
     ASSERT_ARE_NOT_EQUAL(int, 0, result);
 
     // cleanup
+    g_fail_alloc_calls = 0;
     mqtt_client_deinit(mqttHandle);
 }
 
-/*Test_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_publish shall return a non-zero value.]*/
+/*Tests_SRS_MQTT_CLIENT_07_020: [If any failure is encountered then mqtt_client_publish shall return a non-zero value.]*/
 TEST_FUNCTION(mqtt_client_publish_xio_send_fails)
 {
     // arrange
@@ -1011,17 +1308,17 @@ TEST_FUNCTION(mqtt_client_publish_xio_send_fails)
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
-    EXPECTED_CALL(mqtt_codec_publish(DELIVER_AT_MOST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
     EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
-    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
 
     // act
     int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
@@ -1034,6 +1331,8 @@ TEST_FUNCTION(mqtt_client_publish_xio_send_fails)
     mqtt_client_deinit(mqttHandle);
 }
 
+/*Tests_SRS_MQTT_CLIENT_07_022: [On success mqtt_client_publish shall send the MQTT SUBCRIBE packet to the endpoint.]*/
+/*Tests_SRS_MQTT_CLIENT_07_042: [mqtt_client_publish shall encode the PUBLISH packet by calling mqtt_codec_publish_into with a send buffer owned by the client, growing the buffer only when the packet does not fit.]*/
 TEST_FUNCTION(mqtt_client_publish_succeeds)
 {
     // arrange
@@ -1041,18 +1340,52 @@ TEST_FUNCTION(mqtt_client_publish_succeeds)
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_042: [mqtt_client_publish shall encode the PUBLISH packet by calling mqtt_codec_publish_into with a send buffer owned by the client, growing the buffer only when the packet does not fit.]*/
+TEST_FUNCTION(mqtt_client_publish_second_reuses_send_buffer_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
 
-    EXPECTED_CALL(mqtt_codec_publish(DELIVER_AT_MOST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
 
     // act
     int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
@@ -1065,29 +1398,50 @@ TEST_FUNCTION(mqtt_client_publish_succeeds)
     mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_disconnect_handle_NULL_fail)
+/*Tests_SRS_MQTT_CLIENT_07_046: [If handle or topicHandle is NULL, or if appMsg is NULL and appMsgLength is not 0, then mqtt_client_publish_topic shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_handle_NULL_fail)
 {
     // arrange
 
     // act
-    int result = mqtt_client_disconnect(NULL);
+    int result = mqtt_client_publish_topic(NULL, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_046: [If handle or topicHandle is NULL, or if appMsg is NULL and appMsgLength is not 0, then mqtt_client_publish_topic shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_MQTT_TOPIC_HANDLE_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_topic(mqttHandle, NULL, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
     ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
+    mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_disconnect_mqtt_codec_NULL_fail)
+/*Tests_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_mqtt_codec_publishTopic_into_fail)
 {
     // arrange
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(mqtt_codec_disconnect()).SetReturn((BUFFER_HANDLE)NULL);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, false, false, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(0);
 
     // act
-    int result = mqtt_client_disconnect(mqttHandle);
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
     ASSERT_ARE_NOT_EQUAL(int, 0, result);
@@ -1097,114 +1451,2608 @@ TEST_FUNCTION(mqtt_client_disconnect_mqtt_codec_NULL_fail)
     mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_disconnect_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_048: [If any failure is encountered then mqtt_client_publish_topic shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_xio_send_fails)
 {
     // arrange
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(mqtt_codec_disconnect());
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, false, false, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, false, false, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
 
     // act
-    int result = mqtt_client_disconnect(mqttHandle);
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
-    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_disconnect_send_complete_SEND_OK_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_047: [mqtt_client_publish_topic shall encode the PUBLISH packet by calling mqtt_codec_publishTopic_into with the client send buffer, growing the buffer only when the packet does not fit.]*/
+/*Tests_SRS_MQTT_CLIENT_07_049: [On success mqtt_client_publish_topic shall send the MQTT PUBLISH packet to the endpoint and return 0.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_succeeds)
 {
     // arrange
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
-    (void)mqtt_client_disconnect(mqttHandle);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(xio_close(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, true, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, false, true, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
 
     // act
-    ASSERT_IS_NOT_NULL(g_sendComplete);
-    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, true, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
-
-TEST_FUNCTION(mqtt_client_disconnect_send_complete_SEND_ERROR_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_135: [mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_reserve shall reserve the packet id of a QoS 1 or 2 publish, picking the lowest free one when packetId is 0.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_packet_id_0_reserves_free_id_succeeds)
 {
     // arrange
+    uint16_t packetId = 0;
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
-    (void)mqtt_client_disconnect(mqttHandle);
     umock_c_reset_all_calls();
 
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, 1, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, false, false, 1, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
     // act
-    ASSERT_IS_NOT_NULL(g_sendComplete);
-    g_sendComplete(g_onSendCtx, IO_SEND_ERROR);
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, 0, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_last_packet_id(mqttHandle, &packetId));
+    ASSERT_ARE_EQUAL(int, 1, (int)packetId);
 
     // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
-/*Codes_SRS_MQTT_CLIENT_07_023: [If the parameter handle is NULL then mqtt_client_dowork shall do nothing.]*/
-TEST_FUNCTION(mqtt_client_dowork_ping_handle_NULL_fails)
+/*Tests_SRS_MQTT_CLIENT_07_134: [While the window is full or publishes are queued mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall refuse a QoS 1 or 2 publish with MQTT_CLIENT_WINDOW_FULL, since a packet encoded in a buffer cannot be queued, and mqtt_client_publish_commit shall release the reservation.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_window_full_refused)
 {
     // arrange
+    size_t windowCount = 0;
+    size_t queuedCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_QUEUE, TestWritableCallback, NULL);
+    (void)mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+    umock_c_reset_all_calls();
 
     // act
-    mqtt_client_dowork(NULL);
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID + 1, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
 
     // assert
+    ASSERT_ARE_EQUAL(int, MQTT_CLIENT_WINDOW_FULL, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 1, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
 
     // cleanup
+    mqtt_client_deinit(mqttHandle);
 }
 
-/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
-/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
-/*Codes_SRS_MQTT_CLIENT_07_026: [if keepAliveInternal is > 0 and the send time is greater than the MQTT KeepAliveInterval then it shall construct an MQTT PINGREQ packet.]*/
-TEST_FUNCTION(mqtt_client_dowork_ping_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_136: [When in flight tracking is on mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall keep a DUP flagged copy of every QoS 1 and 2 packet before sending it, and shall fail a packet without sending it when maxInFlight messages are in flight.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_inflight_tracked_succeeds)
 {
     // arrange
+    size_t inFlightCount = 0;
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    umock_c_reset_all_calls();
 
-    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
-    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_050: [If handle or templateHandle is NULL, or if appMsg is NULL and appMsgLength is not 0, then mqtt_client_publish_template shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_template_MQTT_PUBLISH_TEMPLATE_HANDLE_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_template(mqttHandle, NULL, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_052: [If any failure is encountered then mqtt_client_publish_template shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_template_xio_send_fails)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTemplateGetQos(TEST_TEMPLATE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishTemplate_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishTemplate_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_publish_template(mqttHandle, TEST_TEMPLATE_HANDLE, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_051: [mqtt_client_publish_template shall encode the PUBLISH packet by calling mqtt_codec_publishTemplate_into with the client send buffer, growing the buffer only when the packet does not fit.]*/
+/*Tests_SRS_MQTT_CLIENT_07_053: [On success mqtt_client_publish_template shall send the MQTT PUBLISH packet to the endpoint and return 0.]*/
+TEST_FUNCTION(mqtt_client_publish_template_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTemplateGetQos(TEST_TEMPLATE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTemplate_into(NULL, 0, TEST_TEMPLATE_HANDLE, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTemplate_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, TEST_TEMPLATE_HANDLE, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish_template(mqttHandle, TEST_TEMPLATE_HANDLE, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_054: [If handle or topicName is NULL then mqtt_client_publish_reserve shall return NULL.]*/
+TEST_FUNCTION(mqtt_client_publish_reserve_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    uint8_t* result = mqtt_client_publish_reserve(NULL, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_057: [If any failure is encountered then mqtt_client_publish_reserve shall return NULL.]*/
+TEST_FUNCTION(mqtt_client_publish_reserve_buffer_alloc_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    // The packet id map is allocated by the first reservation, so only the buffer allocation fails
+    (void)mqtt_client_subscribe(mqttHandle, TEST_PACKET_ID + 1, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishReserve_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_RESERVE_MAX_LEN));
+    EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    g_fail_alloc_calls = 1;
+
+    // act
+    uint8_t* result = mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    g_fail_alloc_calls = 0;
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_056: [mqtt_client_publish_reserve shall lay out the PUBLISH packet by calling mqtt_codec_publishReserve_into with a reserve buffer owned by the client, growing the buffer only when the packet does not fit.]*/
+/*Tests_SRS_MQTT_CLIENT_07_058: [On success mqtt_client_publish_reserve shall return a writable region of maxLen bytes that is the payload of the outbound PUBLISH packet.]*/
+TEST_FUNCTION(mqtt_client_publish_reserve_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    size_t reservedLen = MQTT_MAX_FIXED_HEADER_SIZE + TEST_RESERVE_VARIABLE_HEADER_LEN + TEST_RESERVE_MAX_LEN;
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishReserve_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_RESERVE_MAX_LEN));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, reservedLen));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishReserve_into(IGNORED_PTR_ARG, reservedLen, DELIVER_AT_LEAST_ONCE, false, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_RESERVE_MAX_LEN))
+        .IgnoreArgument(1);
+
+    // act
+    uint8_t* result = mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, true, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    memset(result, 0x50, TEST_RESERVE_MAX_LEN);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_059: [If handle is NULL or no publish is reserved then mqtt_client_publish_commit shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_not_reserved_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_061: [If any failure is encountered then mqtt_client_publish_commit shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_actualLen_too_large_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(mqtt_codec_publishCommit(IGNORED_PTR_ARG, IGNORED_NUM_ARG, TEST_RESERVE_MAX_LEN, TEST_RESERVE_MAX_LEN + 1, IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, TEST_RESERVE_MAX_LEN + 1);
+    int secondResult = mqtt_client_publish_commit(mqttHandle, TEST_RESERVE_MAX_LEN);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, secondResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_061: [If any failure is encountered then mqtt_client_publish_commit shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_xio_send_fails)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(mqtt_codec_publishCommit(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_060: [mqtt_client_publish_commit shall call mqtt_codec_publishCommit to write the remaining length for actualLen bytes of payload and shall release the reservation.]*/
+/*Tests_SRS_MQTT_CLIENT_07_062: [On success mqtt_client_publish_commit shall send the MQTT PUBLISH packet to the endpoint directly from the reserved buffer and return 0.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    size_t reservedLen = MQTT_MAX_FIXED_HEADER_SIZE + TEST_RESERVE_VARIABLE_HEADER_LEN + TEST_RESERVE_MAX_LEN;
+    uint8_t* payload = mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+    memset(payload, 0x50, 10);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishCommit(IGNORED_PTR_ARG, reservedLen, TEST_RESERVE_MAX_LEN, 10, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_MAX_FIXED_HEADER_SIZE + TEST_RESERVE_VARIABLE_HEADER_LEN + 10 - TEST_RESERVE_PACKET_OFFSET, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, 10);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_134: [While the window is full or publishes are queued mqtt_client_publish_topic, mqtt_client_publish_template and mqtt_client_publish_commit shall refuse a QoS 1 or 2 publish with MQTT_CLIENT_WINDOW_FULL, since a packet encoded in a buffer cannot be queued, and mqtt_client_publish_commit shall release the reservation.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_window_full_releases_reservation)
+{
+    // arrange
+    size_t reservedLen = MQTT_MAX_FIXED_HEADER_SIZE + TEST_RESERVE_VARIABLE_HEADER_LEN + TEST_RESERVE_MAX_LEN;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+    (void)mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, 0, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+    (void)mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, 0, TEST_RESERVE_MAX_LEN);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishReserve_into(IGNORED_PTR_ARG, reservedLen, DELIVER_AT_LEAST_ONCE, false, false, 2, TEST_TOPIC_NAME, TEST_RESERVE_MAX_LEN))
+        .IgnoreArgument(1);
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, 10);
+    int secondResult = mqtt_client_publish_commit(mqttHandle, 10);
+    uint8_t* payload = mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, 0, TEST_RESERVE_MAX_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, MQTT_CLIENT_WINDOW_FULL, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, secondResult);
+    ASSERT_IS_NOT_NULL(payload);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+static void setup_publish_batch_message_mocks(void)
+{
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_063: [If handle or msgHandles is NULL or count is 0 then mqtt_client_publish_batch shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_handle_NULL_fail)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+
+    // act
+    int result = mqtt_client_publish_batch(NULL, msgHandles, 2, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_063: [If handle or msgHandles is NULL or count is 0 then mqtt_client_publish_batch shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_count_0_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE };
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 0, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_064: [mqtt_client_publish_batch shall encode the PUBLISH packet of each message back to back in the client send buffer.]*/
+/*Tests_SRS_MQTT_CLIENT_07_067: [mqtt_client_publish_batch shall send all encoded packets with a single call to xio_send.]*/
+/*Tests_SRS_MQTT_CLIENT_07_069: [mqtt_client_publish_batch shall return 0 only if every message was sent.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    int msgResults[] = { -1, -1 };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 2 * sizeof(uint16_t)));
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    setup_publish_batch_message_mocks();
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN * 2))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN * 2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 2, msgResults);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, msgResults[0]);
+    ASSERT_ARE_EQUAL(int, 0, msgResults[1]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_065: [If a message is NULL or cannot be encoded then mqtt_client_publish_batch shall set its entry in msgResults to a non-zero value and continue with the next message.]*/
+/*Tests_SRS_MQTT_CLIENT_07_069: [mqtt_client_publish_batch shall return 0 only if every message was sent.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_one_message_fails_sends_others)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, NULL };
+    int msgResults[] = { -1, -1, -1 };
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 3 * sizeof(uint16_t)));
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE)).SetReturn((const APP_PAYLOAD*)NULL);
+    setup_publish_batch_message_mocks();
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 3, msgResults);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[0]);
+    ASSERT_ARE_EQUAL(int, 0, msgResults[1]);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[2]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_068: [If the send fails then mqtt_client_publish_batch shall set the msgResults entry of every encoded message to a non-zero value and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_xio_send_fails)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE };
+    int msgResults[] = { -1 };
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, sizeof(uint16_t)));
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 1, msgResults);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_117: [mqtt_client_publish_batch shall set the msgResults entry of a refused message to MQTT_CLIENT_WINDOW_FULL and return MQTT_CLIENT_WINDOW_FULL when every message that was not sent or queued was refused, and if the send fails it shall drop the messages it queued and free the packet ids and window slots of the messages it encoded that are not kept in flight.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_xio_send_fails_keeps_refused_window_slot)
+{
+    // arrange
+    size_t windowCount = 0;
+    size_t queuedCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    int msgResults[] = { -1, -1 };
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 2 * sizeof(uint16_t)));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE)).SetReturn(DELIVER_AT_MOST_ONCE);
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE)).SetReturn(DELIVER_AT_MOST_ONCE);
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_MOST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 2, msgResults);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[0]);
+    ASSERT_ARE_EQUAL(int, MQTT_CLIENT_WINDOW_FULL, msgResults[1]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 1, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_133: [mqtt_client_publish_batch shall record the packet ids of the QoS 1 and 2 messages it encodes in a buffer owned by the client, and if that buffer cannot hold count ids it shall set every msgResults entry to a non-zero value and return a non-zero value without sending.]*/
+TEST_FUNCTION(mqtt_client_publish_batch_packet_ids_realloc_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    MQTT_MESSAGE_HANDLE msgHandles[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    int msgResults[] = { 0, 0 };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 2 * sizeof(uint16_t))).SetReturn(NULL);
+
+    // act
+    int result = mqtt_client_publish_batch(mqttHandle, msgHandles, 2, msgResults);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[0]);
+    ASSERT_ARE_NOT_EQUAL(int, 0, msgResults[1]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_070: [If handle is NULL then mqtt_client_set_send_coalescing shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_send_coalescing_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_send_coalescing(NULL, TEST_PUBLISH_PACKET_LEN * 4, 0);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_072: [mqtt_client_set_send_coalescing shall queue outbound packets until maxBatchSize bytes are queued or mqtt_client_dowork sends them, and a maxBatchSize of 0 shall turn coalescing off.]*/
+/*Tests_SRS_MQTT_CLIENT_07_073: [mqtt_client_dowork shall send the packets in the send queue with a single call to xio_send once maxDelayMs has elapsed since the first of them was queued.]*/
+TEST_FUNCTION(mqtt_client_set_send_coalescing_dowork_sends_queue_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    int result = mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 4, 0);
+    umock_c_reset_all_calls();
+
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN * 4));
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN * 2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int publishResult1 = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    int publishResult2 = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, publishResult1);
+    ASSERT_ARE_EQUAL(int, 0, publishResult2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_073: [mqtt_client_dowork shall send the packets in the send queue with a single call to xio_send once maxDelayMs has elapsed since the first of them was queued.]*/
+TEST_FUNCTION(mqtt_client_set_send_coalescing_dowork_holds_queue_until_max_delay)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 4, 10);
+    g_current_ms = 1000;
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    g_current_ms = 1005;
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    g_current_ms = 0;
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_072: [mqtt_client_set_send_coalescing shall queue outbound packets until maxBatchSize bytes are queued or mqtt_client_dowork sends them, and a maxBatchSize of 0 shall turn coalescing off.]*/
+TEST_FUNCTION(mqtt_client_set_send_coalescing_max_batch_size_sends_queue_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 2, 0);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN * 2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_075: [mqtt_client_disconnect shall flush the send queue so the DISCONNECT packet is written immediately.]*/
+TEST_FUNCTION(mqtt_client_set_send_coalescing_disconnect_sends_queue_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 4, 0);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_disconnectPacket());
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN + MQTT_DISCONNECT_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_disconnect(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_076: [If handle or sendStats is NULL then mqtt_client_get_send_stats shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_send_stats_sendStats_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_send_stats(mqttHandle, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_077: [mqtt_client_get_send_stats shall copy the number of packets, xio_send calls and bytes sent by the client into sendStats and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_send_stats_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_SEND_STATS sendStats;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 4, 0);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    mqtt_client_dowork(mqttHandle);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_send_stats(mqttHandle, &sendStats);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 3, (size_t)sendStats.packetCount);
+    ASSERT_ARE_EQUAL(size_t, 2, (size_t)sendStats.sendCount);
+    ASSERT_ARE_EQUAL(size_t, TEST_PUBLISH_PACKET_LEN * 3, (size_t)sendStats.byteCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_078: [If handle is NULL then mqtt_client_set_reassembly_high_water_mark shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_reassembly_high_water_mark_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_reassembly_high_water_mark(NULL, 1024);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_079: [mqtt_client_set_reassembly_high_water_mark shall call mqtt_codec_setReassemblyHighWaterMark and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_reassembly_high_water_mark_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setReassemblyHighWaterMark(TEST_MQTTCODEC_HANDLE, 1024));
+
+    // act
+    int result = mqtt_client_set_reassembly_high_water_mark(mqttHandle, 1024);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_079: [mqtt_client_set_reassembly_high_water_mark shall call mqtt_codec_setReassemblyHighWaterMark and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_reassembly_high_water_mark_codec_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setReassemblyHighWaterMark(TEST_MQTTCODEC_HANDLE, 1024)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_set_reassembly_high_water_mark(mqttHandle, 1024);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_129: [mqtt_client_set_reassembly_high_water_mark shall use highWaterMark for the send buffer and the reserve buffer too, freeing them right away when they are larger and not in use.]*/
+TEST_FUNCTION(mqtt_client_set_reassembly_high_water_mark_frees_send_buffer_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setReassemblyHighWaterMark(TEST_MQTTCODEC_HANDLE, TEST_PUBLISH_PACKET_LEN - 1));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_client_set_reassembly_high_water_mark(mqttHandle, TEST_PUBLISH_PACKET_LEN - 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_128: [Once a PUBLISH encoded in the send buffer or the reserve buffer was handed to the transport, a send buffer, a batch packet id buffer or an unused reserve buffer larger than the high water mark shall be freed.]*/
+TEST_FUNCTION(mqtt_client_publish_topic_above_high_water_mark_frees_send_buffer_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_reassembly_high_water_mark(mqttHandle, TEST_PUBLISH_PACKET_LEN - 1);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishTopic_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_TOPIC_HANDLE, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_client_publish_topic(mqttHandle, TEST_TOPIC_HANDLE, DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_128: [Once a PUBLISH encoded in the send buffer or the reserve buffer was handed to the transport, a send buffer, a batch packet id buffer or an unused reserve buffer larger than the high water mark shall be freed.]*/
+TEST_FUNCTION(mqtt_client_publish_commit_above_high_water_mark_frees_reserve_buffer_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_reassembly_high_water_mark(mqttHandle, TEST_RESERVE_MAX_LEN);
+    (void)mqtt_client_publish_reserve(mqttHandle, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, false, TEST_PACKET_ID, TEST_RESERVE_MAX_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(mqtt_codec_publishCommit(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_client_publish_commit(mqttHandle, 10);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_085: [If handle is NULL then mqtt_client_set_max_packet_size shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_max_packet_size_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_max_packet_size(NULL, 1024);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_086: [mqtt_client_set_max_packet_size shall call mqtt_codec_setMaxPacketSize and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_max_packet_size_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setMaxPacketSize(TEST_MQTTCODEC_HANDLE, 1024, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+
+    // act
+    int result = mqtt_client_set_max_packet_size(mqttHandle, 1024);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL(g_packetDiscarded);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_086: [mqtt_client_set_max_packet_size shall call mqtt_codec_setMaxPacketSize and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_max_packet_size_codec_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setMaxPacketSize(TEST_MQTTCODEC_HANDLE, 1024, IGNORED_PTR_ARG))
+        .IgnoreArgument(3).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_set_max_packet_size(mqttHandle, 1024);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_087: [When the codec discards an oversized packet the client shall call the Operation Callback with MQTT_CLIENT_ON_PACKET_DISCARDED and a PACKET_DISCARDED structure.]*/
+TEST_FUNCTION(mqtt_client_packet_discarded_calls_operation_callback_succeeds)
+{
+    // arrange
+    PACKET_DISCARDED packetDiscarded;
+    packetDiscarded.packetType = PUBLISH_TYPE;
+    packetDiscarded.packetLength = 4096;
+
+    TEST_COMPLETE_DATA_INSTANCE testData;
+    testData.actionResult = MQTT_CLIENT_ON_PACKET_DISCARDED;
+    testData.msgInfo = &packetDiscarded;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, &testData);
+    (void)mqtt_client_set_max_packet_size(mqttHandle, 1024);
+    umock_c_reset_all_calls();
+
+    // act
+    g_packetDiscarded(mqttHandle, PUBLISH_TYPE, 4096);
+
+    // assert
+    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_088: [If handle or discardedCount is NULL then mqtt_client_get_discarded_packet_count shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_discarded_packet_count_discardedCount_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_discarded_packet_count(mqttHandle, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_089: [mqtt_client_get_discarded_packet_count shall store the value of mqtt_codec_getDiscardedPacketCount in discardedCount and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_discarded_packet_count_succeeds)
+{
+    // arrange
+    uint64_t discardedCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_getDiscardedPacketCount(TEST_MQTTCODEC_HANDLE)).SetReturn(3);
+
+    // act
+    int result = mqtt_client_get_discarded_packet_count(mqttHandle, &discardedCount);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 3, (int)discardedCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_080: [If handle is NULL, or only some of onPublishBegin, onPublishChunk and onPublishEnd are NULL, then mqtt_client_set_publish_streaming shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_publish_streaming_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_publish_streaming(NULL, 1024, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_080: [If handle is NULL, or only some of onPublishBegin, onPublishChunk and onPublishEnd are NULL, then mqtt_client_set_publish_streaming shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_publish_streaming_onPublishEnd_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_set_publish_streaming(mqttHandle, 1024, TestPublishBeginCallback, TestPublishChunkCallback, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_081: [mqtt_client_set_publish_streaming shall call mqtt_codec_setPublishStreaming with threshold, passing NULL callbacks when streaming is turned off, and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_publish_streaming_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setPublishStreaming(TEST_MQTTCODEC_HANDLE, 1024, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(3).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_set_publish_streaming(mqttHandle, 1024, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL(g_publishBegin);
+    ASSERT_IS_NOT_NULL(g_publishChunk);
+    ASSERT_IS_NOT_NULL(g_publishEnd);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_081: [mqtt_client_set_publish_streaming shall call mqtt_codec_setPublishStreaming with threshold, passing NULL callbacks when streaming is turned off, and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_publish_streaming_off_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_publish_streaming(mqttHandle, 1024, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setPublishStreaming(TEST_MQTTCODEC_HANDLE, 0, NULL, NULL, NULL));
+
+    // act
+    int result = mqtt_client_set_publish_streaming(mqttHandle, 0, NULL, NULL, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(g_publishBegin);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_081: [mqtt_client_set_publish_streaming shall call mqtt_codec_setPublishStreaming with threshold, passing NULL callbacks when streaming is turned off, and return a non-zero value if it fails.]*/
+TEST_FUNCTION(mqtt_client_set_publish_streaming_codec_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_setPublishStreaming(TEST_MQTTCODEC_HANDLE, 1024, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(3).IgnoreArgument(4).IgnoreArgument(5).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_set_publish_streaming(mqttHandle, 1024, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_082: [When a streamed PUBLISH begins the client shall call onPublishBegin with the topic name, QOS and payload length.]*/
+/*Tests_SRS_MQTT_CLIENT_07_083: [Each chunk of a streamed PUBLISH payload shall be passed to onPublishChunk as it arrives.]*/
+/*Tests_SRS_MQTT_CLIENT_07_084: [When a streamed PUBLISH ends the client shall call onPublishEnd and then send the PUBACK or PUBREC its QOS requires.]*/
+TEST_FUNCTION(mqtt_client_publish_streamed_AT_LEAST_ONCE_succeeds)
+{
+    // arrange
+    const uint8_t PAYLOAD[] = { 0x4d, 0x73, 0x67 };
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_publish_streaming(mqttHandle, 0, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_publishAck_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    g_publishBegin(mqttHandle, 0x02, TEST_TOPIC_NAME, TEST_PACKET_ID, sizeof(PAYLOAD));
+    g_publishChunk(mqttHandle, PAYLOAD, 1);
+    g_publishChunk(mqttHandle, PAYLOAD + 1, sizeof(PAYLOAD) - 1);
+    g_publishEnd(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, (int)DELIVER_AT_LEAST_ONCE, (int)g_streamQosValue);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PAYLOAD), g_streamPayloadLength);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PAYLOAD), g_streamPayloadReceived);
+    ASSERT_IS_TRUE(g_streamEndInvoked);
+    ASSERT_IS_FALSE(g_msgRecvCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_084: [When a streamed PUBLISH ends the client shall call onPublishEnd and then send the PUBACK or PUBREC its QOS requires.]*/
+TEST_FUNCTION(mqtt_client_publish_streamed_AT_MOST_ONCE_succeeds)
+{
+    // arrange
+    const uint8_t PAYLOAD[] = { 0x4d, 0x73, 0x67 };
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_publish_streaming(mqttHandle, 0, TestPublishBeginCallback, TestPublishChunkCallback, TestPublishEndCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    g_publishBegin(mqttHandle, 0x00, TEST_TOPIC_NAME, 0, sizeof(PAYLOAD));
+    g_publishChunk(mqttHandle, PAYLOAD, sizeof(PAYLOAD));
+    g_publishEnd(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, (int)DELIVER_AT_MOST_ONCE, (int)g_streamQosValue);
+    ASSERT_IS_TRUE(g_streamEndInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_095: [If handle is NULL or maxInFlight is 65535 or more then mqtt_client_set_inflight_tracking shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_inflight_tracking_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_inflight_tracking(NULL, 16, 1000);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_097: [mqtt_client_set_inflight_tracking shall allocate the table for maxInFlight messages once, a maxInFlight of 0 shall turn tracking off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_inflight_tracking_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    int result = mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_097: [mqtt_client_set_inflight_tracking shall allocate the table for maxInFlight messages once, a maxInFlight of 0 shall turn tracking off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_inflight_tracking_alloc_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    int result = mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_096: [If any message is in flight mqtt_client_set_inflight_tracking shall leave the settings unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_inflight_tracking_messages_in_flight_fail)
+{
+    // arrange
+    size_t inFlightCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_set_inflight_tracking(mqttHandle, 0, 0);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_102: [If handle or inFlightCount is NULL then mqtt_client_get_inflight_count shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_inflight_count_inFlightCount_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_inflight_count(mqttHandle, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_098: [When in flight tracking is on mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall keep a DUP flagged clone of every QoS 1 and 2 message before sending it, and shall fail a message without sending it when maxInFlight messages are in flight.]*/
+/*Tests_SRS_MQTT_CLIENT_07_103: [mqtt_client_get_inflight_count shall store the number of messages waiting for an acknowledgement in inFlightCount and return 0.]*/
+TEST_FUNCTION(mqtt_client_publish_inflight_tracked_succeeds)
+{
+    // arrange
+    size_t inFlightCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    umock_c_reset_all_calls();
+
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mqttmessage_clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_setIsDuplicateMsg(TEST_MESSAGE_HANDLE, true));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_098: [When in flight tracking is on mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall keep a DUP flagged clone of every QoS 1 and 2 message before sending it, and shall fail a message without sending it when maxInFlight messages are in flight.]*/
+TEST_FUNCTION(mqtt_client_publish_inflight_full_fail)
+{
+    // arrange
+    size_t inFlightCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 1, 1000);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE)).SetReturn(TEST_PACKET_ID + 1);
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID + 1, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_140: [A QoS 1 or 2 publish with a packet id that is still in flight shall fail without being sent, and the message in flight shall keep waiting for its acknowledgement.]*/
+TEST_FUNCTION(mqtt_client_publish_packetId_in_flight_fail)
+{
+    // arrange
+    size_t inFlightCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    setup_publish_batch_message_mocks();
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_099: [A PUBACK shall release an in flight QoS 1 message and a PUBREC the message of a QoS 2 publish, whose packet id stays in flight until the PUBCOMP arrives.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_ACK_releases_inflight_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_RESP[] = { 0x12, 0x34 };
+    size_t length = sizeof(PUBLISH_ACK_RESP) / sizeof(PUBLISH_ACK_RESP[0]);
+    size_t inFlightCount = 1;
+    TEST_COMPLETE_DATA_INSTANCE testData;
+    PUBLISH_ACK puback = { 0 };
+    puback.packetId = 0x1234;
+
+    testData.actionResult = MQTT_CLIENT_ON_PUBLISH_ACK;
+    testData.msgInfo = &puback;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mqttmessage_destroy(TEST_MESSAGE_HANDLE));
+
+    // act
+    g_packetComplete(mqttHandle, PUBACK_TYPE, 0, PUBLISH_ACK_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 0, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_099: [A PUBACK shall release an in flight QoS 1 message and a PUBREC the message of a QoS 2 publish, whose packet id stays in flight until the PUBCOMP arrives.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RECEIVE_keeps_inflight_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_RESP[] = { 0x12, 0x34 };
+    size_t length = sizeof(PUBLISH_ACK_RESP) / sizeof(PUBLISH_ACK_RESP[0]);
+    size_t inFlightCount = 0;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE)).SetReturn(DELIVER_EXACTLY_ONCE);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mqttmessage_destroy(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mqtt_codec_publishRelease_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    g_packetComplete(mqttHandle, PUBREC_TYPE, 0, PUBLISH_ACK_RESP, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_inflight_count(mqttHandle, &inFlightCount));
+    ASSERT_ARE_EQUAL(size_t, 1, inFlightCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_100: [mqtt_client_dowork shall send again, oldest first, every in flight message whose PUBLISH or PUBREL was last sent retryTimeoutMs or more ago, a PUBLISH with the DUP flag set.]*/
+TEST_FUNCTION(mqtt_client_dowork_resends_inflight_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    g_current_ms = 1000;
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    setup_publish_batch_message_mocks();
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_131: [A resent PUBLISH shall keep its packet id and shall not change the packet id returned by mqtt_client_get_last_packet_id.]*/
+TEST_FUNCTION(mqtt_client_dowork_resend_keeps_last_packet_id_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+    uint16_t lastPacketId = 0;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_subscribe(mqttHandle, TEST_PACKET_ID + 1, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    g_current_ms = 1000;
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_last_packet_id(mqttHandle, &lastPacketId));
+    ASSERT_ARE_EQUAL(int, TEST_PACKET_ID + 1, (int)lastPacketId);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_100: [mqtt_client_dowork shall send again, oldest first, every in flight message whose PUBLISH or PUBREL was last sent retryTimeoutMs or more ago, a PUBLISH with the DUP flag set.]*/
+TEST_FUNCTION(mqtt_client_dowork_inflight_not_expired_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 1000);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    g_current_ms = 999;
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_101: [When a CONNACK accepts the connection every in flight message shall be sent again in the order it was sent, a PUBLISH with the DUP flag set and a PUBREL as is.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_resends_inflight_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 0);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeConnack(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    setup_publish_batch_message_mocks();
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_101: [When a CONNACK accepts the connection every in flight message shall be sent again in the order it was sent, a PUBLISH with the DUP flag set and a PUBREL as is.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_opCallback_NULL_resends_inflight_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, NULL, NULL);
+    (void)mqtt_client_set_inflight_tracking(mqttHandle, 16, 0);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeConnack(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    setup_publish_batch_message_mocks();
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+
+    // assert
+    ASSERT_IS_FALSE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_120: [When a CONNACK accepts the connection the window shall only keep the packet ids of in flight messages and the queued publishes shall then be sent while the window has room.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_opCallback_NULL_drains_window_succeeds)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+    size_t windowCount = 0;
+    size_t queuedCount = 0;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, NULL, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_QUEUE, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    // act
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+
+    // assert
+    ASSERT_IS_FALSE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 1, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_104: [When packetId is 0 mqtt_client_subscribe and mqtt_client_unsubscribe shall use the lowest free packet id, and fail if every packet id is in use.]*/
+TEST_FUNCTION(mqtt_client_subscribe_packetId_0_picks_id_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_subscribe(1, TEST_SUBSCRIBE_PAYLOAD, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_106: [Packet ids chosen by the caller shall be marked as in use, so that the ids the client picks do not collide with them.]*/
+TEST_FUNCTION(mqtt_client_subscribe_packetId_0_skips_id_chosen_before_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_subscribe(mqttHandle, 1, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_subscribe(2, TEST_SUBSCRIBE_PAYLOAD, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_104: [When packetId is 0 mqtt_client_subscribe and mqtt_client_unsubscribe shall use the lowest free packet id, and fail if every packet id is in use.]*/
+/*Tests_SRS_MQTT_CLIENT_07_106: [Packet ids chosen by the caller shall be marked as in use, so that the ids the client picks do not collide with them.]*/
+TEST_FUNCTION(mqtt_client_unsubscribe_packetId_0_skips_used_id_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+    (void)mqtt_client_subscribe(mqttHandle, 2, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_unsubscribe(3, TEST_UNSUBSCRIPTION_TOPIC, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_unsubscribe(mqttHandle, 0, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+TEST_FUNCTION(mqtt_client_subscribe_packetId_released_by_SUBACK_succeeds)
+{
+    // arrange
+    unsigned char SUBSCRIBE_ACK_RESP[] = { 0x00, 0x01, 0x01 };
+    size_t length = sizeof(SUBSCRIBE_ACK_RESP) / sizeof(SUBSCRIBE_ACK_RESP[0]);
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+    g_packetComplete(mqttHandle, SUBACK_TYPE, 0, SUBSCRIBE_ACK_RESP, length);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_subscribe(1, TEST_SUBSCRIBE_PAYLOAD, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_132: [The map of packet ids in use shall be allocated by the first packet id reservation, whether the caller chose the id or the client picks it, so that every packet id chosen by the caller is marked.]*/
+TEST_FUNCTION(mqtt_client_subscribe_packet_id_map_malloc_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    int result = mqtt_client_subscribe(mqttHandle, TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_107: [The packet id of a PUBLISH, SUBSCRIBE or UNSUBSCRIBE shall be released when its PUBACK, PUBCOMP, SUBACK or UNSUBACK is processed, or when the packet could not be sent and is not kept in flight.]*/
+TEST_FUNCTION(mqtt_client_subscribe_packetId_released_on_send_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_subscribe(1, TEST_SUBSCRIBE_PAYLOAD, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(mqtt_codec_subscribe(1, TEST_SUBSCRIBE_PAYLOAD, 2));
+    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int failResult = mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+    int result = mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, failResult);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_105: [When a QoS 1 or 2 message has packet id 0 mqtt_client_publish, mqtt_client_publish_batch and mqtt_client_publish_segmented shall pick the lowest free packet id and store it in the message with mqttmessage_setPacketId before encoding it.]*/
+TEST_FUNCTION(mqtt_client_publish_packetId_0_picks_id_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqttmessage_setPacketId(TEST_MESSAGE_HANDLE, 1));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, 1, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, 1, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_109: [If handle or packetId is NULL then mqtt_client_get_last_packet_id shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_last_packet_id_handle_NULL_fail)
+{
+    // arrange
+    uint16_t packetId;
+
+    // act
+    int result = mqtt_client_get_last_packet_id(NULL, &packetId);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_110: [mqtt_client_get_last_packet_id shall store the packet id used by the last QoS 1 or 2 publish, subscribe or unsubscribe in packetId and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_last_packet_id_succeeds)
+{
+    // arrange
+    uint16_t packetId = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_subscribe(mqttHandle, 0, TEST_SUBSCRIBE_PAYLOAD, 2);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_last_packet_id(mqttHandle, &packetId);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 1, (int)packetId);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_111: [If handle is NULL, mode is not an MQTT_CLIENT_FLOW_CONTROL_MODE value or maxInFlight is 65535 or more then mqtt_client_set_flow_control shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_flow_control_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_set_flow_control(NULL, 4, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_113: [mqtt_client_set_flow_control shall allocate the window for maxInFlight packet ids once, a maxInFlight of 0 shall turn flow control off, and if the allocation fails it shall leave the settings unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_flow_control_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).IgnoreArgument(1);
+
+    // act
+    int result = mqtt_client_set_flow_control(mqttHandle, 4, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_112: [If a publish holds a window slot or is queued mqtt_client_set_flow_control shall leave the settings unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_set_flow_control_window_in_use_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 4, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_set_flow_control(mqttHandle, 0, MQTT_CLIENT_FLOW_CONTROL_FAIL, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_114: [When flow control is on every QoS 1 and 2 publish that was sent shall hold a window slot until its PUBACK or PUBCOMP arrives, and so shall one whose send failed while it is kept in flight to be sent again.]*/
+/*Tests_SRS_MQTT_CLIENT_07_115: [While the window is full or publishes are queued a QoS 1 or 2 message shall not be sent, in MQTT_CLIENT_FLOW_CONTROL_FAIL mode it shall be refused with MQTT_CLIENT_WINDOW_FULL and in MQTT_CLIENT_FLOW_CONTROL_QUEUE mode it shall be queued and count as sent.]*/
+TEST_FUNCTION(mqtt_client_publish_window_full_refused)
+{
+    // arrange
+    size_t windowCount = 0;
+    size_t queuedCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, MQTT_CLIENT_WINDOW_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 1, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_115: [While the window is full or publishes are queued a QoS 1 or 2 message shall not be sent, in MQTT_CLIENT_FLOW_CONTROL_FAIL mode it shall be refused with MQTT_CLIENT_WINDOW_FULL and in MQTT_CLIENT_FLOW_CONTROL_QUEUE mode it shall be queued and count as sent.]*/
+/*Tests_SRS_MQTT_CLIENT_07_116: [mqtt_client_publish and mqtt_client_publish_batch shall queue a clone of the message, mqtt_client_publish_segmented shall queue the message itself and call onSendComplete once it has been sent.]*/
+TEST_FUNCTION(mqtt_client_publish_window_full_queued)
+{
+    // arrange
+    size_t windowCount = 0;
+    size_t queuedCount = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_QUEUE, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mqttmessage_clone(TEST_MESSAGE_HANDLE));
+
+    // act
+    int result = mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 1, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 1, queuedCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_119: [After a publish was refused or queued onWritable shall be called once the queue is empty and the window has a free slot.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_ACK_opens_window_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_RESP[] = { 0x12, 0x34 };
+    size_t length = sizeof(PUBLISH_ACK_RESP) / sizeof(PUBLISH_ACK_RESP[0]);
+    size_t windowCount = 1;
+    size_t queuedCount = 1;
+    TEST_COMPLETE_DATA_INSTANCE testData;
+    PUBLISH_ACK puback = { 0 };
+    puback.packetId = 0x1234;
+
+    testData.actionResult = MQTT_CLIENT_ON_PUBLISH_ACK;
+    testData.msgInfo = &puback;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
+    (void)mqtt_client_set_flow_control(mqttHandle, 1, MQTT_CLIENT_FLOW_CONTROL_FAIL, TestWritableCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+
+    // act
+    g_packetComplete(mqttHandle, PUBACK_TYPE, 0, PUBLISH_ACK_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(size_t, 1, g_writableCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount));
+    ASSERT_ARE_EQUAL(size_t, 0, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_122: [If handle, windowCount or queuedCount is NULL then mqtt_client_get_flow_control_state shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_flow_control_state_handle_NULL_fail)
+{
+    // arrange
+    size_t windowCount;
+    size_t queuedCount;
+
+    // act
+    int result = mqtt_client_get_flow_control_state(NULL, &windowCount, &queuedCount);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_123: [mqtt_client_get_flow_control_state shall store the number of publishes holding a window slot in windowCount and the number of queued publishes in queuedCount and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_flow_control_state_succeeds)
+{
+    // arrange
+    size_t windowCount = 1;
+    size_t queuedCount = 1;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_get_flow_control_state(mqttHandle, &windowCount, &queuedCount);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, windowCount);
+    ASSERT_ARE_EQUAL(size_t, 0, queuedCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_036: [If one of the parameters handle, msgHandle or onSendComplete is NULL then mqtt_client_publish_segmented shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_publish_segmented(NULL, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_036: [If one of the parameters handle, msgHandle or onSendComplete is NULL then mqtt_client_publish_segmented shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_MQTT_MESSAGE_HANDLE_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, NULL, TestPublishSendComplete, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_036: [If one of the parameters handle, msgHandle or onSendComplete is NULL then mqtt_client_publish_segmented shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_onSendComplete_NULL_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_037: [If any failure is encountered then mqtt_client_publish_segmented shall return a non-zero value and shall not call onSendComplete.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_mqtt_codec_publishSegments_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .SetReturn((BUFFER_HANDLE)NULL);
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(g_publishSendCompleteInvoked);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_040: [If the payload segment fails to send after the header was sent, mqtt_client_publish_segmented shall return a non-zero value since the connection can no longer be used.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_payload_xio_send_fails)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(g_publishSendCompleteInvoked);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_038: [mqtt_client_publish_segmented shall encode only the PUBLISH header by calling mqtt_codec_publishSegments, borrowing the payload of msgHandle.]*/
+/*Tests_SRS_MQTT_CLIENT_07_039: [mqtt_client_publish_segmented shall send the header segment followed by the payload segment without concatenating them.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length, IGNORED_PTR_ARG))
+        .IgnoreArgument(8);
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, TEST_BUFFER_U_CHAR, 11, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(4).IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(4).IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(g_publishSendCompleteInvoked);
+
+    // cleanup
+    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_041: [Once the payload segment has been sent, mqtt_client_publish_segmented shall call onSendComplete with the msgHandle, the send result and context, after which the payload may be released.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_send_complete_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(g_publishSendCompleteInvoked);
+    ASSERT_ARE_EQUAL(int, (int)IO_SEND_OK, (int)g_publishSendCompleteResult);
+    ASSERT_IS_TRUE(g_publishSendCompleteMsg == TEST_MESSAGE_HANDLE);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_041: [Once the payload segment has been sent, mqtt_client_publish_segmented shall call onSendComplete with the msgHandle, the send result and context, after which the payload may be released.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_send_complete_SEND_ERROR_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    g_sendComplete(g_onSendCtx, IO_SEND_ERROR);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(g_publishSendCompleteInvoked);
+    ASSERT_ARE_EQUAL(int, (int)IO_SEND_ERROR, (int)g_publishSendCompleteResult);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_041: [Once the payload segment has been sent, mqtt_client_publish_segmented shall call onSendComplete with the msgHandle, the send result and context, after which the payload may be released.]*/
+TEST_FUNCTION(mqtt_client_publish_segmented_no_payload_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqttmessage_getApplicationMsg(TEST_MESSAGE_HANDLE)).SetReturn(&TEST_EMPTY_APP_PAYLOAD);
+    STRICT_EXPECTED_CALL(mqttmessage_getQosType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsDuplicateMsg(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getIsRetained(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getPacketId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mqttmessage_getTopicName(TEST_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, true, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_client_publish_segmented(mqttHandle, TEST_MESSAGE_HANDLE, TestPublishSendComplete, NULL);
+    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(g_publishSendCompleteInvoked);
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+TEST_FUNCTION(mqtt_client_disconnect_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_client_disconnect(NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_011: [If any failure is encountered then mqtt_client_disconnect shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_disconnect_xio_send_fail)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_disconnectPacket());
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_client_disconnect(mqttHandle);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_044: [mqtt_client_disconnect shall send the constant DISCONNECT packet returned by mqtt_codec_disconnectPacket.]*/
+TEST_FUNCTION(mqtt_client_disconnect_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_disconnectPacket());
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, TEST_DISCONNECT_PACKET, MQTT_DISCONNECT_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(4).IgnoreArgument(5);
+
+    // act
+    int result = mqtt_client_disconnect(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+TEST_FUNCTION(mqtt_client_disconnect_send_complete_SEND_OK_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_disconnect(mqttHandle);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(xio_close(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+    // act
+    ASSERT_IS_NOT_NULL(g_sendComplete);
+    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+
+    // assert
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+
+TEST_FUNCTION(mqtt_client_disconnect_send_complete_SEND_ERROR_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_disconnect(mqttHandle);
+    umock_c_reset_all_calls();
+
+    // act
+    ASSERT_IS_NOT_NULL(g_sendComplete);
+    g_sendComplete(g_onSendCtx, IO_SEND_ERROR);
+
+    // assert
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Codes_SRS_MQTT_CLIENT_07_023: [If the parameter handle is NULL then mqtt_client_dowork shall do nothing.]*/
+TEST_FUNCTION(mqtt_client_dowork_ping_handle_NULL_fails)
+{
+    // arrange
+
+    // act
+    mqtt_client_dowork(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
+/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
+/*Codes_SRS_MQTT_CLIENT_07_026: [if keepAliveInternal is > 0 and the send time is greater than the MQTT KeepAliveInterval then it shall construct an MQTT PINGREQ packet.]*/
+/*Tests_SRS_MQTT_CLIENT_07_045: [mqtt_client_dowork shall send the constant PINGREQ packet returned by mqtt_codec_pingPacket.]*/
+TEST_FUNCTION(mqtt_client_dowork_ping_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
+    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    umock_c_reset_all_calls();
+
+    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mqtt_codec_pingPacket());
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, TEST_PING_PACKET, MQTT_PING_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(4).IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_130: [mqtt_client_dowork shall flush the send queue after queuing the PINGREQ so the keep alive send time is updated before the next call.]*/
+TEST_FUNCTION(mqtt_client_dowork_ping_send_coalescing_sends_one_ping_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
+    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, 64, 100);
+    umock_c_reset_all_calls();
+
+    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mqtt_codec_pingPacket());
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PING_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+    g_current_ms += 10;
+    mqtt_client_dowork(mqttHandle);
+    g_current_ms += 10;
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/* Tests_SRS_MQTT_CLIENT_07_035: [If the timeSincePing has expired past the maxPingRespTime then mqtt_client_dowork shall call the Operation Callback function with the message MQTT_CLIENT_NO_PING_RESPONSE] */
+TEST_FUNCTION(mqtt_client_dowork_ping_No_ping_response_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions ={ 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+
+    unsigned char CONNACK_RESP[] ={ 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
+    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+
+    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
+    mqtt_client_dowork(mqttHandle);
+
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 8 * 1000;
+
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
+/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
+/*Codes_SRS_MQTT_CLIENT_07_026: [if keepAliveInternal is > 0 and the send time is greater than the MQTT KeepAliveInterval then it shall construct an MQTT PINGREQ packet.]*/
+TEST_FUNCTION(mqtt_client_dowork_no_keepalive_no_ping_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, 0, false, true, DELIVER_AT_MOST_ONCE);
+
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
+    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    umock_c_reset_all_calls();
+
+    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
+/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
+TEST_FUNCTION(mqtt_client_dowork_no_ping_succeeds)
+{
+    // arrange
+    g_current_ms = (TEST_KEEP_ALIVE_INTERVAL-5)*1000;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+
+    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
+    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    mqtt_client_dowork(mqttHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+TEST_FUNCTION(mqtt_client_dowork_tickcounter_fails_succeeds)
+{
+    // arrange
+    g_current_ms = (TEST_KEEP_ALIVE_INTERVAL - 5) * 1000;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
 
     unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
     size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
 
     (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
     g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
     umock_c_reset_all_calls();
 
-    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
-
     EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mqtt_codec_ping());
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_delete(TEST_BUFFER_HANDLE));
-    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2).SetReturn(__LINE__);
 
     // act
     mqtt_client_dowork(mqttHandle);
@@ -1216,146 +4064,235 @@ TEST_FUNCTION(mqtt_client_dowork_ping_succeeds)
     mqtt_client_deinit(mqttHandle);
 }
 
-/* Tests_SRS_MQTT_CLIENT_07_035: [If the timeSincePing has expired past the maxPingRespTime then mqtt_client_dowork shall call the Operation Callback function with the message MQTT_CLIENT_NO_PING_RESPONSE] */
-TEST_FUNCTION(mqtt_client_dowork_ping_No_ping_response_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_124: [If handle or timeoutMs is NULL then mqtt_client_get_dowork_timeout shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_handle_NULL_fail)
+{
+    // arrange
+    uint32_t timeoutMs;
+
+    // act
+    int result = mqtt_client_get_dowork_timeout(NULL, &timeoutMs);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_125: [If tickcounter_get_current_ms fails then mqtt_client_get_dowork_timeout shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_tickcounter_fail)
 {
     // arrange
+    uint32_t timeoutMs;
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
 
-    MQTT_CLIENT_OPTIONS mqttOptions ={ 0 };
-    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2).SetReturn(__LINE__);
 
-    unsigned char CONNACK_RESP[] ={ 0x1, 0x0 };
-    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
+    // act
+    int result = mqtt_client_get_dowork_timeout(mqttHandle, &timeoutMs);
 
-    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
-    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
-    mqtt_client_dowork(mqttHandle);
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
 
+/*Tests_SRS_MQTT_CLIENT_07_126: [mqtt_client_get_dowork_timeout shall store in timeoutMs the milliseconds left until mqtt_client_dowork has to send a PINGREQ, report a missing PINGRESP, resend an in flight message or send the send queue, 0 when one of them is due and MQTT_CLIENT_NO_TIMEOUT when none is pending, and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_nothing_pending_succeeds)
+{
+    // arrange
+    uint32_t timeoutMs = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
 
     // act
-    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 8 * 1000;
-
-    mqtt_client_dowork(mqttHandle);
+    int result = mqtt_client_get_dowork_timeout(mqttHandle, &timeoutMs);
 
     // assert
-    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(timeoutMs == MQTT_CLIENT_NO_TIMEOUT);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
-/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
-/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
-/*Codes_SRS_MQTT_CLIENT_07_026: [if keepAliveInternal is > 0 and the send time is greater than the MQTT KeepAliveInterval then it shall construct an MQTT PINGREQ packet.]*/
-TEST_FUNCTION(mqtt_client_dowork_no_keepalive_no_ping_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_126: [mqtt_client_get_dowork_timeout shall store in timeoutMs the milliseconds left until mqtt_client_dowork has to send a PINGREQ, report a missing PINGRESP, resend an in flight message or send the send queue, 0 when one of them is due and MQTT_CLIENT_NO_TIMEOUT when none is pending, and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_keep_alive_succeeds)
 {
     // arrange
+    uint32_t timeoutMs = 0;
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
 
     MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
-    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, 0, false, true, DELIVER_AT_MOST_ONCE);
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
 
     unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
     size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
 
     (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
     g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
     umock_c_reset_all_calls();
 
-    g_current_ms = TEST_KEEP_ALIVE_INTERVAL * 2 * 1000;
-
-    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
+    g_current_ms = 1000;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
 
     // act
-    mqtt_client_dowork(mqttHandle);
+    int result = mqtt_client_get_dowork_timeout(mqttHandle, &timeoutMs);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, (TEST_KEEP_ALIVE_INTERVAL - 10 + 1) * 1000 - 1000, (int)timeoutMs);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
+    g_current_ms = 0;
     mqtt_client_deinit(mqttHandle);
 }
 
-/*Codes_SRS_MQTT_CLIENT_07_024: [mqtt_client_dowork shall call the xio_dowork function to complete operations.]*/
-/*Codes_SRS_MQTT_CLIENT_07_025: [mqtt_client_dowork shall retrieve the the last packet send value and ...]*/
-TEST_FUNCTION(mqtt_client_dowork_no_ping_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_126: [mqtt_client_get_dowork_timeout shall store in timeoutMs the milliseconds left until mqtt_client_dowork has to send a PINGREQ, report a missing PINGRESP, resend an in flight message or send the send queue, 0 when one of them is due and MQTT_CLIENT_NO_TIMEOUT when none is pending, and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_send_queue_succeeds)
 {
     // arrange
-    g_current_ms = (TEST_KEEP_ALIVE_INTERVAL-5)*1000;
+    uint32_t timeoutMs = 0;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_set_send_coalescing(mqttHandle, TEST_PUBLISH_PACKET_LEN * 4, 10);
+    g_current_ms = 1000;
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    g_current_ms = 1004;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    int result = mqtt_client_get_dowork_timeout(mqttHandle, &timeoutMs);
 
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 6, (int)timeoutMs);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    g_current_ms = 0;
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_137: [When bytes were received since mqtt_client_dowork began mqtt_client_get_dowork_timeout shall report 0, since a TLS xio may hold decrypted bytes that only its next xio_dowork delivers.]*/
+TEST_FUNCTION(mqtt_client_get_dowork_timeout_bytes_received_succeeds)
+{
+    // arrange
+    uint32_t timeoutMs = MQTT_CLIENT_NO_TIMEOUT;
+    unsigned char CONNACK_PACKET[] = { 0x20, 0x02, 0x00, 0x00 };
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
 
     MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
     SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
 
-    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
-    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-
     (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
     g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    g_bytesRecv(g_bytesRecvCtx, CONNACK_PACKET, sizeof(CONNACK_PACKET));
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
 
     // act
-    mqtt_client_dowork(mqttHandle);
+    int result = mqtt_client_get_dowork_timeout(mqttHandle, &timeoutMs);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, (int)timeoutMs);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
-TEST_FUNCTION(mqtt_client_dowork_tickcounter_fails_succeeds)
+/*Tests_SRS_MQTT_CLIENT_07_138: [If handle or pendingSendCount is NULL then mqtt_client_get_pending_send_count shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_pending_send_count_handle_NULL_fail)
 {
     // arrange
-    g_current_ms = (TEST_KEEP_ALIVE_INTERVAL - 5) * 1000;
+    size_t pendingSendCount;
+
+    // act
+    int result = mqtt_client_get_pending_send_count(NULL, &pendingSendCount);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
+/*Tests_SRS_MQTT_CLIENT_07_138: [If handle or pendingSendCount is NULL then mqtt_client_get_pending_send_count shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_client_get_pending_send_count_pendingSendCount_NULL_fail)
+{
+    // arrange
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
 
-    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
-    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, TEST_USERNAME, TEST_PASSWORD, TEST_KEEP_ALIVE_INTERVAL, false, true, DELIVER_AT_MOST_ONCE);
+    // act
+    int result = mqtt_client_get_pending_send_count(mqttHandle, NULL);
 
-    unsigned char CONNACK_RESP[] = { 0x1, 0x0 };
-    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    (void)mqtt_client_connect(mqttHandle, TEST_IO_HANDLE, &mqttOptions);
-    g_openComplete(g_onCompleteCtx, IO_OPEN_OK);
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_139: [mqtt_client_get_pending_send_count shall store in pendingSendCount the number of xio_send calls made since mqtt_client_connect whose send complete callback has not been called, and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_pending_send_count_succeeds)
+{
+    // arrange
+    size_t pendingSendCount = 0;
+    size_t completedCount = 1;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(xio_dowork(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2).SetReturn(__LINE__);
+    // act
+    int result = mqtt_client_get_pending_send_count(mqttHandle, &pendingSendCount);
+    g_sendComplete(g_onSendCtx, IO_SEND_OK);
+    (void)mqtt_client_get_pending_send_count(mqttHandle, &completedCount);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, pendingSendCount);
+    ASSERT_ARE_EQUAL(size_t, 0, completedCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_139: [mqtt_client_get_pending_send_count shall store in pendingSendCount the number of xio_send calls made since mqtt_client_connect whose send complete callback has not been called, and return 0.]*/
+TEST_FUNCTION(mqtt_client_get_pending_send_count_xio_send_fails_succeeds)
+{
+    // arrange
+    size_t pendingSendCount = 1;
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    setup_publish_batch_message_mocks();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, TEST_PUBLISH_PACKET_LEN));
+    STRICT_EXPECTED_CALL(mqtt_codec_publish_into(IGNORED_PTR_ARG, TEST_PUBLISH_PACKET_LEN, DELIVER_AT_LEAST_ONCE, true, true, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_APP_PAYLOAD.message, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
 
     // act
-    mqtt_client_dowork(mqttHandle);
+    (void)mqtt_client_publish(mqttHandle, TEST_MESSAGE_HANDLE);
+    int result = mqtt_client_get_pending_send_count(mqttHandle, &pendingSendCount);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, pendingSendCount);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
@@ -1377,14 +4314,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_context_NULL_fails)
     testData.actionResult = MQTT_CLIENT_ON_CONNACK;
     testData.msgInfo = &connack;
 
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
     // act
-    g_packetComplete(NULL, CONNACK_TYPE, 0, connack_handle);
+    g_packetComplete(NULL, CONNACK_TYPE, 0, CONNACK_RESP, length);
 
     // assert
     ASSERT_IS_FALSE(g_operationCallbackInvoked);
@@ -1395,7 +4329,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_context_NULL_fails)
 }
 
 /*Test_SRS_MQTT_CLIENT_07_027: [The callbackCtx parameter shall be an unmodified pointer that was passed to the mqtt_client_init function.]*/
-TEST_FUNCTION(mqtt_client_recvCompleteCallback_BUFFER_HANDLE_NULL_fails)
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_data_NULL_fails)
 {
     // arrange
     TEST_COMPLETE_DATA_INSTANCE testData;
@@ -1410,7 +4344,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_BUFFER_HANDLE_NULL_fails)
     umock_c_reset_all_calls();
 
     // act
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, NULL);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, NULL, 0);
 
     // assert
     ASSERT_IS_FALSE(g_operationCallbackInvoked);
@@ -1437,12 +4371,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeConnack(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
     // act
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1469,12 +4402,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_auth_reject_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE connack_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(CONNACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeConnack(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
     // act
-    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, connack_handle);
+    g_packetComplete(mqttHandle, CONNACK_TYPE, 0, CONNACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1485,6 +4417,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_CONNACK_auth_reject_succeeds)
 }
 
 /*Test_SRS_MQTT_CLIENT_07_029: [If the actionResult parameter are of types PUBACK_TYPE, PUBREC_TYPE, PUBREL_TYPE or PUBCOMP_TYPE then the msgInfo value shall be a PUBLISH_ACK structure.]*/
+/*Tests_SRS_MQTT_CLIENT_07_094: [The message passed to the ON_MQTT_MESSAGE_RECV_CALLBACK shall borrow its topic name and payload from the inbound packet with mqttmessage_createBorrowed.]*/
 TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_EXACTLY_ONCE_succeeds)
 {
     // arrange
@@ -1497,26 +4430,22 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_EXACTLY_ONCE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&PUBLISH_RESP);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE publish_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_RESP);
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(mqttmessage_create(TEST_PACKET_ID, IGNORED_PTR_ARG, DELIVER_EXACTLY_ONCE, IGNORED_PTR_ARG, TEST_APP_PAYLOAD.length))
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x0d, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mqttmessage_createBorrowed(TEST_PACKET_ID, IGNORED_PTR_ARG, DELIVER_EXACTLY_ONCE, IGNORED_PTR_ARG, TEST_APP_PAYLOAD.length))
         .IgnoreArgument(2)
         .IgnoreArgument(4);
     STRICT_EXPECTED_CALL(mqttmessage_setIsDuplicateMsg(TEST_MESSAGE_HANDLE, true));
     STRICT_EXPECTED_CALL(mqttmessage_setIsRetained(TEST_MESSAGE_HANDLE, true));
-    STRICT_EXPECTED_CALL(mqtt_codec_publishReceived(TEST_PACKET_ID));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishReceived_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
     STRICT_EXPECTED_CALL(mqttmessage_destroy(TEST_MESSAGE_HANDLE));
-    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, publish_handle);
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, PUBLISH_RESP, length);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
@@ -1539,14 +4468,15 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_EXACTLY_ONCE_fails)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&PUBLISH_RESP);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE publish_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_RESP);
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x0d, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mqttmessage_createBorrowed(TEST_PACKET_ID, IGNORED_PTR_ARG, DELIVER_EXACTLY_ONCE, IGNORED_PTR_ARG, TEST_APP_PAYLOAD.length))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4)
+        .SetReturn(NULL);
 
     // act
-    g_fail_alloc_calls = 1;
-    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, publish_handle);
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, PUBLISH_RESP, length);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
@@ -1569,26 +4499,22 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_AT_LEAST_ONCE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&PUBLISH_RESP);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE publish_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_RESP);
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(mqttmessage_create(TEST_PACKET_ID, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, IGNORED_PTR_ARG, TEST_APP_PAYLOAD.length))
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x0a, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mqttmessage_createBorrowed(TEST_PACKET_ID, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, IGNORED_PTR_ARG, TEST_APP_PAYLOAD.length))
         .IgnoreArgument(2)
         .IgnoreArgument(4);
     STRICT_EXPECTED_CALL(mqttmessage_setIsDuplicateMsg(TEST_MESSAGE_HANDLE, true));
     STRICT_EXPECTED_CALL(mqttmessage_setIsRetained(TEST_MESSAGE_HANDLE, false));
-    STRICT_EXPECTED_CALL(mqtt_codec_publishAck(TEST_PACKET_ID));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_publishAck_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
     STRICT_EXPECTED_CALL(mqttmessage_destroy(TEST_MESSAGE_HANDLE));
-    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, publish_handle);
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, PUBLISH_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_msgRecvCallbackInvoked);
@@ -1610,11 +4536,69 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_AT_MOST_ONCE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&PUBLISH_VALUE);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE publish_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_VALUE);
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(mqttmessage_create(0, IGNORED_PTR_ARG, DELIVER_AT_MOST_ONCE, IGNORED_PTR_ARG, 22))
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x00, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mqttmessage_createBorrowed(0, IGNORED_PTR_ARG, DELIVER_AT_MOST_ONCE, IGNORED_PTR_ARG, 22))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mqttmessage_setIsDuplicateMsg(TEST_MESSAGE_HANDLE, false));
+    STRICT_EXPECTED_CALL(mqttmessage_setIsRetained(TEST_MESSAGE_HANDLE, false));
+    STRICT_EXPECTED_CALL(mqttmessage_destroy(TEST_MESSAGE_HANDLE));
+
+    // act
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, PUBLISH_VALUE, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_msgRecvCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_090: [The CONNACK, PUBLISH, PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK and UNSUBACK packets shall be decoded in place with the mqtt_codec_decode functions.]*/
+/*Tests_SRS_MQTT_CLIENT_07_093: [If an inbound packet cannot be decoded the client shall call the Operation Callback with MQTT_CLIENT_ON_ERROR.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_decode_fails)
+{
+    // arrange
+    unsigned char PUBLISH_RESP[] = { 0x00, 0x0a, 0x74, 0x6f };
+    size_t length = sizeof(PUBLISH_RESP) / sizeof(PUBLISH_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x02, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4).SetReturn(__LINE__);
+
+    // act
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, 0x02, PUBLISH_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_errorCallbackInvoked);
+    ASSERT_IS_FALSE(g_msgRecvCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_092: [The topic name of an inbound PUBLISH shall be NUL terminated in a stack buffer, memory shall only be allocated for topic names of TOPIC_NAME_STACK_SIZE bytes or more.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_long_topic_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_RESP[2 + 200 + 3];
+    size_t length = sizeof(PUBLISH_RESP) / sizeof(PUBLISH_RESP[0]);
+    PUBLISH_RESP[0] = 0x00;
+    PUBLISH_RESP[1] = 200;
+    (void)memset(PUBLISH_RESP + 2, 't', 200 + 3);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodePublish(0x00, IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(2).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(gballoc_malloc(201));
+    STRICT_EXPECTED_CALL(mqttmessage_createBorrowed(0, IGNORED_PTR_ARG, DELIVER_AT_MOST_ONCE, IGNORED_PTR_ARG, 3))
         .IgnoreArgument(2)
         .IgnoreArgument(4);
     STRICT_EXPECTED_CALL(mqttmessage_setIsDuplicateMsg(TEST_MESSAGE_HANDLE, false));
@@ -1623,7 +4607,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_AT_MOST_ONCE_succeeds)
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    g_packetComplete(mqttHandle, PUBLISH_TYPE, flag, publish_handle);
+    g_packetComplete(mqttHandle, PUBLISH_TYPE, 0x00, PUBLISH_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_msgRecvCallbackInvoked);
@@ -1649,12 +4633,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_ACK_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
     // act
-    g_packetComplete(mqttHandle, PUBACK_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBACK_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1665,6 +4648,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_ACK_succeeds)
 }
 
 /*Test_SRS_MQTT_CLIENT_07_029: [If the actionResult parameter are of types PUBACK_TYPE, PUBREC_TYPE, PUBREL_TYPE or PUBCOMP_TYPE then the msgInfo value shall be a PUBLISH_ACK structure.]*/
+/*Tests_SRS_MQTT_CLIENT_07_043: [The PUBACK, PUBREC, PUBREL and PUBCOMP replies shall be encoded on the stack with the mqtt_codec_*_into functions and sent without allocating memory.]*/
 TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RECEIVE_succeeds)
 {
     // arrange
@@ -1680,18 +4664,16 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RECEIVE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
-    EXPECTED_CALL(mqtt_codec_publishRelease(IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mqtt_codec_publishRelease_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
 
     // act
-    g_packetComplete(mqttHandle, PUBREC_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBREC_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1717,14 +4699,13 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RECEIVE_fails)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
-    EXPECTED_CALL(mqtt_codec_publishRelease(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    EXPECTED_CALL(mqtt_codec_publishRelease_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 
     // act
     g_mqtt_codec_publish_func_fail = true;
-    g_packetComplete(mqttHandle, PUBREC_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBREC_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1750,18 +4731,16 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RELEASE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
-    EXPECTED_CALL(mqtt_codec_publishComplete(IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mqtt_codec_publishComplete_into(IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, TEST_PACKET_ID))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-    EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(xio_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MQTT_PUBLISH_REPLY_PACKET_SIZE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(2).IgnoreArgument(4).IgnoreArgument(5);
 
     // act
-    g_packetComplete(mqttHandle, PUBREL_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBREL_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1787,14 +4766,13 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_RELEASE_fails)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
-    EXPECTED_CALL(mqtt_codec_publishComplete(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    EXPECTED_CALL(mqtt_codec_publishComplete_into(IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 
     // act
     g_mqtt_codec_publish_func_fail = true;
-    g_packetComplete(mqttHandle, PUBREL_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBREL_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1820,12 +4798,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_COMPLETE_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PUBLISH_ACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
     // act
-    g_packetComplete(mqttHandle, PUBCOMP_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PUBCOMP_TYPE, 0, PUBLISH_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1835,7 +4812,8 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PUBLISH_COMPLETE_succeeds)
     mqtt_client_deinit(mqttHandle);
 }
 
-/*Test_SRS_MQTT_CLIENT_07_031: [If the actionResult parameter is of type UNSUBACK_TYPE then the msgInfo value shall be a UNSUBSCRIBE_ACK structure.]*/
+/*Test_SRS_MQTT_CLIENT_07_030: [If the actionResult parameter is of type SUBACK_TYPE then the msgInfo value shall be a SUBSCRIBE_ACK structure.]*/
+/*Tests_SRS_MQTT_CLIENT_07_091: [The SUBACK return codes shall be converted in a stack array, memory shall only be allocated when there are more than SUBACK_STACK_RETURN_CODES of them.]*/
 TEST_FUNCTION(mqtt_client_recvCompleteCallback_SUBACK_succeeds)
 {
     // arrange
@@ -1858,22 +4836,84 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_SUBACK_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(SUBSCRIBE_ACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeSuback(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    // act
+    g_packetComplete(mqttHandle, SUBACK_TYPE, 0, SUBSCRIBE_ACK_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    free(suback.qosReturn);
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_091: [The SUBACK return codes shall be converted in a stack array, memory shall only be allocated when there are more than SUBACK_STACK_RETURN_CODES of them.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_SUBACK_many_return_codes_succeeds)
+{
+    // arrange
+    const size_t PACKET_RETCODE_COUNT = 20;
+    unsigned char SUBSCRIBE_ACK_RESP[2 + 20] = { 0x12, 0x34 };
+    size_t length = sizeof(SUBSCRIBE_ACK_RESP) / sizeof(SUBSCRIBE_ACK_RESP[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData;
+    QOS_VALUE qosReturn[20];
+    SUBSCRIBE_ACK suback = { 0 };
+    suback.packetId = 0x1234;
+    suback.qosReturn = qosReturn;
+    suback.qosCount = PACKET_RETCODE_COUNT;
+    for (size_t index = 0; index < PACKET_RETCODE_COUNT; index++)
+    {
+        SUBSCRIBE_ACK_RESP[2 + index] = (unsigned char)(index % 3);
+        qosReturn[index] = (QOS_VALUE)(index % 3);
+    }
+
+    testData.actionResult = MQTT_CLIENT_ON_SUBSCRIBE_ACK;
+    testData.msgInfo = &suback;
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeSuback(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(QOS_VALUE) * PACKET_RETCODE_COUNT));
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    g_packetComplete(mqttHandle, SUBACK_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, SUBACK_TYPE, 0, SUBSCRIBE_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
-    free(suback.qosReturn);
+    mqtt_client_deinit(mqttHandle);
+}
+
+/*Tests_SRS_MQTT_CLIENT_07_093: [If an inbound packet cannot be decoded the client shall call the Operation Callback with MQTT_CLIENT_ON_ERROR.]*/
+TEST_FUNCTION(mqtt_client_recvCompleteCallback_SUBACK_decode_fails)
+{
+    // arrange
+    unsigned char SUBSCRIBE_ACK_RESP[] = { 0x12 };
+    size_t length = sizeof(SUBSCRIBE_ACK_RESP) / sizeof(SUBSCRIBE_ACK_RESP[0]);
+
+    MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeSuback(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3).SetReturn(__LINE__);
+
+    // act
+    g_packetComplete(mqttHandle, SUBACK_TYPE, 0, SUBSCRIBE_ACK_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_errorCallbackInvoked);
+    ASSERT_IS_FALSE(g_operationCallbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
     mqtt_client_deinit(mqttHandle);
 }
 
@@ -1881,7 +4921,7 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_SUBACK_succeeds)
 TEST_FUNCTION(mqtt_client_recvCompleteCallback_UNSUBACK_succeeds)
 {
     // arrange
-    unsigned char UNSUBSCRIBE_ACK_RESP[] = { 0xB0, 0x02, 0x12, 0x34 };
+    unsigned char UNSUBSCRIBE_ACK_RESP[] = { 0x12, 0x34 };
     size_t length = sizeof(UNSUBSCRIBE_ACK_RESP) / sizeof(UNSUBSCRIBE_ACK_RESP[0]);
     TEST_COMPLETE_DATA_INSTANCE testData;
     UNSUBSCRIBE_ACK unsuback = { 0 };
@@ -1893,12 +4933,11 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_UNSUBACK_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, (void*)&testData);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(UNSUBSCRIBE_ACK_RESP);
+    STRICT_EXPECTED_CALL(mqtt_codec_decodeAck(IGNORED_PTR_ARG, length, IGNORED_PTR_ARG))
+        .IgnoreArgument(1).IgnoreArgument(3);
 
     // act
-    g_packetComplete(mqttHandle, UNSUBACK_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, UNSUBACK_TYPE, 0, UNSUBSCRIBE_ACK_RESP, length);
 
     // assert
     ASSERT_IS_TRUE(g_operationCallbackInvoked);
@@ -1917,12 +4956,9 @@ TEST_FUNCTION(mqtt_client_recvCompleteCallback_PINGRESP_succeeds)
     MQTT_CLIENT_HANDLE mqttHandle = mqtt_client_init(TestRecvCallback, TestOpCallback, NULL);
     umock_c_reset_all_calls();
 
-    BUFFER_HANDLE packet_handle = TEST_BUFFER_HANDLE;
-    STRICT_EXPECTED_CALL(BUFFER_length(TEST_BUFFER_HANDLE)).SetReturn(length);
-    STRICT_EXPECTED_CALL(BUFFER_u_char(TEST_BUFFER_HANDLE)).SetReturn(PINGRESP_ACK_RESP);
 
     // act
-    g_packetComplete(mqttHandle, PINGRESP_TYPE, 0, packet_handle);
+    g_packetComplete(mqttHandle, PINGRESP_TYPE, 0, PINGRESP_ACK_RESP, length);
 
     // assert
     ASSERT_IS_FALSE(g_operationCallbackInvoked);
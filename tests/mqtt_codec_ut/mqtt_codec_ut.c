@@ -13,11 +13,20 @@
 extern "C" {
 #endif
 
+    static size_t g_alloc_count;
+
     void* my_gballoc_malloc(size_t size)
     {
+        g_alloc_count++;
         return malloc(size);
     }
 
+    void* my_gballoc_realloc(void* ptr, size_t size)
+    {
+        g_alloc_count++;
+        return realloc(ptr, size);
+    }
+
     void my_gballoc_free(void* ptr)
     {
         free(ptr);
@@ -38,6 +47,15 @@ extern "C" {
 
 static bool g_fail_alloc_calls;
 static bool g_callbackInvoked;
+static size_t g_publishBeginCount;
+static size_t g_publishEndCount;
+static uint16_t g_streamPacketId;
+static size_t g_streamPayloadLength;
+static char g_streamTopic[64];
+static unsigned char g_streamPayload[64];
+static size_t g_streamPayloadReceived;
+static size_t g_packetDiscardedCount;
+static size_t g_packetDiscardedLength;
 static CONTROL_PACKET_TYPE g_curr_packet_type;
 static const char* TEST_SUBSCRIPTION_TOPIC = "subTopic";
 static const char* TEST_CLIENT_ID = "single_threaded_test";
@@ -132,6 +150,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_build, real_BUFFER_build);
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, real_BUFFER_new);
@@ -159,6 +178,15 @@ TEST_FUNCTION_INITIALIZE(method_init)
     }
     g_fail_alloc_calls = false;
     g_callbackInvoked = false;
+    g_alloc_count = 0;
+    g_publishBeginCount = 0;
+    g_publishEndCount = 0;
+    g_streamPacketId = 0;
+    g_streamPayloadLength = 0;
+    g_streamPayloadReceived = 0;
+    memset(g_streamTopic, 0, sizeof(g_streamTopic));
+    g_packetDiscardedCount = 0;
+    g_packetDiscardedLength = 0;
 
     umock_c_reset_all_calls();
 }
@@ -174,7 +202,7 @@ static void PrintLogFunction(unsigned int options, char* format, ...)
     (void)format;
 }
 
-static void TestOnCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int flags, BUFFER_HANDLE headerData)
+static void TestOnCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, int flags, const uint8_t* data, size_t length)
 {
     TEST_COMPLETE_DATA_INSTANCE* testData = (TEST_COMPLETE_DATA_INSTANCE*)context;
     (void)flags;
@@ -184,9 +212,9 @@ static void TestOnCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, in
         {
             g_callbackInvoked = true;
         }
-        else if (testData->Length > 0 && testData->dataHeader != NULL)
+        else if (testData->Length > 0 && testData->dataHeader != NULL && data != NULL && length == testData->Length)
         {
-            if (memcmp(testData->dataHeader, real_BUFFER_u_char(headerData), testData->Length) == 0)
+            if (memcmp(testData->dataHeader, data, testData->Length) == 0)
             {
                 g_callbackInvoked = true;
             }
@@ -194,6 +222,37 @@ static void TestOnCompleteCallback(void* context, CONTROL_PACKET_TYPE packet, in
     }
 }
 
+static void TestOnPublishBegin(void* context, int flags, const char* topicName, uint16_t packetId, size_t payloadLength)
+{
+    (void)context;
+    (void)flags;
+    g_publishBeginCount++;
+    (void)strcpy(g_streamTopic, topicName);
+    g_streamPacketId = packetId;
+    g_streamPayloadLength = payloadLength;
+}
+
+static void TestOnPublishChunk(void* context, const uint8_t* data, size_t length)
+{
+    (void)context;
+    (void)memcpy(g_streamPayload + g_streamPayloadReceived, data, length);
+    g_streamPayloadReceived += length;
+}
+
+static void TestOnPublishEnd(void* context)
+{
+    (void)context;
+    g_publishEndCount++;
+}
+
+static void TestOnPacketDiscarded(void* context, CONTROL_PACKET_TYPE packet, size_t packetLength)
+{
+    (void)context;
+    (void)packet;
+    g_packetDiscardedCount++;
+    g_packetDiscardedLength = packetLength;
+}
+
 /* Tests_SRS_MQTT_CODEC_07_002: [On success mqtt_codec_create shall return a MQTTCODEC_HANDLE value.] */
 TEST_FUNCTION(mqtt_codec_create_succeed)
 {
@@ -251,14 +310,14 @@ TEST_FUNCTION(mqtt_codec_connect_MQTTCLIENT_OPTIONS_NULL_fail)
 }
 
 /* Tests_SRS_MQTT_CODEC_07_010: [If any error is encountered then mqtt_codec_connect shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_connect_BUFFER_enlarge_fail)
+TEST_FUNCTION(mqtt_codec_connect_BUFFER_pre_build_fail)
 {
     // arrange
     MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
     SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, "testuser", "testpassword", 20, false, true, DELIVER_AT_MOST_ONCE);
 
-    STRICT_EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_new());
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
@@ -274,15 +333,11 @@ TEST_FUNCTION(mqtt_codec_connect_WillMsg_zero_WillTopic_nonzero_fail)
     MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
     SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, TEST_WILL_MSG, NULL, "testuser", "testpassword", 20, false, true, DELIVER_AT_MOST_ONCE);
 
-    STRICT_EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-
     // act
     BUFFER_HANDLE handle = mqtt_codec_connect(&mqttOptions);
 
     // assert
-    ASSERT_IS_NULL(handle);
+    ASSERT_IS_NULL(handle);    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
 TEST_FUNCTION(mqtt_codec_connect_second_succeeds)
@@ -296,17 +351,9 @@ TEST_FUNCTION(mqtt_codec_connect_second_succeeds)
         0x6c, 0x6c, 0x20, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x00, 0x08, 0x57, 0x69, 0x6c, 0x6c, 0x20, 0x4d, 0x73, 0x67 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(CONNECT_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -335,17 +382,9 @@ TEST_FUNCTION(mqtt_codec_connect_succeeds)
         0x65, 0x73, 0x74, 0x75, 0x73, 0x65, 0x72, 0x00, 0x0c, 0x74, 0x65, 0x73, 0x74, 0x70, 0x61, 0x73, 0x73, 0x77, 0x6f, 0x72, 0x64 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(CONNECT_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -374,17 +413,9 @@ TEST_FUNCTION(mqtt_codec_connect_no_password_succeeds)
         0x65, 0x73, 0x74, 0x75, 0x73, 0x65, 0x72, 0x00, 0x00 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(CONNECT_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -419,17 +450,9 @@ TEST_FUNCTION(mqtt_codec_connect_Large_Data_succeeds)
     };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(CONNECT_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -453,7 +476,8 @@ TEST_FUNCTION(mqtt_codec_disconnect_succeed)
     const unsigned char DISCONNECT_VALUE[] = { 0xE0, 0x00 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(DISCONNECT_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
@@ -473,11 +497,11 @@ TEST_FUNCTION(mqtt_codec_disconnect_succeed)
 }
 
 /* Tests_SRS_MQTT_CODEC_07_012: [If any error is encountered mqtt_codec_disconnect shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_disconnect_BUFFER_enlarge_fails)
+TEST_FUNCTION(mqtt_codec_disconnect_BUFFER_pre_build_fails)
 {
     // arrange
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
@@ -489,11 +513,11 @@ TEST_FUNCTION(mqtt_codec_disconnect_BUFFER_enlarge_fails)
 }
 
 /* Tests_SRS_MQTT_CODEC_07_022: [If any error is encountered mqtt_codec_ping shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_ping_BUFFER_enlarge_fails)
+TEST_FUNCTION(mqtt_codec_ping_BUFFER_pre_build_fails)
 {
     // arrange
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
@@ -509,8 +533,9 @@ TEST_FUNCTION(mqtt_codec_ping_succeeds)
     // arrange
     const unsigned char PING_VALUE[] = { 0xC0, 0x00 };
 
-    STRICT_EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PING_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
@@ -543,13 +568,10 @@ TEST_FUNCTION(mqtt_codec_publish_topicName_NULL_fail)
 }
 
 /* Tests_SRS_CONTROL_PACKET_07_052: [mqtt_codec_publish shall constuct the MQTT variable header and shall return a non-zero value on failure.] */
-TEST_FUNCTION(mqtt_codec_publish_construct_BUFFER_enlarge_fail)
+TEST_FUNCTION(mqtt_codec_publish_BUFFER_new_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_new()).SetReturn(NULL);
 
     // act
     BUFFER_HANDLE handle = mqtt_codec_publish(DELIVER_AT_MOST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN);
@@ -560,15 +582,11 @@ TEST_FUNCTION(mqtt_codec_publish_construct_BUFFER_enlarge_fail)
 }
 
 /* Tests_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_BUFFER_enlarge_fails)
+TEST_FUNCTION(mqtt_codec_publish_BUFFER_pre_build_fails)
 {
     // arrange
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
@@ -580,23 +598,12 @@ TEST_FUNCTION(mqtt_codec_publish_BUFFER_enlarge_fails)
 }
 
 /* Tests_SRS_MQTT_CODEC_07_006: [If any error is encountered then mqtt_codec_publish shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_constructFixedHeader_fails)
+TEST_FUNCTION(mqtt_codec_publish_BUFFER_u_char_fails)
 {
     // arrange
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
@@ -614,18 +621,9 @@ TEST_FUNCTION(mqtt_codec_publish_msgBuffer_NULL_succeeds)
     const unsigned char PUBLISH_VALUE[] = { 0x38, 0x0c, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -651,20 +649,9 @@ TEST_FUNCTION(mqtt_codec_publish_succeeds)
         0x73, 0x73, 0x61, 0x67, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x73, 0x65, 0x6e, 0x64 };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -689,20 +676,9 @@ TEST_FUNCTION(mqtt_codec_publish_second_succeeds)
     const unsigned char PUBLISH_VALUE[] = { 0x30, 0x1c, 0x00, 0x04, 0x6d, 0x73, 0x67, 0x41, 0x54, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x70, 0x70, 0x20, 0x6d, 0x73, 0x67, 0x20, 0x41, 0x2e };
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
@@ -720,564 +696,2279 @@ TEST_FUNCTION(mqtt_codec_publish_second_succeeds)
     real_BUFFER_delete(handle);
 }
 
-/* Tests_SRS_MQTT_CODEC_07_013: [On success mqtt_codec_publishAck shall return a BUFFER_HANDLE representation of a MQTT PUBACK packet.] */
-TEST_FUNCTION(mqtt_codec_publish_ack_pre_build_fail)
+/* Tests_SRS_MQTT_CODEC_07_037: [If the parameters topicName or segments are NULL, or if msgBuffer is NULL and buffLen is not 0 then mqtt_codec_publishSegments shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_topicName_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1)
-        .SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishAck(TEST_PACKET_ID);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, NULL, TEST_MESSAGE, TEST_MESSAGE_LEN, segments);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_036: [mqtt_codec_publish shall return NULL if the buffLen variable is greater than the MAX_SEND_SIZE (0xFFFFFF7F).] */
-TEST_FUNCTION(mqtt_codec_publish_over_max_size_fail)
+/* Tests_SRS_MQTT_CODEC_07_037: [If the parameters topicName or segments are NULL, or if msgBuffer is NULL and buffLen is not 0 then mqtt_codec_publishSegments shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_segments_NULL_fail)
 {
     // arrange
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publish(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, OVER_MAX_SEND_SIZE);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN, NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
-
-    // cleanup
-    real_BUFFER_delete(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Tests_SRS_MQTT_CODEC_07_014 : [If any error is encountered then mqtt_codec_publishAck shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_ack_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_037: [If the parameters topicName or segments are NULL, or if msgBuffer is NULL and buffLen is not 0 then mqtt_codec_publishSegments shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_msgBuffer_NULL_fail)
 {
     // arrange
-    unsigned char PUBLISH_ACK_VALUE[] = { 0x40, 0x02, 0x12, 0x34 };
-
-    EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishAck(TEST_PACKET_ID);
-
-    unsigned char* data = real_BUFFER_u_char(handle);
-    size_t length = BUFFER_length(handle);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, NULL, TEST_MESSAGE_LEN, segments);
 
     // assert
+    ASSERT_IS_NULL(handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
-
-    // cleanup
-    real_BUFFER_delete(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_016 : [If any error is encountered then mqtt_codec_publishRecieved shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_received_pre_build_fail)
+/* Tests_SRS_MQTT_CODEC_07_038: [mqtt_codec_publishSegments shall return NULL if the buffLen variable is greater than the MAX_SEND_SIZE (0xFFFFFF7F).] */
+TEST_FUNCTION(mqtt_codec_publishSegments_over_max_size_fail)
 {
     // arrange
-    STRICT_EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1)
-        .SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishReceived(TEST_PACKET_ID);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, OVER_MAX_SEND_SIZE, segments);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_015: [On success mqtt_codec_publishRecieved shall return a BUFFER_HANDLE representation of a MQTT PUBREC packet.] */
-TEST_FUNCTION(mqtt_codec_publish_received_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_039: [If any error is encountered then mqtt_codec_publishSegments shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_BUFFER_pre_build_fails)
 {
     // arrange
-    unsigned char PUBLISH_ACK_VALUE[] = { 0x50, 0x02, 0x12, 0x34 };
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishReceived(TEST_PACKET_ID);
-
-    unsigned char* data = real_BUFFER_u_char(handle);
-    size_t length = BUFFER_length(handle);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN, segments);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
-
-    // cleanup
-    real_BUFFER_delete(handle);
+    ASSERT_IS_NULL(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_018 : [If any error is encountered then mqtt_codec_publishRelease shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_release_pre_build_fail)
+/* Tests_SRS_MQTT_CODEC_07_040: [mqtt_codec_publishSegments shall return a BUFFER_HANDLE that contains only the fixed and variable header of the MQTT PUBLISH message, with a remaining length that includes buffLen.] */
+/* Tests_SRS_MQTT_CODEC_07_041: [mqtt_codec_publishSegments shall set segments[0] to the header bytes in the returned BUFFER_HANDLE and segments[1] to msgBuffer and buffLen without copying the payload.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_succeeds)
 {
     // arrange
+    const unsigned char PUBLISH_HEADER_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34 };
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
+
     EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1)
-        .SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_HEADER_VALUE)))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishRelease(TEST_PACKET_ID);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN, segments);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_HEADER_VALUE), segments[0].length);
+    ASSERT_IS_TRUE(segments[0].data == real_BUFFER_u_char(handle));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(segments[0].data, PUBLISH_HEADER_VALUE, sizeof(PUBLISH_HEADER_VALUE)));
+    ASSERT_IS_TRUE(segments[1].data == TEST_MESSAGE);
+    ASSERT_ARE_EQUAL(size_t, TEST_MESSAGE_LEN, segments[1].length);
+
+    // cleanup
+    real_BUFFER_delete(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_017: [On success mqtt_codec_publishRelease shall return a BUFFER_HANDLE representation of a MQTT PUBREL packet.] */
-TEST_FUNCTION(mqtt_codec_publish_release_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_041: [mqtt_codec_publishSegments shall set segments[0] to the header bytes in the returned BUFFER_HANDLE and segments[1] to msgBuffer and buffLen without copying the payload.] */
+TEST_FUNCTION(mqtt_codec_publishSegments_no_payload_succeeds)
 {
     // arrange
-    unsigned char PUBLISH_ACK_VALUE[] = { 0x62, 0x02, 0x12, 0x34 };
+    const unsigned char PUBLISH_VALUE[] = { 0x38, 0x0c, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65 };
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_VALUE)))
         .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishRelease(TEST_PACKET_ID);
-
-    unsigned char* data = real_BUFFER_u_char(handle);
-    size_t length = BUFFER_length(handle);
+    BUFFER_HANDLE handle = mqtt_codec_publishSegments(DELIVER_AT_MOST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, NULL, 0, segments);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), segments[0].length);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(segments[0].data, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
+    ASSERT_ARE_EQUAL(size_t, 0, segments[1].length);
 
     // cleanup
     real_BUFFER_delete(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_020 : [If any error is encountered then mqtt_codec_publishComplete shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_publish_complete_pre_build_fail)
+/* Tests_SRS_MQTT_CODEC_07_049: [If topicName is NULL, empty, longer than 65535 bytes or contains the wildcard characters '+' or '#' then mqtt_codec_topicCreate shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_topicCreate_topicName_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1)
-        .SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishComplete(TEST_PACKET_ID);
+    MQTT_TOPIC_HANDLE handle = mqtt_codec_topicCreate(NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_019: [On success mqtt_codec_publishComplete shall return a BUFFER_HANDLE representation of a MQTT PUBCOMP packet.] */
-TEST_FUNCTION(mqtt_codec_publish_complete_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_049: [If topicName is NULL, empty, longer than 65535 bytes or contains the wildcard characters '+' or '#' then mqtt_codec_topicCreate shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_topicCreate_wildcard_fail)
 {
     // arrange
-    unsigned char PUBLISH_COMP_VALUE[] = { 0x70, 0x02, 0x12, 0x34 };
-
-    EXPECTED_CALL(BUFFER_new());
-    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_publishComplete(TEST_PACKET_ID);
-
-    unsigned char* data = real_BUFFER_u_char(handle);
-    size_t length = BUFFER_length(handle);
+    MQTT_TOPIC_HANDLE handle = mqtt_codec_topicCreate("devices/+/messages/#");
 
     // assert
+    ASSERT_IS_NULL(handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_COMP_VALUE, length));
-
-    // cleanup
-    real_BUFFER_delete(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_023: [If the parameters subscribeList is NULL or if count is 0 then mqtt_codec_subscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_subscribe_subscribeList_NULL_fails)
+/* Tests_SRS_MQTT_CODEC_07_051: [If any error is encountered then mqtt_codec_topicCreate shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_topicCreate_malloc_fail)
 {
     // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, NULL, 0);
+    MQTT_TOPIC_HANDLE handle = mqtt_codec_topicCreate(TEST_TOPIC_NAME);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_subscribe_BUFFER_enlarge_fails)
+/* Tests_SRS_MQTT_CODEC_07_050: [mqtt_codec_topicCreate shall allocate the handle and the length prefixed UTF-8 encoding of topicName in a single allocation.] */
+/* Tests_SRS_MQTT_CODEC_07_054: [mqtt_codec_topicGetName shall return the NULL terminated topic name stored in topicHandle.] */
+/* Tests_SRS_MQTT_CODEC_07_052: [mqtt_codec_topicDestroy shall free all resources associated with topicHandle and shall do nothing if topicHandle is NULL.] */
+TEST_FUNCTION(mqtt_codec_topicCreate_succeeds)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+    MQTT_TOPIC_HANDLE handle = mqtt_codec_topicCreate(TEST_TOPIC_NAME);
+    const char* topicName = mqtt_codec_topicGetName(handle);
 
     // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, topicName);
+
+    // cleanup
+    mqtt_codec_topicDestroy(handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_subscribe_addListItemsToSubscribePacket_fails)
+/* Tests_SRS_MQTT_CODEC_07_053: [If topicHandle is NULL then mqtt_codec_topicGetName shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_topicGetName_topicHandle_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+    const char* topicName = mqtt_codec_topicGetName(NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
+    ASSERT_IS_NULL(topicName);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_subscribe_constructFixedHeader_fails)
+/* Tests_SRS_MQTT_CODEC_07_055: [If topicHandle is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall fail.] */
+TEST_FUNCTION(mqtt_codec_publishTopic_topicHandle_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    unsigned char buffer[64];
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+    BUFFER_HANDLE handle = mqtt_codec_publishTopic(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, NULL, TEST_MESSAGE, TEST_MESSAGE_LEN);
+    size_t result = mqtt_codec_publishTopic_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, NULL, TEST_MESSAGE, TEST_MESSAGE_LEN);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_026: [mqtt_codec_subscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.]*/
-/* Codes_SRS_MQTT_CODEC_07_024: [mqtt_codec_subscribe shall iterate through count items in the subscribeList.] */
-TEST_FUNCTION(mqtt_codec_subscribe_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_056: [mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall copy the pre-encoded topic from topicHandle and shall produce the same packet as mqtt_codec_publish and mqtt_codec_publish_into.] */
+TEST_FUNCTION(mqtt_codec_publishTopic_succeeds)
 {
     // arrange
-    unsigned char SUBSCRIBE_VALUE[] = { 0x82, 0x1a, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x01, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32, 0x02 };
-
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    const unsigned char PUBLISH_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34, 0x4d, 0x65, \
+        0x73, 0x73, 0x61, 0x67, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x73, 0x65, 0x6e, 0x64 };
+    MQTT_TOPIC_HANDLE topicHandle = mqtt_codec_topicCreate(TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
 
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(PUBLISH_VALUE)))
+        .IgnoreArgument(1);
     EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
     EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+    BUFFER_HANDLE handle = mqtt_codec_publishTopic(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, topicHandle, TEST_MESSAGE, TEST_MESSAGE_LEN);
 
     unsigned char* data = real_BUFFER_u_char(handle);
     size_t length = BUFFER_length(handle);
 
     // assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
     ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, SUBSCRIBE_VALUE, length));
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), length);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_VALUE, length));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     real_BUFFER_delete(handle);
+    mqtt_codec_topicDestroy(topicHandle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_027: [If the parameters unsubscribeList is NULL or if count is 0 then mqtt_codec_unsubscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_unsubscribe_subscribeList_NULL_fails)
+/* Tests_SRS_MQTT_CODEC_07_056: [mqtt_codec_publishTopic and mqtt_codec_publishTopic_into shall copy the pre-encoded topic from topicHandle and shall produce the same packet as mqtt_codec_publish and mqtt_codec_publish_into.] */
+TEST_FUNCTION(mqtt_codec_publishTopic_into_succeeds)
 {
     // arrange
+    const unsigned char PUBLISH_VALUE[] = { 0x30, 0x1c, 0x00, 0x04, 0x6d, 0x73, 0x67, 0x41, 0x54, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x70, 0x70, 0x20, 0x6d, 0x73, 0x67, 0x20, 0x41, 0x2e };
+    unsigned char buffer[64];
+    MQTT_TOPIC_HANDLE topicHandle = mqtt_codec_topicCreate(TOPIC_NAME_A);
+    umock_c_reset_all_calls();
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, NULL, 0);
+    size_t result = mqtt_codec_publishTopic_into(buffer, sizeof(buffer), DELIVER_AT_MOST_ONCE, false, false, 12, topicHandle, APP_NAME_A, APP_NAME_A_LEN);
 
     // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
+
+    // cleanup
+    mqtt_codec_topicDestroy(topicHandle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_unsubscribe_BUFFER_enlarge_fails)
+/* Tests_SRS_MQTT_CODEC_07_057: [If topicName is not a valid PUBLISH topic as defined for mqtt_codec_topicCreate or qosValue is not a valid QOS_VALUE then mqtt_codec_publishTemplateCreate shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateCreate_topicName_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, false, false, NULL);
 
     // assert
+    ASSERT_IS_NULL(handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_059: [If any error is encountered then mqtt_codec_publishTemplateCreate shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateCreate_malloc_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, false, false, TEST_TOPIC_NAME);
+
+    // assert
     ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_unsubscribe_addListItemToUnsubscribePacket_BUFFER_enlarge_fails)
+/* Tests_SRS_MQTT_CODEC_07_061: [If templateHandle or segments is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publishTemplate_into shall return 0 and mqtt_codec_publishTemplateSegments shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_publishTemplate_into_templateHandle_NULL_fail)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    unsigned char buffer[64];
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+    size_t result = mqtt_codec_publishTemplate_into(buffer, sizeof(buffer), NULL, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN);
+    int segmentResult = mqtt_codec_publishTemplateSegments(NULL, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN, buffer, sizeof(buffer), segments);
 
     // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, segmentResult);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
-TEST_FUNCTION(mqtt_codec_unsubscribe_constructFixedHeader_fails)
+/* Tests_SRS_MQTT_CODEC_07_058: [mqtt_codec_publishTemplateCreate shall pre-compute the PUBLISH flags and variable header in a single allocation.] */
+/* Tests_SRS_MQTT_CODEC_07_062: [mqtt_codec_publishTemplate_into shall write the fixed header, copy the pre-computed variable header, stamp packetId in place when the QoS requires one and copy msgBuffer.] */
+/* Tests_SRS_MQTT_CODEC_07_060: [mqtt_codec_publishTemplateDestroy shall free all resources associated with templateHandle and shall do nothing if templateHandle is NULL.] */
+TEST_FUNCTION(mqtt_codec_publishTemplate_into_succeeds)
 {
     // arrange
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    const unsigned char PUBLISH_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34, 0x4d, 0x65, \
+        0x73, 0x73, 0x61, 0x67, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x73, 0x65, 0x6e, 0x64 };
+    unsigned char buffer[64];
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    (void)mqtt_codec_publishTemplate_into(buffer, sizeof(buffer), handle, 0x5678, TEST_MESSAGE, TEST_MESSAGE_LEN);
+    size_t result = mqtt_codec_publishTemplate_into(buffer, sizeof(buffer), handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN);
 
     // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NULL(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_030: [mqtt_codec_unsubscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.] */
-TEST_FUNCTION(mqtt_codec_unsubscribe_succeeds)
+/* Tests_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+TEST_FUNCTION(mqtt_codec_publishTemplate_into_buffer_too_small_returns_required_size)
 {
     // arrange
-    unsigned char UNSUBSCRIBE_VALUE[] = { 0xa2, 0x18, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32 };
+    unsigned char buffer[30];
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    memset(buffer, 0xcc, sizeof(buffer));
+    umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_enlarge(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    // act
+    size_t result = mqtt_codec_publishTemplate_into(buffer, sizeof(buffer), handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 31, result);
+    ASSERT_ARE_EQUAL(int, 0xcc, buffer[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_062: [mqtt_codec_publishTemplate_into shall write the fixed header, copy the pre-computed variable header, stamp packetId in place when the QoS requires one and copy msgBuffer.] */
+TEST_FUNCTION(mqtt_codec_publishTemplate_into_qos0_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_VALUE[] = { 0x30, 0x1c, 0x00, 0x04, 0x6d, 0x73, 0x67, 0x41, 0x54, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x70, 0x70, 0x20, 0x6d, 0x73, 0x67, 0x20, 0x41, 0x2e };
+    unsigned char buffer[64];
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_MOST_ONCE, false, false, TOPIC_NAME_A);
+    umock_c_reset_all_calls();
+
+    // act
+    size_t result = mqtt_codec_publishTemplate_into(buffer, sizeof(buffer), handle, 12, APP_NAME_A, APP_NAME_A_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_063: [mqtt_codec_publishTemplateSegments shall build the fixed header, the variable header and packetId in header without writing to the template, and set segments[0] to the header and segments[1] to msgBuffer without copying the payload.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateSegments_succeeds)
+{
+    // arrange
+    const unsigned char HEADER_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34 };
+    unsigned char header[64];
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_publishTemplateSegments(handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN, header, sizeof(header), segments);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(segments[0].data == header);
+    ASSERT_ARE_EQUAL(size_t, sizeof(HEADER_VALUE), segments[0].length);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(segments[0].data, HEADER_VALUE, sizeof(HEADER_VALUE)));
+    ASSERT_IS_TRUE(segments[1].data == TEST_MESSAGE);
+    ASSERT_ARE_EQUAL(size_t, TEST_MESSAGE_LEN, segments[1].length);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_063: [mqtt_codec_publishTemplateSegments shall build the fixed header, the variable header and packetId in header without writing to the template, and set segments[0] to the header and segments[1] to msgBuffer without copying the payload.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateSegments_shared_template_succeeds)
+{
+    // arrange
+    unsigned char firstHeader[64];
+    unsigned char secondHeader[64];
+    unsigned char packet[64];
+    MQTT_BUFFER_SEGMENT firstSegments[MQTT_PUBLISH_SEGMENT_COUNT];
+    MQTT_BUFFER_SEGMENT secondSegments[MQTT_PUBLISH_SEGMENT_COUNT];
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
+
+    // act
+    int firstResult = mqtt_codec_publishTemplateSegments(handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN, firstHeader, sizeof(firstHeader), firstSegments);
+    int secondResult = mqtt_codec_publishTemplateSegments(handle, 0x5678, TEST_MESSAGE, TEST_MESSAGE_LEN, secondHeader, sizeof(secondHeader), secondSegments);
+    size_t packetLen = mqtt_codec_publishTemplate_into(packet, sizeof(packet), handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, firstResult);
+    ASSERT_ARE_EQUAL(int, 0, secondResult);
+    ASSERT_ARE_EQUAL(int, 0x12, (int)firstSegments[0].data[firstSegments[0].length - 2]);
+    ASSERT_ARE_EQUAL(int, 0x34, (int)firstSegments[0].data[firstSegments[0].length - 1]);
+    ASSERT_ARE_EQUAL(int, 0x56, (int)secondSegments[0].data[secondSegments[0].length - 2]);
+    ASSERT_ARE_EQUAL(int, 0x78, (int)secondSegments[0].data[secondSegments[0].length - 1]);
+    ASSERT_ARE_EQUAL(size_t, firstSegments[0].length + TEST_MESSAGE_LEN, packetLen);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(packet, firstSegments[0].data, firstSegments[0].length));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_104: [If header is NULL or capacity is smaller than the header of the packet then mqtt_codec_publishTemplateSegments shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateSegments_header_too_small_fail)
+{
+    // arrange
+    unsigned char header[64];
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
+
+    // act
+    int nullResult = mqtt_codec_publishTemplateSegments(handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN, NULL, sizeof(header), segments);
+    int smallResult = mqtt_codec_publishTemplateSegments(handle, TEST_PACKET_ID, TEST_MESSAGE, TEST_MESSAGE_LEN, header, 15, segments);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, nullResult);
+    ASSERT_ARE_NOT_EQUAL(int, 0, smallResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_102: [mqtt_codec_publishTemplateHeaderSize shall return the header storage mqtt_codec_publishTemplateSegments needs for any payload, MQTT_MAX_FIXED_HEADER_SIZE plus the variable header length.] */
+/* Tests_SRS_MQTT_CODEC_07_103: [If templateHandle is NULL then mqtt_codec_publishTemplateHeaderSize shall return 0.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateHeaderSize_succeeds)
+{
+    // arrange
+    MQTT_PUBLISH_TEMPLATE_HANDLE handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
+
+    // act
+    size_t result = mqtt_codec_publishTemplateHeaderSize(handle);
+    size_t nullResult = mqtt_codec_publishTemplateHeaderSize(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, MQTT_MAX_FIXED_HEADER_SIZE + 14, result);
+    ASSERT_ARE_EQUAL(size_t, 0, nullResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_109: [If templateHandle is NULL then mqtt_codec_publishTemplateGetQos shall return DELIVER_FAILURE.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateGetQos_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    QOS_VALUE result = mqtt_codec_publishTemplateGetQos(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, DELIVER_FAILURE, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_108: [mqtt_codec_publishTemplateGetQos shall return the QoS the template was created with.] */
+TEST_FUNCTION(mqtt_codec_publishTemplateGetQos_succeeds)
+{
+    // arrange
+    MQTT_PUBLISH_TEMPLATE_HANDLE qos0Handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_MOST_ONCE, false, true, TEST_TOPIC_NAME);
+    MQTT_PUBLISH_TEMPLATE_HANDLE qos1Handle = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, true, false, TEST_TOPIC_NAME);
+    MQTT_PUBLISH_TEMPLATE_HANDLE qos2Handle = mqtt_codec_publishTemplateCreate(DELIVER_EXACTLY_ONCE, false, false, TEST_TOPIC_NAME);
+    umock_c_reset_all_calls();
+
+    // act
+    QOS_VALUE qos0Result = mqtt_codec_publishTemplateGetQos(qos0Handle);
+    QOS_VALUE qos1Result = mqtt_codec_publishTemplateGetQos(qos1Handle);
+    QOS_VALUE qos2Result = mqtt_codec_publishTemplateGetQos(qos2Handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, DELIVER_AT_MOST_ONCE, qos0Result);
+    ASSERT_ARE_EQUAL(int, DELIVER_AT_LEAST_ONCE, qos1Result);
+    ASSERT_ARE_EQUAL(int, DELIVER_EXACTLY_ONCE, qos2Result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_publishTemplateDestroy(qos0Handle);
+    mqtt_codec_publishTemplateDestroy(qos1Handle);
+    mqtt_codec_publishTemplateDestroy(qos2Handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_064: [If topicName is NULL or maxLen is greater than MAX_SEND_SIZE then mqtt_codec_publishReserve_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_publishReserve_into_topicName_NULL_fail)
+{
+    // arrange
+    unsigned char buffer[64];
 
+    // act
+    size_t result = mqtt_codec_publishReserve_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, false, false, TEST_PACKET_ID, NULL, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_065: [mqtt_codec_publishReserve_into shall return MQTT_MAX_FIXED_HEADER_SIZE plus the variable header length plus maxLen and shall not write to buffer if buffer is NULL or capacity is smaller than that.] */
+TEST_FUNCTION(mqtt_codec_publishReserve_into_buffer_NULL_returns_required_size)
+{
+    // arrange
+
+    // act
+    size_t result = mqtt_codec_publishReserve_into(NULL, 0, DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, MQTT_MAX_FIXED_HEADER_SIZE + 14 + 100, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_066: [mqtt_codec_publishReserve_into shall store the PUBLISH type and flags in the first byte of buffer and write the variable header after MQTT_MAX_FIXED_HEADER_SIZE bytes, leaving the last maxLen bytes for the payload.] */
+/* Tests_SRS_MQTT_CODEC_07_068: [mqtt_codec_publishCommit shall write the fixed header for actualLen bytes of payload so that it ends where the variable header starts, set packetOffset to the start of the packet and return the packet length.] */
+TEST_FUNCTION(mqtt_codec_publishCommit_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34, 0x4d, 0x65, \
+        0x73, 0x73, 0x61, 0x67, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x73, 0x65, 0x6e, 0x64 };
+    unsigned char buffer[256];
+    size_t maxLen = 200;
+    size_t packetOffset = 0;
+
+    // act
+    size_t reservedLen = mqtt_codec_publishReserve_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, maxLen);
+    (void)memcpy(buffer + reservedLen - maxLen, TEST_MESSAGE, TEST_MESSAGE_LEN);
+    size_t result = mqtt_codec_publishCommit(buffer, reservedLen, maxLen, TEST_MESSAGE_LEN, &packetOffset);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), result);
+    ASSERT_ARE_EQUAL(size_t, MQTT_MAX_FIXED_HEADER_SIZE - 2, packetOffset);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer + packetOffset, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_067: [If buffer or packetOffset is NULL, if reservedLen cannot hold the fixed header room and maxLen bytes or if actualLen is greater than maxLen then mqtt_codec_publishCommit shall return 0.] */
+TEST_FUNCTION(mqtt_codec_publishCommit_actualLen_too_large_fail)
+{
+    // arrange
+    unsigned char buffer[64];
+    size_t packetOffset = 0;
+    size_t reservedLen = mqtt_codec_publishReserve_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, 10);
+
+    // act
+    size_t result = mqtt_codec_publishCommit(buffer, reservedLen, 10, 11, &packetOffset);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_013: [On success mqtt_codec_publishAck shall return a BUFFER_HANDLE representation of a MQTT PUBACK packet.] */
+TEST_FUNCTION(mqtt_codec_publish_ack_pre_build_fail)
+{
+    // arrange
     EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_prepend(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1)
+        .SetReturn(__LINE__);
     EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
 
     // act
-    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+    BUFFER_HANDLE handle = mqtt_codec_publishAck(TEST_PACKET_ID);
 
-    unsigned char* data = real_BUFFER_u_char(handle);
-    size_t length = BUFFER_length(handle);
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_036: [mqtt_codec_publish shall return NULL if the buffLen variable is greater than the MAX_SEND_SIZE (0xFFFFFF7F).] */
+TEST_FUNCTION(mqtt_codec_publish_over_max_size_fail)
+{
+    // arrange
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publish(DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, OVER_MAX_SEND_SIZE);
 
     // assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_IS_NOT_NULL(handle);
-    ASSERT_ARE_EQUAL(int, 0, memcmp(data, UNSUBSCRIBE_VALUE, length));
+    ASSERT_IS_NULL(handle);
 
     // cleanup
     real_BUFFER_delete(handle);
 }
 
+/* Tests_SRS_MQTT_CODEC_07_014 : [If any error is encountered then mqtt_codec_publishAck shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publish_ack_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_VALUE[] = { 0x40, 0x02, 0x12, 0x34 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishAck(TEST_PACKET_ID);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_016 : [If any error is encountered then mqtt_codec_publishRecieved shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publish_received_pre_build_fail)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1)
+        .SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishReceived(TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_015: [On success mqtt_codec_publishRecieved shall return a BUFFER_HANDLE representation of a MQTT PUBREC packet.] */
+TEST_FUNCTION(mqtt_codec_publish_received_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_VALUE[] = { 0x50, 0x02, 0x12, 0x34 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishReceived(TEST_PACKET_ID);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_018 : [If any error is encountered then mqtt_codec_publishRelease shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publish_release_pre_build_fail)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1)
+        .SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishRelease(TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_017: [On success mqtt_codec_publishRelease shall return a BUFFER_HANDLE representation of a MQTT PUBREL packet.] */
+TEST_FUNCTION(mqtt_codec_publish_release_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_ACK_VALUE[] = { 0x62, 0x02, 0x12, 0x34 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishRelease(TEST_PACKET_ID);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_ACK_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_020 : [If any error is encountered then mqtt_codec_publishComplete shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_publish_complete_pre_build_fail)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1)
+        .SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishComplete(TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_019: [On success mqtt_codec_publishComplete shall return a BUFFER_HANDLE representation of a MQTT PUBCOMP packet.] */
+TEST_FUNCTION(mqtt_codec_publish_complete_succeeds)
+{
+    // arrange
+    unsigned char PUBLISH_COMP_VALUE[] = { 0x70, 0x02, 0x12, 0x34 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, 4))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_publishComplete(TEST_PACKET_ID);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, PUBLISH_COMP_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_023: [If the parameters subscribeList is NULL or if count is 0 then mqtt_codec_subscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_subscribe_subscribeList_NULL_fails)
+{
+    // arrange
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, NULL, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_subscribe_BUFFER_new_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new()).SetReturn(NULL);
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_subscribe_BUFFER_pre_build_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_025: [If any error is encountered then mqtt_codec_subscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_subscribe_BUFFER_u_char_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)).SetReturn(NULL);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_026: [mqtt_codec_subscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.]*/
+/* Codes_SRS_MQTT_CODEC_07_024: [mqtt_codec_subscribe shall iterate through count items in the subscribeList.] */
+TEST_FUNCTION(mqtt_codec_subscribe_succeeds)
+{
+    // arrange
+    unsigned char SUBSCRIBE_VALUE[] = { 0x82, 0x1a, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x01, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32, 0x02 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(SUBSCRIBE_VALUE)))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_subscribe(TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, SUBSCRIBE_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_027: [If the parameters unsubscribeList is NULL or if count is 0 then mqtt_codec_unsubscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_subscribeList_NULL_fails)
+{
+    // arrange
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, NULL, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_BUFFER_new_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new()).SetReturn(NULL);
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_BUFFER_pre_build_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(__LINE__);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_029: [If any error is encountered then mqtt_codec_unsubscribe shall return NULL.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_BUFFER_u_char_fails)
+{
+    // arrange
+    EXPECTED_CALL(BUFFER_new());
+    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)).SetReturn(NULL);
+    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_030: [mqtt_codec_unsubscribe shall return a BUFFER_HANDLE that represents a MQTT SUBSCRIBE message.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_succeeds)
+{
+    // arrange
+    unsigned char UNSUBSCRIBE_VALUE[] = { 0xa2, 0x18, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32 };
+
+    EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(UNSUBSCRIBE_VALUE)))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
+    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE handle = mqtt_codec_unsubscribe(TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    unsigned char* data = real_BUFFER_u_char(handle);
+    size_t length = BUFFER_length(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(data, UNSUBSCRIBE_VALUE, length));
+
+    // cleanup
+    real_BUFFER_delete(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_042: [If mqttOptions is NULL or the options fail the same validation as mqtt_codec_connect then mqtt_codec_connect_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_connect_into_MQTTCLIENT_OPTIONS_NULL_fail)
+{
+    // arrange
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_connect_into(buffer, sizeof(buffer), NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_connect_into_succeeds)
+{
+    // arrange
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, "testuser", "testpassword", 20, false, true, DELIVER_AT_MOST_ONCE);
+    unsigned char buffer[64];
+
+    const unsigned char CONNECT_VALUE[] = { 0x10, 0x38, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x04, 0xc2, 0x00, 0x14, 0x00, 0x14, 0x73, 0x69, \
+        0x6e, 0x67, 0x6c, 0x65, 0x5f, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x65, 0x64, 0x5f, 0x74, 0x65, 0x73, 0x74, 0x00, 0x08, 0x74, \
+        0x65, 0x73, 0x74, 0x75, 0x73, 0x65, 0x72, 0x00, 0x0c, 0x74, 0x65, 0x73, 0x74, 0x70, 0x61, 0x73, 0x73, 0x77, 0x6f, 0x72, 0x64 };
+
+    // act
+    size_t result = mqtt_codec_connect_into(buffer, sizeof(buffer), &mqttOptions);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(CONNECT_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, CONNECT_VALUE, sizeof(CONNECT_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+TEST_FUNCTION(mqtt_codec_connect_into_buffer_NULL_returns_required_size)
+{
+    // arrange
+    MQTT_CLIENT_OPTIONS mqttOptions = { 0 };
+    SetupMqttLibOptions(&mqttOptions, TEST_CLIENT_ID, NULL, NULL, "testuser", "testpassword", 20, false, true, DELIVER_AT_MOST_ONCE);
+
+    // act
+    size_t result = mqtt_codec_connect_into(NULL, 0, &mqttOptions);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 58, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+TEST_FUNCTION(mqtt_codec_disconnect_into_buffer_too_small_returns_required_size)
+{
+    // arrange
+    unsigned char buffer[] = { 0xcc, 0xcc };
+
+    // act
+    size_t result = mqtt_codec_disconnect_into(buffer, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, result);
+    ASSERT_ARE_EQUAL(int, 0xcc, buffer[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_disconnect_into_succeeds)
+{
+    // arrange
+    const unsigned char DISCONNECT_VALUE[] = { 0xe0, 0x00 };
+    unsigned char buffer[2];
+
+    // act
+    size_t result = mqtt_codec_disconnect_into(buffer, sizeof(buffer));
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(DISCONNECT_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, DISCONNECT_VALUE, sizeof(DISCONNECT_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_ping_into_succeeds)
+{
+    // arrange
+    const unsigned char PING_VALUE[] = { 0xc0, 0x00 };
+    unsigned char buffer[2];
+
+    // act
+    size_t result = mqtt_codec_ping_into(buffer, sizeof(buffer));
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PING_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PING_VALUE, sizeof(PING_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_047: [mqtt_codec_pingPacket shall return a pointer to the constant MQTT_PING_PACKET_SIZE byte MQTT PINGREQ packet.] */
+TEST_FUNCTION(mqtt_codec_pingPacket_succeeds)
+{
+    // arrange
+    const unsigned char PING_VALUE[] = { 0xc0, 0x00 };
+
+    // act
+    const uint8_t* result = mqtt_codec_pingPacket();
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PING_VALUE), MQTT_PING_PACKET_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(result, PING_VALUE, sizeof(PING_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_048: [mqtt_codec_disconnectPacket shall return a pointer to the constant MQTT_DISCONNECT_PACKET_SIZE byte MQTT DISCONNECT packet.] */
+TEST_FUNCTION(mqtt_codec_disconnectPacket_succeeds)
+{
+    // arrange
+    const unsigned char DISCONNECT_VALUE[] = { 0xe0, 0x00 };
+
+    // act
+    const uint8_t* result = mqtt_codec_disconnectPacket();
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, sizeof(DISCONNECT_VALUE), MQTT_DISCONNECT_PACKET_SIZE);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(result, DISCONNECT_VALUE, sizeof(DISCONNECT_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_045: [If topicName is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publish_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_publish_into_topicName_NULL_fail)
+{
+    // arrange
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_publish_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, NULL, TEST_MESSAGE, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_045: [If topicName is NULL, if msgBuffer is NULL and buffLen is not 0 or if buffLen is greater than MAX_SEND_SIZE then mqtt_codec_publish_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_publish_into_over_max_size_fail)
+{
+    // arrange
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_publish_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, OVER_MAX_SEND_SIZE);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_043: [If buffer is NULL or capacity is smaller than the encoded packet then the mqtt_codec_*_into functions shall not write to buffer and shall return the number of bytes the packet requires.] */
+TEST_FUNCTION(mqtt_codec_publish_into_buffer_too_small_returns_required_size)
+{
+    // arrange
+    unsigned char buffer[30];
+    memset(buffer, 0xcc, sizeof(buffer));
+
+    // act
+    size_t result = mqtt_codec_publish_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 31, result);
+    ASSERT_ARE_EQUAL(int, 0xcc, buffer[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_publish_into_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_VALUE[] = { 0x3a, 0x1d, 0x00, 0x0a, 0x74, 0x6f, 0x70, 0x69, 0x63, 0x20, 0x4e, 0x61, 0x6d, 0x65, 0x12, 0x34, 0x4d, 0x65, \
+        0x73, 0x73, 0x61, 0x67, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x73, 0x65, 0x6e, 0x64 };
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_publish_into(buffer, sizeof(buffer), DELIVER_AT_LEAST_ONCE, true, false, TEST_PACKET_ID, TEST_TOPIC_NAME, TEST_MESSAGE, TEST_MESSAGE_LEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_VALUE, sizeof(PUBLISH_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_publishAck_into_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_ACK_VALUE[] = { 0x40, 0x02, 0x12, 0x34 };
+    unsigned char buffer[4];
+
+    // act
+    size_t result = mqtt_codec_publishAck_into(buffer, sizeof(buffer), TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_ACK_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_ACK_VALUE, sizeof(PUBLISH_ACK_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_publishReceived_into_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_REC_VALUE[] = { 0x50, 0x02, 0x12, 0x34 };
+    unsigned char buffer[4];
+
+    // act
+    size_t result = mqtt_codec_publishReceived_into(buffer, sizeof(buffer), TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_REC_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_REC_VALUE, sizeof(PUBLISH_REC_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_publishRelease_into_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_REL_VALUE[] = { 0x62, 0x02, 0x12, 0x34 };
+    unsigned char buffer[4];
+
+    // act
+    size_t result = mqtt_codec_publishRelease_into(buffer, sizeof(buffer), TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_REL_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_REL_VALUE, sizeof(PUBLISH_REL_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_publishComplete_into_succeeds)
+{
+    // arrange
+    const unsigned char PUBLISH_COMP_VALUE[] = { 0x70, 0x02, 0x12, 0x34 };
+    unsigned char buffer[4];
+
+    // act
+    size_t result = mqtt_codec_publishComplete_into(buffer, sizeof(buffer), TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBLISH_COMP_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, PUBLISH_COMP_VALUE, sizeof(PUBLISH_COMP_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_046: [If subscribeList or unsubscribeList is NULL, if count is 0 or if any topic is longer than 65535 bytes then mqtt_codec_subscribe_into and mqtt_codec_unsubscribe_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_subscribe_into_subscribeList_NULL_fails)
+{
+    // arrange
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_subscribe_into(buffer, sizeof(buffer), TEST_PACKET_ID, NULL, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_subscribe_into_succeeds)
+{
+    // arrange
+    unsigned char SUBSCRIBE_VALUE[] = { 0x82, 0x1a, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x01, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32, 0x02 };
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_subscribe_into(buffer, sizeof(buffer), TEST_PACKET_ID, TEST_SUBSCRIBE_PAYLOAD, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(SUBSCRIBE_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, SUBSCRIBE_VALUE, sizeof(SUBSCRIBE_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_046: [If subscribeList or unsubscribeList is NULL, if count is 0 or if any topic is longer than 65535 bytes then mqtt_codec_subscribe_into and mqtt_codec_unsubscribe_into shall return 0.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_into_count_0_fails)
+{
+    // arrange
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_unsubscribe_into(buffer, sizeof(buffer), TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_044: [On success the mqtt_codec_*_into functions shall write the complete MQTT packet to the start of buffer and return the number of bytes written.] */
+TEST_FUNCTION(mqtt_codec_unsubscribe_into_succeeds)
+{
+    // arrange
+    unsigned char UNSUBSCRIBE_VALUE[] = { 0xa2, 0x18, 0x12, 0x34, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x31, 0x00, 0x09, 0x73, 0x75, 0x62, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x32 };
+    unsigned char buffer[64];
+
+    // act
+    size_t result = mqtt_codec_unsubscribe_into(buffer, sizeof(buffer), TEST_PACKET_ID, TEST_UNSUBSCRIPTION_TOPIC, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, sizeof(UNSUBSCRIBE_VALUE), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, UNSUBSCRIBE_VALUE, sizeof(UNSUBSCRIBE_VALUE)));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /* Codes_SRS_MQTT_CODEC_07_031: [If the parameters handle or buffer is NULL then mqtt_codec_bytesReceived shall return a non-zero value.] */
 TEST_FUNCTION(mqtt_codec_bytesReceived_MQTTCODEC_HANDLE_fails)
 {
     // arrange
-    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
+    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
+
+    // act
+    mqtt_codec_bytesReceived(NULL, CONNACK_RESP, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Codes_SRS_MQTT_CODEC_07_031: [If the parameters handle or buffer is NULL then mqtt_codec_bytesReceived shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_buffer_NULL_fails)
+{
+    // arrange
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+
+    umock_c_reset_all_calls();
+
+    // act
+    mqtt_codec_bytesReceived(handle, NULL, 1);
+    
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_032: [If the parameters size is zero then mqtt_codec_bytesReceived shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_buffer_Len_0_fails)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+
+    umock_c_reset_all_calls();
+
+    // act
+    mqtt_codec_bytesReceived(handle, CONNACK_RESP, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
+/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_connack_succeed)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = CONNACK_RESP + FIXED_HEADER_SIZE;
+    testData.Length = 2;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    g_curr_packet_type = CONNACK_TYPE;
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, CONNACK_RESP+index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+TEST_FUNCTION(mqtt_codec_bytesReceived_connack_auth_reject_succeed)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] ={ 0x20, 0x2, 0x00, 0x05 };
+    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
+
+    TEST_COMPLETE_DATA_INSTANCE testData ={ 0 };
+    testData.dataHeader = CONNACK_RESP + FIXED_HEADER_SIZE;
+    testData.Length = 2;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    g_curr_packet_type = CONNACK_TYPE;
+
+    // act
+    mqtt_codec_bytesReceived(handle, CONNACK_RESP, length);
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
+/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_puback_succeed)
+{
+    // arrange
+    unsigned char PUBACK_RESP[] = { 0x40, 0x2, 0x12, 0x34 };
+    size_t length = sizeof(PUBACK_RESP) / sizeof(PUBACK_RESP[0]);
+
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBACK_RESP + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    g_curr_packet_type = PUBACK_TYPE;
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, PUBACK_RESP + index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
+/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_pingresp_succeed)
+{
+    // arrange
+    unsigned char PINGRESP_RESP[] = { 0xD0, 0x0 };
+    size_t length = sizeof(PINGRESP_RESP) / sizeof(PINGRESP_RESP[0]);
+
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    g_curr_packet_type = PINGRESP_TYPE;
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, PINGRESP_RESP + index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_long_message_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = {
+        0x32,  0xdc,  0x01,  0x00,  0xd5,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x73,  0x2f,  0x74,  0x65,  0x73,  0x74,  0x44,  0x65,  0x76,  0x69,
+        0x63,  0x65,  0x2f,  0x6d,  0x65,  0x73,  0x73,  0x61,  0x67,  0x65,  0x73,  0x2f,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x62,  0x6f,
+        0x75,  0x6e,  0x64,  0x2f,  0x69,  0x6f,  0x74,  0x68,  0x75,  0x62,  0x2d,  0x61,  0x63,  0x6b,  0x3d,  0x66,  0x75,  0x6c,  0x6c,  0x26,
+        0x25,  0x32,  0x34,  0x2e,  0x6d,  0x69,  0x64,  0x3d,  0x37,  0x35,  0x63,  0x65,  0x63,  0x30,  0x62,  0x32,  0x2d,  0x66,  0x30,  0x36,
+        0x39,  0x2d,  0x34,  0x66,  0x32,  0x61,  0x2d,  0x39,  0x38,  0x39,  0x35,  0x2d,  0x66,  0x31,  0x62,  0x35,  0x30,  0x34,  0x36,  0x62,
+        0x31,  0x34,  0x35,  0x63,  0x26,  0x25,  0x32,  0x34,  0x2e,  0x74,  0x6f,  0x3d,  0x25,  0x32,  0x46,  0x64,  0x65,  0x76,  0x69,  0x63,
+        0x65,  0x73,  0x25,  0x32,  0x46,  0x74,  0x65,  0x73,  0x74,  0x44,  0x65,  0x76,  0x69,  0x63,  0x65,  0x25,  0x32,  0x46,  0x6d,  0x65,
+        0x73,  0x73,  0x61,  0x67,  0x65,  0x73,  0x25,  0x32,  0x46,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x42,  0x6f,  0x75,  0x6e,  0x64,
+        0x26,  0x25,  0x32,  0x34,  0x2e,  0x63,  0x69,  0x64,  0x26,  0x25,  0x32,  0x34,  0x2e,  0x75,  0x69,  0x64,  0x3d,  0x53,  0x79,  0x73,
+        0x74,  0x65,  0x6d,  0x2e,  0x41,  0x72,  0x72,  0x61,  0x79,  0x53,  0x65,  0x67,  0x6d,  0x65,  0x6e,  0x74,  0x25,  0x36,  0x30,  0x31,
+        0x25,  0x35,  0x42,  0x53,  0x79,  0x73,  0x74,  0x65,  0x6d,  0x2e,  0x42,  0x79,  0x74,  0x65,  0x25,  0x35,  0x44,  0x00,  0x0e,  0x4d,
+        0x4c,  0x42
+    };
+
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + (FIXED_HEADER_SIZE + 1);
+    testData.Length = length - (FIXED_HEADER_SIZE + 1);
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
+/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    //                            1    2     3     4     T     o     p     i     c     10    11    d     a     t     a     sp    M     s     g
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
+/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_second_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    //                            1    2     3     4     T     o     p     i     c     10    11    d     a     t     a     sp    M     s     g
+    unsigned char PUBLISH[] = { 0x30, 0x1e, 0x00, 0x04, 0x6d, 0x73, 0x67, 0x41, 0x00, 0x16, 0x54, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x70, 0x70, 0x20, 0x6d, 0x73, 0x67, 0x20, 0x41, 0x2e };
+    //unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    // act
+    for (size_t index = 0; index < length; index++)
+    {
+        // Send 1 byte at a time
+        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_070: [If the whole packet body is contiguous in buffer then mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function with a pointer into buffer and shall not copy the packet.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_whole_packet_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_069: [Once the remaining length of a packet is known mqtt_codec_bytesReceived shall copy all of the packet bytes available in buffer in a single operation.] */
+/* Tests_SRS_MQTT_CODEC_07_071: [If the packet body spans more than one call then mqtt_codec_bytesReceived shall reassemble it in a buffer owned by the codec.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_split_packet_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+
+    // act
+    int result1 = mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+    int result2 = mqtt_codec_bytesReceived(handle, PUBLISH + 7, length - 7);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_070: [If the whole packet body is contiguous in buffer then mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function with a pointer into buffer and shall not copy the packet.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_two_packets_in_one_buffer_succeed)
+{
+    // arrange
+    unsigned char PUBACK_RESP[] = { 0x40, 0x2, 0x12, 0x34, 0x40, 0x2, 0x12, 0x34 };
+    size_t length = sizeof(PUBACK_RESP) / sizeof(PUBACK_RESP[0]);
+
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBACK_RESP + FIXED_HEADER_SIZE;
+    testData.Length = 2;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    g_curr_packet_type = PUBACK_TYPE;
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBACK_RESP, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_071: [If the packet body spans more than one call then mqtt_codec_bytesReceived shall reassemble it in a buffer owned by the codec.] */
+/* Tests_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_split_packet_realloc_fails)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_072: [The reassembly buffer shall be reused for subsequent packets and only reallocated when a packet does not fit in it.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_split_packets_reuse_buffer_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+    (void)mqtt_codec_bytesReceived(handle, PUBLISH + 7, length - 7);
+    umock_c_reset_all_calls();
+    g_callbackInvoked = false;
+    g_alloc_count = 0;
+
+    // act
+    for (size_t index = 0; index < 100; index++)
+    {
+        (void)mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+        (void)mqtt_codec_bytesReceived(handle, PUBLISH + 7, length - 7);
+    }
+
+    // assert
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(size_t, 0, g_alloc_count);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_073: [Once a packet has been delivered, if the reassembly buffer is larger than the high water mark it shall be freed.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_split_packet_over_high_water_mark_frees_buffer)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_setReassemblyHighWaterMark(handle, testData.Length - 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result1 = mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+    int result2 = mqtt_codec_bytesReceived(handle, PUBLISH + 7, length - 7);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_074: [If the parameter handle is NULL then mqtt_codec_setReassemblyHighWaterMark shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_setReassemblyHighWaterMark_handle_NULL_fails)
+{
+    // arrange
+
+    // act
+    int result = mqtt_codec_setReassemblyHighWaterMark(NULL, 1024);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_075: [mqtt_codec_setReassemblyHighWaterMark shall store highWaterMark and return zero, freeing a larger reassembly buffer if no packet is being reassembled.] */
+TEST_FUNCTION(mqtt_codec_setReassemblyHighWaterMark_frees_larger_buffer_succeed)
+{
+    // arrange
+    g_curr_packet_type = PUBLISH_TYPE;
+
+    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_bytesReceived(handle, PUBLISH, 7);
+    (void)mqtt_codec_bytesReceived(handle, PUBLISH + 7, length - 7);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_codec_setReassemblyHighWaterMark(handle, 4);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_076: [If handle is NULL, or only some of publishBegin, publishChunk and publishEnd are NULL, then mqtt_codec_setPublishStreaming shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_setPublishStreaming_handle_NULL_fails)
+{
+    // arrange
+
+    // act
+    int result = mqtt_codec_setPublishStreaming(NULL, 0, TestOnPublishBegin, TestOnPublishChunk, TestOnPublishEnd);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_076: [If handle is NULL, or only some of publishBegin, publishChunk and publishEnd are NULL, then mqtt_codec_setPublishStreaming shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_setPublishStreaming_publishChunk_NULL_fails)
+{
+    // arrange
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_setPublishStreaming(handle, 0, TestOnPublishBegin, NULL, TestOnPublishEnd);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_077: [When streaming is on, a PUBLISH whose remaining length is at least threshold shall be parsed incrementally instead of being buffered.] */
+/* Tests_SRS_MQTT_CODEC_07_078: [Once the topic name and packet id of a streamed PUBLISH have been read mqtt_codec_bytesReceived shall call the ON_PUBLISH_BEGIN_CALLBACK function with the payload length.] */
+/* Tests_SRS_MQTT_CODEC_07_079: [mqtt_codec_bytesReceived shall pass the payload bytes of a streamed PUBLISH available in buffer to the ON_PUBLISH_CHUNK_CALLBACK function without copying them.] */
+/* Tests_SRS_MQTT_CODEC_07_080: [Once the last payload byte has been passed on mqtt_codec_bytesReceived shall call the ON_PUBLISH_END_CALLBACK function.] */
+/* Tests_SRS_MQTT_CODEC_07_081: [mqtt_codec_setPublishStreaming shall store the callbacks and threshold, which take effect from the next packet, and return zero. NULL callbacks turn streaming off.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_streamed_succeed)
+{
+    // arrange
+    unsigned char PUBLISH[] = { 0x3A, 0x11, 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    size_t index;
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    int setResult = mqtt_codec_setPublishStreaming(handle, 0, TestOnPublishBegin, TestOnPublishChunk, TestOnPublishEnd);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 3));
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, 10))
+        .IgnoreArgument(1);
+
+    // act
+    // 5 bytes at a time splits both the variable header and the payload
+    for (index = 0; index < length; index += 5)
+    {
+        (void)mqtt_codec_bytesReceived(handle, PUBLISH + index, (length - index < 5) ? length - index : 5);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, setResult);
+    ASSERT_IS_FALSE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(size_t, 1, g_publishBeginCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_publishEndCount);
+    ASSERT_ARE_EQUAL(char_ptr, "Topic", g_streamTopic);
+    ASSERT_ARE_EQUAL(int, 0x1234, (int)g_streamPacketId);
+    ASSERT_ARE_EQUAL(size_t, 8, g_streamPayloadLength);
+    ASSERT_ARE_EQUAL(size_t, 8, g_streamPayloadReceived);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(g_streamPayload, "data Msg", 8));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_077: [When streaming is on, a PUBLISH whose remaining length is at least threshold shall be parsed incrementally instead of being buffered.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_under_stream_threshold_succeed)
+{
+    // arrange
+    unsigned char PUBLISH[] = { 0x3A, 0x11, 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_setPublishStreaming(handle, 1024, TestOnPublishBegin, TestOnPublishChunk, TestOnPublishEnd);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(size_t, 0, g_publishBeginCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_publish_streamed_topic_too_long_fails)
+{
+    // arrange
+    unsigned char PUBLISH[] = { 0x3A, 0x11, 0x00, 0x20, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_setPublishStreaming(handle, 0, TestOnPublishBegin, TestOnPublishChunk, TestOnPublishEnd);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 3));
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, length);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_publishBeginCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_082: [If the parameter handle is NULL then mqtt_codec_setMaxPacketSize shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_setMaxPacketSize_handle_NULL_fails)
+{
+    // arrange
+
+    // act
+    int result = mqtt_codec_setMaxPacketSize(NULL, 10, TestOnPacketDiscarded);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_083: [mqtt_codec_setMaxPacketSize shall store maxPacketSize and packetDiscarded, which take effect from the next packet, and return zero. A maxPacketSize of 0 removes the limit.] */
+/* Tests_SRS_MQTT_CODEC_07_084: [If the remaining length of a packet is larger than the maximum packet size mqtt_codec_bytesReceived shall count it, call the ON_PACKET_DISCARDED_CALLBACK function and skip its bytes without buffering them.] */
+/* Tests_SRS_MQTT_CODEC_07_085: [Once the last byte of a discarded packet has been skipped mqtt_codec_bytesReceived shall continue with the next packet.] */
+/* Tests_SRS_MQTT_CODEC_07_087: [mqtt_codec_getDiscardedPacketCount shall return the number of packets discarded for exceeding the maximum packet size.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_packet_over_max_size_discarded_succeed)
+{
+    // arrange
+    //                          PUBLISH discarded                                                                                                           PINGRESP
+    unsigned char PACKETS[] = { 0x30, 0x11, 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67, 0xD0, 0x00 };
+    size_t length = sizeof(PACKETS) / sizeof(PACKETS[0]);
+    size_t index;
+    int result = 0;
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    int setResult = mqtt_codec_setMaxPacketSize(handle, 16, TestOnPacketDiscarded);
+    umock_c_reset_all_calls();
+
+    // act
+    // 5 bytes at a time so the discarded packet spans several calls
+    for (index = 0; index < length && result == 0; index += 5)
+    {
+        result = mqtt_codec_bytesReceived(handle, PACKETS + index, (length - index < 5) ? length - index : 5);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, setResult);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_packetDiscardedCount);
+    ASSERT_ARE_EQUAL(size_t, 17, g_packetDiscardedLength);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(int, 1, (int)mqtt_codec_getDiscardedPacketCount(handle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_083: [mqtt_codec_setMaxPacketSize shall store maxPacketSize and packetDiscarded, which take effect from the next packet, and return zero. A maxPacketSize of 0 removes the limit.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_packet_at_max_size_succeed)
+{
+    // arrange
+    unsigned char PUBLISH[] = { 0x30, 0x11, 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
+    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
+    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
+    testData.Length = length - FIXED_HEADER_SIZE;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    (void)mqtt_codec_setMaxPacketSize(handle, 17, TestOnPacketDiscarded);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(size_t, 0, g_packetDiscardedCount);
+    ASSERT_ARE_EQUAL(int, 0, (int)mqtt_codec_getDiscardedPacketCount(handle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_086: [If the parameter handle is NULL then mqtt_codec_getDiscardedPacketCount shall return 0.] */
+TEST_FUNCTION(mqtt_codec_getDiscardedPacketCount_handle_NULL_fails)
+{
+    // arrange
+
+    // act
+    uint64_t result = mqtt_codec_getDiscardedPacketCount(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_088: [If the parameters handle, consumed, packets or packetCount are NULL, or buffer is NULL and size is not zero, then mqtt_codec_parse shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_parse_handle_NULL_fails)
+{
+    // arrange
+    unsigned char PINGRESP[] = { 0xD0, 0x00 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
+
+    // act
+    int result = mqtt_codec_parse(NULL, PINGRESP, sizeof(PINGRESP), &consumed, packets, 2, &packetCount);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_088: [If the parameters handle, consumed, packets or packetCount are NULL, or buffer is NULL and size is not zero, then mqtt_codec_parse shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_parse_consumed_NULL_fails)
+{
+    // arrange
+    unsigned char PINGRESP[] = { 0xD0, 0x00 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t packetCount;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_parse(handle, PINGRESP, sizeof(PINGRESP), NULL, packets, 2, &packetCount);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_090: [mqtt_codec_parse shall describe each complete packet at the start of buffer in packets with its type, flags, variable header and payload, set packetCount and consumed and return zero.] */
+/* Tests_SRS_MQTT_CODEC_07_091: [mqtt_codec_parse shall stop when maxPackets packets have been decoded or the next packet is not complete in buffer, the bytes of that packet are not consumed.] */
+/* Tests_SRS_MQTT_CODEC_07_092: [The header and payload of each MQTT_PACKET_VIEW shall point into buffer, mqtt_codec_parse shall not copy or allocate.] */
+TEST_FUNCTION(mqtt_codec_parse_complete_packets_succeed)
+{
+    // arrange
+    //                         PUBLISH                                                                                                  PUBACK                  PINGRESP    partial PUBACK
+    unsigned char PACKETS[] = { 0x3A, 0x11, 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67, 0x40, 0x02, 0x12, 0x34, 0xD0, 0x00, 0x40, 0x02, 0x12 };
+    MQTT_PACKET_VIEW packets[4];
+    size_t consumed;
+    size_t packetCount;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_parse(handle, PACKETS, sizeof(PACKETS), &consumed, packets, 4, &packetCount);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 3, packetCount);
+    ASSERT_ARE_EQUAL(size_t, 25, consumed);
+    ASSERT_ARE_EQUAL(int, PUBLISH_TYPE, packets[0].packetType);
+    ASSERT_ARE_EQUAL(int, 0x0A, packets[0].flags);
+    ASSERT_ARE_EQUAL(void_ptr, PACKETS + 2, packets[0].header);
+    ASSERT_ARE_EQUAL(size_t, 9, packets[0].headerLength);
+    ASSERT_ARE_EQUAL(void_ptr, PACKETS + 11, packets[0].payload);
+    ASSERT_ARE_EQUAL(size_t, 8, packets[0].payloadLength);
+    ASSERT_ARE_EQUAL(int, PUBACK_TYPE, packets[1].packetType);
+    ASSERT_ARE_EQUAL(void_ptr, PACKETS + 21, packets[1].header);
+    ASSERT_ARE_EQUAL(size_t, 2, packets[1].headerLength);
+    ASSERT_ARE_EQUAL(size_t, 0, packets[1].payloadLength);
+    ASSERT_ARE_EQUAL(int, PINGRESP_TYPE, packets[2].packetType);
+    ASSERT_ARE_EQUAL(size_t, 0, packets[2].headerLength);
+    ASSERT_IS_FALSE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_091: [mqtt_codec_parse shall stop when maxPackets packets have been decoded or the next packet is not complete in buffer, the bytes of that packet are not consumed.] */
+TEST_FUNCTION(mqtt_codec_parse_maxPackets_reached_succeed)
+{
+    // arrange
+    unsigned char PACKETS[] = { 0x40, 0x02, 0x12, 0x34, 0xD0, 0x00, 0xD0, 0x00 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_codec_parse(handle, PACKETS, sizeof(PACKETS), &consumed, packets, 2, &packetCount);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, packetCount);
+    ASSERT_ARE_EQUAL(size_t, 6, consumed);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
+}
+
+/* Tests_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+TEST_FUNCTION(mqtt_codec_parse_topic_longer_than_packet_fails)
+{
+    // arrange
+    unsigned char PACKETS[] = { 0xD0, 0x00, 0x30, 0x04, 0x00, 0x20, 0x54, 0x6f };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
+
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    umock_c_reset_all_calls();
 
     // act
-    mqtt_codec_bytesReceived(NULL, CONNACK_RESP, 1);
+    int result = mqtt_codec_parse(handle, PACKETS, sizeof(PACKETS), &consumed, packets, 2, &packetCount);
 
     // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, packetCount);
+    ASSERT_ARE_EQUAL(size_t, 2, consumed);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_031: [If the parameters handle or buffer is NULL then mqtt_codec_bytesReceived shall return a non-zero value.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_buffer_NULL_fails)
+/* Tests_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+TEST_FUNCTION(mqtt_codec_parse_packet_over_max_size_fails)
 {
     // arrange
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    unsigned char PACKETS[] = { 0x40, 0x02, 0x12, 0x34 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
 
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    (void)mqtt_codec_setMaxPacketSize(handle, 1, NULL);
     umock_c_reset_all_calls();
 
     // act
-    mqtt_codec_bytesReceived(handle, NULL, 1);
-    
+    int result = mqtt_codec_parse(handle, PACKETS, sizeof(PACKETS), &consumed, packets, 2, &packetCount);
+
     // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, packetCount);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_032: [If the parameters size is zero then mqtt_codec_bytesReceived shall return a non-zero value.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_buffer_Len_0_fails)
+/* Tests_SRS_MQTT_CODEC_07_089: [If a packet passed to mqtt_codec_bytesReceived is only partly decoded then mqtt_codec_parse shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_parse_bytesReceived_packet_pending_fails)
 {
     // arrange
-    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
+    unsigned char PACKETS[] = { 0x40, 0x02, 0x12, 0x34 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
 
     MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
-
+    (void)mqtt_codec_bytesReceived(handle, PACKETS, 1);
     umock_c_reset_all_calls();
 
     // act
-    mqtt_codec_bytesReceived(handle, CONNACK_RESP, 0);
+    int result = mqtt_codec_parse(handle, PACKETS, sizeof(PACKETS), &consumed, packets, 2, &packetCount);
 
     // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
-/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_connack_succeed)
+/* Tests_SRS_MQTT_CODEC_07_093: [If a packet is malformed or its remaining length is larger than the maximum packet size then mqtt_codec_parse shall return a non-zero value, consumed and packetCount describe the packets decoded before it.] */
+TEST_FUNCTION(mqtt_codec_parse_malformed_then_valid_packet_succeed)
 {
     // arrange
-    unsigned char CONNACK_RESP[] = { 0x20, 0x2, 0x1, 0x0 };
-    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-
-    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
-    testData.dataHeader = CONNACK_RESP + FIXED_HEADER_SIZE;
-    testData.Length = 2;
-
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    unsigned char MALFORMED[] = { 0x30, 0x04, 0x00, 0x20, 0x54, 0x6f };
+    unsigned char PUBACK[] = { 0x40, 0x02, 0x12, 0x34 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
 
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-
-    g_curr_packet_type = CONNACK_TYPE;
-
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, CONNACK_RESP+index, 1);
-    }
+    int malformedResult = mqtt_codec_parse(handle, MALFORMED, sizeof(MALFORMED), &consumed, packets, 2, &packetCount);
+    int result = mqtt_codec_parse(handle, PUBACK, sizeof(PUBACK), &consumed, packets, 2, &packetCount);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_NOT_EQUAL(int, 0, malformedResult);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, packetCount);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBACK), consumed);
+    ASSERT_ARE_EQUAL(int, PUBACK_TYPE, packets[0].packetType);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_codec_destroy(handle);
 }
 
-TEST_FUNCTION(mqtt_codec_bytesReceived_connack_auth_reject_succeed)
+/* Tests_SRS_MQTT_CODEC_07_107: [If an earlier call to mqtt_codec_bytesReceived failed then mqtt_codec_parse shall reset the codec as mqtt_codec_reset does and decode buffer from its first byte.] */
+TEST_FUNCTION(mqtt_codec_parse_after_bytesReceived_error_succeed)
 {
     // arrange
-    unsigned char CONNACK_RESP[] ={ 0x20, 0x2, 0x00, 0x05 };
-    size_t length = sizeof(CONNACK_RESP) / sizeof(CONNACK_RESP[0]);
-
-    TEST_COMPLETE_DATA_INSTANCE testData ={ 0 };
-    testData.dataHeader = CONNACK_RESP + FIXED_HEADER_SIZE;
-    testData.Length = 2;
-
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    unsigned char MALFORMED[] = { 0x30, 0x80, 0x80, 0x80, 0x80, 0x01 };
+    unsigned char PUBACK[] = { 0x40, 0x02, 0x12, 0x34 };
+    MQTT_PACKET_VIEW packets[2];
+    size_t consumed;
+    size_t packetCount;
 
+    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, NULL);
+    (void)mqtt_codec_bytesReceived(handle, MALFORMED, sizeof(MALFORMED));
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-
-    g_curr_packet_type = CONNACK_TYPE;
-
     // act
-    mqtt_codec_bytesReceived(handle, CONNACK_RESP, length);
+    int result = mqtt_codec_parse(handle, PUBACK, sizeof(PUBACK), &consumed, packets, 2, &packetCount);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, packetCount);
+    ASSERT_ARE_EQUAL(size_t, sizeof(PUBACK), consumed);
+    ASSERT_ARE_EQUAL(int, PUBACK_TYPE, packets[0].packetType);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
-/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_puback_succeed)
+/* Tests_SRS_MQTT_CODEC_07_105: [If handle is NULL then mqtt_codec_reset shall do nothing.] */
+TEST_FUNCTION(mqtt_codec_reset_handle_NULL_succeed)
 {
     // arrange
-    unsigned char PUBACK_RESP[] = { 0x40, 0x2, 0x12, 0x34 };
+
+    // act
+    mqtt_codec_reset(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_106: [mqtt_codec_reset shall drop the error state and any partly decoded packet so the next byte passed to mqtt_codec_bytesReceived starts a new packet.] */
+TEST_FUNCTION(mqtt_codec_reset_after_bytesReceived_error_succeed)
+{
+    // arrange
+    unsigned char MALFORMED[] = { 0x30, 0x80, 0x80, 0x80, 0x80, 0x01 };
+    unsigned char PUBACK_RESP[] = { 0x40, 0x02, 0x12, 0x34 };
     size_t length = sizeof(PUBACK_RESP) / sizeof(PUBACK_RESP[0]);
 
     TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
@@ -1285,27 +2976,17 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_puback_succeed)
     testData.Length = length - FIXED_HEADER_SIZE;
 
     MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
-
+    (void)mqtt_codec_bytesReceived(handle, MALFORMED, sizeof(MALFORMED));
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-
     g_curr_packet_type = PUBACK_TYPE;
 
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, PUBACK_RESP + index, 1);
-    }
+    mqtt_codec_reset(handle);
+    int result = mqtt_codec_bytesReceived(handle, PUBACK_RESP, length);
 
     // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
     ASSERT_IS_TRUE(g_callbackInvoked);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
@@ -1313,173 +2994,192 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_puback_succeed)
     mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
-/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_pingresp_succeed)
+/* Tests_SRS_MQTT_CODEC_07_094: [If data or connack is NULL, or length is less than 2, then mqtt_codec_decodeConnack shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_decodeConnack_length_too_short_fails)
 {
     // arrange
-    unsigned char PINGRESP_RESP[] = { 0xD0, 0x0 };
-    size_t length = sizeof(PINGRESP_RESP) / sizeof(PINGRESP_RESP[0]);
+    unsigned char CONNACK_RESP[] = { 0x01 };
+    CONNECT_ACK connack = { 0 };
 
-    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
-
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    // act
+    int result = mqtt_codec_decodeConnack(CONNACK_RESP, sizeof(CONNACK_RESP), &connack);
 
-    umock_c_reset_all_calls();
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    g_curr_packet_type = PINGRESP_TYPE;
+/* Tests_SRS_MQTT_CODEC_07_095: [mqtt_codec_decodeConnack shall set isSessionPresent from the first byte of data and returnCode from the second and return zero.] */
+TEST_FUNCTION(mqtt_codec_decodeConnack_succeed)
+{
+    // arrange
+    unsigned char CONNACK_RESP[] = { 0x01, 0x05 };
+    CONNECT_ACK connack = { 0 };
 
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, PINGRESP_RESP + index, 1);
-    }
+    int result = mqtt_codec_decodeConnack(CONNACK_RESP, sizeof(CONNACK_RESP), &connack);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(connack.isSessionPresent);
+    ASSERT_ARE_EQUAL(int, (int)CONN_REFUSED_NOT_AUTHORIZED, (int)connack.returnCode);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    // cleanup
-    mqtt_codec_destroy(handle);
 }
 
-TEST_FUNCTION(mqtt_codec_bytesReceived_publish_long_message_succeed)
+/* Tests_SRS_MQTT_CODEC_07_096: [If data or publishView is NULL, the topic name is empty, the topic name and packet id do not fit in length or flags hold an invalid QOS then mqtt_codec_decodePublish shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_decodePublish_packet_id_missing_fails)
 {
     // arrange
-    size_t i;
-    g_curr_packet_type = PUBLISH_TYPE;
+    unsigned char PUBLISH_BODY[] = { 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12 };
+    MQTT_PUBLISH_VIEW publishView;
 
-    unsigned char PUBLISH[] = {
-        0x32,  0xdc,  0x01,  0x00,  0xd5,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x73,  0x2f,  0x74,  0x65,  0x73,  0x74,  0x44,  0x65,  0x76,  0x69,
-        0x63,  0x65,  0x2f,  0x6d,  0x65,  0x73,  0x73,  0x61,  0x67,  0x65,  0x73,  0x2f,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x62,  0x6f,
-        0x75,  0x6e,  0x64,  0x2f,  0x69,  0x6f,  0x74,  0x68,  0x75,  0x62,  0x2d,  0x61,  0x63,  0x6b,  0x3d,  0x66,  0x75,  0x6c,  0x6c,  0x26,
-        0x25,  0x32,  0x34,  0x2e,  0x6d,  0x69,  0x64,  0x3d,  0x37,  0x35,  0x63,  0x65,  0x63,  0x30,  0x62,  0x32,  0x2d,  0x66,  0x30,  0x36,
-        0x39,  0x2d,  0x34,  0x66,  0x32,  0x61,  0x2d,  0x39,  0x38,  0x39,  0x35,  0x2d,  0x66,  0x31,  0x62,  0x35,  0x30,  0x34,  0x36,  0x62,
-        0x31,  0x34,  0x35,  0x63,  0x26,  0x25,  0x32,  0x34,  0x2e,  0x74,  0x6f,  0x3d,  0x25,  0x32,  0x46,  0x64,  0x65,  0x76,  0x69,  0x63,
-        0x65,  0x73,  0x25,  0x32,  0x46,  0x74,  0x65,  0x73,  0x74,  0x44,  0x65,  0x76,  0x69,  0x63,  0x65,  0x25,  0x32,  0x46,  0x6d,  0x65,
-        0x73,  0x73,  0x61,  0x67,  0x65,  0x73,  0x25,  0x32,  0x46,  0x64,  0x65,  0x76,  0x69,  0x63,  0x65,  0x42,  0x6f,  0x75,  0x6e,  0x64,
-        0x26,  0x25,  0x32,  0x34,  0x2e,  0x63,  0x69,  0x64,  0x26,  0x25,  0x32,  0x34,  0x2e,  0x75,  0x69,  0x64,  0x3d,  0x53,  0x79,  0x73,
-        0x74,  0x65,  0x6d,  0x2e,  0x41,  0x72,  0x72,  0x61,  0x79,  0x53,  0x65,  0x67,  0x6d,  0x65,  0x6e,  0x74,  0x25,  0x36,  0x30,  0x31,
-        0x25,  0x35,  0x42,  0x53,  0x79,  0x73,  0x74,  0x65,  0x6d,  0x2e,  0x42,  0x79,  0x74,  0x65,  0x25,  0x35,  0x44,  0x00,  0x0e,  0x4d,
-        0x4c,  0x42
-    };
+    // act
+    int result = mqtt_codec_decodePublish(0x02, PUBLISH_BODY, sizeof(PUBLISH_BODY), &publishView);
 
-    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
-    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
-    testData.dataHeader = PUBLISH + (FIXED_HEADER_SIZE + 1);
-    testData.Length = length - (FIXED_HEADER_SIZE + 1);
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+/* Tests_SRS_MQTT_CODEC_07_096: [If data or publishView is NULL, the topic name is empty, the topic name and packet id do not fit in length or flags hold an invalid QOS then mqtt_codec_decodePublish shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_decodePublish_invalid_qos_fails)
+{
+    // arrange
+    unsigned char PUBLISH_BODY[] = { 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34 };
+    MQTT_PUBLISH_VIEW publishView;
 
-    umock_c_reset_all_calls();
+    // act
+    int result = mqtt_codec_decodePublish(0x06, PUBLISH_BODY, sizeof(PUBLISH_BODY), &publishView);
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    for (i = 0; i < testData.Length; i++)
-    {
-        EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-        EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    }
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_097: [mqtt_codec_decodePublish shall point topicName and payload into data, set the packet id, QOS, duplicate and retain values and return zero.] */
+TEST_FUNCTION(mqtt_codec_decodePublish_succeed)
+{
+    // arrange
+    unsigned char PUBLISH_BODY[] = { 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x4d, 0x73, 0x67 };
+    MQTT_PUBLISH_VIEW publishView;
 
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
-    }
+    int result = mqtt_codec_decodePublish(0x0D, PUBLISH_BODY, sizeof(PUBLISH_BODY), &publishView);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(void_ptr, PUBLISH_BODY + 2, publishView.topicName);
+    ASSERT_ARE_EQUAL(size_t, 5, publishView.topicLength);
+    ASSERT_ARE_EQUAL(int, 0x1234, (int)publishView.packetId);
+    ASSERT_ARE_EQUAL(int, (int)DELIVER_EXACTLY_ONCE, (int)publishView.qosValue);
+    ASSERT_IS_TRUE(publishView.isDuplicateMsg);
+    ASSERT_IS_TRUE(publishView.isRetained);
+    ASSERT_ARE_EQUAL(void_ptr, PUBLISH_BODY + 9, publishView.payload);
+    ASSERT_ARE_EQUAL(size_t, 3, publishView.payloadLength);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    // cleanup
-    mqtt_codec_destroy(handle);
 }
 
-/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
-/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_publish_succeed)
+/* Tests_SRS_MQTT_CODEC_07_097: [mqtt_codec_decodePublish shall point topicName and payload into data, set the packet id, QOS, duplicate and retain values and return zero.] */
+TEST_FUNCTION(mqtt_codec_decodePublish_retain_AT_MOST_ONCE_succeed)
 {
     // arrange
-    size_t i;
-    g_curr_packet_type = PUBLISH_TYPE;
+    unsigned char PUBLISH_BODY[] = { 0x00, 0x05, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x4d, 0x73, 0x67 };
+    MQTT_PUBLISH_VIEW publishView;
 
-    //                            1    2     3     4     T     o     p     i     c     10    11    d     a     t     a     sp    M     s     g
-    unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
-    size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
-    TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
-    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
-    testData.Length = length - FIXED_HEADER_SIZE;
+    // act
+    int result = mqtt_codec_decodePublish(0x01, PUBLISH_BODY, sizeof(PUBLISH_BODY), &publishView);
 
-    MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, (int)publishView.packetId);
+    ASSERT_ARE_EQUAL(int, (int)DELIVER_AT_MOST_ONCE, (int)publishView.qosValue);
+    ASSERT_IS_FALSE(publishView.isDuplicateMsg);
+    ASSERT_IS_TRUE(publishView.isRetained);
+    ASSERT_ARE_EQUAL(size_t, 3, publishView.payloadLength);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    umock_c_reset_all_calls();
+/* Tests_SRS_MQTT_CODEC_07_098: [If data or packetId is NULL, or length is less than 2, then mqtt_codec_decodeAck shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_decodeAck_packetId_NULL_fails)
+{
+    // arrange
+    unsigned char PUBACK_BODY[] = { 0x12, 0x34 };
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    for (i = 0; i < testData.Length; i++)
-    {
-        EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-        EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    }
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    // act
+    int result = mqtt_codec_decodeAck(PUBACK_BODY, sizeof(PUBACK_BODY), NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_099: [mqtt_codec_decodeAck shall read the packet id from the first two bytes of data and return zero.] */
+TEST_FUNCTION(mqtt_codec_decodeAck_succeed)
+{
+    // arrange
+    unsigned char PUBACK_BODY[] = { 0x12, 0x34 };
+    uint16_t packetId = 0;
 
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
-    }
+    int result = mqtt_codec_decodeAck(PUBACK_BODY, sizeof(PUBACK_BODY), &packetId);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0x1234, (int)packetId);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
 
-    // cleanup
-    mqtt_codec_destroy(handle);
+/* Tests_SRS_MQTT_CODEC_07_100: [If data or subackView is NULL, or length is less than 2, then mqtt_codec_decodeSuback shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_decodeSuback_length_too_short_fails)
+{
+    // arrange
+    unsigned char SUBACK_BODY[] = { 0x12 };
+    MQTT_SUBACK_VIEW subackView;
+
+    // act
+    int result = mqtt_codec_decodeSuback(SUBACK_BODY, sizeof(SUBACK_BODY), &subackView);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/* Codes_SRS_MQTT_CODEC_07_033: [mqtt_codec_bytesReceived constructs a sequence of bytes into the corresponding MQTT packets and on success returns zero.] */
-/* Codes_SRS_MQTT_CODEC_07_034: [Upon a constructing a complete MQTT packet mqtt_codec_bytesReceived shall call the ON_PACKET_COMPLETE_CALLBACK function.] */
-TEST_FUNCTION(mqtt_codec_bytesReceived_publish_second_succeed)
+/* Tests_SRS_MQTT_CODEC_07_101: [mqtt_codec_decodeSuback shall read the packet id, point returnCodes at the bytes that follow it in data and return zero.] */
+TEST_FUNCTION(mqtt_codec_decodeSuback_succeed)
 {
     // arrange
-    size_t i;
-    g_curr_packet_type = PUBLISH_TYPE;
+    unsigned char SUBACK_BODY[] = { 0x12, 0x34, 0x01, 0x80, 0x02 };
+    MQTT_SUBACK_VIEW subackView;
 
-    //                            1    2     3     4     T     o     p     i     c     10    11    d     a     t     a     sp    M     s     g
-    unsigned char PUBLISH[] = { 0x30, 0x1e, 0x00, 0x04, 0x6d, 0x73, 0x67, 0x41, 0x00, 0x16, 0x54, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x70, 0x70, 0x20, 0x6d, 0x73, 0x67, 0x20, 0x41, 0x2e };
-    //unsigned char PUBLISH[] = { 0x3F, 0x11, 0x00, 0x06, 0x54, 0x6f, 0x70, 0x69, 0x63, 0x12, 0x34, 0x64, 0x61, 0x74, 0x61, 0x20, 0x4d, 0x73, 0x67 };
+    // act
+    int result = mqtt_codec_decodeSuback(SUBACK_BODY, sizeof(SUBACK_BODY), &subackView);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0x1234, (int)subackView.packetId);
+    ASSERT_ARE_EQUAL(void_ptr, SUBACK_BODY + 2, subackView.returnCodes);
+    ASSERT_ARE_EQUAL(size_t, 3, subackView.returnCodeCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Tests_SRS_MQTT_CODEC_07_035: [If any error is encountered then the packet state will be marked as error and mqtt_codec_bytesReceived shall return a non-zero value.] */
+TEST_FUNCTION(mqtt_codec_bytesReceived_remaining_length_too_long_fails)
+{
+    // arrange
+    unsigned char PUBLISH[] = { 0x30, 0x80, 0x80, 0x80, 0x80, 0x01 };
     size_t length = sizeof(PUBLISH) / sizeof(PUBLISH[0]);
     TEST_COMPLETE_DATA_INSTANCE testData = { 0 };
-    testData.dataHeader = PUBLISH + FIXED_HEADER_SIZE;
-    testData.Length = length - FIXED_HEADER_SIZE;
 
     MQTTCODEC_HANDLE handle = mqtt_codec_create(TestOnCompleteCallback, &testData);
 
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    for (i = 0; i < testData.Length; i++)
-    {
-        EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-        EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    }
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-
     // act
-    for (size_t index = 0; index < length; index++)
-    {
-        // Send 1 byte at a time
-        mqtt_codec_bytesReceived(handle, PUBLISH + index, 1);
-    }
+    int result = mqtt_codec_bytesReceived(handle, PUBLISH, length);
 
     // assert
-    ASSERT_IS_TRUE(g_callbackInvoked);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(g_callbackInvoked);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
@@ -1491,7 +3191,6 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_publish_second_succeed)
 TEST_FUNCTION(mqtt_codec_bytesReceived_suback_succeed)
 {
     // arrange
-    size_t i;
     g_curr_packet_type = SUBACK_TYPE;
 
     unsigned char SUBACK_RESP[] = { 0x90, 0x5, 0x12, 0x34, 0x01, 0x80, 0x02 };
@@ -1504,14 +3203,7 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_suback_succeed)
 
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    for (i = 0; i < testData.Length; i++)
-    {
-        EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-        EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    }
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
 
     // act
     for (size_t index = 0; index < length; index++)
@@ -1533,7 +3225,6 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_suback_succeed)
 TEST_FUNCTION(mqtt_codec_bytesReceived_unsuback_succeed)
 {
     // arrange
-    size_t i;
     g_curr_packet_type = UNSUBACK_TYPE;
 
     unsigned char UNSUBACK_RESP[] = { 0xB0, 0x5, 0x12, 0x34, 0x01, 0x80, 0x02 };
@@ -1546,14 +3237,7 @@ TEST_FUNCTION(mqtt_codec_bytesReceived_unsuback_succeed)
 
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(BUFFER_new());
-    EXPECTED_CALL(BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    for (i = 0; i < testData.Length; i++)
-    {
-        EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-        EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
-    }
-    EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, testData.Length));
 
     // act
     for (size_t index = 0; index < length; index++)
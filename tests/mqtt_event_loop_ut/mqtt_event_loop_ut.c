@@ -0,0 +1,923 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+static int g_fail_alloc_calls;
+
+void* my_gballoc_malloc(size_t size)
+{
+    void* alloc_result;
+    if (g_fail_alloc_calls != 0)
+    {
+        alloc_result = NULL;
+    }
+    else
+    {
+        alloc_result = malloc(size);
+    }
+    return alloc_result;
+}
+
+void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    void* alloc_result;
+    if (g_fail_alloc_calls != 0)
+    {
+        alloc_result = NULL;
+    }
+    else
+    {
+        alloc_result = realloc(ptr, size);
+    }
+    return alloc_result;
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#define ENABLE_MOCKS
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_umqtt_c/mqtt_client.h"
+
+#undef ENABLE_MOCKS
+
+#include "azure_umqtt_c/mqtt_event_loop.h"
+
+static const TICK_COUNTER_HANDLE TEST_COUNTER_HANDLE = (TICK_COUNTER_HANDLE)0x12;
+static const MQTT_CLIENT_HANDLE TEST_CLIENT_HANDLE = (MQTT_CLIENT_HANDLE)0x21;
+static const MQTT_CLIENT_HANDLE TEST_OTHER_CLIENT_HANDLE = (MQTT_CLIENT_HANDLE)0x22;
+static const uint32_t TEST_DOWORK_TIMEOUT = 500;
+
+static uint64_t g_current_ms;
+static uint32_t g_doworkTimeout;
+static int g_doworkTimeoutResult;
+static size_t g_doworkCount;
+static size_t g_pendingSendCount;
+static int g_pendingSendCountResult;
+// When set, mqtt_client_dowork completes the pending sends as an xio does once the socket takes the rest of a partial write
+static bool g_completeSendsOnDowork;
+// When set, the first mqtt_client_dowork removes the client that was not called from the loop
+static MQTT_EVENT_LOOP_HANDLE g_removeOnDowork;
+
+TEST_MUTEX_HANDLE test_serialize_mutex;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, uint64_t* current_ms)
+    {
+        (void)tick_counter;
+        *current_ms = g_current_ms;
+        return 0;
+    }
+
+    void my_mqtt_client_dowork(MQTT_CLIENT_HANDLE handle)
+    {
+        g_doworkCount++;
+        if (g_completeSendsOnDowork)
+        {
+            g_pendingSendCount = 0;
+        }
+        if (g_removeOnDowork != NULL)
+        {
+            (void)mqtt_event_loop_remove(g_removeOnDowork, (handle == TEST_CLIENT_HANDLE) ? TEST_OTHER_CLIENT_HANDLE : TEST_CLIENT_HANDLE);
+            g_removeOnDowork = NULL;
+        }
+    }
+
+    int my_mqtt_client_get_dowork_timeout(MQTT_CLIENT_HANDLE handle, uint32_t* timeoutMs)
+    {
+        (void)handle;
+        *timeoutMs = g_doworkTimeout;
+        return g_doworkTimeoutResult;
+    }
+
+    int my_mqtt_client_get_pending_send_count(MQTT_CLIENT_HANDLE handle, size_t* pendingSendCount)
+    {
+        (void)handle;
+        *pendingSendCount = g_pendingSendCount;
+        return g_pendingSendCountResult;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+BEGIN_TEST_SUITE(mqtt_event_loop_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    int result;
+
+    test_serialize_mutex = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(test_serialize_mutex);
+
+    umock_c_init(on_umock_c_error);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MQTT_CLIENT_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_client_dowork, my_mqtt_client_dowork);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_client_get_dowork_timeout, my_mqtt_client_get_dowork_timeout);
+    REGISTER_GLOBAL_MOCK_HOOK(mqtt_client_get_pending_send_count, my_mqtt_client_get_pending_send_count);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_COUNTER_HANDLE);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(test_serialize_mutex);
+}
+
+TEST_FUNCTION_INITIALIZE(method_init)
+{
+    if (TEST_MUTEX_ACQUIRE(test_serialize_mutex))
+    {
+        ASSERT_FAIL("Could not acquire test serialization mutex.");
+    }
+
+    g_fail_alloc_calls = 0;
+    g_current_ms = 0;
+    g_doworkTimeout = MQTT_CLIENT_NO_TIMEOUT;
+    g_doworkTimeoutResult = 0;
+    g_doworkCount = 0;
+    g_pendingSendCount = 0;
+    g_pendingSendCountResult = 0;
+    g_completeSendsOnDowork = false;
+    g_removeOnDowork = NULL;
+}
+
+TEST_FUNCTION_CLEANUP(method_cleanup)
+{
+    umock_c_reset_all_calls();
+    TEST_MUTEX_RELEASE(test_serialize_mutex);
+}
+
+static void setup_dowork_mocks(MQTT_CLIENT_HANDLE client)
+{
+    STRICT_EXPECTED_CALL(mqtt_client_dowork(client));
+    STRICT_EXPECTED_CALL(mqtt_client_get_dowork_timeout(client, IGNORED_PTR_ARG)).IgnoreArgument(2);
+}
+
+static void setup_run_once_mocks(void)
+{
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+}
+
+// Adds client and lets the first run take its deadline from g_doworkTimeout
+static MQTT_EVENT_LOOP_HANDLE create_loop_with_client(MQTT_CLIENT_HANDLE client, int fd)
+{
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    ASSERT_IS_NOT_NULL(loop);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_add(loop, client, fd));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+    g_doworkCount = 0;
+    umock_c_reset_all_calls();
+    return loop;
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_001: [mqtt_event_loop_create shall allocate the loop, an epoll instance and a tickcounter and return the MQTT_EVENT_LOOP_HANDLE on success.]*/
+TEST_FUNCTION(mqtt_event_loop_create_succeeds)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+
+    // act
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+
+    // assert
+    ASSERT_IS_NOT_NULL(loop);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_002: [If any of them cannot be created mqtt_event_loop_create shall free what was created and return NULL.]*/
+TEST_FUNCTION(mqtt_event_loop_create_malloc_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+
+    // assert
+    ASSERT_IS_NULL(loop);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_002: [If any of them cannot be created mqtt_event_loop_create shall free what was created and return NULL.]*/
+TEST_FUNCTION(mqtt_event_loop_create_tickcounter_create_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create()).SetReturn((TICK_COUNTER_HANDLE)NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+
+    // assert
+    ASSERT_IS_NULL(loop);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_003: [If handle is NULL then mqtt_event_loop_destroy shall do nothing.]*/
+TEST_FUNCTION(mqtt_event_loop_destroy_handle_NULL_succeeds)
+{
+    // arrange
+
+    // act
+    mqtt_event_loop_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_004: [mqtt_event_loop_destroy shall close the epoll instance and free every registration without calling into the clients.]*/
+TEST_FUNCTION(mqtt_event_loop_destroy_with_client_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_COUNTER_HANDLE));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    mqtt_event_loop_destroy(loop);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_005: [If handle or client is NULL, fd is below -1 or client was already added then mqtt_event_loop_add shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_event_loop_add(NULL, TEST_CLIENT_HANDLE, -1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_005: [If handle or client is NULL, fd is below -1 or client was already added then mqtt_event_loop_add shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_client_NULL_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_add(loop, NULL, -1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_005: [If handle or client is NULL, fd is below -1 or client was already added then mqtt_event_loop_add shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_fd_invalid_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -2);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_005: [If handle or client is NULL, fd is below -1 or client was already added then mqtt_event_loop_add shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_twice_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_006: [When fd is not -1 mqtt_event_loop_add shall register it with epoll for readability, and if that fails it shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_epoll_ctl_fail)
+{
+    // arrange
+    int fds[2];
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    ASSERT_ARE_EQUAL(int, 0, pipe(fds));
+    (void)close(fds[0]);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, fds[0]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, mqtt_event_loop_remove(loop, TEST_CLIENT_HANDLE));
+
+    // cleanup
+    (void)close(fds[1]);
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_007: [If any allocation fails mqtt_event_loop_add shall leave the loop unchanged and return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_add_malloc_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+    g_fail_alloc_calls = 1;
+
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+    // act
+    int result = mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    g_fail_alloc_calls = 0;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1));
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_008: [mqtt_event_loop_add shall make the client due so the next mqtt_event_loop_run_once calls mqtt_client_dowork for it, and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_add_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    int result = mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_008: [mqtt_event_loop_add shall make the client due so the next mqtt_event_loop_run_once calls mqtt_client_dowork for it, and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_add_many_clients_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    const size_t clientCount = 100;
+    for (size_t index = 0; index < clientCount; index++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_add(loop, (MQTT_CLIENT_HANDLE)(0x1000 + index * 0x100), -1));
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, clientCount, g_doworkCount);
+    for (size_t index = 0; index < clientCount; index += 2)
+    {
+        ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_remove(loop, (MQTT_CLIENT_HANDLE)(0x1000 + index * 0x100)));
+    }
+    for (size_t index = 1; index < clientCount; index += 2)
+    {
+        ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_schedule(loop, (MQTT_CLIENT_HANDLE)(0x1000 + index * 0x100)));
+    }
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_009: [If handle or client is NULL or client was not added then mqtt_event_loop_remove shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_remove_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_event_loop_remove(NULL, TEST_CLIENT_HANDLE);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_009: [If handle or client is NULL or client was not added then mqtt_event_loop_remove shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_remove_client_not_added_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_remove(loop, TEST_OTHER_CLIENT_HANDLE);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_010: [mqtt_event_loop_remove shall unregister the socket of the client from epoll, forget the client and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_remove_succeeds)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, pipe(fds));
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+    ASSERT_ARE_EQUAL(int, 1, (int)write(fds[1], "x", 1));
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqtt_event_loop_remove(loop, TEST_CLIENT_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+    ASSERT_ARE_EQUAL(size_t, 0, g_doworkCount);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, fds[0]));
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_011: [A client removed from a callback during mqtt_event_loop_run_once shall not be called again by that run.]*/
+TEST_FUNCTION(mqtt_event_loop_remove_during_run_once_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    (void)mqtt_event_loop_add(loop, TEST_OTHER_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+    g_removeOnDowork = loop;
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_012: [If handle or client is NULL or client was not added then mqtt_event_loop_schedule shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_schedule_client_not_added_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_schedule(loop, TEST_CLIENT_HANDLE);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_013: [mqtt_event_loop_schedule shall make the client due so the next mqtt_event_loop_run_once calls mqtt_client_dowork for it and takes its deadline again, and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_schedule_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+
+    setup_run_once_mocks();
+    setup_dowork_mocks(TEST_CLIENT_HANDLE);
+
+    // act
+    int result = mqtt_event_loop_schedule(loop, TEST_CLIENT_HANDLE);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_014: [If handle is NULL or tickcounter_get_current_ms fails then mqtt_event_loop_run_once shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    int result = mqtt_event_loop_run_once(NULL, 0);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_014: [If handle is NULL or tickcounter_get_current_ms fails then mqtt_event_loop_run_once shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_tickcounter_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2).SetReturn(__LINE__);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_015: [mqtt_event_loop_run_once shall call epoll_wait with the smaller of maxWaitMs and the time left until the earliest client deadline, 0 when that deadline has been reached.]*/
+/*Tests_SRS_MQTT_EVENT_LOOP_07_017: [mqtt_event_loop_run_once shall call mqtt_client_dowork for every client whose socket epoll reports, then for every client whose deadline has been reached, and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_new_client_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, -1);
+    umock_c_reset_all_calls();
+
+    setup_run_once_mocks();
+    setup_dowork_mocks(TEST_CLIENT_HANDLE);
+
+    // act
+    // The new client is due, so the run must not wait for maxWaitMs
+    int result = mqtt_event_loop_run_once(loop, 60000);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_deadline_not_reached_succeeds)
+{
+    // arrange
+    g_doworkTimeout = TEST_DOWORK_TIMEOUT;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+    g_current_ms = TEST_DOWORK_TIMEOUT - 1;
+
+    setup_run_once_mocks();
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_deadline_reached_succeeds)
+{
+    // arrange
+    g_doworkTimeout = TEST_DOWORK_TIMEOUT;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+    g_current_ms = TEST_DOWORK_TIMEOUT;
+
+    setup_run_once_mocks();
+    setup_dowork_mocks(TEST_CLIENT_HANDLE);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_no_timeout_succeeds)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+    g_current_ms = 24 * 60 * 60 * 1000;
+
+    setup_run_once_mocks();
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_work_still_due_succeeds)
+{
+    // arrange
+    g_doworkTimeout = 0;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+    size_t sameTickCount = g_doworkCount;
+    g_current_ms = 1;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, sameTickCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_018: [After mqtt_client_dowork the deadline of a client shall be taken from mqtt_client_get_dowork_timeout, with no deadline for MQTT_CLIENT_NO_TIMEOUT, 1 millisecond later when the work is still due and a second later when mqtt_client_get_dowork_timeout fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_get_dowork_timeout_fail)
+{
+    // arrange
+    g_doworkTimeoutResult = __LINE__;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, -1);
+
+    // act
+    g_current_ms = 999;
+    int result = mqtt_event_loop_run_once(loop, 0);
+    size_t earlyCount = g_doworkCount;
+    g_current_ms = 1000;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, earlyCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_017: [mqtt_event_loop_run_once shall call mqtt_client_dowork for every client whose socket epoll reports, then for every client whose deadline has been reached, and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_readable_socket_succeeds)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, pipe(fds));
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    (void)mqtt_event_loop_add(loop, TEST_CLIENT_HANDLE, fds[0]);
+    (void)mqtt_event_loop_add(loop, TEST_OTHER_CLIENT_HANDLE, -1);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+    ASSERT_ARE_EQUAL(int, 1, (int)write(fds[1], "x", 1));
+    umock_c_reset_all_calls();
+
+    setup_run_once_mocks();
+    setup_dowork_mocks(TEST_CLIENT_HANDLE);
+    STRICT_EXPECTED_CALL(mqtt_client_get_pending_send_count(TEST_CLIENT_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 60000);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_019: [When epoll reports a hang up or an error on a socket mqtt_event_loop_run_once shall unregister it after calling mqtt_client_dowork and keep servicing the client at its deadlines.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_hang_up_succeeds)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, pipe(fds));
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+    (void)close(fds[1]);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+    size_t hangUpCount = g_doworkCount;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+    size_t afterCount = g_doworkCount;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_schedule(loop, TEST_CLIENT_HANDLE));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, hangUpCount);
+    ASSERT_ARE_EQUAL(size_t, 1, afterCount);
+    ASSERT_ARE_EQUAL(size_t, 2, g_doworkCount);
+
+    // cleanup
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_remove(loop, TEST_CLIENT_HANDLE));
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_022: [After mqtt_client_dowork the socket of a client shall also be registered for writability while mqtt_client_get_pending_send_count reports sends the xio has not completed, and for readability only once they completed or when mqtt_client_get_pending_send_count fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_partial_send_waits_for_writable_succeeds)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    g_pendingSendCount = 1;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+    g_completeSendsOnDowork = true;
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 60000);
+    size_t writableCount = g_doworkCount;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, writableCount);
+    ASSERT_ARE_EQUAL(size_t, 1, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_022: [After mqtt_client_dowork the socket of a client shall also be registered for writability while mqtt_client_get_pending_send_count reports sends the xio has not completed, and for readability only once they completed or when mqtt_client_get_pending_send_count fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_no_pending_send_not_writable_succeeds)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_022: [After mqtt_client_dowork the socket of a client shall also be registered for writability while mqtt_client_get_pending_send_count reports sends the xio has not completed, and for readability only once they completed or when mqtt_client_get_pending_send_count fails.]*/
+TEST_FUNCTION(mqtt_event_loop_run_once_get_pending_send_count_fail)
+{
+    // arrange
+    int fds[2];
+    ASSERT_ARE_EQUAL(int, 0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    g_pendingSendCount = 1;
+    g_pendingSendCountResult = __LINE__;
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+
+    // act
+    int result = mqtt_event_loop_run_once(loop, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_doworkCount);
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_020: [If handle or loopStats is NULL then mqtt_event_loop_get_stats shall return a non-zero value.]*/
+TEST_FUNCTION(mqtt_event_loop_get_stats_loopStats_NULL_fail)
+{
+    // arrange
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_get_stats(loop, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+}
+
+/*Tests_SRS_MQTT_EVENT_LOOP_07_021: [mqtt_event_loop_get_stats shall copy the number of epoll_wait calls and of mqtt_client_dowork calls made for a ready socket and for a reached deadline into loopStats and return 0.]*/
+TEST_FUNCTION(mqtt_event_loop_get_stats_succeeds)
+{
+    // arrange
+    int fds[2];
+    MQTT_EVENT_LOOP_STATS loopStats;
+    ASSERT_ARE_EQUAL(int, 0, pipe(fds));
+    MQTT_EVENT_LOOP_HANDLE loop = create_loop_with_client(TEST_CLIENT_HANDLE, fds[0]);
+    ASSERT_ARE_EQUAL(int, 1, (int)write(fds[1], "x", 1));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_event_loop_run_once(loop, 0));
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqtt_event_loop_get_stats(loop, &loopStats);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 2, (int)loopStats.waitCount);
+    ASSERT_ARE_EQUAL(int, 1, (int)loopStats.readyCount);
+    ASSERT_ARE_EQUAL(int, 1, (int)loopStats.timerCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_event_loop_destroy(loop);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+}
+
+END_TEST_SUITE(mqtt_event_loop_ut)
@@ -39,18 +39,32 @@ extern "C" {
 
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
 
 #undef ENABLE_MOCKS
 
 #include "azure_umqtt_c/mqtt_message.h"
 
 static bool g_fail_alloc_calls;
+static size_t g_payloadFreeCount;
+static void* g_freedPayload;
 
 static const char* TEST_SUBSCRIPTION_TOPIC = "subTopic";
 static const uint8_t TEST_PACKET_ID = (uint8_t)0x12;
 static const char* TEST_TOPIC_NAME = "topic Name";
 static const uint8_t* TEST_MESSAGE = (const uint8_t*)"Message to send";
 static const int TEST_MSG_LEN = sizeof(TEST_MESSAGE)/sizeof(TEST_MESSAGE[0]);
+// Too large to be stored inline with the message
+static const uint8_t TEST_LARGE_MESSAGE[1024] = { 0x4d };
+static const size_t TEST_LARGE_MSG_LEN = sizeof(TEST_LARGE_MESSAGE);
+static const LOCK_HANDLE TEST_LOCK_HANDLE = (LOCK_HANDLE)0x45;
+static const size_t TEST_POOL_CAPACITY = 4;
+
+static void TestPayloadFree(void* appMsg)
+{
+    g_payloadFreeCount++;
+    g_freedPayload = appMsg;
+}
 
 typedef struct TEST_COMPLETE_DATA_INSTANCE_TAG
 {
@@ -60,6 +74,7 @@ typedef struct TEST_COMPLETE_DATA_INSTANCE_TAG
 
 TEST_DEFINE_ENUM_TYPE(QOS_VALUE, QOS_VALUE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(QOS_VALUE, QOS_VALUE_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(LOCK_RESULT, LOCK_RESULT_VALUES);
 
 TEST_MUTEX_HANDLE test_serialize_mutex;
 
@@ -82,10 +97,16 @@ TEST_SUITE_INITIALIZE(suite_init)
     umock_c_init(on_umock_c_error);
 
     REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_TYPE(LOCK_RESULT, LOCK_RESULT);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
     REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -100,6 +121,8 @@ TEST_FUNCTION_INITIALIZE(method_init)
         ASSERT_FAIL("Could not acquire test serialization mutex.");
     }
     g_fail_alloc_calls = false;
+    g_payloadFreeCount = 0;
+    g_freedPayload = NULL;
     umock_c_reset_all_calls();
 }
 
@@ -126,8 +149,6 @@ TEST_FUNCTION(mqttmessage_create_appMsgLength_NULL_succeed)
 {
     // arrange
     EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_TOPIC_NAME))
-        .IgnoreArgument(1);
 
     // act
     MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, NULL, 0);
@@ -141,29 +162,83 @@ TEST_FUNCTION(mqttmessage_create_appMsgLength_NULL_succeed)
 
 /* Test_SRS_MQTTMESSAGE_07_002: [mqttmessage_create shall allocate and copy the topicName and appMsg parameters.]*/
 /* Test_SRS_MQTTMESSAGE_07_004: [If mqttmessage_create succeeds the it shall return a NON-NULL MQTT_MESSAGE_HANDLE value.] */
+/* Test_SRS_MQTTMESSAGE_07_037: [If the topicName with its terminator and appMsg take up to MQTT_MESSAGE_INLINE_SIZE bytes mqttmessage_create shall store them in the allocation of the message.] */
 TEST_FUNCTION(mqttmessage_create_succeed)
 {
     // arrange
     EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_TOPIC_NAME))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     // act
     MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
 
     // assert
     ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_MESSAGE, mqttmessage_getApplicationMsg(handle)->message, TEST_MSG_LEN));
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     mqttmessage_destroy(handle);
 }
 
+/* Test_SRS_MQTTMESSAGE_07_003: [If any memory allocation fails mqttmessage_create shall free any allocated memory and return NULL.] */
+TEST_FUNCTION(mqttmessage_create_malloc_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_038: [Otherwise mqttmessage_create shall store the topicName and appMsg in a separate allocation that the clones of the message share.] */
+TEST_FUNCTION(mqttmessage_create_large_succeed)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_TOPIC_NAME) + 1 + TEST_LARGE_MSG_LEN));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_LARGE_MESSAGE, TEST_LARGE_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_LARGE_MESSAGE, mqttmessage_getApplicationMsg(handle)->message, TEST_LARGE_MSG_LEN));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_003: [If any memory allocation fails mqttmessage_create shall free any allocated memory and return NULL.] */
+TEST_FUNCTION(mqttmessage_create_large_malloc_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_TOPIC_NAME) + 1 + TEST_LARGE_MSG_LEN))
+        .SetReturn(NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_LARGE_MESSAGE, TEST_LARGE_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /* Test_SRS_MQTTMESSAGE_07_006: [mqttmessage_destroyMessage shall free all resources associated with the MQTT_MESSAGE_HANDLE value] */
 TEST_FUNCTION(mqttmessage_destroy_succeed)
 {
     // arrange
-    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_LARGE_MESSAGE, TEST_LARGE_MSG_LEN);
     umock_c_reset_all_calls();
 
     EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
@@ -190,14 +265,38 @@ TEST_FUNCTION(mqttmessage_destroy_handle_NULL_fail)
 }
 
 /* Test_SRS_MQTTMESSAGE_07_008: [mqttmessage_clone shall create a new MQTT_MESSAGE_HANDLE with data content identical of the handle value.] */
+/* Test_SRS_MQTTMESSAGE_07_034: [Otherwise mqttmessage_clone shall only allocate the new message and share the topicName and appMsg storage of handle by adding a reference to it.] */
 TEST_FUNCTION(mqttmessage_clone_succeed)
 {
     // arrange
-    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_LARGE_MESSAGE, TEST_LARGE_MSG_LEN);
+    (void)mqttmessage_setIsRetained(handle, true);
     umock_c_reset_all_calls();
 
     EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_PTR_ARG, TEST_TOPIC_NAME));
+
+    // act
+    MQTT_MESSAGE_HANDLE cloneHandle = mqttmessage_clone(handle);
+
+    // assert
+    ASSERT_IS_NOT_NULL(cloneHandle);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, handle, cloneHandle);
+    ASSERT_ARE_EQUAL(void_ptr, mqttmessage_getTopicName(handle), mqttmessage_getTopicName(cloneHandle));
+    ASSERT_ARE_EQUAL(void_ptr, mqttmessage_getApplicationMsg(handle)->message, mqttmessage_getApplicationMsg(cloneHandle)->message);
+    ASSERT_IS_TRUE(mqttmessage_getIsRetained(cloneHandle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+    mqttmessage_destroy(cloneHandle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_035: [If handle is borrowed or stores its topicName and appMsg inline mqttmessage_clone shall copy them as mqttmessage_create does.] */
+TEST_FUNCTION(mqttmessage_clone_inline_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
     EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     // act
@@ -205,13 +304,57 @@ TEST_FUNCTION(mqttmessage_clone_succeed)
 
     // assert
     ASSERT_IS_NOT_NULL(cloneHandle);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, mqttmessage_getTopicName(handle), mqttmessage_getTopicName(cloneHandle));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(cloneHandle));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_MESSAGE, mqttmessage_getApplicationMsg(cloneHandle)->message, TEST_MSG_LEN));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+    mqttmessage_destroy(cloneHandle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_035: [If handle is borrowed or stores its topicName and appMsg inline mqttmessage_clone shall copy them as mqttmessage_create does.] */
+TEST_FUNCTION(mqttmessage_clone_borrowed_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
 
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE cloneHandle = mqttmessage_clone(handle);
+
+    // assert
+    ASSERT_IS_NOT_NULL(cloneHandle);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(cloneHandle));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(cloneHandle));
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     mqttmessage_destroy(handle);
     mqttmessage_destroy(cloneHandle);
 }
 
+/* Test_SRS_MQTTMESSAGE_07_036: [The topicName and appMsg storage shall be freed with the last message that shares it.] */
+TEST_FUNCTION(mqttmessage_destroy_clone_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_LARGE_MESSAGE, TEST_LARGE_MSG_LEN);
+    MQTT_MESSAGE_HANDLE cloneHandle = mqttmessage_clone(handle);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(cloneHandle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(cloneHandle);
+}
+
 /* Test_SRS_MQTTMESSAGE_07_007: [If handle parameter is NULL then mqttmessage_clone shall return NULL.] */
 TEST_FUNCTION(mqttmessage_clone_handle_fails)
 {
@@ -225,6 +368,233 @@ TEST_FUNCTION(mqttmessage_clone_handle_fails)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+/* Test_SRS_MQTTMESSAGE_07_026: [If topicName is NULL, or appMsg is NULL and appMsgLength is not zero, then mqttmessage_createBorrowed shall return NULL.] */
+TEST_FUNCTION(mqttmessage_createBorrowed_Topicname_NULL_fail)
+{
+    // arrange
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, NULL, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_027: [mqttmessage_createBorrowed shall only allocate the message, topicName and appMsg shall be referenced without being copied.] */
+TEST_FUNCTION(mqttmessage_createBorrowed_succeed)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(void_ptr, TEST_MESSAGE, mqttmessage_getApplicationMsg(handle)->message);
+    ASSERT_ARE_EQUAL(int, (int)DELIVER_AT_LEAST_ONCE, (int)mqttmessage_getQosType(handle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_028: [If the allocation fails mqttmessage_createBorrowed shall return NULL.] */
+TEST_FUNCTION(mqttmessage_createBorrowed_malloc_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_033: [mqttmessage_destroy shall release one reference and only free the message when no reference is left. The topicName and appMsg of a borrowed message shall not be freed.] */
+TEST_FUNCTION(mqttmessage_destroy_borrowed_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_029: [If handle is NULL then mqttmessage_retain shall return NULL.] */
+TEST_FUNCTION(mqttmessage_retain_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_retain(NULL);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_030: [If the message is borrowed mqttmessage_retain shall copy the topicName and appMsg into memory owned by the message.] */
+/* Test_SRS_MQTTMESSAGE_07_032: [mqttmessage_retain shall add a reference to the message and return handle.] */
+TEST_FUNCTION(mqttmessage_retain_borrowed_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_TOPIC_NAME) + 1 + TEST_MSG_LEN));
+
+    // act
+    MQTT_MESSAGE_HANDLE retained = mqttmessage_retain(handle);
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, handle, retained);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(retained));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(retained));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_MESSAGE, mqttmessage_getApplicationMsg(retained)->message, TEST_MSG_LEN));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(retained);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_031: [If the copy fails mqttmessage_retain shall leave the message unchanged and return NULL.] */
+TEST_FUNCTION(mqttmessage_retain_borrowed_malloc_fail)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_createBorrowed(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_TOPIC_NAME) + 1 + TEST_MSG_LEN))
+        .SetReturn(NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE retained = mqttmessage_retain(handle);
+
+    // assert
+    ASSERT_IS_NULL(retained);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_032: [mqttmessage_retain shall add a reference to the message and return handle.] */
+/* Test_SRS_MQTTMESSAGE_07_033: [mqttmessage_destroy shall release one reference and only free the message when no reference is left. The topicName and appMsg of a borrowed message shall not be freed.] */
+TEST_FUNCTION(mqttmessage_retain_owned_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    // act
+    MQTT_MESSAGE_HANDLE retained = mqttmessage_retain(handle);
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, handle, retained);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(retained);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_048: [If topicName or payloadFree is NULL, or appMsg is NULL and appMsgLength is not zero, then mqttmessage_create_take_ownership shall return NULL.] */
+TEST_FUNCTION(mqttmessage_create_take_ownership_payloadFree_NULL_fail)
+{
+    // arrange
+    uint8_t appMsg[] = { 0x4d, 0x73, 0x67 };
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create_take_ownership(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, appMsg, sizeof(appMsg), NULL);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_049: [mqttmessage_create_take_ownership shall copy the topicName and reference appMsg without copying it.] */
+TEST_FUNCTION(mqttmessage_create_take_ownership_succeed)
+{
+    // arrange
+    uint8_t appMsg[] = { 0x4d, 0x73, 0x67 };
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create_take_ownership(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, appMsg, sizeof(appMsg), TestPayloadFree);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_TOPIC_NAME, mqttmessage_getTopicName(handle));
+    ASSERT_ARE_EQUAL(void_ptr, appMsg, mqttmessage_getApplicationMsg(handle)->message);
+    ASSERT_ARE_EQUAL(size_t, sizeof(appMsg), mqttmessage_getApplicationMsg(handle)->length);
+    ASSERT_ARE_EQUAL(size_t, 0, g_payloadFreeCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_050: [If any memory allocation fails mqttmessage_create_take_ownership shall free any allocated memory, leave appMsg owned by the caller and return NULL.] */
+TEST_FUNCTION(mqttmessage_create_take_ownership_malloc_fail)
+{
+    // arrange
+    uint8_t appMsg[] = { 0x4d, 0x73, 0x67 };
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create_take_ownership(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, appMsg, sizeof(appMsg), TestPayloadFree);
+
+    // assert
+    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, g_payloadFreeCount);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_034: [Otherwise mqttmessage_clone shall only allocate the new message and share the topicName and appMsg storage of handle by adding a reference to it.] */
+/* Test_SRS_MQTTMESSAGE_07_051: [An appMsg adopted by mqttmessage_create_take_ownership shall be passed to its payloadFree with the last message that shares it.] */
+TEST_FUNCTION(mqttmessage_destroy_take_ownership_clone_succeed)
+{
+    // arrange
+    uint8_t appMsg[] = { 0x4d, 0x73, 0x67 };
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create_take_ownership(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, appMsg, sizeof(appMsg), TestPayloadFree);
+    MQTT_MESSAGE_HANDLE cloneHandle = mqttmessage_clone(handle);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    mqttmessage_destroy(handle);
+    size_t freeCountAfterFirst = g_payloadFreeCount;
+    mqttmessage_destroy(cloneHandle);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, freeCountAfterFirst);
+    ASSERT_ARE_EQUAL(size_t, 1, g_payloadFreeCount);
+    ASSERT_ARE_EQUAL(void_ptr, appMsg, g_freedPayload);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /* Test_SRS_MQTTMESSAGE_07_010: [If handle is NULL then mqttmessage_getPacketId shall return 0.] */
 TEST_FUNCTION(mqttmessage_getPacketId_handle_fails)
 {
@@ -376,6 +746,39 @@ TEST_FUNCTION(mqttmessage_getIsRetained_handle_fails)
     ASSERT_IS_FALSE(value);
 }
 
+/* Tests_SRS_MQTTMESSAGE_07_052: [If handle is NULL then mqttmessage_setPacketId shall return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_setPacketId_handle_fails)
+{
+    // arrange
+
+    // act
+    int value = mqttmessage_setPacketId(NULL, TEST_PACKET_ID);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, value);
+}
+
+/* Test_SRS_MQTTMESSAGE_07_053: [mqttmessage_setPacketId shall store the packetId value in the MQTT_MESSAGE_HANDLE handle.] */
+TEST_FUNCTION(mqttmessage_set_and_get_PacketId_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(0, TEST_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    // act
+    int value = mqttmessage_setPacketId(handle, TEST_PACKET_ID);
+
+    uint16_t packetId = mqttmessage_getPacketId(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, value);
+    ASSERT_ARE_EQUAL(int, TEST_PACKET_ID, packetId);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+}
+
 /* Tests_SRS_MQTTMESSAGE_07_024: [If handle is NULL then mqttmessage_setIsRetained shall return a non-zero value.] */
 TEST_FUNCTION(mqttmessage_setIsRetained_handle_fails)
 {
@@ -441,4 +844,170 @@ TEST_FUNCTION(mqttmessage_getApplicationMsg_succeed)
     mqttmessage_destroy(handle);
 }
 
+/* Test_SRS_MQTTMESSAGE_07_039: [If capacity is zero or the pool is already initialized mqttmessage_initPool shall return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_initPool_capacity_0_fail)
+{
+    // arrange
+
+    // act
+    int result = mqttmessage_initPool(0);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_040: [mqttmessage_initPool shall allocate capacity slots that each hold a message with up to MQTT_MESSAGE_INLINE_SIZE bytes of topicName and appMsg.] */
+/* Test_SRS_MQTTMESSAGE_07_043: [mqttmessage_deinitPool shall free the pool, messages created afterwards shall be allocated with malloc.] */
+TEST_FUNCTION(mqttmessage_initPool_succeed)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqttmessage_initPool(TEST_POOL_CAPACITY);
+    int deinitResult = mqttmessage_deinitPool();
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, deinitResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_039: [If capacity is zero or the pool is already initialized mqttmessage_initPool shall return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_initPool_twice_fail)
+{
+    // arrange
+    (void)mqttmessage_initPool(TEST_POOL_CAPACITY);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqttmessage_initPool(TEST_POOL_CAPACITY);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    (void)mqttmessage_deinitPool();
+}
+
+/* Test_SRS_MQTTMESSAGE_07_041: [If any allocation fails mqttmessage_initPool shall free any allocated memory and return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_initPool_Lock_Init_fail)
+{
+    // arrange
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = mqttmessage_initPool(TEST_POOL_CAPACITY);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, mqttmessage_deinitPool());
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_045: [mqttmessage_getPoolStats shall copy the pool counters to poolStats.] */
+/* Test_SRS_MQTTMESSAGE_07_046: [When the pool is initialized a message shall be allocated from a free slot, counted in hitCount, or with malloc when no slot is free, counted in missCount.] */
+/* Test_SRS_MQTTMESSAGE_07_047: [A message allocated from the pool shall return its slot to the pool when it is freed.] */
+TEST_FUNCTION(mqttmessage_create_from_pool_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_POOL_STATS poolStats;
+    (void)mqttmessage_initPool(1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    int result = mqttmessage_getPoolStats(&poolStats);
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 1, (int)poolStats.hitCount);
+    ASSERT_ARE_EQUAL(int, 0, (int)poolStats.missCount);
+    ASSERT_ARE_EQUAL(int, 1, (int)poolStats.slotsInUse);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ASSERT_ARE_EQUAL(int, 0, mqttmessage_deinitPool());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_046: [When the pool is initialized a message shall be allocated from a free slot, counted in hitCount, or with malloc when no slot is free, counted in missCount.] */
+TEST_FUNCTION(mqttmessage_create_pool_exhausted_succeed)
+{
+    // arrange
+    MQTT_MESSAGE_POOL_STATS poolStats;
+    (void)mqttmessage_initPool(1);
+    MQTT_MESSAGE_HANDLE pooledHandle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    mqttmessage_destroy(handle);
+
+    // assert
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, mqttmessage_getPoolStats(&poolStats));
+    ASSERT_ARE_EQUAL(int, 1, (int)poolStats.missCount);
+
+    mqttmessage_destroy(pooledHandle);
+    ASSERT_ARE_EQUAL(int, 0, mqttmessage_deinitPool());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_042: [If the pool is not initialized or a message allocated from it has not been freed mqttmessage_deinitPool shall return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_deinitPool_in_use_fail)
+{
+    // arrange
+    (void)mqttmessage_initPool(1);
+    MQTT_MESSAGE_HANDLE handle = mqttmessage_create(TEST_PACKET_ID, TEST_TOPIC_NAME, DELIVER_AT_MOST_ONCE, TEST_MESSAGE, TEST_MSG_LEN);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mqttmessage_deinitPool();
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    mqttmessage_destroy(handle);
+    ASSERT_ARE_EQUAL(int, 0, mqttmessage_deinitPool());
+}
+
+/* Test_SRS_MQTTMESSAGE_07_044: [If poolStats is NULL or the pool is not initialized mqttmessage_getPoolStats shall return a non-zero value.] */
+TEST_FUNCTION(mqttmessage_getPoolStats_not_initialized_fail)
+{
+    // arrange
+    MQTT_MESSAGE_POOL_STATS poolStats;
+
+    // act
+    int result = mqttmessage_getPoolStats(&poolStats);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 END_TEST_SUITE(mqtt_message_ut)
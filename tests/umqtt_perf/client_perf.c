@@ -0,0 +1,288 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include "umqtt_perf.h"
+#include "azure_c_shared_utility/xio.h"
+#include "azure_umqtt_c/mqtt_client.h"
+#include "azure_umqtt_c/mqtt_codec.h"
+
+#define PERF_PACKET_ID          0x1234
+#define PERF_TOPIC_NAME         "devices/perf_device/messages/devicebound/"
+#define PERF_MAX_PACKET_SIZE    256
+
+// Loopback transport: opens immediately, counts what the client sends and lets the benchmark
+// hand inbound bytes straight to the client
+static ON_BYTES_RECEIVED g_onBytesReceived;
+static void* g_onBytesReceivedCtx;
+static size_t g_bytesSent;
+static size_t g_ackCount;
+
+static OPTIONHANDLER_HANDLE perf_io_retrieveoptions(CONCRETE_IO_HANDLE concrete_io)
+{
+    (void)concrete_io;
+    return NULL;
+}
+
+static CONCRETE_IO_HANDLE perf_io_create(void* io_create_parameters)
+{
+    (void)io_create_parameters;
+    return (CONCRETE_IO_HANDLE)&g_bytesSent;
+}
+
+static void perf_io_destroy(CONCRETE_IO_HANDLE concrete_io)
+{
+    (void)concrete_io;
+}
+
+static int perf_io_open(CONCRETE_IO_HANDLE concrete_io, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    (void)concrete_io;
+    (void)on_io_error;
+    (void)on_io_error_context;
+    g_onBytesReceived = on_bytes_received;
+    g_onBytesReceivedCtx = on_bytes_received_context;
+    on_io_open_complete(on_io_open_complete_context, IO_OPEN_OK);
+    return 0;
+}
+
+static int perf_io_close(CONCRETE_IO_HANDLE concrete_io, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    (void)concrete_io;
+    if (on_io_close_complete != NULL)
+    {
+        on_io_close_complete(callback_context);
+    }
+    return 0;
+}
+
+static int perf_io_send(CONCRETE_IO_HANDLE concrete_io, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    (void)concrete_io;
+    (void)buffer;
+    g_bytesSent += size;
+    if (on_send_complete != NULL)
+    {
+        on_send_complete(callback_context, IO_SEND_OK);
+    }
+    return 0;
+}
+
+static void perf_io_dowork(CONCRETE_IO_HANDLE concrete_io)
+{
+    (void)concrete_io;
+}
+
+static int perf_io_setoption(CONCRETE_IO_HANDLE concrete_io, const char* optionName, const void* value)
+{
+    (void)concrete_io;
+    (void)optionName;
+    (void)value;
+    return 0;
+}
+
+static const IO_INTERFACE_DESCRIPTION perf_io_interface_description =
+{
+    perf_io_retrieveoptions,
+    perf_io_create,
+    perf_io_destroy,
+    perf_io_open,
+    perf_io_close,
+    perf_io_send,
+    perf_io_dowork,
+    perf_io_setoption
+};
+
+static void on_message_recv(MQTT_MESSAGE_HANDLE msgHandle, void* callbackCtx)
+{
+    (void)msgHandle;
+    (void)callbackCtx;
+    g_ackCount++;
+}
+
+static void on_operation(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* callbackCtx)
+{
+    (void)handle;
+    (void)msgInfo;
+    (void)callbackCtx;
+    if (actionResult != MQTT_CLIENT_ON_ERROR && actionResult != MQTT_CLIENT_ON_CONNACK)
+    {
+        g_ackCount++;
+    }
+}
+
+static size_t build_ack(uint8_t* packet, CONTROL_PACKET_TYPE packetType, size_t returnCodeCount)
+{
+    size_t result = 0;
+    packet[result++] = (uint8_t)packetType;
+    packet[result++] = (uint8_t)(2 + returnCodeCount);
+    packet[result++] = (uint8_t)(PERF_PACKET_ID >> 8);
+    packet[result++] = (uint8_t)(PERF_PACKET_ID & 0xFF);
+    for (size_t index = 0; index < returnCodeCount; index++)
+    {
+        packet[result++] = (uint8_t)DELIVER_AT_LEAST_ONCE;
+    }
+    return result;
+}
+
+// One op is one inbound packet handed to the client as a single read, decoded and reported to the callbacks
+static int run_inbound_case(const char* name, const uint8_t* packet, size_t packetLen, size_t iterations)
+{
+    int result;
+    MQTT_CLIENT_HANDLE client = mqtt_client_init(on_message_recv, on_operation, NULL);
+    XIO_HANDLE xio = xio_create(&perf_io_interface_description, NULL);
+    MQTT_CLIENT_OPTIONS options;
+
+    memset(&options, 0, sizeof(options));
+    options.clientId = "perf_client";
+    options.qualityOfServiceValue = DELIVER_AT_MOST_ONCE;
+
+    if (client == NULL || xio == NULL || mqtt_client_connect(client, xio, &options) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_ALLOC_STATS stats;
+
+        result = 0;
+        g_ackCount = 0;
+        perf_alloc_reset();
+        uint64_t start = perf_get_time_ns();
+        for (size_t index = 0; index < iterations; index++)
+        {
+            g_onBytesReceived(g_onBytesReceivedCtx, packet, packetLen);
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        perf_alloc_get_stats(&stats);
+
+        if (g_ackCount != iterations)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            perf_print_result(name, iterations, elapsed, &stats, packetLen);
+        }
+    }
+
+    mqtt_client_deinit(client);
+    if (xio != NULL)
+    {
+        xio_destroy(xio);
+    }
+    return result;
+}
+
+#define PERF_INFLIGHT_WINDOW    64
+
+// One op is a QoS 1 PUBLISH kept in the in-flight table, or holding a flow control window slot when windowed is true,
+// plus the PUBACK that releases it PERF_INFLIGHT_WINDOW publishes later
+static int run_inflight_case(const char* name, bool windowed, size_t iterations)
+{
+    int result = 0;
+    MQTT_CLIENT_HANDLE client = mqtt_client_init(on_message_recv, on_operation, NULL);
+    XIO_HANDLE xio = xio_create(&perf_io_interface_description, NULL);
+    MQTT_CLIENT_OPTIONS options;
+    MQTT_MESSAGE_HANDLE msgHandles[PERF_INFLIGHT_WINDOW];
+    uint8_t payload[16] = { 0 };
+
+    // Message n carries packet id n + 1, it is acknowledged before it is published again
+    for (size_t index = 0; index < PERF_INFLIGHT_WINDOW; index++)
+    {
+        msgHandles[index] = mqttmessage_create((uint16_t)(index + 1), PERF_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, payload, sizeof(payload));
+        if (msgHandles[index] == NULL)
+        {
+            result = __LINE__;
+        }
+    }
+
+    memset(&options, 0, sizeof(options));
+    options.clientId = "perf_client";
+    options.qualityOfServiceValue = DELIVER_AT_MOST_ONCE;
+
+    if (result != 0 || client == NULL || xio == NULL || mqtt_client_connect(client, xio, &options) != 0 ||
+        (windowed ? mqtt_client_set_flow_control(client, PERF_INFLIGHT_WINDOW, MQTT_CLIENT_FLOW_CONTROL_FAIL, NULL, NULL) :
+            mqtt_client_set_inflight_tracking(client, PERF_INFLIGHT_WINDOW, 0)) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_ALLOC_STATS stats;
+        uint8_t ack[4] = { (uint8_t)PUBACK_TYPE, 2, 0, 0 };
+        size_t inFlightCount;
+        size_t queuedCount = 0;
+
+        g_ackCount = 0;
+        perf_alloc_reset();
+        uint64_t start = perf_get_time_ns();
+        for (size_t index = 0; index < iterations + PERF_INFLIGHT_WINDOW && result == 0; index++)
+        {
+            if (index >= PERF_INFLIGHT_WINDOW)
+            {
+                ack[3] = (uint8_t)(index % PERF_INFLIGHT_WINDOW + 1);
+                g_onBytesReceived(g_onBytesReceivedCtx, ack, sizeof(ack));
+            }
+            if (index < iterations)
+            {
+                result = mqtt_client_publish(client, msgHandles[index % PERF_INFLIGHT_WINDOW]);
+            }
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        perf_alloc_get_stats(&stats);
+        int stateResult = windowed ? mqtt_client_get_flow_control_state(client, &inFlightCount, &queuedCount) :
+            mqtt_client_get_inflight_count(client, &inFlightCount);
+
+        if (result != 0 || g_ackCount != iterations || stateResult != 0 || inFlightCount != 0 || queuedCount != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            perf_print_result(name, iterations, elapsed, &stats, sizeof(payload));
+        }
+    }
+
+    mqtt_client_deinit(client);
+    for (size_t index = 0; index < PERF_INFLIGHT_WINDOW; index++)
+    {
+        if (msgHandles[index] != NULL)
+        {
+            mqttmessage_destroy(msgHandles[index]);
+        }
+    }
+    if (xio != NULL)
+    {
+        xio_destroy(xio);
+    }
+    return result;
+}
+
+int client_perf_inbound_run(size_t iterations)
+{
+    int result = 0;
+    uint8_t packet[PERF_MAX_PACKET_SIZE];
+    uint8_t payload[16] = { 0 };
+    size_t packetLen;
+
+    perf_print_header("mqtt_client inbound");
+    packetLen = build_ack(packet, PUBACK_TYPE, 0);
+    result |= run_inbound_case("puback", packet, packetLen, iterations);
+    // The PUBREC is answered with a PUBREL
+    packetLen = build_ack(packet, PUBREC_TYPE, 0);
+    result |= run_inbound_case("pubrec + pubrel reply", packet, packetLen, iterations);
+    packetLen = build_ack(packet, UNSUBACK_TYPE, 0);
+    result |= run_inbound_case("unsuback", packet, packetLen, iterations);
+    packetLen = build_ack(packet, SUBACK_TYPE, 4);
+    result |= run_inbound_case("suback 4 return codes", packet, packetLen, iterations);
+    // Above the client's stack array the return codes are converted in allocated memory
+    packetLen = build_ack(packet, SUBACK_TYPE, 64);
+    result |= run_inbound_case("suback 64 return codes", packet, packetLen, iterations);
+    packetLen = mqtt_codec_publish_into(packet, sizeof(packet), DELIVER_AT_MOST_ONCE, false, false, 0, PERF_TOPIC_NAME, payload, sizeof(payload));
+    result |= run_inbound_case("publish qos0 16B", packet, packetLen, iterations);
+    result |= run_inflight_case("tracked publish + puback", false, iterations);
+    result |= run_inflight_case("windowed publish + puback", true, iterations);
+    return result;
+}
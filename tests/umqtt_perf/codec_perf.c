@@ -0,0 +1,217 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include "umqtt_perf.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_umqtt_c/mqtt_codec.h"
+
+#define PERF_PACKET_ID          0x1234
+#define PERF_TOPIC_NAME         "devices/perf_device/messages/events/"
+#define PERF_SMALL_PAYLOAD      16
+#define PERF_LARGE_PAYLOAD      1024
+
+static uint8_t g_payload[PERF_LARGE_PAYLOAD];
+static SUBSCRIBE_PAYLOAD g_subscribeList[] = { { "devices/perf_device/messages/devicebound/#", DELIVER_AT_LEAST_ONCE }, { "$iothub/methods/POST/#", DELIVER_AT_MOST_ONCE } };
+static const char* g_unsubscribeList[] = { "devices/perf_device/messages/devicebound/#", "$iothub/methods/POST/#" };
+
+typedef BUFFER_HANDLE(*ENCODE_FUNCTION)(void);
+typedef size_t(*ENCODE_INTO_FUNCTION)(uint8_t* buffer, size_t capacity);
+
+static uint8_t g_encodeBuffer[PERF_LARGE_PAYLOAD + 128];
+static MQTT_TOPIC_HANDLE g_topicHandle;
+static MQTT_PUBLISH_TEMPLATE_HANDLE g_publishTemplate;
+static uint16_t g_templatePacketId;
+
+static BUFFER_HANDLE encode_connect(void)
+{
+    MQTT_CLIENT_OPTIONS options;
+    memset(&options, 0, sizeof(options));
+    options.clientId = "perf_device";
+    options.username = "perfhub.azure-devices.net/perf_device";
+    options.password = "SharedAccessSignature sr=perfhub.azure-devices.net&sig=0000000000000000000000000000000000000000000&se=1484433462";
+    options.keepAliveInterval = 240;
+    options.useCleanSession = true;
+    return mqtt_codec_connect(&options);
+}
+
+static BUFFER_HANDLE encode_publish_small(void)
+{
+    return mqtt_codec_publish(DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, g_payload, PERF_SMALL_PAYLOAD);
+}
+
+static BUFFER_HANDLE encode_publish_large(void)
+{
+    return mqtt_codec_publish(DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, g_payload, PERF_LARGE_PAYLOAD);
+}
+
+static BUFFER_HANDLE encode_publish_ack(void)
+{
+    return mqtt_codec_publishAck(PERF_PACKET_ID);
+}
+
+static BUFFER_HANDLE encode_ping(void)
+{
+    return mqtt_codec_ping();
+}
+
+static BUFFER_HANDLE encode_disconnect(void)
+{
+    return mqtt_codec_disconnect();
+}
+
+static BUFFER_HANDLE encode_subscribe(void)
+{
+    return mqtt_codec_subscribe(PERF_PACKET_ID, g_subscribeList, sizeof(g_subscribeList) / sizeof(g_subscribeList[0]));
+}
+
+static BUFFER_HANDLE encode_unsubscribe(void)
+{
+    return mqtt_codec_unsubscribe(PERF_PACKET_ID, g_unsubscribeList, sizeof(g_unsubscribeList) / sizeof(g_unsubscribeList[0]));
+}
+
+static size_t encode_publish_small_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publish_into(buffer, capacity, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, g_payload, PERF_SMALL_PAYLOAD);
+}
+
+static size_t encode_publish_large_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publish_into(buffer, capacity, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, g_payload, PERF_LARGE_PAYLOAD);
+}
+
+static size_t encode_publish_topic_small_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publishTopic_into(buffer, capacity, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, g_topicHandle, g_payload, PERF_SMALL_PAYLOAD);
+}
+
+static size_t encode_publish_template_small_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publishTemplate_into(buffer, capacity, g_publishTemplate, ++g_templatePacketId, g_payload, PERF_SMALL_PAYLOAD);
+}
+
+static size_t encode_publish_template_large_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publishTemplate_into(buffer, capacity, g_publishTemplate, ++g_templatePacketId, g_payload, PERF_LARGE_PAYLOAD);
+}
+
+static size_t encode_publish_template_segments(uint8_t* buffer, size_t capacity)
+{
+    MQTT_BUFFER_SEGMENT segments[MQTT_PUBLISH_SEGMENT_COUNT];
+    return (mqtt_codec_publishTemplateSegments(g_publishTemplate, ++g_templatePacketId, g_payload, PERF_SMALL_PAYLOAD, buffer, capacity, segments) != 0) ? 0 : segments[0].length + segments[1].length;
+}
+
+static size_t encode_publish_ack_into(uint8_t* buffer, size_t capacity)
+{
+    return mqtt_codec_publishAck_into(buffer, capacity, PERF_PACKET_ID);
+}
+
+static int run_encode_case(const char* name, ENCODE_FUNCTION encode, size_t iterations)
+{
+    int result = 0;
+    size_t packetLength = 0;
+    PERF_ALLOC_STATS stats;
+
+    perf_alloc_reset();
+    uint64_t start = perf_get_time_ns();
+    for (size_t index = 0; index < iterations; index++)
+    {
+        BUFFER_HANDLE packet = encode();
+        if (packet == NULL)
+        {
+            result = __LINE__;
+            break;
+        }
+        packetLength = BUFFER_length(packet);
+        BUFFER_delete(packet);
+    }
+    uint64_t elapsed = perf_get_time_ns() - start;
+    perf_alloc_get_stats(&stats);
+
+    if (result == 0)
+    {
+        perf_print_result(name, iterations, elapsed, &stats, packetLength);
+    }
+    return result;
+}
+
+static int run_encode_into_case(const char* name, ENCODE_INTO_FUNCTION encode, size_t iterations)
+{
+    int result = 0;
+    size_t packetLength = 0;
+    PERF_ALLOC_STATS stats;
+
+    perf_alloc_reset();
+    uint64_t start = perf_get_time_ns();
+    for (size_t index = 0; index < iterations; index++)
+    {
+        packetLength = encode(g_encodeBuffer, sizeof(g_encodeBuffer));
+        if (packetLength == 0 || packetLength > sizeof(g_encodeBuffer))
+        {
+            result = __LINE__;
+            break;
+        }
+    }
+    uint64_t elapsed = perf_get_time_ns() - start;
+    perf_alloc_get_stats(&stats);
+
+    if (result == 0)
+    {
+        perf_print_result(name, iterations, elapsed, &stats, packetLength);
+    }
+    return result;
+}
+
+int codec_perf_encode_run(size_t iterations)
+{
+    int result = 0;
+    memset(g_payload, 'P', sizeof(g_payload));
+
+    // allocs/op counts every allocation made while encoding a packet (including the BUFFER_HANDLE itself)
+    perf_print_header("mqtt_codec encode");
+    result |= run_encode_case("connect", encode_connect, iterations);
+    result |= run_encode_case("publish qos1 16B", encode_publish_small, iterations);
+    result |= run_encode_case("publish qos1 1KB", encode_publish_large, iterations);
+    result |= run_encode_case("puback", encode_publish_ack, iterations);
+    result |= run_encode_case("pingreq", encode_ping, iterations);
+    result |= run_encode_case("disconnect", encode_disconnect, iterations);
+    result |= run_encode_case("subscribe", encode_subscribe, iterations);
+    result |= run_encode_case("unsubscribe", encode_unsubscribe, iterations);
+
+    // The same packets encoded into a caller owned buffer
+    perf_print_header("mqtt_codec encode into");
+    result |= run_encode_into_case("publish qos1 16B", encode_publish_small_into, iterations);
+    result |= run_encode_into_case("publish qos1 1KB", encode_publish_large_into, iterations);
+    result |= run_encode_into_case("puback", encode_publish_ack_into, iterations);
+
+    // The topic handle is encoded once up front, each publish only copies its bytes
+    g_topicHandle = mqtt_codec_topicCreate(PERF_TOPIC_NAME);
+    if (g_topicHandle == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result |= run_encode_into_case("publish topic qos1 16B", encode_publish_topic_small_into, iterations);
+        mqtt_codec_topicDestroy(g_topicHandle);
+        g_topicHandle = NULL;
+    }
+
+    // Publishes sharing topic, QoS and flags through a template, only the packet id and payload change per packet
+    perf_print_header("mqtt_codec publish template");
+    g_publishTemplate = mqtt_codec_publishTemplateCreate(DELIVER_AT_LEAST_ONCE, false, false, PERF_TOPIC_NAME);
+    if (g_publishTemplate == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result |= run_encode_into_case("template qos1 16B", encode_publish_template_small_into, iterations);
+        result |= run_encode_into_case("template qos1 1KB", encode_publish_template_large_into, iterations);
+        result |= run_encode_into_case("template segments qos1 16B", encode_publish_template_segments, iterations);
+        mqtt_codec_publishTemplateDestroy(g_publishTemplate);
+        g_publishTemplate = NULL;
+    }
+    return result;
+}
@@ -0,0 +1,196 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include "umqtt_perf.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_umqtt_c/mqtt_codec.h"
+
+#define PERF_PACKET_ID          0x1234
+#define PERF_TOPIC_NAME         "devices/perf_device/messages/devicebound/"
+#define PERF_CHUNK_SIZE         (16 * 1024)
+#define PERF_BYTES_PER_CASE     (1024 * 1024)
+#define PERF_BATCH_PACKETS      64
+#define PERF_VIEW_COUNT         16
+
+static size_t g_packetsDecoded;
+
+static void on_packet_complete(void* context, CONTROL_PACKET_TYPE packet, int flags, const uint8_t* data, size_t length)
+{
+    (void)context;
+    (void)flags;
+    (void)data;
+    (void)length;
+    if (packet == PUBLISH_TYPE)
+    {
+        g_packetsDecoded++;
+    }
+}
+
+// Feeds the packet to the decoder the way a socket would hand it over, in PERF_CHUNK_SIZE reads.
+// highWaterMark 0 keeps the codec default
+static int run_decode_case(const char* name, size_t payloadLen, size_t highWaterMark, size_t iterations)
+{
+    int result;
+    uint8_t* payload = (uint8_t*)malloc(payloadLen);
+    size_t packetLen = mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, payload, payloadLen);
+    uint8_t* packet = (uint8_t*)malloc(packetLen);
+    MQTTCODEC_HANDLE codec = mqtt_codec_create(on_packet_complete, NULL);
+
+    if (payload == NULL || packet == NULL || codec == NULL)
+    {
+        result = __LINE__;
+    }
+    else if (highWaterMark > 0 && mqtt_codec_setReassemblyHighWaterMark(codec, highWaterMark) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_ALLOC_STATS stats;
+
+        memset(payload, 'P', payloadLen);
+        (void)mqtt_codec_publish_into(packet, packetLen, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, payload, payloadLen);
+
+        result = 0;
+        g_packetsDecoded = 0;
+        perf_alloc_reset();
+        uint64_t start = perf_get_time_ns();
+        for (size_t index = 0; index < iterations && result == 0; index++)
+        {
+            size_t offset = 0;
+            while (offset < packetLen && result == 0)
+            {
+                size_t chunkLen = (packetLen - offset < PERF_CHUNK_SIZE) ? packetLen - offset : PERF_CHUNK_SIZE;
+                if (mqtt_codec_bytesReceived(codec, packet + offset, chunkLen) != 0)
+                {
+                    result = __LINE__;
+                }
+                offset += chunkLen;
+            }
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        perf_alloc_get_stats(&stats);
+
+        if (result == 0 && g_packetsDecoded != iterations)
+        {
+            result = __LINE__;
+        }
+        if (result == 0)
+        {
+            perf_print_throughput(name, iterations, elapsed, &stats, packetLen);
+        }
+    }
+
+    mqtt_codec_destroy(codec);
+    free(packet);
+    free(payload);
+    return result;
+}
+
+// Decodes a read holding PERF_BATCH_PACKETS small PUBLISH packets, either pushed through mqtt_codec_bytesReceived
+// or pulled with mqtt_codec_parse PERF_VIEW_COUNT packets at a time. One op is one packet
+static int run_batch_case(const char* name, bool pull, size_t iterations)
+{
+    int result;
+    uint8_t payload[16] = { 0 };
+    size_t packetLen = mqtt_codec_publish_into(NULL, 0, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, payload, sizeof(payload));
+    size_t readLen = packetLen * PERF_BATCH_PACKETS;
+    uint8_t* read = (uint8_t*)malloc(readLen);
+    MQTTCODEC_HANDLE codec = mqtt_codec_create(on_packet_complete, NULL);
+
+    if (read == NULL || codec == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_ALLOC_STATS stats;
+        MQTT_PACKET_VIEW views[PERF_VIEW_COUNT];
+        size_t rounds = (iterations + PERF_BATCH_PACKETS - 1) / PERF_BATCH_PACKETS;
+
+        memset(payload, 'P', sizeof(payload));
+        for (size_t index = 0; index < PERF_BATCH_PACKETS; index++)
+        {
+            (void)mqtt_codec_publish_into(read + index * packetLen, packetLen, DELIVER_AT_LEAST_ONCE, false, false, PERF_PACKET_ID, PERF_TOPIC_NAME, payload, sizeof(payload));
+        }
+
+        result = 0;
+        g_packetsDecoded = 0;
+        perf_alloc_reset();
+        uint64_t start = perf_get_time_ns();
+        for (size_t index = 0; index < rounds && result == 0; index++)
+        {
+            if (!pull)
+            {
+                if (mqtt_codec_bytesReceived(codec, read, readLen) != 0)
+                {
+                    result = __LINE__;
+                }
+            }
+            else
+            {
+                size_t offset = 0;
+                while (offset < readLen && result == 0)
+                {
+                    size_t consumed;
+                    size_t packetCount;
+                    if (mqtt_codec_parse(codec, read + offset, readLen - offset, &consumed, views, PERF_VIEW_COUNT, &packetCount) != 0 || packetCount == 0)
+                    {
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        for (size_t view = 0; view < packetCount; view++)
+                        {
+                            on_packet_complete(NULL, views[view].packetType, views[view].flags, views[view].header, views[view].headerLength + views[view].payloadLength);
+                        }
+                        offset += consumed;
+                    }
+                }
+            }
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        perf_alloc_get_stats(&stats);
+
+        if (result == 0 && g_packetsDecoded != rounds * PERF_BATCH_PACKETS)
+        {
+            result = __LINE__;
+        }
+        if (result == 0)
+        {
+            perf_print_throughput(name, rounds * PERF_BATCH_PACKETS, elapsed, &stats, packetLen);
+        }
+    }
+
+    mqtt_codec_destroy(codec);
+    free(read);
+    return result;
+}
+
+static size_t scale_iterations(size_t iterations, size_t payloadLen)
+{
+    // Large packets run fewer times so every case decodes a comparable number of bytes
+    size_t result = (size_t)(((uint64_t)iterations * PERF_BYTES_PER_CASE / 1024) / payloadLen);
+    return (result == 0) ? 1 : result;
+}
+
+int codec_perf_decode_run(size_t iterations)
+{
+    int result = 0;
+
+    // A single PUBLISH is decoded per op, fed in 16KB reads
+    perf_print_throughput_header("mqtt_codec decode");
+    result |= run_decode_case("publish qos1 16B", 16, 0, iterations);
+    result |= run_decode_case("publish qos1 1KB", 1024, 0, iterations);
+    result |= run_decode_case("publish qos1 1MB", 1024 * 1024, 0, scale_iterations(iterations, 1024 * 1024));
+    // With the high water mark above the packet size the reassembly buffer is reused
+    result |= run_decode_case("publish qos1 1MB buffer kept", 1024 * 1024, 2 * 1024 * 1024, scale_iterations(iterations, 1024 * 1024));
+
+    // 64 PUBLISH packets of 16B arrive in one read
+    perf_print_throughput_header("mqtt_codec batch decode");
+    result |= run_batch_case("bytesReceived callbacks", false, iterations);
+    result |= run_batch_case("parse 16 views per call", true, iterations);
+    return result;
+}
@@ -0,0 +1,368 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "umqtt_perf.h"
+#include "azure_c_shared_utility/xio.h"
+#include "azure_umqtt_c/mqtt_client.h"
+#include "azure_umqtt_c/mqtt_event_loop.h"
+
+#define PERF_IDLE_CLIENTS       1000
+#define PERF_IDLE_DURATION_MS   1000
+#define PERF_KEEP_ALIVE_SEC     240
+#define PERF_CONNECT_ROUNDS     100
+#define PERF_SETTLE_ROUNDS      10
+#define PERF_RESERVED_FDS       32
+
+// Socket pair transport: xio_dowork reads the client end until it would block, as a socket xio does, while the
+// benchmark plays the broker on the other end
+typedef struct PERF_SOCKET_IO_TAG
+{
+    int fd;
+    ON_BYTES_RECEIVED onBytesReceived;
+    void* onBytesReceivedCtx;
+} PERF_SOCKET_IO;
+
+static size_t g_connackCount;
+
+static OPTIONHANDLER_HANDLE perf_socket_io_retrieveoptions(CONCRETE_IO_HANDLE concrete_io)
+{
+    (void)concrete_io;
+    return NULL;
+}
+
+static CONCRETE_IO_HANDLE perf_socket_io_create(void* io_create_parameters)
+{
+    PERF_SOCKET_IO* result = (PERF_SOCKET_IO*)malloc(sizeof(PERF_SOCKET_IO));
+    if (result != NULL)
+    {
+        result->fd = *(int*)io_create_parameters;
+        result->onBytesReceived = NULL;
+        result->onBytesReceivedCtx = NULL;
+    }
+    return result;
+}
+
+static void perf_socket_io_destroy(CONCRETE_IO_HANDLE concrete_io)
+{
+    free(concrete_io);
+}
+
+static int perf_socket_io_open(CONCRETE_IO_HANDLE concrete_io, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    PERF_SOCKET_IO* socketIo = (PERF_SOCKET_IO*)concrete_io;
+    (void)on_io_error;
+    (void)on_io_error_context;
+    socketIo->onBytesReceived = on_bytes_received;
+    socketIo->onBytesReceivedCtx = on_bytes_received_context;
+    on_io_open_complete(on_io_open_complete_context, IO_OPEN_OK);
+    return 0;
+}
+
+static int perf_socket_io_close(CONCRETE_IO_HANDLE concrete_io, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    (void)concrete_io;
+    if (on_io_close_complete != NULL)
+    {
+        on_io_close_complete(callback_context);
+    }
+    return 0;
+}
+
+static int perf_socket_io_send(CONCRETE_IO_HANDLE concrete_io, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    PERF_SOCKET_IO* socketIo = (PERF_SOCKET_IO*)concrete_io;
+    if (write(socketIo->fd, buffer, size) != (ssize_t)size)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        if (on_send_complete != NULL)
+        {
+            on_send_complete(callback_context, IO_SEND_OK);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static void perf_socket_io_dowork(CONCRETE_IO_HANDLE concrete_io)
+{
+    PERF_SOCKET_IO* socketIo = (PERF_SOCKET_IO*)concrete_io;
+    unsigned char buffer[64];
+    ssize_t received;
+    while ((received = read(socketIo->fd, buffer, sizeof(buffer))) > 0)
+    {
+        socketIo->onBytesReceived(socketIo->onBytesReceivedCtx, buffer, (size_t)received);
+    }
+}
+
+static int perf_socket_io_setoption(CONCRETE_IO_HANDLE concrete_io, const char* optionName, const void* value)
+{
+    (void)concrete_io;
+    (void)optionName;
+    (void)value;
+    return 0;
+}
+
+static const IO_INTERFACE_DESCRIPTION perf_socket_io_interface_description =
+{
+    perf_socket_io_retrieveoptions,
+    perf_socket_io_create,
+    perf_socket_io_destroy,
+    perf_socket_io_open,
+    perf_socket_io_close,
+    perf_socket_io_send,
+    perf_socket_io_dowork,
+    perf_socket_io_setoption
+};
+
+static void on_message_recv(MQTT_MESSAGE_HANDLE msgHandle, void* callbackCtx)
+{
+    (void)msgHandle;
+    (void)callbackCtx;
+}
+
+static void on_operation(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* callbackCtx)
+{
+    (void)handle;
+    (void)msgInfo;
+    (void)callbackCtx;
+    if (actionResult == MQTT_CLIENT_ON_CONNACK)
+    {
+        g_connackCount++;
+    }
+}
+
+typedef struct PERF_CONNECTION_TAG
+{
+    MQTT_CLIENT_HANDLE client;
+    XIO_HANDLE xio;
+    int fds[2];
+} PERF_CONNECTION;
+
+// Each connection needs two descriptors, the soft limit is raised as far as the hard limit allows
+static size_t get_connection_limit(void)
+{
+    size_t result = PERF_IDLE_CLIENTS;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        if (limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            (void)setrlimit(RLIMIT_NOFILE, &limit);
+            (void)getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        if (limit.rlim_cur != RLIM_INFINITY && (limit.rlim_cur - PERF_RESERVED_FDS) / 2 < result)
+        {
+            result = (size_t)(limit.rlim_cur - PERF_RESERVED_FDS) / 2;
+        }
+    }
+    return result;
+}
+
+static uint64_t get_cpu_time_us(void)
+{
+    struct rusage usage;
+    uint64_t result = 0;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        result = (uint64_t)usage.ru_utime.tv_sec * 1000000 + (uint64_t)usage.ru_utime.tv_usec +
+            (uint64_t)usage.ru_stime.tv_sec * 1000000 + (uint64_t)usage.ru_stime.tv_usec;
+    }
+    return result;
+}
+
+static void print_idle_result(const char* name, size_t count, uint64_t cpuUs, uint64_t elapsedNs, uint64_t doworkCount, uint64_t wakeupCount)
+{
+    double seconds = (elapsedNs == 0) ? 1e-9 : (double)elapsedNs / 1e9;
+    (void)printf("%-28s %12.2f %12.1f %12.1f %12.1f\n", name, (double)cpuUs / (double)count / seconds,
+        (double)cpuUs / 10000.0 / seconds, (double)doworkCount / seconds, (double)wakeupCount / seconds);
+}
+
+// Opens count connections whose CONNECT was sent and whose CONNACK waits in the socket to be read
+static int open_connections(PERF_CONNECTION* connections, size_t count)
+{
+    int result = 0;
+    const unsigned char connack[] = { (unsigned char)CONNACK_TYPE, 2, 0, 0 };
+    MQTT_CLIENT_OPTIONS options;
+
+    memset(&options, 0, sizeof(options));
+    options.clientId = "perf_client";
+    options.keepAliveInterval = PERF_KEEP_ALIVE_SEC;
+    options.qualityOfServiceValue = DELIVER_AT_MOST_ONCE;
+
+    for (size_t index = 0; index < count; index++)
+    {
+        connections[index].fds[0] = -1;
+        connections[index].fds[1] = -1;
+    }
+    for (size_t index = 0; index < count && result == 0; index++)
+    {
+        PERF_CONNECTION* connection = &connections[index];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, connection->fds) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            (void)fcntl(connection->fds[0], F_SETFL, fcntl(connection->fds[0], F_GETFL, 0) | O_NONBLOCK);
+            connection->client = mqtt_client_init(on_message_recv, on_operation, NULL);
+            connection->xio = xio_create(&perf_socket_io_interface_description, &connection->fds[0]);
+            if (connection->client == NULL || connection->xio == NULL || mqtt_client_connect(connection->client, connection->xio, &options) != 0 ||
+                write(connection->fds[1], connack, sizeof(connack)) != (ssize_t)sizeof(connack))
+            {
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+static void close_connections(PERF_CONNECTION* connections, size_t count)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+        mqtt_client_deinit(connections[index].client);
+        if (connections[index].xio != NULL)
+        {
+            xio_destroy(connections[index].xio);
+        }
+        if (connections[index].fds[0] != -1)
+        {
+            (void)close(connections[index].fds[0]);
+            (void)close(connections[index].fds[1]);
+        }
+    }
+}
+
+// The clients are connected through the loop, which only sees the CONNACKs through epoll, then left idle
+static int run_event_loop_case(const char* name, PERF_CONNECTION* connections, size_t count)
+{
+    int result = 0;
+    MQTT_EVENT_LOOP_HANDLE loop = mqtt_event_loop_create();
+    if (loop == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        MQTT_EVENT_LOOP_STATS before;
+        MQTT_EVENT_LOOP_STATS after;
+
+        for (size_t index = 0; index < count && result == 0; index++)
+        {
+            result = mqtt_event_loop_add(loop, connections[index].client, connections[index].fds[0]);
+        }
+        for (size_t round = 0; round < PERF_CONNECT_ROUNDS && result == 0 && g_connackCount < count; round++)
+        {
+            result = mqtt_event_loop_run_once(loop, 10);
+        }
+        // A client that read its CONNACK is serviced once more in case its xio holds more bytes, which is not idle time
+        for (size_t round = 0; round < PERF_SETTLE_ROUNDS && result == 0; round++)
+        {
+            result = mqtt_event_loop_run_once(loop, 1);
+        }
+
+        if (result != 0 || g_connackCount != count || mqtt_event_loop_get_stats(loop, &before) != 0)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            uint64_t startCpu = get_cpu_time_us();
+            uint64_t start = perf_get_time_ns();
+            uint64_t elapsed = 0;
+            while (result == 0 && elapsed < (uint64_t)PERF_IDLE_DURATION_MS * 1000000)
+            {
+                result = mqtt_event_loop_run_once(loop, (uint32_t)(PERF_IDLE_DURATION_MS - elapsed / 1000000));
+                elapsed = perf_get_time_ns() - start;
+            }
+            uint64_t cpuUs = get_cpu_time_us() - startCpu;
+
+            if (result != 0 || mqtt_event_loop_get_stats(loop, &after) != 0)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                print_idle_result(name, count, cpuUs, elapsed, (after.readyCount + after.timerCount) - (before.readyCount + before.timerCount),
+                    after.waitCount - before.waitCount);
+            }
+        }
+
+        for (size_t index = 0; index < count; index++)
+        {
+            (void)mqtt_event_loop_remove(loop, connections[index].client);
+        }
+        mqtt_event_loop_destroy(loop);
+    }
+    return result;
+}
+
+// Every client is given to mqtt_client_dowork on each pass, sleepMs apart, as a polling application does
+static int run_poll_case(const char* name, PERF_CONNECTION* connections, size_t count, uint32_t sleepMs)
+{
+    uint64_t doworkCount = 0;
+    uint64_t passCount = 0;
+    uint64_t startCpu = get_cpu_time_us();
+    uint64_t start = perf_get_time_ns();
+    uint64_t elapsed = 0;
+    while (elapsed < (uint64_t)PERF_IDLE_DURATION_MS * 1000000)
+    {
+        for (size_t index = 0; index < count; index++)
+        {
+            mqtt_client_dowork(connections[index].client);
+        }
+        doworkCount += count;
+        passCount++;
+        if (sleepMs > 0)
+        {
+            struct timespec delay;
+            delay.tv_sec = 0;
+            delay.tv_nsec = (long)sleepMs * 1000000;
+            (void)nanosleep(&delay, NULL);
+        }
+        elapsed = perf_get_time_ns() - start;
+    }
+    print_idle_result(name, count, get_cpu_time_us() - startCpu, elapsed, doworkCount, passCount);
+    return 0;
+}
+
+int event_loop_perf_idle_run(void)
+{
+    int result;
+    size_t count = get_connection_limit();
+    PERF_CONNECTION* connections = (PERF_CONNECTION*)calloc(count, sizeof(PERF_CONNECTION));
+
+    (void)printf("\nmqtt_event_loop idle (%zu connections, %d ms each)\n", count, PERF_IDLE_DURATION_MS);
+    (void)printf("%-28s %12s %12s %12s %12s\n", "case", "us/conn/s", "% of a core", "dowork/s", "wakeups/s");
+    if (connections == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        g_connackCount = 0;
+        result = open_connections(connections, count);
+        if (result == 0)
+        {
+            result |= run_event_loop_case("epoll event loop", connections, count);
+            result |= run_poll_case("dowork poll, 1 ms sleep", connections, count, 1);
+            result |= run_poll_case("dowork poll, busy", connections, count, 0);
+        }
+        close_connections(connections, count);
+        free(connections);
+    }
+    return result;
+}
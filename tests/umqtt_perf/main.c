@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "umqtt_perf.h"
+
+int main(int argc, char** argv)
+{
+    int result = 0;
+    size_t iterations = PERF_DEFAULT_ITERATIONS;
+    if (argc > 1)
+    {
+        iterations = (size_t)strtoul(argv[1], NULL, 10);
+    }
+
+    (void)printf("umqtt performance benchmarks (%zu iterations)\n", iterations);
+    if (codec_perf_encode_run(iterations) != 0)
+    {
+        (void)printf("codec encode benchmark failed\n");
+        result = __LINE__;
+    }
+    if (codec_perf_decode_run(iterations) != 0)
+    {
+        (void)printf("codec decode benchmark failed\n");
+        result = __LINE__;
+    }
+    if (client_perf_inbound_run(iterations) != 0)
+    {
+        (void)printf("client inbound benchmark failed\n");
+        result = __LINE__;
+    }
+    if (message_perf_run(iterations) != 0)
+    {
+        (void)printf("message benchmark failed\n");
+        result = __LINE__;
+    }
+#if defined(__linux__)
+    if (event_loop_perf_idle_run() != 0)
+    {
+        (void)printf("event loop benchmark failed\n");
+        result = __LINE__;
+    }
+#endif
+    return result;
+}
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "umqtt_perf.h"
+#include "azure_umqtt_c/mqtt_message.h"
+
+#define PERF_PACKET_ID          0x1234
+#define PERF_TOPIC_NAME         "devices/perf_device/messages/devicebound/"
+#define PERF_SHORT_TOPIC_NAME   "dev/telemy"
+#define PERF_FAN_OUT            8
+#define PERF_RETAINED_COUNT     1000000
+#define PERF_LARGE_PAYLOAD_LEN  (1024 * 1024)
+// The large payload cases touch a megabyte per op, so they run fewer ops
+#define PERF_LARGE_DIVISOR      100
+
+// One op creates a message, hands fanOut clones of it to consumers and destroys all of them.
+// fanOut 0 measures create and destroy alone
+static int run_message_case(const char* name, const char* topicName, size_t payloadLen, size_t fanOut, size_t iterations)
+{
+    int result = 0;
+    uint8_t* payload = (uint8_t*)malloc(payloadLen);
+    MQTT_MESSAGE_HANDLE clones[PERF_FAN_OUT];
+
+    if (payload == NULL || fanOut > PERF_FAN_OUT)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        PERF_ALLOC_STATS stats;
+
+        memset(payload, 'P', payloadLen);
+        perf_alloc_reset();
+        uint64_t start = perf_get_time_ns();
+        for (size_t index = 0; index < iterations && result == 0; index++)
+        {
+            MQTT_MESSAGE_HANDLE msgHandle = mqttmessage_create(PERF_PACKET_ID, topicName, DELIVER_AT_LEAST_ONCE, payload, payloadLen);
+            if (msgHandle == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                for (size_t clone = 0; clone < fanOut; clone++)
+                {
+                    if ((clones[clone] = mqttmessage_clone(msgHandle)) == NULL)
+                    {
+                        result = __LINE__;
+                    }
+                }
+                mqttmessage_destroy(msgHandle);
+                for (size_t clone = 0; clone < fanOut; clone++)
+                {
+                    mqttmessage_destroy(clones[clone]);
+                }
+            }
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        perf_alloc_get_stats(&stats);
+
+        if (result == 0)
+        {
+            perf_print_result(name, iterations, elapsed, &stats, payloadLen);
+        }
+    }
+
+    free(payload);
+    return result;
+}
+
+// Keeps PERF_RETAINED_COUNT messages alive at once and reports the resident memory they take up per message
+static int run_retained_case(const char* name, const char* topicName, size_t payloadLen)
+{
+    int result = 0;
+    uint8_t* payload = (uint8_t*)malloc(payloadLen);
+    MQTT_MESSAGE_HANDLE* msgHandles = (MQTT_MESSAGE_HANDLE*)malloc(PERF_RETAINED_COUNT * sizeof(MQTT_MESSAGE_HANDLE));
+
+    if (payload == NULL || msgHandles == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t created = 0;
+
+        // Touch the handle array so it is resident before the baseline is taken
+        memset(msgHandles, 0, PERF_RETAINED_COUNT * sizeof(MQTT_MESSAGE_HANDLE));
+        memset(payload, 'P', payloadLen);
+        size_t rssBefore = perf_get_rss_bytes();
+        uint64_t start = perf_get_time_ns();
+        while (created < PERF_RETAINED_COUNT && (msgHandles[created] = mqttmessage_create(PERF_PACKET_ID, topicName, DELIVER_AT_LEAST_ONCE, payload, payloadLen)) != NULL)
+        {
+            created++;
+        }
+        uint64_t elapsed = perf_get_time_ns() - start;
+        size_t rssAfter = perf_get_rss_bytes();
+
+        if (created != PERF_RETAINED_COUNT)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            // RSS can shrink while the messages are created, that reads as no growth rather than a wrapped size_t
+            size_t rssGrowth = (rssAfter > rssBefore) ? rssAfter - rssBefore : 0;
+            (void)printf("%-28s %12.1f %12.1f %12.1f\n", name, (double)elapsed / (double)created,
+                (double)rssGrowth / (double)created, (double)rssGrowth / (1024.0 * 1024.0));
+        }
+
+        for (size_t index = 0; index < created; index++)
+        {
+            mqttmessage_destroy(msgHandles[index]);
+        }
+#if defined(__GLIBC__)
+        // Give the freed messages back to the system so the next case starts from the same RSS
+        (void)malloc_trim(0);
+#endif
+    }
+
+    free(msgHandles);
+    free(payload);
+    return result;
+}
+
+// One op builds a heap payload the way an application would and turns it into a message, either by copying it
+// and freeing the original or by handing it over with mqttmessage_create_take_ownership
+static int run_ownership_case(const char* name, size_t payloadLen, bool takeOwnership, size_t iterations)
+{
+    int result = 0;
+    PERF_ALLOC_STATS stats;
+
+    perf_alloc_reset();
+    uint64_t start = perf_get_time_ns();
+    for (size_t index = 0; index < iterations && result == 0; index++)
+    {
+        uint8_t* payload = (uint8_t*)malloc(payloadLen);
+        if (payload == NULL)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            MQTT_MESSAGE_HANDLE msgHandle;
+            memset(payload, 'P', payloadLen);
+            if (takeOwnership)
+            {
+                if ((msgHandle = mqttmessage_create_take_ownership(PERF_PACKET_ID, PERF_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, payload, payloadLen, free)) == NULL)
+                {
+                    free(payload);
+                }
+            }
+            else
+            {
+                msgHandle = mqttmessage_create(PERF_PACKET_ID, PERF_TOPIC_NAME, DELIVER_AT_LEAST_ONCE, payload, payloadLen);
+                free(payload);
+            }
+
+            if (msgHandle == NULL)
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                mqttmessage_destroy(msgHandle);
+            }
+        }
+    }
+    uint64_t elapsed = perf_get_time_ns() - start;
+    perf_alloc_get_stats(&stats);
+
+    if (result == 0)
+    {
+        perf_print_result(name, iterations, elapsed, &stats, payloadLen);
+    }
+    return result;
+}
+
+// Prints how many creates the pool served and releases it, every pooled message must have been destroyed
+static int report_and_deinit_pool(void)
+{
+    int result;
+    MQTT_MESSAGE_POOL_STATS poolStats;
+
+    if (mqttmessage_getPoolStats(&poolStats) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        (void)printf("%-28s hits %llu, misses %llu\n", "pool", (unsigned long long)poolStats.hitCount, (unsigned long long)poolStats.missCount);
+        result = (mqttmessage_deinitPool() != 0) ? __LINE__ : 0;
+    }
+    return result;
+}
+
+int message_perf_run(size_t iterations)
+{
+    int result = 0;
+
+    perf_print_header("mqtt_message");
+    result |= run_message_case("create + destroy 8B", PERF_SHORT_TOPIC_NAME, 8, 0, iterations);
+    result |= run_message_case("create + destroy 16B", PERF_TOPIC_NAME, 16, 0, iterations);
+    result |= run_message_case("create + destroy 1KB", PERF_TOPIC_NAME, 1024, 0, iterations);
+    result |= run_message_case("create + 8 clones 16B", PERF_TOPIC_NAME, 16, PERF_FAN_OUT, iterations);
+    result |= run_message_case("create + 8 clones 4KB", PERF_TOPIC_NAME, 4 * 1024, PERF_FAN_OUT, iterations);
+    result |= run_ownership_case("create 1MB copied", PERF_LARGE_PAYLOAD_LEN, false, iterations / PERF_LARGE_DIVISOR + 1);
+    result |= run_ownership_case("create 1MB take ownership", PERF_LARGE_PAYLOAD_LEN, true, iterations / PERF_LARGE_DIVISOR + 1);
+    if (mqttmessage_initPool(PERF_FAN_OUT + 1) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result |= run_message_case("create + destroy 8B pooled", PERF_SHORT_TOPIC_NAME, 8, 0, iterations);
+        result |= run_message_case("create + 8 clones 16B pooled", PERF_TOPIC_NAME, 16, PERF_FAN_OUT, iterations);
+        result |= report_and_deinit_pool();
+    }
+
+    (void)printf("\nmqtt_message retained (%d messages)\n", PERF_RETAINED_COUNT);
+    (void)printf("%-28s %12s %12s %12s\n", "case", "ns/create", "RSS B/msg", "RSS MB");
+    result |= run_retained_case("retained 8B", PERF_SHORT_TOPIC_NAME, 8);
+    result |= run_retained_case("retained 16B", PERF_TOPIC_NAME, 16);
+    result |= run_retained_case("retained 1KB", PERF_TOPIC_NAME, 1024);
+    // The pool's slots are resident from mqttmessage_initPool on, so the pooled cases show the create cost only
+    if (mqttmessage_initPool(PERF_RETAINED_COUNT) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result |= run_retained_case("retained 8B pooled", PERF_SHORT_TOPIC_NAME, 8);
+        result |= run_retained_case("retained 16B pooled", PERF_TOPIC_NAME, 16);
+        result |= report_and_deinit_pool();
+    }
+    return result;
+}
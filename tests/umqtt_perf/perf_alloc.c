@@ -0,0 +1,113 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+#include "umqtt_perf.h"
+
+// The code under measurement is compiled with GB_MEASURE_MEMORY_FOR_THIS so
+// every malloc/realloc/free it makes lands in these functions.
+static PERF_ALLOC_STATS g_allocStats;
+
+void* gballoc_malloc(size_t size)
+{
+    g_allocStats.allocCount++;
+    g_allocStats.bytesAllocated += size;
+    return malloc(size);
+}
+
+void* gballoc_calloc(size_t nmemb, size_t size)
+{
+    g_allocStats.allocCount++;
+    g_allocStats.bytesAllocated += nmemb * size;
+    return calloc(nmemb, size);
+}
+
+void* gballoc_realloc(void* ptr, size_t size)
+{
+    g_allocStats.allocCount++;
+    g_allocStats.bytesAllocated += size;
+    return realloc(ptr, size);
+}
+
+void gballoc_free(void* ptr)
+{
+    if (ptr != NULL)
+    {
+        g_allocStats.freeCount++;
+    }
+    free(ptr);
+}
+
+void perf_alloc_reset(void)
+{
+    g_allocStats.allocCount = 0;
+    g_allocStats.freeCount = 0;
+    g_allocStats.bytesAllocated = 0;
+}
+
+void perf_alloc_get_stats(PERF_ALLOC_STATS* stats)
+{
+    *stats = g_allocStats;
+}
+
+uint64_t perf_get_time_ns(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+size_t perf_get_rss_bytes(void)
+{
+    size_t result = 0;
+#if defined(__linux__)
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL)
+    {
+        unsigned long totalPages;
+        unsigned long residentPages;
+        if (fscanf(statm, "%lu %lu", &totalPages, &residentPages) == 2)
+        {
+            result = (size_t)residentPages * (size_t)sysconf(_SC_PAGESIZE);
+        }
+        (void)fclose(statm);
+    }
+#endif
+    return result;
+}
+
+void perf_print_header(const char* title)
+{
+    (void)printf("\n%s\n", title);
+    (void)printf("%-28s %12s %12s %12s %12s\n", "case", "ns/op", "allocs/op", "frees/op", "bytes/op");
+}
+
+void perf_print_result(const char* name, size_t iterations, uint64_t elapsedNs, const PERF_ALLOC_STATS* stats, size_t bytesPerOp)
+{
+    double divisor = (iterations == 0) ? 1.0 : (double)iterations;
+    (void)printf("%-28s %12.1f %12.2f %12.2f %12zu\n", name, (double)elapsedNs / divisor,
+        (double)stats->allocCount / divisor, (double)stats->freeCount / divisor, bytesPerOp);
+}
+
+void perf_print_throughput_header(const char* title)
+{
+    (void)printf("\n%s\n", title);
+    (void)printf("%-28s %12s %12s %12s %12s\n", "case", "ns/op", "MB/s", "allocs/op", "bytes/op");
+}
+
+void perf_print_throughput(const char* name, size_t iterations, uint64_t elapsedNs, const PERF_ALLOC_STATS* stats, size_t bytesPerOp)
+{
+    double divisor = (iterations == 0) ? 1.0 : (double)iterations;
+    double seconds = (elapsedNs == 0) ? 1e-9 : (double)elapsedNs / 1e9;
+    (void)printf("%-28s %12.1f %12.1f %12.2f %12zu\n", name, (double)elapsedNs / divisor,
+        ((double)bytesPerOp * (double)iterations) / (1024.0 * 1024.0) / seconds, (double)stats->allocCount / divisor, bytesPerOp);
+}
@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef UMQTT_PERF_H
+#define UMQTT_PERF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PERF_DEFAULT_ITERATIONS     100000
+
+typedef struct PERF_ALLOC_STATS_TAG
+{
+    size_t allocCount;
+    size_t freeCount;
+    size_t bytesAllocated;
+} PERF_ALLOC_STATS;
+
+extern void perf_alloc_reset(void);
+extern void perf_alloc_get_stats(PERF_ALLOC_STATS* stats);
+
+extern uint64_t perf_get_time_ns(void);
+// Resident set size of the process, 0 where it cannot be read
+extern size_t perf_get_rss_bytes(void);
+extern void perf_print_header(const char* title);
+extern void perf_print_result(const char* name, size_t iterations, uint64_t elapsedNs, const PERF_ALLOC_STATS* stats, size_t bytesPerOp);
+extern void perf_print_throughput_header(const char* title);
+extern void perf_print_throughput(const char* name, size_t iterations, uint64_t elapsedNs, const PERF_ALLOC_STATS* stats, size_t bytesPerOp);
+
+extern int codec_perf_encode_run(size_t iterations);
+extern int codec_perf_decode_run(size_t iterations);
+extern int client_perf_inbound_run(size_t iterations);
+extern int message_perf_run(size_t iterations);
+#if defined(__linux__)
+// Measures CPU time per idle connection, so it runs for a fixed time instead of a number of iterations
+extern int event_loop_perf_idle_run(void);
+#endif
+
+#endif // UMQTT_PERF_H